@@ -0,0 +1,72 @@
+#!/bin/sh
+# Fault injection: kill the server with SIGKILL in the middle of a write load, every other round
+# also append a torn record to a shard log, then restart it and verify that every acknowledged
+# write of every round so far is back with its exact value.
+# Usage: crash_test.sh <server.elf> <bench.elf> [rounds]
+# Server settings such as DICT_SYNC are taken from the environment.
+set -e
+
+server=$(realpath "$1")
+bench=$(realpath "$2")
+rounds=${3:-10}
+value_size=48
+
+workdir=$(mktemp -d)
+trap 'kill -KILL $pid 2> /dev/null || true; rm -rf "$workdir"' EXIT
+
+stat() {
+    "$bench" -x STATS | sed -n "s/^$1://p"
+}
+
+start() {
+    (cd "$workdir" && exec "$server" > /dev/null 2> "$workdir/server.err") &
+    pid=$!
+    until [ "$(stat backend_recovery_pending_shards)" = 0 ]; do
+        sleep 0.05
+    done
+}
+
+random() {
+    awk -v seed="$1" -v max="$2" 'BEGIN { srand(seed); print int(rand() * max) }'
+}
+
+start
+printf '%6s %10s %10s %12s %8s\n' round acked torn_bytes recovery_ms result
+round=1
+while [ "$round" -le "$rounds" ]; do
+    # One client, so the acknowledged stores are a prefix of the round's key set.
+    "$bench" -F -n 100000000 -v $value_size -s "$round" > "$workdir/fill.$round" 2> /dev/null &
+    fill=$!
+    sleep "0.$(random "$round" 8)5"
+    kill -KILL $pid
+    wait $pid 2> /dev/null || true
+    wait $fill 2> /dev/null || true
+
+    torn=0
+    if [ $((round % 2)) = 0 ]; then
+        torn=$(($(random "$round" 40) + 1))
+        shard=$(printf '%s/log/shard.%02d.log' "$workdir" "$(random "$round" 16)")
+        head -c "$torn" /dev/urandom >> "$shard"
+    fi
+
+    start
+    result=ok
+    checked=1
+    while [ "$checked" -le "$round" ]; do
+        acked=$(sed -n 's/^acked: //p' "$workdir/fill.$checked")
+        if [ "$acked" -gt 0 ] &&
+            ! "$bench" -C -n "$acked" -v $value_size -s "$checked" > "$workdir/check" 2>&1; then
+            result=FAIL
+            cat "$workdir/check" >&2
+        fi
+        checked=$((checked + 1))
+    done
+    printf '%6s %10s %10s %12s %8s\n' "$round" \
+        "$(sed -n 's/^acked: //p' "$workdir/fill.$round")" \
+        "$(stat backend_recovery_truncated_bytes)" "$(stat backend_recovery_ms)" $result
+    [ $result = ok ] || exit 1
+    round=$((round + 1))
+done
+
+kill -TERM $pid
+wait $pid 2> /dev/null || true
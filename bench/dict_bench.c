@@ -0,0 +1,557 @@
+/************************************************************************************************
+Copyright (c) 2024, Guido Ramirez <guidoramirez7@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute,
+sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial
+portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+SPDX-License-Identifier: MIT
+*************************************************************************************************/
+
+/** @file dict_bench.c
+ ** @brief Dictionary server benchmark client.
+ **
+ ** Runs a reproducible GET/SET/DEL mix against a running server and prints the achieved
+ ** throughput. It is also the training workload of the profile guided release build.
+ **
+ ** Two more modes drive the crash recovery scripts: -F stores a numbered key set whose values
+ ** encode their key and reports how many stores were acknowledged, -C reads that key set back and
+ ** counts the missing and corrupt values. -x sends a single command and prints its reply body.
+ ** With -u GETs are sent as UDP datagrams, falling back to TCP when the server redirects them.
+ **/
+
+/* === Headers files inclusions =============================================================== */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+/* === Macros definitions ====================================================================== */
+
+#define BENCH_IP             "127.0.0.1"
+#define BENCH_PORT           (5000)
+#define BENCH_OPS            (20000) /**< Default number of operations */
+#define BENCH_KEYS           (1000)  /**< Default keyspace size */
+#define BENCH_VALUE_SIZE     (16)    /**< Default value size in bytes */
+#define BENCH_GET_PERCENT    (70)    /**< Default share of GET operations */
+#define BENCH_DEL_PERCENT    (5)     /**< Default share of DEL operations, the rest are SET */
+#define BENCH_CONNECT_WAIT_S (5)     /**< Time to wait for the server to listen */
+#define BENCH_BUFFER_SIZE    (4096)
+#define BENCH_MAX_CLIENTS    (256)   /**< Upper bound of concurrent connections */
+#define BENCH_BODY_WAIT_MS   (200)   /**< Time a -x reply body may lag behind its status */
+#define BENCH_UDP_WAIT_MS    (200)   /**< Time before a UDP GET is sent again */
+#define BENCH_UDP_TRIES      (5)     /**< UDP GET attempts before the client fails */
+
+#define LOG_ERROR(format, ...) fprintf(stderr, "ERROR -> " format "\n", ##__VA_ARGS__)
+
+/* === Private data type declarations ========================================================== */
+
+typedef enum {
+    BENCH_OP_GET = 0,
+    BENCH_OP_SET,
+    BENCH_OP_DEL,
+} bench_op;
+
+typedef enum {
+    BENCH_MODE_MIX = 0, /**< Random GET/SET/DEL mix over the keyspace */
+    BENCH_MODE_FILL,    /**< SET the numbered key set, stopping at the first failure */
+    BENCH_MODE_CHECK,   /**< GET the numbered key set and verify every value */
+} bench_mode;
+
+typedef struct {
+    bench_mode mode;   /**< Workload */
+    const char * ip;   /**< Server address */
+    int port;          /**< Server port */
+    long ops;          /**< Operations to run */
+    int keys;          /**< Keyspace size */
+    int value_size;    /**< Value size in bytes */
+    int get_percent;   /**< Share of GET operations */
+    int del_percent;   /**< Share of DEL operations */
+    unsigned int seed; /**< Random seed, equal seeds give equal workloads */
+    int clients;       /**< Concurrent connections, each one in its own thread */
+    int udp;           /**< Send GETs over UDP */
+} bench_config_t;
+
+typedef struct {
+    const bench_config_t * config; /**< Shared configuration */
+    unsigned int seed;             /**< Seed of this client */
+    long first;                    /**< First numbered key of this client, fill and check modes */
+    long ops;                      /**< Operations this client runs */
+    long done[3];                  /**< Operations completed, indexed by bench_op */
+    long missing;                  /**< Check mode, keys not found */
+    long corrupt;                  /**< Check mode, values not matching their key */
+    long redirects;                /**< UDP GETs the server sent back to TCP */
+    int err;                       /**< 0 if every request succeeded */
+} bench_client_t;
+
+/* === Private variable declarations =========================================================== */
+
+/* === Private function declarations =========================================================== */
+
+static int bench_connect(const bench_config_t * config, int type);
+
+static int bench_reply_done(bench_op op, const char * buffer, int length);
+
+static int bench_request(int fd, bench_op op, const char * request, int length, char * buffer,
+                         int size);
+
+static int bench_udp_get(bench_client_t * client, int udp_fd, int fd, const char * request,
+                         int length, char * buffer, int size);
+
+static int bench_command(const bench_config_t * config, const char * command);
+
+static void bench_fill_value(const bench_config_t * config, long key, char * value);
+
+static double bench_now(void);
+
+static void * bench_client_run(void * arg);
+
+static void bench_usage(const char * name);
+
+/* === Public variable definitions ============================================================= */
+
+/* === Private variable definitions ============================================================ */
+
+/* === Private function implementation ========================================================= */
+/**
+ * @brief Connect to the server, retrying until it is listening.
+ *
+ * @param config Benchmark configuration.
+ * @param type SOCK_STREAM, or SOCK_DGRAM for a socket that only talks to the server.
+ * @return int Socket file descriptor, -1 on error.
+ */
+static int bench_connect(const bench_config_t * config, int type) {
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(config->port);
+    if (inet_pton(AF_INET, config->ip, &addr.sin_addr) <= 0) {
+        LOG_ERROR("Invalid IP address [%s]", config->ip);
+        return -1;
+    }
+
+    double deadline = bench_now() + BENCH_CONNECT_WAIT_S;
+    for (;;) {
+        int fd = socket(AF_INET, type, 0);
+        if (fd < 0)
+            return -1;
+        if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+            if (type == SOCK_STREAM)
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &(int){1}, sizeof(int));
+            return fd;
+        }
+        close(fd);
+        if (bench_now() > deadline) {
+            LOG_ERROR("Can not connect to [%s:%d]", config->ip, config->port);
+            return -1;
+        }
+        usleep(50000);
+    }
+}
+/**
+ * @brief Check if a complete reply was received.
+ *
+ * Replies are "OK\n\0", "NOTFOUND\n\0" or "ERROR:<code>". A successful GET is followed by the
+ * value terminated by a line feed.
+ *
+ * @param op Operation sent.
+ * @param buffer Bytes received so far.
+ * @param length Number of bytes received.
+ * @return int 1 if the reply is complete, 0 otherwise.
+ */
+static int bench_reply_done(bench_op op, const char * buffer, int length) {
+    if (length >= 6 && strncmp(buffer, "ERROR:", 6) == 0)
+        return 1;
+    if (length >= 10 && strncmp(buffer, "NOTFOUND\n", 9) == 0)
+        return 1;
+    if (length >= 4 && strncmp(buffer, "OK\n", 3) == 0)
+        return op != BENCH_OP_GET || (length > 4 && buffer[length - 1] == '\n');
+    return 0;
+}
+/**
+ * @brief Send a request and wait for its complete reply.
+ *
+ * @param fd Socket file descriptor.
+ * @param op Operation sent.
+ * @param request Request text.
+ * @param length Request length.
+ * @param buffer Buffer where the reply will be stored.
+ * @param size Reply buffer's size.
+ * @return int Reply length, -1 on error.
+ */
+static int bench_request(int fd, bench_op op, const char * request, int length, char * buffer,
+                         int size) {
+    int received = 0;
+
+    if (send(fd, request, length, 0) != length)
+        return -1;
+
+    while (!bench_reply_done(op, buffer, received)) {
+        if (received == size)
+            return -1;
+        int cnt = recv(fd, buffer + received, size - received, 0);
+        if (cnt <= 0) {
+            if (cnt < 0 && errno == EINTR)
+                continue;
+            return -1;
+        }
+        received += cnt;
+        // The GET reply comes in two segments. Acknowledge the first one at once, otherwise the
+        // delayed ACK holds the second one back and the benchmark measures the ACK timer.
+        setsockopt(fd, IPPROTO_TCP, TCP_QUICKACK, &(int){1}, sizeof(int));
+    }
+    return received;
+}
+/**
+ * @brief Send a GET as one datagram and wait for the reply datagram.
+ *
+ * Lost datagrams are sent again. A redirect reply repeats the GET over TCP.
+ *
+ * @param client Client state.
+ * @param udp_fd UDP socket connected to the server.
+ * @param fd TCP socket.
+ * @param request Request text.
+ * @param length Request length.
+ * @param buffer Buffer where the reply will be stored.
+ * @param size Reply buffer's size.
+ * @return int Reply length, -1 on error.
+ */
+static int bench_udp_get(bench_client_t * client, int udp_fd, int fd, const char * request,
+                         int length, char * buffer, int size) {
+    for (int tries = 0; tries < BENCH_UDP_TRIES; tries++) {
+        if (send(udp_fd, request, length, 0) != length)
+            return -1;
+        int received = recv(udp_fd, buffer, size, 0);
+        if (received < 0 && (errno == EAGAIN || errno == EINTR))
+            continue;
+        if (received >= 4 && strncmp(buffer, "TCP\n", 4) == 0) {
+            client->redirects++;
+            return bench_request(fd, BENCH_OP_GET, request, length, buffer, size);
+        }
+        return received;
+    }
+    return -1;
+}
+/**
+ * @brief Send one command and print its reply body.
+ *
+ * Commands other than GET may reply with a bare status, so the body is awaited only for
+ * BENCH_BODY_WAIT_MS after it.
+ *
+ * @param config Benchmark configuration.
+ * @param command Command text, without the line feed.
+ * @return int 0 if the server replied OK, 1 otherwise.
+ */
+static int bench_command(const bench_config_t * config, const char * command) {
+    static char buffer[1024 * 1024];
+    int received = 0;
+
+    int fd = bench_connect(config, SOCK_STREAM);
+    if (fd < 0)
+        return 1;
+    if (dprintf(fd, "%s\n", command) < 0) {
+        close(fd);
+        return 1;
+    }
+
+    for (;;) {
+        int done = bench_reply_done(BENCH_OP_GET, buffer, received);
+        if (done && received > 4 && buffer[received - 1] == '\n')
+            break;
+        if (received >= 4 && strncmp(buffer, "OK\n", 3) == 0 &&
+            poll(&(struct pollfd){.fd = fd, .events = POLLIN}, 1, BENCH_BODY_WAIT_MS) == 0)
+            break;
+        if (done && strncmp(buffer, "OK\n", 3) != 0)
+            break;
+        int cnt = received < (int)sizeof(buffer)
+                      ? recv(fd, buffer + received, sizeof(buffer) - received, 0)
+                      : 0;
+        if (cnt <= 0)
+            break;
+        received += cnt;
+    }
+    close(fd);
+
+    if (received < 4 || strncmp(buffer, "OK\n", 3) != 0) {
+        LOG_ERROR("%s -> %.*s", command, received, buffer);
+        return 1;
+    }
+    fwrite(buffer + 4, 1, received - 4, stdout);
+    return 0;
+}
+/**
+ * @brief Build the value of a numbered key, the key name followed by padding.
+ *
+ * @param config Benchmark configuration.
+ * @param key Key number.
+ * @param value Buffer of value_size + 1 bytes where the value will be stored.
+ */
+static void bench_fill_value(const bench_config_t * config, long key, char * value) {
+    int length = snprintf(value, config->value_size + 1, "fill%u_%ld:", config->seed, key);
+    if (length < config->value_size)
+        memset(value + length, 'x', config->value_size - length);
+    value[config->value_size] = '\0';
+}
+/**
+ * @brief Monotonic time in seconds.
+ *
+ * @return double Seconds.
+ */
+static double bench_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+/**
+ * @brief Client thread. Runs its share of the workload on its own connection.
+ *
+ * @param arg Client state.
+ * @return void* Always NULL.
+ */
+static void * bench_client_run(void * arg) {
+    bench_client_t * client = arg;
+    const bench_config_t * config = client->config;
+
+    client->err = 1;
+    int udp_fd = -1;
+    char * value = malloc(config->value_size + 1);
+    char * request = malloc(config->value_size + 64);
+    char * reply = malloc(config->value_size + BENCH_BUFFER_SIZE);
+    int reply_size = config->value_size + BENCH_BUFFER_SIZE;
+    if (value == NULL || request == NULL || reply == NULL)
+        goto finish;
+    memset(value, 'x', config->value_size);
+    value[config->value_size] = '\0';
+
+    int fd = bench_connect(config, SOCK_STREAM);
+    if (fd < 0)
+        goto finish;
+    if (config->udp) {
+        udp_fd = bench_connect(config, SOCK_DGRAM);
+        struct timeval wait = {.tv_usec = BENCH_UDP_WAIT_MS * 1000};
+        if (udp_fd < 0 || setsockopt(udp_fd, SOL_SOCKET, SO_RCVTIMEO, &wait, sizeof(wait)) < 0) {
+            close(fd);
+            goto finish;
+        }
+    }
+
+    if (config->mode != BENCH_MODE_MIX) {
+        bench_op op = config->mode == BENCH_MODE_FILL ? BENCH_OP_SET : BENCH_OP_GET;
+        for (long key = client->first; key < client->first + client->ops; key++) {
+            bench_fill_value(config, key, value);
+            int length = op == BENCH_OP_SET
+                             ? sprintf(request, "SET fill%u_%ld %s\n", config->seed, key, value)
+                             : sprintf(request, "GET fill%u_%ld\n", config->seed, key);
+            int received = bench_request(fd, op, request, length, reply, reply_size);
+            if (received < 0 || strncmp(reply, "ERROR:", 6) == 0) {
+                // A fill stops at the first store not acknowledged, e.g. the server was killed.
+                LOG_ERROR("Key %ld failed", key);
+                close(fd);
+                goto finish;
+            }
+            if (op == BENCH_OP_GET && strncmp(reply, "NOTFOUND\n", 9) == 0)
+                client->missing++;
+            else if (op == BENCH_OP_GET && (received != config->value_size + 5 ||
+                                            memcmp(reply + 4, value, config->value_size) != 0))
+                client->corrupt++;
+            client->done[op]++;
+        }
+        close(fd);
+        client->err = 0;
+        goto finish;
+    }
+
+    for (long i = 0; i < client->ops; i++) {
+        int key = rand_r(&client->seed) % config->keys;
+        int dice = rand_r(&client->seed) % 100;
+        bench_op op = dice < config->get_percent                         ? BENCH_OP_GET
+                      : dice < config->get_percent + config->del_percent ? BENCH_OP_DEL
+                                                                         : BENCH_OP_SET;
+        int length;
+        if (op == BENCH_OP_GET)
+            length = sprintf(request, "GET bench%d\n", key);
+        else if (op == BENCH_OP_DEL)
+            length = sprintf(request, "DEL bench%d\n", key);
+        else
+            length = sprintf(request, "SET bench%d %s\n", key, value);
+
+        int received = op == BENCH_OP_GET && udp_fd >= 0
+                           ? bench_udp_get(client, udp_fd, fd, request, length, reply, reply_size)
+                           : bench_request(fd, op, request, length, reply, reply_size);
+        if (received < 0) {
+            LOG_ERROR("Request %ld failed", i);
+            close(fd);
+            goto finish;
+        }
+        client->done[op]++;
+    }
+    close(fd);
+    client->err = 0;
+
+finish:
+    if (udp_fd >= 0)
+        close(udp_fd);
+    free(value);
+    free(request);
+    free(reply);
+    return NULL;
+}
+/**
+ * @brief Print command line usage.
+ *
+ * @param name Program name.
+ */
+static void bench_usage(const char * name) {
+    fprintf(stderr,
+            "Usage: %s [-h ip] [-p port] [-n ops] [-k keys] [-v value_size] [-g get_percent]"
+            " [-d del_percent] [-s seed] [-c clients] [-u] [-F | -C]\n"
+            "       %s [-h ip] [-p port] -x command\n",
+            name, name);
+}
+
+/* === Public function implementation ========================================================== */
+
+int main(int argc, char * argv[]) {
+    bench_config_t config = {
+        .ip = BENCH_IP,
+        .port = BENCH_PORT,
+        .ops = BENCH_OPS,
+        .keys = BENCH_KEYS,
+        .value_size = BENCH_VALUE_SIZE,
+        .get_percent = BENCH_GET_PERCENT,
+        .del_percent = BENCH_DEL_PERCENT,
+        .seed = 1,
+        .clients = 1,
+    };
+    const char * command = NULL;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "h:p:n:k:v:g:d:s:c:uFCx:")) != -1) {
+        switch (opt) {
+        case 'h':
+            config.ip = optarg;
+            break;
+        case 'p':
+            config.port = atoi(optarg);
+            break;
+        case 'n':
+            config.ops = atol(optarg);
+            break;
+        case 'k':
+            config.keys = atoi(optarg);
+            break;
+        case 'v':
+            config.value_size = atoi(optarg);
+            break;
+        case 'g':
+            config.get_percent = atoi(optarg);
+            break;
+        case 'd':
+            config.del_percent = atoi(optarg);
+            break;
+        case 's':
+            config.seed = strtoul(optarg, NULL, 10);
+            break;
+        case 'c':
+            config.clients = atoi(optarg);
+            break;
+        case 'u':
+            config.udp = 1;
+            break;
+        case 'F':
+            config.mode = BENCH_MODE_FILL;
+            break;
+        case 'C':
+            config.mode = BENCH_MODE_CHECK;
+            break;
+        case 'x':
+            command = optarg;
+            break;
+        default:
+            bench_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (config.ops <= 0 || config.keys <= 0 || config.value_size <= 0 ||
+        config.get_percent + config.del_percent > 100 || config.clients < 1 ||
+        config.clients > BENCH_MAX_CLIENTS) {
+        bench_usage(argv[0]);
+        return 1;
+    }
+    if (command != NULL)
+        return bench_command(&config, command);
+
+    static bench_client_t clients[BENCH_MAX_CLIENTS];
+    pthread_t threads[BENCH_MAX_CLIENTS];
+    long done[3] = {0};
+    long missing = 0;
+    long corrupt = 0;
+    long redirects = 0;
+    long first = 0;
+    int failed = 0;
+
+    double start = bench_now();
+    for (int i = 0; i < config.clients; i++) {
+        clients[i].config = &config;
+        clients[i].seed = config.seed + i;
+        clients[i].ops = config.ops / config.clients + (i < config.ops % config.clients);
+        clients[i].first = first;
+        first += clients[i].ops;
+        if (pthread_create(&threads[i], NULL, bench_client_run, &clients[i]) != 0) {
+            LOG_ERROR("Can not start client %d", i);
+            return 1;
+        }
+    }
+    for (int i = 0; i < config.clients; i++) {
+        pthread_join(threads[i], NULL);
+        failed |= clients[i].err;
+        missing += clients[i].missing;
+        corrupt += clients[i].corrupt;
+        redirects += clients[i].redirects;
+        for (int op = 0; op < 3; op++)
+            done[op] += clients[i].done[op];
+    }
+    double elapsed = bench_now() - start;
+
+    // With one client the acknowledged stores are exactly the first ones of the key set.
+    if (config.mode == BENCH_MODE_FILL)
+        printf("acked: %ld\n", done[BENCH_OP_SET]);
+    if (config.mode == BENCH_MODE_CHECK)
+        printf("checked: %ld\nmissing: %ld\ncorrupt: %ld\n", done[BENCH_OP_GET], missing,
+               corrupt);
+    if (failed || missing > 0 || corrupt > 0)
+        return 1;
+
+    printf("clients: %d\n", config.clients);
+    printf("ops: %ld (get %ld, set %ld, del %ld)\n", config.ops, done[BENCH_OP_GET],
+           done[BENCH_OP_SET], done[BENCH_OP_DEL]);
+    if (config.udp)
+        printf("udp_redirects: %ld\n", redirects);
+    printf("elapsed_s: %.3f\n", elapsed);
+    printf("ops_per_sec: %.0f\n", config.ops / elapsed);
+
+    return 0;
+}
+
+/* === End of documentation ==================================================================== */
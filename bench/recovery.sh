@@ -0,0 +1,43 @@
+#!/bin/sh
+# Measure the time a server takes to recover its store after a crash, for several data sizes.
+# Usage: recovery.sh <server.elf> <bench.elf> "<key counts>" [value_size]
+# Every store is filled, the server killed with SIGKILL and restarted once with a single recovery
+# thread and once with the default, one per CPU. Logs are read from a warm page cache.
+set -e
+
+server=$(realpath "$1")
+bench=$(realpath "$2")
+counts=$3
+value_size=${4:-64}
+
+workdir=$(mktemp -d)
+trap 'kill -KILL $pid 2> /dev/null || true; rm -rf "$workdir"' EXIT
+
+stat() {
+    "$bench" -x STATS | sed -n "s/^$1://p"
+}
+
+printf '%10s %10s %8s %10s %12s\n' keys log_mb threads first_ms recovery_ms
+for keys in $counts; do
+    rm -rf "$workdir"/*
+    (cd "$workdir" && exec "$server" > /dev/null 2>&1) &
+    pid=$!
+    "$bench" -F -n "$keys" -v "$value_size" -c 4 > /dev/null
+    kill -KILL $pid
+    wait $pid 2> /dev/null || true
+
+    for threads in 1 0; do
+        (cd "$workdir" && DICT_RECOVERY_THREADS=$threads exec "$server" > /dev/null 2>&1) &
+        pid=$!
+        until [ "$(stat backend_recovery_pending_shards)" = 0 ]; do
+            sleep 0.05
+        done
+        printf '%10s %10s %8s %10s %12s\n' "$keys" \
+            "$(stat backend_log_bytes | awk '{printf "%.1f", $1 / 1048576}')" \
+            "$(stat backend_recovery_threads)" "$(stat backend_recovery_first_ms)" \
+            "$(stat backend_recovery_ms)"
+        [ "$(stat backend_keys)" = "$keys" ] || { echo "recovered a wrong key count" >&2; exit 1; }
+        kill -KILL $pid
+        wait $pid 2> /dev/null || true
+    done
+done
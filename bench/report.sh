@@ -0,0 +1,25 @@
+#!/bin/sh
+# Compare the throughput of several server builds running the same workload.
+# Usage: report.sh <bench.elf> "<bench options>" "<name>=[VAR=value ...] <server.elf>" ...
+# Variables before the binary are passed to the server environment.
+# The first entry is the reference for the speedup column.
+set -e
+
+dir=$(dirname "$0")
+bench=$1
+options=$2
+shift 2
+
+printf '%-12s %12s %8s\n' build ops/sec speedup
+reference=
+for entry in "$@"; do
+    name=${entry%%=*}
+    spec=${entry#*=}
+    server=${spec##* }
+    vars=${spec% *}
+    [ "$vars" != "$spec" ] || vars=
+    # shellcheck disable=SC2086
+    ops=$(env $vars "$dir/run_bench.sh" "$server" "$bench" $options | sed -n 's/^ops_per_sec: //p')
+    [ -n "$reference" ] || reference=$ops
+    printf '%-12s %12s %7.2fx\n' "$name" "$ops" "$(echo "$ops $reference" | awk '{print $1 / $2}')"
+done
@@ -0,0 +1,21 @@
+#!/bin/sh
+# Run the benchmark client against a fresh server started in a temporary directory.
+# Usage: run_bench.sh <server.elf> <bench.elf> [bench options]
+set -e
+
+server=$(realpath "$1")
+bench=$(realpath "$2")
+shift 2
+
+workdir=$(mktemp -d)
+(cd "$workdir" && exec "$server" > /dev/null 2>&1) &
+pid=$!
+
+status=0
+"$bench" "$@" || status=$?
+
+# SIGTERM lets the server return from main(), which is when profile data is written.
+kill -TERM "$pid"
+wait "$pid" || true
+rm -rf "$workdir"
+exit $status
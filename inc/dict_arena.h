@@ -0,0 +1,226 @@
+/************************************************************************************************
+Copyright (c) 2024, Guido Ramirez <guidoramirez7@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute,
+sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial
+portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+SPDX-License-Identifier: MIT
+*************************************************************************************************/
+
+#ifndef DICT_ARENA_H
+#define DICT_ARENA_H
+
+/** @file dict_arena.h
+ ** @brief Huge page backed memory arena function definitions.
+ **
+ ** Memory is mapped in DICT_ARENA_CHUNK_SIZE chunks aligned to the huge page size. Each chunk
+ ** tries explicit huge pages (MAP_HUGETLB) first, then transparent huge pages requested with
+ ** madvise(MADV_HUGEPAGE), and falls back to normal pages. Chunks are split in
+ ** DICT_ARENA_SLAB_SIZE slabs, each one holding blocks of a single power of two size class and
+ ** tracking them in a bitmap kept outside the slab. A slab left without blocks gives its pages
+ ** back to the OS with madvise(MADV_DONTNEED).
+ **
+ ** Churn leaves slabs sparsely used. dict_arena_defrag() lets the owner of the references move
+ ** blocks out of those slabs into denser ones, so the sparse ones empty and are given back.
+ **
+ ** An arena is not thread safe, the owner serializes every call.
+ **/
+
+/* === Headers files inclusions ================================================================ */
+
+#include <stddef.h>
+
+/* === C++ header ============================================================================ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* === Public macros definitions =============================================================== */
+
+#define DICT_ARENA_CHUNK_SIZE (2 * 1024 * 1024) /**< Chunk and huge page size. */
+#define DICT_ARENA_MIN_CLASS  (16)              /**< Smallest block size. */
+#define DICT_ARENA_MAX_CLASS  (64 * 1024)       /**< Largest block carved from a chunk. */
+#define DICT_ARENA_SLAB_SIZE  (64 * 1024)       /**< Unit of a chunk given to a size class. */
+
+/* === Public data type declarations =========================================================== */
+
+typedef enum {
+    DICT_ARENA_PAGES_NORMAL = 0, /**< Regular pages */
+    DICT_ARENA_PAGES_THP,        /**< Transparent huge pages requested with madvise */
+    DICT_ARENA_PAGES_HUGETLB,    /**< Explicit huge pages from the hugetlbfs pool */
+    DICT_ARENA_PAGES_COUNT,      /**< Number of page kinds, not a kind */
+} dict_arena_pages;
+
+typedef struct dict_arena * dict_arena;
+
+typedef struct {
+    size_t allocated; /**< Bytes requested by live blocks */
+    size_t reserved;  /**< Bytes taken by live blocks, after class rounding */
+    size_t mapped;    /**< Bytes mapped for chunks and large blocks */
+    size_t slab_free; /**< Free bytes inside slabs still holding blocks */
+    size_t released;  /**< Bytes of free slabs given back to the OS, still mapped */
+} dict_arena_usage_t;
+
+/* === Public variable declarations ============================================================ */
+
+/* === Public function declarations ============================================================ */
+
+/**
+ * @brief Create an empty arena. Chunks are mapped on demand.
+ *
+ * @return dict_arena Arena, NULL if there is no memory.
+ */
+dict_arena dict_arena_create(void);
+
+/**
+ * @brief Unmap every chunk and release the arena. Blocks larger than DICT_ARENA_MAX_CLASS have
+ * their own mapping and must be freed before.
+ *
+ * @param arena Arena.
+ */
+void dict_arena_destroy(dict_arena arena);
+
+/**
+ * @brief Allocate a block.
+ *
+ * Blocks larger than DICT_ARENA_MAX_CLASS get their own mapping.
+ *
+ * @param arena Arena.
+ * @param size Block size.
+ * @return void* Block, NULL if there is no memory.
+ */
+void * dict_arena_alloc(dict_arena arena, size_t size);
+
+/**
+ * @brief Release a block.
+ *
+ * @param arena Arena.
+ * @param block Block returned by dict_arena_alloc().
+ * @param size Size given to dict_arena_alloc().
+ */
+void dict_arena_free(dict_arena arena, void * block, size_t size);
+
+/**
+ * @brief Release a block with its own mapping from the arena without unmapping it, so the
+ * caller can unmap it later, possibly from another thread.
+ *
+ * @param arena Arena.
+ * @param block Block returned by dict_arena_alloc().
+ * @param size Size given to dict_arena_alloc().
+ * @param region_size Where the size to give dict_arena_unmap() is stored.
+ * @param pages Where the kind of pages to give dict_arena_unmap() is stored.
+ * @return void* Region to give dict_arena_unmap(), NULL if the block lives in a slab and must
+ * be released with dict_arena_free().
+ */
+void * dict_arena_detach(dict_arena arena, void * block, size_t size, size_t * region_size,
+                        dict_arena_pages * pages);
+
+/**
+ * @brief Prepare a defragmentation pass. Makes the densest slab of each class the target of
+ * the blocks moved by dict_arena_defrag().
+ *
+ * @param arena Arena.
+ */
+void dict_arena_defrag_begin(dict_arena arena);
+
+/**
+ * @brief Move a block out of a sparse slab into a denser one.
+ *
+ * Slabs at most half used are sparse. The content is copied and the old block released, the
+ * caller replaces every reference to it with the returned address.
+ *
+ * @param arena Arena.
+ * @param block Block returned by dict_arena_alloc().
+ * @param size Size given to dict_arena_alloc().
+ * @return void* New address, NULL if the block stays where it is.
+ */
+void * dict_arena_defrag(dict_arena arena, void * block, size_t size);
+
+/**
+ * @brief Give the pages of free slabs back to the OS.
+ *
+ * A slab left without blocks keeps its pages, so freeing never makes a system call and a
+ * slab reused soon costs no page faults. Call this from background work, such as a
+ * defragmentation step, to hand the memory back in bounded steps.
+ *
+ * @param arena Arena.
+ * @param slabs Most slabs to release in this call.
+ * @return int 1 if free slabs still wait to be released, 0 otherwise.
+ */
+int dict_arena_trim(dict_arena arena, int slabs);
+
+/**
+ * @brief Bytes a block of a given size really takes from the arena.
+ *
+ * @param size Size given to dict_arena_alloc().
+ * @return size_t Size after class or page rounding, headers included.
+ */
+size_t dict_arena_block_size(size_t size);
+
+/**
+ * @brief Read the arena counters. Mapped minus allocated is what fragmentation and free
+ * blocks cost.
+ *
+ * @param arena Arena.
+ * @param usage Where the counters will be stored.
+ */
+void dict_arena_usage(dict_arena arena, dict_arena_usage_t * usage);
+
+/**
+ * @brief Map a zeroed region, with huge pages when it is at least DICT_ARENA_CHUNK_SIZE long.
+ *
+ * @param size Region size.
+ * @param pages Kind of pages that back the region.
+ * @return void* Region, NULL if there is no memory.
+ */
+void * dict_arena_map(size_t size, dict_arena_pages * pages);
+
+/**
+ * @brief Unmap a region returned by dict_arena_map().
+ *
+ * @param region Region.
+ * @param size Size given to dict_arena_map().
+ * @param pages Kind of pages reported by dict_arena_map().
+ */
+void dict_arena_unmap(void * region, size_t size, dict_arena_pages pages);
+
+/**
+ * @brief Name of a page kind, as used in statistics.
+ *
+ * @param pages Page kind.
+ * @return const char* "normal", "thp" or "hugetlb".
+ */
+const char * dict_arena_pages_name(dict_arena_pages pages);
+
+/**
+ * @brief Write arena statistics as "name:value" lines.
+ *
+ * Mapped bytes are process wide, they include every dict_arena_map() region.
+ *
+ * @param arena Arena.
+ * @param buffer Buffer where the statistics will be stored.
+ * @param buffer_size Buffer's size.
+ * @return int Number of characters written.
+ */
+int dict_arena_stats(dict_arena arena, char * buffer, int buffer_size);
+
+/* === End of documentation ==================================================================== */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DICT_ARENA_H */
@@ -0,0 +1,161 @@
+/************************************************************************************************
+Copyright (c) 2024, Guido Ramirez <guidoramirez7@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute,
+sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial
+portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+SPDX-License-Identifier: MIT
+*************************************************************************************************/
+
+#ifndef DICT_ART_H
+#define DICT_ART_H
+
+/** @file dict_art.h
+ ** @brief Adaptive radix tree keyed by strings.
+ **
+ ** Inner nodes grow from 4 to 16, 48 and 256 children as keys are added and shrink back as they
+ ** go, so sparse levels stay small. Chains of single children are compressed into the prefix of
+ ** the node below, which suits keys sharing long prefixes such as "tenant:region:object:id".
+ ** Keys are visited in byte order, and every key under a prefix is one subtree: it is found with
+ ** a single descent and can be detached whole.
+ **
+ ** Not thread safe, callers serialize changes against lookups.
+ **/
+
+/* === Headers files inclusions ================================================================ */
+
+#include <stddef.h>
+
+/* === C++ header ============================================================================ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* === Public macros definitions =============================================================== */
+
+/* === Public data type declarations =========================================================== */
+
+typedef struct dict_art * dict_art;
+
+/**
+ * @brief Callback for every key of a walk, in byte order.
+ *
+ * @param key Key name. Only valid during the call.
+ * @param value Value stored with the key.
+ * @param context User context given to the walk.
+ * @return int 0 to continue, any other value stops the walk.
+ */
+typedef int (*dict_art_visit)(const char * key, void * value, void * context);
+
+/** Tree size, kept up to date by every change. */
+typedef struct {
+    size_t keys;          /**< Keys stored */
+    size_t key_bytes;     /**< Key names, terminators included */
+    size_t node_bytes;    /**< Inner nodes */
+    size_t leaf_bytes;    /**< Leaves, their key names included */
+    size_t nodes[4];      /**< Inner nodes with up to 4, 16, 48 and 256 children */
+} dict_art_usage_t;
+
+/* === Public variable declarations ============================================================ */
+
+/* === Public function declarations ============================================================ */
+
+/**
+ * @brief Create an empty tree.
+ *
+ * @return dict_art Tree, NULL if out of memory.
+ */
+dict_art dict_art_create(void);
+/**
+ * @brief Free a tree.
+ *
+ * @param tree Tree, may be NULL.
+ * @param release Called for every value before it is dropped, may be NULL.
+ * @param context User context given to release.
+ */
+void dict_art_destroy(dict_art tree, dict_art_visit release, void * context);
+/**
+ * @brief Look a key up.
+ *
+ * @param tree Tree.
+ * @param key Key name.
+ * @return void* Value stored with the key, NULL if it is missing.
+ */
+void * dict_art_get(dict_art tree, const char * key);
+/**
+ * @brief Store a value, replacing the one stored with the key.
+ *
+ * @param tree Tree.
+ * @param key Key name.
+ * @param value Value, not NULL.
+ * @param old Where the replaced value is stored, NULL if the key is new.
+ * @return int
+ *              - 0 if no error.
+ *              - -1 if out of memory, the tree is unchanged.
+ */
+int dict_art_put(dict_art tree, const char * key, void * value, void ** old);
+/**
+ * @brief Remove a key.
+ *
+ * @param tree Tree.
+ * @param key Key name.
+ * @return void* Value that was stored with the key, NULL if it is missing.
+ */
+void * dict_art_del(dict_art tree, const char * key);
+/**
+ * @brief Walk the keys starting with a prefix, in byte order.
+ *
+ * @param tree Tree.
+ * @param prefix Prefix, "" for every key.
+ * @param visit Callback called once per key.
+ * @param context User context given to the callback.
+ * @return int Value of the callback that stopped the walk, 0 if it went to the end.
+ */
+int dict_art_scan(dict_art tree, const char * prefix, dict_art_visit visit, void * context);
+/**
+ * @brief Move every key starting with a prefix to a tree of its own. Only the path down to the
+ * prefix is touched, whatever the number of keys moved.
+ *
+ * @param tree Tree.
+ * @param prefix Prefix.
+ * @param moved Where the new tree is stored, NULL if no key has the prefix.
+ * @return int
+ *              - 0 if no error.
+ *              - -1 if out of memory, the tree is unchanged.
+ */
+int dict_art_split(dict_art tree, const char * prefix, dict_art * moved);
+/**
+ * @brief Bytes of the leaf that stores a key.
+ *
+ * @param key Key name.
+ * @return size_t Leaf size, key name included.
+ */
+size_t dict_art_leaf_size(const char * key);
+/**
+ * @brief Report the size of a tree.
+ *
+ * @param tree Tree.
+ * @param usage Where the size is stored.
+ */
+void dict_art_usage(dict_art tree, dict_art_usage_t * usage);
+
+/* === End of documentation ==================================================================== */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DICT_ART_H */
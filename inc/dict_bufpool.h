@@ -0,0 +1,137 @@
+/************************************************************************************************
+Copyright (c) 2024, Guido Ramirez <guidoramirez7@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute,
+sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial
+portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+SPDX-License-Identifier: MIT
+*************************************************************************************************/
+
+#ifndef DICT_BUFPOOL_H
+#define DICT_BUFPOOL_H
+
+/** @file dict_bufpool.h
+ ** @brief Size class pool of connection buffers.
+ **
+ ** Buffers come in power of two classes from DICT_BUFPOOL_MIN_SIZE to DICT_BUFPOOL_MAX_SIZE.
+ ** Released buffers are kept on a free list of their class for the next request, up to a byte
+ ** budget, and handed back to malloc() beyond it or when the pool is trimmed. Larger buffers,
+ ** such as the output of one reply with a large value, are allocated to size and freed as soon
+ ** as they are released. A pool has no
+ ** lock: each worker owns one and serves only its own connections from it. The usage counters
+ ** may be read from any thread.
+ **/
+
+/* === Headers files inclusions ================================================================ */
+
+#include <stddef.h>
+
+/* === C++ header ============================================================================ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* === Public macros definitions =============================================================== */
+
+#define DICT_BUFPOOL_MIN_SIZE (512)                      /**< Smallest class */
+#define DICT_BUFPOOL_CLASSES  (12)                       /**< Number of classes */
+#define DICT_BUFPOOL_MAX_SIZE (DICT_BUFPOOL_MIN_SIZE << (DICT_BUFPOOL_CLASSES - 1)) /**< 1 MiB */
+
+/* === Public data type declarations =========================================================== */
+
+/**
+ * @brief Buffer pool, owned by a single thread.
+ */
+typedef struct dict_bufpool_s * dict_bufpool;
+
+/**
+ * @brief Pool usage.
+ */
+typedef struct {
+    size_t used_bytes;     /**< Buffers handed out */
+    size_t cached_bytes;   /**< Buffers kept for reuse */
+    unsigned long gets;    /**< Buffers requested */
+    unsigned long hits;    /**< Requests served from a free list */
+    unsigned long grows;   /**< Buffers replaced by a larger one */
+    unsigned long frees;   /**< Buffers handed back to malloc() */
+} dict_bufpool_usage_t;
+
+/* === Public variable declarations ============================================================ */
+
+/* === Public function declarations ============================================================ */
+
+/**
+ * @brief Create a pool.
+ *
+ * @param keep_bytes Most bytes kept on the free lists, released buffers beyond are freed.
+ * @return dict_bufpool Pool, NULL if out of memory.
+ */
+dict_bufpool dict_bufpool_create(size_t keep_bytes);
+
+/**
+ * @brief Get a buffer of at least a size.
+ *
+ * @param pool Pool.
+ * @param size Bytes needed. Beyond DICT_BUFPOOL_MAX_SIZE the buffer is not kept for reuse.
+ * @param capacity Where the buffer's real size will be stored.
+ * @return char* Buffer, NULL if out of memory.
+ */
+char * dict_bufpool_get(dict_bufpool pool, size_t size, size_t * capacity);
+
+/**
+ * @brief Replace a buffer by a larger one, keeping its first bytes.
+ *
+ * @param pool Pool.
+ * @param buffer Buffer from this pool.
+ * @param length Bytes of the buffer to keep.
+ * @param size Bytes needed.
+ * @param capacity Buffer's size, updated with the new buffer's.
+ * @return char* New buffer, NULL on error and then the old one is still valid.
+ */
+char * dict_bufpool_grow(dict_bufpool pool, char * buffer, size_t length, size_t size,
+                         size_t * capacity);
+
+/**
+ * @brief Give a buffer back to the pool.
+ *
+ * @param pool Pool the buffer came from.
+ * @param buffer Buffer, NULL is ignored.
+ * @param capacity Buffer's size.
+ */
+void dict_bufpool_put(dict_bufpool pool, char * buffer, size_t capacity);
+
+/**
+ * @brief Free every buffer kept for reuse, when traffic stopped.
+ *
+ * @param pool Pool.
+ */
+void dict_bufpool_trim(dict_bufpool pool);
+
+/**
+ * @brief Read the usage of a pool. Safe from any thread.
+ *
+ * @param pool Pool.
+ * @param usage Where the usage will be added.
+ */
+void dict_bufpool_usage(dict_bufpool pool, dict_bufpool_usage_t * usage);
+
+/* === End of documentation ==================================================================== */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DICT_BUFPOOL_H */
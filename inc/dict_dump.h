@@ -0,0 +1,107 @@
+/************************************************************************************************
+Copyright (c) 2024, Guido Ramirez <guidoramirez7@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute,
+sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial
+portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+SPDX-License-Identifier: MIT
+*************************************************************************************************/
+
+#ifndef DICT_DUMP_H
+#define DICT_DUMP_H
+
+/** @file dict_dump.h
+ ** @brief Keyspace export and import function definitions.
+ **
+ ** A dump is a set of part files named `<name>.<n>` inside DICT_DUMP_DIR. Each part starts with
+ ** DICT_DUMP_MAGIC and holds a sequence of records made of two native endian uint32_t lengths
+ ** (key and value) followed by the key and value bytes.
+ **
+ ** Dump names come from clients, so they are plain file names checked like keys: not empty, no
+ ** leading dot and no slash. Clients can not reach files outside DICT_DUMP_DIR.
+ **/
+
+/* === Headers files inclusions ================================================================ */
+
+/* === C++ header ============================================================================ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* === Public macros definitions =============================================================== */
+
+#define DICT_DUMP_MAGIC   "DSD1" /**< Header of every dump part file. */
+#define DICT_DUMP_THREADS (4)    /**< Worker threads, and part files, used by a dump. */
+#define DICT_DUMP_DIR     "dump" /**< Directory holding every dump, created on demand. */
+#define DICT_DUMP_NAME_MAX (200) /**< Longest dump name, leaves room for the part suffix. */
+
+/* === Public data type declarations =========================================================== */
+
+/* === Public variable declarations ============================================================ */
+
+/* === Public function declarations ============================================================ */
+
+/**
+ * @brief Start a background export of every key stored in the backend.
+ *
+ * The key list is partitioned across DICT_DUMP_THREADS workers, each one writing its own part
+ * file sequentially. Parts are written to a temporary name and renamed once all of them are
+ * complete, so a partial dump is never visible under `<name>.<n>` and a failed one leaves the
+ * previous dump of that name whole.
+ *
+ * The keys of the in-process engines (memory, art) are exported as they were when the key list
+ * was taken. The other engines keep serving writes, each of their values is read when its part
+ * reaches it, see dict_dump.c.
+ *
+ * @param name Dump name, the prefix of the part files inside DICT_DUMP_DIR.
+ * @return int
+ *              - 0 if the export was started.
+ *              - -1 otherwise, with errno set. EBUSY if an export or import is running, EINVAL
+ *                if the name is not a plain file name.
+ */
+int dict_dump_save(const char * name);
+
+/**
+ * @brief Start a background import of a previous export.
+ *
+ * Every part file found is loaded by its own worker thread. Existing keys with the same name
+ * are overwritten.
+ *
+ * @param name Dump name, the prefix of the part files inside DICT_DUMP_DIR.
+ * @return int
+ *              - 0 if the import was started.
+ *              - -1 otherwise, with errno set. EBUSY if an export or import is running, EINVAL
+ *                if the name is not a plain file name.
+ */
+int dict_dump_load(const char * name);
+
+/**
+ * @brief Write the state of the last export or import as "name:value" lines, so clients can
+ * tell whether a job they started completed. dump_state is idle, running, done or failed.
+ *
+ * @param buffer Buffer where the statistics will be stored.
+ * @param buffer_size Buffer's size.
+ * @return int Number of characters written.
+ */
+int dict_dump_stats(char * buffer, int buffer_size);
+
+/* === End of documentation ==================================================================== */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DICT_DUMP_H */
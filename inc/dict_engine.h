@@ -0,0 +1,156 @@
+/************************************************************************************************
+Copyright (c) 2024, Guido Ramirez <guidoramirez7@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute,
+sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial
+portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+SPDX-License-Identifier: MIT
+*************************************************************************************************/
+
+#ifndef DICT_ENGINE_H
+#define DICT_ENGINE_H
+
+/** @file dict_engine.h
+ ** @brief Storage engine interface.
+ **
+ ** The engines listed by make ENGINES are compiled in, the others compile to nothing. Each is
+ ** described by a table of functions with the semantics of the dict_backend_* calls in
+ ** dict_server.h. Those calls route each key to the engine of its
+ ** namespace, the part of the key before DICT_ENGINE_SEPARATOR, and keys outside any configured
+ ** namespace to the default engine. Namespaces keep their prefix in the key given to the engine.
+ **
+ ** An engine is a single instance: namespaces sharing an engine share its store, and only the
+ ** engines some namespace uses are opened.
+ **
+ ** When a single engine is built, it serves every key. Its per key entry points are then external
+ ** and the dict_backend_* calls reach them directly, without the table.
+ **/
+
+/* === Headers files inclusions ================================================================ */
+
+#include "dict_server.h"
+
+/* === C++ header ============================================================================ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* === Public macros definitions =============================================================== */
+
+#define DICT_ENGINE_SEPARATOR      ':' /**< Ends the namespace part of a key */
+#define DICT_ENGINE_MAX_NAMESPACES (16) /**< Namespaces with their own engine */
+
+#if DICT_CONFIG_ENGINE_COUNT == 1
+#define DICT_ENGINE_ENTRY /**< Linkage of the per key entry points of an engine */
+#if DICT_CONFIG_ENGINE_FILE
+#define DICT_ENGINE_ONLY(op) backend_file_##op /**< Per key entry point of the only engine */
+#elif DICT_CONFIG_ENGINE_MEMORY
+#define DICT_ENGINE_ONLY(op) backend_memory_##op
+#elif DICT_CONFIG_ENGINE_LOG
+#define DICT_ENGINE_ONLY(op) backend_log_##op
+#elif DICT_CONFIG_ENGINE_PACKED
+#define DICT_ENGINE_ONLY(op) backend_packed_##op
+#else
+#define DICT_ENGINE_ONLY(op) backend_art_##op
+#endif
+#else
+#define DICT_ENGINE_ENTRY static
+#endif
+
+/* === Public data type declarations =========================================================== */
+
+/**
+ * @brief Storage engine. Every function is safe to call from the dump threads while the server
+ * is running, see the dict_backend_* call of the same name for the details. scan and del_prefix
+ * may be NULL, the engine's keys are then walked with iterate and filtered. copy may be NULL, its
+ * keys are then walked with iterate and visited without values. batch_begin and batch_commit may
+ * be NULL for an engine that never defers anything.
+ */
+typedef struct {
+    const char * name; /**< Name selecting the engine in the configuration */
+    size_t key_max;    /**< Longest key accepted, in bytes */
+    int (*open)(const dict_server_config_t * config);             /**< dict_backend_init() */
+    void (*close)(void);                                          /**< dict_backend_close() */
+    int (*get)(const char * key, char * buffer, int buffer_size, int * length);
+    int (*put)(const char * key, const char * value, int length); /**< dict_backend_set() */
+    int (*del)(const char * key);
+    int (*iterate)(dict_backend_key_visit visit, void * context); /**< dict_backend_keys() */
+    int (*copy)(dict_backend_value_visit visit, void * context);  /**< dict_backend_copy() */
+    int (*stats)(char * buffer, int buffer_size);
+    int (*flush)(void);
+    int (*count)(size_t * count);
+    int (*clear)(void);
+    int (*defrag)(int budget_us);
+    int (*memory)(dict_backend_memory_t * memory);
+    int (*usage)(const char * key, size_t * bytes);
+    int (*prefetch)(const char * key);
+    int (*scan)(const char * prefix, dict_backend_key_visit visit, void * context);
+    int (*del_prefix)(const char * prefix, size_t * count);
+    int (*batch_begin)(void);  /**< dict_backend_batch_begin() */
+    int (*batch_commit)(void); /**< dict_backend_batch_commit() */
+} dict_engine_t;
+
+/* === Public variable declarations ============================================================ */
+
+// Only the engines listed by make ENGINES are defined.
+extern const dict_engine_t dict_engine_file;   /**< A file per key, see dict_backend_file.c */
+extern const dict_engine_t dict_engine_memory; /**< In process hash table */
+extern const dict_engine_t dict_engine_log;    /**< Sharded append only logs */
+extern const dict_engine_t dict_engine_packed; /**< Small values in shared slotted pages */
+extern const dict_engine_t dict_engine_art;    /**< In process adaptive radix tree */
+
+/* === Public function declarations ============================================================ */
+
+/**
+ * @brief Find an engine by name.
+ *
+ * @param name Engine name: file, memory, log, packed or art, if the build lists it in ENGINES.
+ * @return const dict_engine_t* Engine, NULL if there is none with that name.
+ */
+const dict_engine_t * dict_engine_find(const char * name);
+
+/**
+ * @brief Engine serving a key, as selected at dict_backend_init().
+ *
+ * @param key Key name.
+ * @return const dict_engine_t* Engine of the key's namespace, or the default engine.
+ */
+const dict_engine_t * dict_engine_route(const char * key);
+
+/**
+ * @brief Longest key any engine of the build accepts, so a copy of the keyspace can hold every
+ * key a namespace may route to it.
+ *
+ * @return size_t Key length in bytes.
+ */
+size_t dict_engine_key_max(void);
+
+#if DICT_CONFIG_ENGINE_COUNT == 1
+// Per key entry points of the only engine built, see dict_engine_t.
+int DICT_ENGINE_ONLY(get)(const char * key, char * buffer, int buffer_size, int * length);
+int DICT_ENGINE_ONLY(put)(const char * key, const char * value, int length);
+int DICT_ENGINE_ONLY(del)(const char * key);
+int DICT_ENGINE_ONLY(usage)(const char * key, size_t * bytes);
+int DICT_ENGINE_ONLY(prefetch)(const char * key);
+#endif
+
+/* === End of documentation ==================================================================== */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DICT_ENGINE_H */
@@ -0,0 +1,66 @@
+/************************************************************************************************
+Copyright (c) 2024, Guido Ramirez <guidoramirez7@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute,
+sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial
+portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+SPDX-License-Identifier: MIT
+*************************************************************************************************/
+
+#ifndef DICT_LOG_H
+#define DICT_LOG_H
+
+/** @file dict_log.h
+ ** @brief Log macros shared by every module. Compiled out when DICT_CONFIG_LOGGING is 0.
+ **/
+
+/* === Headers files inclusions ================================================================ */
+
+#include <stdio.h>
+#include "dict_config.h"
+
+/* === C++ header ============================================================================ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* === Public macros definitions =============================================================== */
+
+#if DICT_CONFIG_LOGGING
+#define LOG_INFO(format, ...)  printf("INFO-> " format "\n", ##__VA_ARGS__)
+#define LOG_ERROR(format, ...) fprintf(stderr, "ERROR -> " format "\n", ##__VA_ARGS__)
+#else
+#define LOG_INFO(format, ...)                                                                      \
+    do {                                                                                           \
+    } while (0)
+#define LOG_ERROR(format, ...)                                                                     \
+    do {                                                                                           \
+    } while (0)
+#endif
+
+/* === Public data type declarations =========================================================== */
+
+/* === Public variable declarations ============================================================ */
+
+/* === Public function declarations ============================================================ */
+
+/* === End of documentation ==================================================================== */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DICT_LOG_H */
@@ -0,0 +1,136 @@
+/************************************************************************************************
+Copyright (c) 2024, Guido Ramirez <guidoramirez7@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute,
+sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial
+portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+SPDX-License-Identifier: MIT
+*************************************************************************************************/
+
+#ifndef DICT_MAPCACHE_H
+#define DICT_MAPCACHE_H
+
+/** @file dict_mapcache.h
+ ** @brief Cache of read only mappings of key files.
+ **
+ ** A key file read once is mapped and kept, later GETs copy the value straight from the mapping
+ ** without a single file system call. Files are only ever replaced by a rename, never written in
+ ** place, so a mapping is a stable snapshot of one value. SET and DEL drop the key's mapping and
+ ** bump its generation: a reader that opened the old file before the change sees a different
+ ** generation when it tries to add its mapping, and the stale value is never cached.
+ **/
+
+/* === Headers files inclusions ================================================================ */
+
+#include <stddef.h>
+#include "dict_reclaim.h"
+
+/* === C++ header ============================================================================ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* === Public macros definitions =============================================================== */
+
+#define DICT_MAPCACHE_MAX_VALUE (DICT_RECLAIM_MIN_SIZE) /**< Larger files are never mapped */
+
+/* === Public data type declarations =========================================================== */
+
+/* === Public variable declarations ============================================================ */
+
+/* === Public function declarations ============================================================ */
+
+/**
+ * @brief Enable the cache.
+ *
+ * @param entries Mappings kept, the least recently read are dropped beyond it.
+ * @return int
+ *              - 0 if no error.
+ *              - -1 otherwise, the cache stays disabled.
+ */
+int dict_mapcache_start(int entries);
+/**
+ * @brief Drop every mapping and disable the cache. No lookup may be running.
+ */
+void dict_mapcache_stop(void);
+/**
+ * @brief Copy a value from its mapping.
+ *
+ * @param key Key name.
+ * @param buffer Buffer where the value will be stored.
+ * @param buffer_size Buffer's size.
+ * @param length Where the full value length is stored, larger than buffer_size if truncated.
+ * @return int
+ *              - 1 if the key is mapped and was copied.
+ *              - 0 if it is not, the caller reads the file.
+ */
+int dict_mapcache_get(const char * key, char * buffer, int buffer_size, int * length);
+/**
+ * @brief Current generation of a key, taken before opening its file to read it.
+ *
+ * @param key Key name.
+ * @return unsigned long Generation to give dict_mapcache_load().
+ */
+unsigned long dict_mapcache_generation(const char * key);
+/**
+ * @brief Map an open key file, copy its value and keep the mapping unless the key changed since
+ * the generation was taken.
+ *
+ * @param key Key name.
+ * @param generation Generation taken before the file was opened.
+ * @param fd Open key file.
+ * @param size File size.
+ * @param buffer Buffer where the value will be stored.
+ * @param buffer_size Buffer's size.
+ * @param length Where the full value length is stored, larger than buffer_size if truncated.
+ * @return int
+ *              - 1 if the value was copied from the mapping.
+ *              - 0 if the file was not mapped, the caller reads it.
+ */
+int dict_mapcache_load(const char * key, unsigned long generation, int fd, size_t size,
+                       char * buffer, int buffer_size, int * length);
+/**
+ * @brief Drop the mapping of a key after its file was replaced or removed.
+ *
+ * @param key Key name.
+ */
+void dict_mapcache_invalidate(const char * key);
+/**
+ * @brief Drop every mapping after the whole store was replaced.
+ */
+void dict_mapcache_clear(void);
+/**
+ * @brief Bytes currently mapped.
+ *
+ * @return size_t Mapped value bytes.
+ */
+size_t dict_mapcache_bytes(void);
+/**
+ * @brief Write cache statistics as "name:value" lines.
+ *
+ * @param buffer Buffer where the statistics will be stored.
+ * @param buffer_size Buffer's size.
+ * @return int Number of characters written.
+ */
+int dict_mapcache_stats(char * buffer, int buffer_size);
+
+/* === End of documentation ==================================================================== */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DICT_MAPCACHE_H */
@@ -0,0 +1,89 @@
+/************************************************************************************************
+Copyright (c) 2024, Guido Ramirez <guidoramirez7@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute,
+sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial
+portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+SPDX-License-Identifier: MIT
+*************************************************************************************************/
+
+#ifndef DICT_PROFILE_H
+#define DICT_PROFILE_H
+
+/** @file dict_profile.h
+ ** @brief Built in sampling profiler function definitions.
+ **
+ ** A profile arms ITIMER_PROF, so SIGPROF lands on whichever thread is burning CPU. The signal
+ ** handler walks the interrupted thread's frame pointers and stores the return addresses. When
+ ** the profile ends the samples are symbolized with dladdr() and folded, one
+ ** `thread;root;...;leaf count` line per distinct stack, ready for flamegraph.pl. Static
+ ** functions of the executable are named from its .symtab. Frames that neither resolves, such as
+ ** those in stripped libraries, show as `module+0xoffset`, resolvable with addr2line. The
+ ** folded stacks are handed to a callback, the profiler never writes to a client itself.
+ **
+ ** Nothing is installed while no profile runs.
+ **/
+
+/* === Headers files inclusions ================================================================ */
+
+#include <stddef.h>
+
+/* === C++ header ============================================================================ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* === Public macros definitions =============================================================== */
+
+#define DICT_PROFILE_HZ          (99) /**< Samples per second of CPU time */
+#define DICT_PROFILE_MAX_SECONDS (60) /**< Longest profile accepted */
+
+/* === Public data type declarations =========================================================== */
+
+/**
+ * @brief Receives the result of a profile, called on the profiler thread once it is over.
+ *
+ * @param text Folded stacks, released by the callee with free(). NULL if there was no memory.
+ * @param length Bytes in text.
+ * @param context Context given to dict_profile_start().
+ */
+typedef void (*dict_profile_done)(char * text, size_t length, void * context);
+
+/* === Public variable declarations ============================================================ */
+
+/* === Public function declarations ============================================================ */
+
+/**
+ * @brief Start a background profile. Once the time is up the profiler thread folds the stacks
+ * and hands them to the callback, a new profile may already start from it.
+ *
+ * @param seconds Profile length, 1 to DICT_PROFILE_MAX_SECONDS.
+ * @param done Callback receiving the folded stacks, only called if the profile was started.
+ * @param context Passed to the callback.
+ * @return int
+ *              - 0 if the profile was started.
+ *              - -1 otherwise, with errno set. EBUSY if a profile is running, ENOTSUP if stacks
+ *                can not be unwound on this architecture.
+ */
+int dict_profile_start(int seconds, dict_profile_done done, void * context);
+
+/* === End of documentation ==================================================================== */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DICT_PROFILE_H */
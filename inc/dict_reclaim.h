@@ -0,0 +1,119 @@
+/************************************************************************************************
+Copyright (c) 2024, Guido Ramirez <guidoramirez7@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute,
+sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial
+portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+SPDX-License-Identifier: MIT
+*************************************************************************************************/
+
+#ifndef DICT_RECLAIM_H
+#define DICT_RECLAIM_H
+
+/** @file dict_reclaim.h
+ ** @brief Background reclamation of large retired storage.
+ **
+ ** Giving a large file or mapping back to the system costs time proportional to its size. The
+ ** request path hands anything above DICT_RECLAIM_MIN_SIZE to a reclamation thread instead:
+ ** files as an open descriptor whose name is already gone or replaced, truncated in steps and
+ ** closed there, mappings unmapped there, and whole stores through a release function. When
+ ** the thread is not running or its queue is full the work is done in the caller.
+ **/
+
+/* === Headers files inclusions ================================================================ */
+
+#include <stddef.h>
+#include <sys/types.h>
+#include "dict_arena.h"
+
+/* === C++ header ============================================================================ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* === Public macros definitions =============================================================== */
+
+#define DICT_RECLAIM_MIN_SIZE (1024 * 1024) /**< Smaller storage is released in the caller */
+
+/* === Public data type declarations =========================================================== */
+
+/**
+ * @brief Release function run by the reclamation thread.
+ *
+ * @param arg Argument given to dict_reclaim_call().
+ */
+typedef void (*dict_reclaim_release)(void * arg);
+
+/* === Public variable declarations ============================================================ */
+
+/* === Public function declarations ============================================================ */
+
+/**
+ * @brief Start the reclamation thread.
+ *
+ * @return int
+ *              - 0 if no error.
+ *              - -1 otherwise.
+ */
+int dict_reclaim_start(void);
+
+/**
+ * @brief Stop the reclamation thread after it has released everything queued.
+ */
+void dict_reclaim_stop(void);
+
+/**
+ * @brief Truncate and close a retired file.
+ *
+ * @param fd Descriptor opened for writing. Its name must already be unlinked or replaced.
+ * @param size File size.
+ */
+void dict_reclaim_file(int fd, off_t size);
+
+/**
+ * @brief Unmap a region returned by dict_arena_map() or dict_arena_detach().
+ *
+ * @param region Region.
+ * @param size Region size.
+ * @param pages Kind of pages backing the region.
+ */
+void dict_reclaim_unmap(void * region, size_t size, dict_arena_pages pages);
+
+/**
+ * @brief Run a release function, for storage that needs more than a close or an unmap.
+ *
+ * @param release Function that releases the storage.
+ * @param arg Argument given to the function.
+ * @param size Bytes released, for the statistics.
+ */
+void dict_reclaim_call(dict_reclaim_release release, void * arg, size_t size);
+
+/**
+ * @brief Write reclamation statistics as "name:value" lines.
+ *
+ * @param buffer Buffer where the statistics will be stored.
+ * @param buffer_size Buffer's size.
+ * @return int Number of characters written.
+ */
+int dict_reclaim_stats(char * buffer, int buffer_size);
+
+/* === End of documentation ==================================================================== */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DICT_RECLAIM_H */
@@ -28,6 +28,9 @@ SPDX-License-Identifier: MIT
 
 /* === Headers files inclusions ================================================================ */
 
+#include <stddef.h>
+#include "dict_config.h"
+
 /* === C++ header ============================================================================ */
 
 #ifdef __cplusplus
@@ -36,10 +39,80 @@ extern "C" {
 
 /* === Public macros definitions =============================================================== */
 
+#define DICT_SERVER_MAX_WORKERS (64) /**< Upper bound of dict_server_config_t::workers. */
+
 /* === Public data type declarations =========================================================== */
 
 typedef struct dict_server * dict_server;
 
+typedef enum {
+    SERVER_OK = 0,
+    SERVER_E_OS,
+    SERVER_E_NULL,
+    SERVER_E_SIZE,
+    SERVER_E_BUFFER,
+    SERVER_E_INVALID,
+    SERVER_E_MISSING,
+    SERVER_E_TOO_MANY,
+    SERVER_E_NOT_FOUND,
+    SERVER_E_BUSY,
+} server_err_t;
+
+typedef struct {
+    int workers;                       /**< Event loop threads, each with its own socket */
+    int cpus[DICT_SERVER_MAX_WORKERS]; /**< CPU each worker is pinned to, in worker order */
+    int cpu_count;                     /**< Entries in cpus, 0 disables pinning */
+    int numa;                          /**< Prefer the NUMA node of each worker's CPU */
+    int busy_poll_us;                  /**< SO_BUSY_POLL budget, > 0 also spins epoll_wait() */
+    int watchdog_ms;                   /**< Busy loop time reported as a stall, 0 disables */
+    int defrag_cpu_percent;            /**< Share of worker 0 spent on dict_backend_defrag() */
+    int write_back_ms;                 /**< Longest time a write is buffered, 0 writes through */
+    size_t write_back_bytes;           /**< Buffered bytes that trigger a flush, 0 for default */
+    int sync_writes;                   /**< Writes reach the disk before they are acknowledged */
+    int recovery_threads;              /**< Threads recovering the store, 0 for one per CPU */
+    int warmup_ms;                     /**< Time between saves of the hot keys, 0 disables */
+    int udp;                           /**< Also answer single datagram GETs over UDP */
+    int backlog;                       /**< Listen backlog, 0 for the default */
+    int defer_accept_s;                /**< TCP_DEFER_ACCEPT seconds, 0 disables */
+    int nagle;                         /**< Keep Nagle's algorithm, TCP_NODELAY is set otherwise */
+    int mmap_cache_entries;            /**< Key files the file engine keeps mapped, 0 disables */
+    int migrate_keys;                  /**< Move key files of the old layout into the data dir */
+    const char * engine;               /**< Default storage engine, NULL for the build's BACKEND */
+    const char * namespaces;           /**< "namespace=engine" pairs separated by commas, or NULL */
+} dict_server_config_t;
+
+/**
+ * @brief Callback used by dict_backend_keys() and dict_backend_scan() for every stored key.
+ *
+ * @param key Key name. Only valid during the call.
+ * @param context User context given to the walk.
+ * @return int 0 to continue, any other value stops the walk.
+ */
+typedef int (*dict_backend_key_visit)(const char * key, void * context);
+
+/**
+ * @brief Callback used by dict_backend_copy() for every stored key.
+ *
+ * @param key Key name.
+ * @param value Value bytes, only valid during the call. NULL if the engine does not copy values,
+ * the caller reads it with dict_backend_get().
+ * @param length Value length.
+ * @param context User context given to the walk.
+ * @return int 0 to continue, any other value stops the walk.
+ */
+typedef int (*dict_backend_value_visit)(const char * key, const char * value, int length,
+                                        void * context);
+
+/** Backend memory, maintained as data changes. Fields a backend does not keep in memory are 0. */
+typedef struct {
+    size_t key_bytes;       /**< Key names */
+    size_t value_bytes;     /**< Values */
+    size_t index_bytes;     /**< Lookup structures and per entry headers */
+    size_t cache_bytes;     /**< Caches of data kept elsewhere */
+    size_t allocated_bytes; /**< Requested from the backend allocator */
+    size_t mapped_bytes;    /**< Mapped by the backend allocator to serve those requests */
+} dict_backend_memory_t;
+
 /* === Public variable declarations ============================================================
  */
 
@@ -48,7 +121,236 @@ typedef struct dict_server * dict_server;
 
 dict_server dict_server_init(void);
 
-int dict_server_start(void);
+/**
+ * @brief Run the server until dict_server_stop() is called.
+ *
+ * Every worker owns a listening socket bound with SO_REUSEPORT, so the kernel spreads new
+ * connections between them, and serves its connections from its own epoll loop. Workers
+ * are pinned round robin to config->cpus. With config->numa each pinned worker prefers the
+ * memory of its CPU's node for everything it allocates.
+ *
+ * @param config Server configuration, NULL for a single unpinned worker.
+ * @return int
+ *              - EXIT_SUCCESS once stopped.
+ *              - EXIT_FAILURE if the configuration is invalid.
+ */
+int dict_server_start(const dict_server_config_t * config);
+
+/**
+ * @brief Request a running dict_server_start() to return.
+ *
+ * Only sets a flag, so it is safe to call from a signal handler. The server notices it as soon as
+ * the blocking call in progress is interrupted.
+ */
+void dict_server_stop(void);
+
+/**
+ * Storage backend interface.
+ *
+ * The storage engines of dict_engine.h listed by make ENGINES are compiled in. These calls route
+ * each key to the engine of its namespace, chosen at dict_backend_init(), and the calls about the
+ * whole store go to every engine in use. The default engine is the one of DICT_CONFIG_BACKEND in
+ * the generated dict_config.h (make BACKEND=file|memory|log|packed|art, one of ENGINES) unless
+ * the configuration names another. Every function is safe to call from the dump threads while
+ * the server is running.
+ */
+
+/**
+ * @brief Select and open the storage engines before the server starts accepting requests.
+ *
+ * @param config Server configuration, NULL for the defaults.
+ * @return int
+ *              - SERVER_OK if no error.
+ *              - SERVER_E_INVALID if the configuration names an unknown engine.
+ */
+int dict_backend_init(const dict_server_config_t * config);
+
+/**
+ * @brief Make every acknowledged write durable in the backend's storage.
+ *
+ * @return int
+ *              - SERVER_OK if no error.
+ *              - SERVER_E_OS if some write could not be stored.
+ */
+int dict_backend_flush(void);
+
+/**
+ * @brief Flush and stop the backend's background work once the server has stopped.
+ */
+void dict_backend_close(void);
+
+/**
+ * @brief Start a batch of requests of the calling thread. Until dict_backend_batch_commit(),
+ * SET and DEL may return before their change is durable, so a single sync covers the whole
+ * batch. Their replies must wait for the commit.
+ *
+ * @return int Non zero if some engine defers its syncs, zero if every change is already durable
+ * when its call returns.
+ */
+int dict_backend_batch_begin(void);
+
+/**
+ * @brief End the batch of the calling thread and make its changes durable.
+ *
+ * @return int
+ *              - SERVER_OK if no error.
+ *              - SERVER_E_OS if some change of the batch could not be made durable.
+ */
+int dict_backend_batch_commit(void);
+
+/**
+ * @brief Read a key value.
+ *
+ * @param key Key name.
+ * @param buffer Buffer where the value will be stored.
+ * @param buffer_size Buffer's size.
+ * @param length Full value length. It is greater than buffer_size if the value was truncated.
+ * @return int
+ *              - SERVER_OK if no error.
+ *              - SERVER_E_NOT_FOUND if the key does not exist.
+ */
+int dict_backend_get(const char * key, char * buffer, int buffer_size, int * length);
+
+/**
+ * @brief Write a key value, replacing the previous one.
+ *
+ * @param key Key name.
+ * @param value Value to store.
+ * @param length Value length.
+ * @return int
+ *              - SERVER_OK if no error.
+ */
+int dict_backend_set(const char * key, const char * value, int length);
+
+/**
+ * @brief Delete a key.
+ *
+ * @param key Key name.
+ * @return int
+ *              - SERVER_OK if no error.
+ *              - SERVER_E_NOT_FOUND if the key does not exist.
+ */
+int dict_backend_del(const char * key);
+
+/**
+ * @brief Number of stored keys, maintained as keys are added and removed.
+ *
+ * @param count Where the number of keys is stored.
+ * @return int
+ *              - SERVER_OK if no error.
+ */
+int dict_backend_count(size_t * count);
+
+/**
+ * @brief Delete every key at once. An empty store replaces the current one, which is released
+ * in the background.
+ *
+ * @return int
+ *              - SERVER_OK if no error.
+ */
+int dict_backend_clear(void);
+
+/**
+ * @brief Walk every stored key. Keys added or removed during the walk may be missed.
+ *
+ * @param visit Callback called once per key.
+ * @param context User context given to the callback.
+ * @return int
+ *              - SERVER_OK if no error.
+ */
+int dict_backend_keys(dict_backend_key_visit visit, void * context);
+
+/**
+ * @brief Walk every stored key with its value, for a copy of the keyspace.
+ *
+ * Engines keeping values in process memory visit their keys and values under their lock, as
+ * they were at one moment: writes to them wait until the walk ends, so the callback should only
+ * copy. The other engines visit their keys like dict_backend_keys(), without values.
+ *
+ * @param visit Callback called once per key.
+ * @param context User context given to the callback.
+ * @return int
+ *              - SERVER_OK if no error.
+ */
+int dict_backend_copy(dict_backend_value_visit visit, void * context);
+
+/**
+ * @brief Walk the stored keys starting with a prefix. Engines with an ordered index visit only
+ * the matches, in byte order; the others walk every key and skip the rest.
+ *
+ * @param prefix Prefix, "" for every key.
+ * @param visit Callback called once per key.
+ * @param context User context given to the callback.
+ * @return int
+ *              - SERVER_OK if no error.
+ */
+int dict_backend_scan(const char * prefix, dict_backend_key_visit visit, void * context);
+
+/**
+ * @brief Delete every key starting with a prefix. Engines with an ordered index detach the keys
+ * at once and release them in the background; the others delete them one by one.
+ *
+ * @param prefix Prefix, not empty: dict_backend_clear() deletes everything.
+ * @param count Where the number of deleted keys is stored.
+ * @return int
+ *              - SERVER_OK if no error.
+ *              - SERVER_E_INVALID if the prefix is empty.
+ */
+int dict_backend_del_prefix(const char * prefix, size_t * count);
+
+/**
+ * @brief Write backend statistics as "name:value" lines.
+ *
+ * @param buffer Buffer where the statistics will be stored.
+ * @param buffer_size Buffer's size.
+ * @return int Number of characters written.
+ */
+int dict_backend_stats(char * buffer, int buffer_size);
+
+/**
+ * @brief Run one slice of incremental memory defragmentation.
+ *
+ * Called by the server between request batches. A pass starts only once fragmentation is worth
+ * it and then continues over as many slices as it needs.
+ *
+ * @param budget_us Time the slice may take.
+ * @return int 1 if a pass is in progress and wants another slice, 0 if there is nothing to do.
+ */
+int dict_backend_defrag(int budget_us);
+
+/**
+ * @brief Report the memory held by the backend, from counters kept up to date by every change.
+ *
+ * @param memory Where the usage will be stored.
+ * @return int
+ *              - SERVER_OK if no error.
+ */
+int dict_backend_memory(dict_backend_memory_t * memory);
+
+/**
+ * @brief Report the bytes a single key takes, including its share of allocator rounding.
+ *
+ * @param key Key name.
+ * @param bytes Where the size will be stored.
+ * @return int
+ *              - SERVER_OK if no error.
+ *              - SERVER_E_NOT_FOUND if the key does not exist.
+ */
+int dict_backend_usage(const char * key, size_t * bytes);
+
+/**
+ * @brief Start loading a key's value into memory without waiting for it.
+ *
+ * Used to warm the caches below the backend after a restart. Backends whose values already live
+ * in process memory only look the key up.
+ *
+ * @param key Key name.
+ * @return int
+ *              - SERVER_OK if no error.
+ *              - SERVER_E_NOT_FOUND if the key does not exist.
+ *              - SERVER_E_BUSY if the key can not be reached yet, try again later.
+ */
+int dict_backend_prefetch(const char * key);
 
 /* === End of documentation ==================================================================== */
 
@@ -56,4 +358,4 @@ int dict_server_start(void);
 }
 #endif
 
-#endif /* MAIN_H */
\ No newline at end of file
+#endif /* DICT_SERVER_H */
\ No newline at end of file
@@ -0,0 +1,143 @@
+/************************************************************************************************
+Copyright (c) 2024, Guido Ramirez <guidoramirez7@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute,
+sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial
+portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+SPDX-License-Identifier: MIT
+*************************************************************************************************/
+
+#ifndef DICT_TRACE_H
+#define DICT_TRACE_H
+
+/** @file dict_trace.h
+ ** @brief Per request syscall and cycle accounting. Compiled out when DICT_CONFIG_TRACE is 0.
+ **
+ ** Every thread accumulates into its own dict_trace_current. Code issuing a syscall on behalf
+ ** of a request counts it with DICT_TRACE_SYSCALL(), and the server times its phases with
+ ** dict_trace_cycles(). The server folds the thread totals into the stats of the operation that
+ ** caused them and clears them with dict_trace_reset().
+ **/
+
+/* === Headers files inclusions ================================================================ */
+
+#include <stdint.h>
+#include <string.h>
+#include "dict_config.h"
+
+#if DICT_CONFIG_TRACE && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#elif DICT_CONFIG_TRACE
+#include <time.h>
+#endif
+
+/* === C++ header ============================================================================ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* === Public macros definitions =============================================================== */
+
+#if DICT_CONFIG_TRACE
+#define DICT_TRACE_SYSCALL(kind) (dict_trace_current.syscalls[(kind)]++)
+#define DICT_TRACE_PHASE(phase, start)                                                             \
+    (dict_trace_current.cycles[(phase)] += dict_trace_cycles() - (start))
+#else
+#define DICT_TRACE_SYSCALL(kind)       ((void)0)
+#define DICT_TRACE_PHASE(phase, start) ((void)0)
+#endif
+
+/* === Public data type declarations =========================================================== */
+
+/** Syscalls accounted per request. */
+typedef enum {
+    DICT_TRACE_OPEN,
+    DICT_TRACE_READ,
+    DICT_TRACE_WRITE,
+    DICT_TRACE_CLOSE,
+    DICT_TRACE_SEND,
+    DICT_TRACE_RECV,
+    DICT_TRACE_SYSCALL_COUNT,
+} dict_trace_syscall;
+
+/** Phases a request is split in. */
+typedef enum {
+    DICT_TRACE_PARSE,   /**< server_op_check() */
+    DICT_TRACE_STORAGE, /**< Backend access */
+    DICT_TRACE_REPLY,   /**< Building and sending the reply */
+    DICT_TRACE_PHASE_COUNT,
+} dict_trace_phase;
+
+typedef struct {
+    uint64_t syscalls[DICT_TRACE_SYSCALL_COUNT]; /**< Indexed by dict_trace_syscall */
+    uint64_t cycles[DICT_TRACE_PHASE_COUNT];     /**< Indexed by dict_trace_phase */
+} dict_trace_t;
+
+/* === Public variable declarations ============================================================ */
+
+#if DICT_CONFIG_TRACE
+extern __thread dict_trace_t dict_trace_current; /**< Totals of the calling thread */
+#endif
+
+/* === Public function declarations ============================================================ */
+
+#if DICT_CONFIG_TRACE
+/**
+ * @brief Read the cycle counter, rdtsc on x86 and monotonic ns elsewhere.
+ *
+ * @return uint64_t Current counter value.
+ */
+static inline uint64_t dict_trace_cycles(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+/**
+ * @brief Clear the totals of the calling thread.
+ */
+static inline void dict_trace_reset(void) {
+    memset(&dict_trace_current, 0, sizeof(dict_trace_current));
+}
+
+/**
+ * @brief Name of a syscall kind, as shown in stats.
+ *
+ * @param kind Syscall kind.
+ * @return const char* Lower case name.
+ */
+const char * dict_trace_syscall_name(dict_trace_syscall kind);
+
+/**
+ * @brief Name of a phase, as shown in stats.
+ *
+ * @param phase Phase.
+ * @return const char* Lower case name.
+ */
+const char * dict_trace_phase_name(dict_trace_phase phase);
+#endif
+
+/* === End of documentation ==================================================================== */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DICT_TRACE_H */
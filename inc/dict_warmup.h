@@ -0,0 +1,90 @@
+/************************************************************************************************
+Copyright (c) 2024, Guido Ramirez <guidoramirez7@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute,
+sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial
+portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+SPDX-License-Identifier: MIT
+*************************************************************************************************/
+
+#ifndef DICT_WARMUP_H
+#define DICT_WARMUP_H
+
+/** @file dict_warmup.h
+ ** @brief Cache warm-up from the access history of the previous run.
+ **
+ ** Reads are sampled into a small table of hot keys, which a background thread saves to
+ ** DICT_WARMUP_FILE periodically and at shutdown. On start the same thread reads the file back
+ ** and asks the backend to prefetch those keys, hottest first, while the server is already
+ ** accepting traffic.
+ **/
+
+/* === Headers files inclusions ================================================================ */
+
+/* === C++ header ============================================================================ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* === Public macros definitions =============================================================== */
+
+#define DICT_WARMUP_FILE "hotkeys" /**< Hot keys of the last run, one per line, hottest first */
+
+/* === Public data type declarations =========================================================== */
+
+/* === Public variable declarations ============================================================ */
+
+/* === Public function declarations ============================================================ */
+
+/**
+ * @brief Start the warm-up thread: prefetch the saved hot keys, then save the sample
+ * periodically.
+ *
+ * @param interval_ms Time between saves, 0 disables sampling and warm-up.
+ * @return int
+ *              - 0 if no error.
+ *              - -1 otherwise.
+ */
+int dict_warmup_start(int interval_ms);
+
+/**
+ * @brief Stop the warm-up thread and save the sample a last time.
+ */
+void dict_warmup_stop(void);
+
+/**
+ * @brief Record a read of a key. Only some reads are sampled, the rest return at once.
+ *
+ * @param key Key name.
+ */
+void dict_warmup_touch(const char * key);
+
+/**
+ * @brief Write warm-up statistics as "name:value" lines.
+ *
+ * @param buffer Buffer where the statistics will be stored.
+ * @param buffer_size Buffer's size.
+ * @return int Number of characters written.
+ */
+int dict_warmup_stats(char * buffer, int buffer_size);
+
+/* === End of documentation ==================================================================== */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DICT_WARMUP_H */
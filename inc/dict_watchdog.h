@@ -0,0 +1,114 @@
+/************************************************************************************************
+Copyright (c) 2024, Guido Ramirez <guidoramirez7@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute,
+sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial
+portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+SPDX-License-Identifier: MIT
+*************************************************************************************************/
+
+#ifndef DICT_WATCHDOG_H
+#define DICT_WATCHDOG_H
+
+/** @file dict_watchdog.h
+ ** @brief Event loop stall watchdog function definitions.
+ **
+ ** Each event loop owns a beat. It marks the beat busy when epoll_wait() returns and idle before
+ ** waiting again. A watchdog thread reports every loop busy for longer than the configured
+ ** interval, once per stall, and signals the loop thread so it writes its own backtrace to
+ ** stderr while it is still stuck.
+ **/
+
+/* === Headers files inclusions ================================================================ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+/* === C++ header ============================================================================ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* === Public macros definitions =============================================================== */
+
+/* === Public data type declarations =========================================================== */
+
+typedef struct {
+    int index;                       /**< Loop number, used in reports */
+    pthread_t thread;                /**< Loop thread, set by dict_watchdog_attach() */
+    atomic_uint_fast64_t busy_since; /**< Monotonic ns when the loop got busy, 0 while idle */
+    atomic_ulong stalls;             /**< Stalls detected */
+    uint64_t reported;               /**< busy_since of the last stall reported */
+} dict_watchdog_beat_t;
+
+/* === Public variable declarations ============================================================ */
+
+/* === Public function declarations ============================================================ */
+
+/**
+ * @brief Start the watchdog thread over a set of beats.
+ *
+ * @param beats Beats to watch. They must outlive the watchdog.
+ * @param count Number of beats.
+ * @param interval_ms Busy time considered a stall.
+ * @return int
+ *              - 0 if no error.
+ *              - -1 otherwise.
+ */
+int dict_watchdog_start(dict_watchdog_beat_t * beats, int count, int interval_ms);
+
+/**
+ * @brief Stop the watchdog thread, if running, and wait for it.
+ */
+void dict_watchdog_stop(void);
+
+/**
+ * @brief Bind a beat to the calling thread, the one signaled on a stall.
+ *
+ * @param beat Beat.
+ */
+void dict_watchdog_attach(dict_watchdog_beat_t * beat);
+
+/**
+ * @brief Mark a loop busy.
+ *
+ * @param beat Loop beat.
+ * @param now_ns Current monotonic time in nanoseconds.
+ */
+void dict_watchdog_busy(dict_watchdog_beat_t * beat, uint64_t now_ns);
+
+/**
+ * @brief Mark a loop idle, about to wait for events.
+ *
+ * @param beat Loop beat.
+ */
+void dict_watchdog_idle(dict_watchdog_beat_t * beat);
+
+/**
+ * @brief Monotonic time.
+ *
+ * @return uint64_t Nanoseconds.
+ */
+uint64_t dict_watchdog_now_ns(void);
+
+/* === End of documentation ==================================================================== */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DICT_WATCHDOG_H */
@@ -0,0 +1,165 @@
+/************************************************************************************************
+Copyright (c) 2024, Guido Ramirez <guidoramirez7@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute,
+sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial
+portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+SPDX-License-Identifier: MIT
+*************************************************************************************************/
+
+#ifndef DICT_WRITEBACK_H
+#define DICT_WRITEBACK_H
+
+/** @file dict_writeback.h
+ ** @brief Write coalescing buffer in front of a slow store.
+ **
+ ** SET and DEL are absorbed in memory and only the latest state of every key reaches the store.
+ ** A flusher thread writes the buffer every interval, or sooner once it holds the size
+ ** threshold. Writes still buffered are lost on a crash: the age of the oldest one is the
+ ** current crash window, bounded by the interval plus the time a flush takes.
+ **/
+
+/* === Headers files inclusions ================================================================ */
+
+#include <stddef.h>
+
+/* === C++ header ============================================================================ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* === Public macros definitions =============================================================== */
+
+#define DICT_WRITEBACK_BYTES (4 * 1024 * 1024) /**< Default size threshold */
+
+/* === Public data type declarations =========================================================== */
+
+/**
+ * @brief Store called by a flush for every buffered key.
+ *
+ * @param key Key name.
+ * @param value Latest value, NULL if the key was deleted.
+ * @param length Value length.
+ * @return int SERVER_OK if no error. On error the key stays buffered unless written again.
+ */
+typedef int (*dict_writeback_store)(const char * key, const char * value, int length);
+
+/**
+ * @brief Called once after a flush has stored its keys, to make the whole batch durable.
+ *
+ * @return int SERVER_OK if no error.
+ */
+typedef int (*dict_writeback_sync)(void);
+
+/**
+ * @brief Tells whether the store holds a key, asked when a key enters the buffer. Called with
+ * the buffer locked, it must not call back into it.
+ *
+ * @param key Key name.
+ * @return int Non zero if the store holds the key.
+ */
+typedef int (*dict_writeback_exists)(const char * key);
+
+/* === Public variable declarations ============================================================ */
+
+/* === Public function declarations ============================================================ */
+
+/**
+ * @brief Enable the buffer and start its flusher thread.
+ *
+ * @param interval_ms Longest time a write stays buffered.
+ * @param threshold Buffered value bytes that trigger a flush, 0 for DICT_WRITEBACK_BYTES.
+ * @param store Store written by flushes.
+ * @param sync Called after every flush that stored something, may be NULL.
+ * @param exists Asked once per key entering the buffer, for dict_writeback_gain().
+ * @return int
+ *              - 0 if no error.
+ *              - -1 otherwise, the buffer stays disabled.
+ */
+int dict_writeback_start(int interval_ms, size_t threshold, dict_writeback_store store,
+                         dict_writeback_sync sync, dict_writeback_exists exists);
+
+/**
+ * @brief Flush everything buffered and disable the buffer.
+ */
+void dict_writeback_stop(void);
+
+/**
+ * @brief Look a key up in the buffer.
+ *
+ * @param key Key name.
+ * @param buffer Buffer where the value will be stored, may be NULL to only ask for the state.
+ * @param buffer_size Buffer's size.
+ * @param length Where the full value length is stored, may be NULL.
+ * @return int
+ *              - 1 if the key is buffered with a value.
+ *              - 0 if the key is not buffered, the store has its state.
+ *              - -1 if the key is buffered as deleted.
+ */
+int dict_writeback_get(const char * key, char * buffer, int buffer_size, int * length);
+
+/**
+ * @brief Buffer a write.
+ *
+ * @param key Key name.
+ * @param value Value, NULL to delete the key.
+ * @param length Value length.
+ * @return int
+ *              - 1 if the write was buffered.
+ *              - 0 if the buffer is disabled or out of memory, the caller must write the store.
+ */
+int dict_writeback_put(const char * key, const char * value, int length);
+
+/**
+ * @brief Write every buffered key to the store before returning.
+ *
+ * @return int
+ *              - SERVER_OK if no error.
+ *              - SERVER_E_OS if some key could not be stored, it stays buffered.
+ */
+int dict_writeback_flush(void);
+
+/**
+ * @brief Drop every buffered write, for a store about to be cleared.
+ */
+void dict_writeback_discard(void);
+
+/**
+ * @brief Keys the store gains once every buffered write is stored: keys buffered with a value
+ * that the store does not hold, minus keys buffered as deleted that it holds. Kept up to date by
+ * every write, so the store's key count plus this one is the count seen by reads. While a flush
+ * runs, a key it just stored may be counted twice for a moment.
+ *
+ * @return long Keys gained, negative if more are lost.
+ */
+long dict_writeback_gain(void);
+
+/**
+ * @brief Write buffer statistics as "name:value" lines.
+ *
+ * @param buffer Buffer where the statistics will be stored.
+ * @param buffer_size Buffer's size.
+ * @return int Number of characters written.
+ */
+int dict_writeback_stats(char * buffer, int buffer_size);
+
+/* === End of documentation ==================================================================== */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DICT_WRITEBACK_H */
@@ -0,0 +1,610 @@
+/************************************************************************************************
+Copyright (c) 2024, Guido Ramirez <guidoramirez7@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute,
+sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial
+portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+SPDX-License-Identifier: MIT
+*************************************************************************************************/
+
+/** @file dict_arena.c
+ ** @brief Huge page backed memory arena function implementation.
+ **/
+
+/* === Headers files inclusions =============================================================== */
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "dict_arena.h"
+
+/* === Macros definitions ====================================================================== */
+
+#define ARENA_CLASSES      (13) /**< Size classes from DICT_ARENA_MIN_CLASS to DICT_ARENA_MAX_CLASS */
+#define ARENA_LARGE_HEADER (16) /**< Header of blocks with their own mapping, keeps alignment */
+#define ARENA_SLABS        (DICT_ARENA_CHUNK_SIZE / DICT_ARENA_SLAB_SIZE) /**< Slabs per chunk */
+#define ARENA_SLAB_WORDS   (DICT_ARENA_SLAB_SIZE / DICT_ARENA_MIN_CLASS / 64) /**< Bitmap words */
+#define ARENA_NO_CLASS     (-1) /**< Class of a free slab */
+#define ARENA_ROUND_UP(value, align) (((value) + (align) - 1) & ~((size_t)(align) - 1))
+
+/* === Private data type declarations ========================================================== */
+
+struct arena_chunk;
+
+typedef struct arena_slab {
+    struct arena_slab * prev;        /**< Previous slab in the partial or free list */
+    struct arena_slab * next;        /**< Next slab in the partial or free list */
+    struct arena_chunk * chunk;      /**< Chunk the slab belongs to */
+    char * base;                     /**< First byte, DICT_ARENA_SLAB_SIZE long */
+    int class;                       /**< Size class, ARENA_NO_CLASS while free */
+    int live;                        /**< Blocks in use */
+    int capacity;                    /**< Blocks that fit */
+    int hint;                        /**< First bitmap word that may have a free block */
+    int released;                    /**< Pages given back to the OS while free */
+    uint64_t used[ARENA_SLAB_WORDS]; /**< One bit per block, set while in use */
+} arena_slab_t;
+
+typedef struct arena_chunk {
+    char * base;                    /**< Chunk start, aligned to DICT_ARENA_CHUNK_SIZE */
+    dict_arena_pages pages;         /**< Kind of pages backing the chunk */
+    int carved;                     /**< Slabs handed out at least once */
+    int free;                       /**< Carved slabs currently free */
+    arena_slab_t slabs[ARENA_SLABS]; /**< Slab descriptors, kept out of the chunk */
+} arena_chunk_t;
+
+struct dict_arena {
+    arena_slab_t * partial[ARENA_CLASSES]; /**< Slabs with used and free blocks, target first */
+    arena_slab_t * free_slabs;             /**< Slabs without blocks, pages still backed */
+    arena_slab_t * released_slabs;         /**< Slabs without blocks, pages given back */
+    arena_chunk_t ** chunks;               /**< Every chunk, sorted by address */
+    arena_chunk_t * carving;               /**< Chunk new slabs are carved from */
+    size_t chunk_count;                    /**< Number of chunks */
+    size_t chunk_capacity;                 /**< Capacity of the chunk array */
+    size_t allocated;                      /**< Bytes requested by live blocks */
+    size_t reserved;                       /**< Bytes taken by live blocks, after class rounding */
+    size_t large_count;                    /**< Live blocks with their own mapping */
+    size_t mapped;                         /**< Bytes of chunks and large block mappings */
+    size_t slab_bytes;                     /**< Bytes of slabs assigned to a class */
+    size_t slab_reserved;                  /**< Part of reserved taken from slabs */
+    size_t released;                       /**< Bytes of free slabs given back to the OS */
+    size_t unreleased;                     /**< Bytes of free slabs dict_arena_trim() may give */
+};
+
+/* === Private variable declarations =========================================================== */
+
+/* === Private function declarations =========================================================== */
+
+static int arena_class(size_t size);
+
+static int arena_chunk_add(dict_arena arena);
+
+static arena_slab_t * arena_slab_of(dict_arena arena, const void * block);
+
+static arena_slab_t * arena_slab_get(dict_arena arena, int class);
+
+static void arena_slab_put(dict_arena arena, arena_slab_t * slab);
+
+static int arena_slab_release(dict_arena arena, arena_slab_t * slab);
+
+static void arena_list_push(arena_slab_t ** head, arena_slab_t * slab);
+
+static void arena_list_remove(arena_slab_t ** head, arena_slab_t * slab);
+
+static long arena_anon_huge_kb(void);
+
+static size_t arena_map_size(size_t size);
+
+/* === Public variable definitions ============================================================= */
+
+/* === Private variable definitions ============================================================ */
+
+static atomic_size_t arena_mapped[DICT_ARENA_PAGES_COUNT]; /**< Bytes mapped per page kind */
+
+static const char * const arena_pages_name[DICT_ARENA_PAGES_COUNT] = {"normal", "thp", "hugetlb"};
+
+/* === Private function implementation ========================================================= */
+/**
+ * @brief Size class of a block.
+ *
+ * @param size Block size, at most DICT_ARENA_MAX_CLASS.
+ * @return int Class index, its block size is DICT_ARENA_MIN_CLASS << index.
+ */
+static int arena_class(size_t size) {
+    if (size <= DICT_ARENA_MIN_CLASS)
+        return 0;
+    // Bits needed by size - 1, minus the bits of the smallest class.
+    return (int)(8 * sizeof(unsigned long)) - __builtin_clzl(size - 1) - 4;
+}
+/**
+ * @brief Map a new chunk and make it the carving chunk. Its unused slabs stay unused.
+ *
+ * @param arena Arena.
+ * @return int
+ *              - 0 if no error.
+ *              - -1 if there is no memory.
+ */
+static int arena_chunk_add(dict_arena arena) {
+    if (arena->chunk_count == arena->chunk_capacity) {
+        size_t capacity = arena->chunk_capacity ? arena->chunk_capacity * 2 : 16;
+        arena_chunk_t ** chunks = realloc(arena->chunks, capacity * sizeof(*chunks));
+        if (chunks == NULL)
+            return -1;
+        arena->chunks = chunks;
+        arena->chunk_capacity = capacity;
+    }
+
+    arena_chunk_t * chunk = calloc(1, sizeof(*chunk));
+    if (chunk == NULL)
+        return -1;
+    chunk->base = dict_arena_map(DICT_ARENA_CHUNK_SIZE, &chunk->pages);
+    if (chunk->base == NULL) {
+        free(chunk);
+        return -1;
+    }
+
+    // Sorted by address, so arena_slab_of() can search it.
+    size_t at = arena->chunk_count;
+    while (at > 0 && arena->chunks[at - 1]->base > chunk->base) {
+        arena->chunks[at] = arena->chunks[at - 1];
+        at--;
+    }
+    arena->chunks[at] = chunk;
+    arena->chunk_count++;
+    arena->mapped += DICT_ARENA_CHUNK_SIZE;
+    arena->carving = chunk;
+    return 0;
+}
+/**
+ * @brief Find the slab holding a small block.
+ *
+ * @param arena Arena.
+ * @param block Block returned by dict_arena_alloc().
+ * @return arena_slab_t* Slab, NULL if the block is not from this arena.
+ */
+static arena_slab_t * arena_slab_of(dict_arena arena, const void * block) {
+    // Chunks are aligned to their size.
+    char * base = (char *)((uintptr_t)block & ~((uintptr_t)DICT_ARENA_CHUNK_SIZE - 1));
+    size_t low = 0;
+    size_t high = arena->chunk_count;
+
+    while (low < high) {
+        size_t mid = (low + high) / 2;
+        arena_chunk_t * chunk = arena->chunks[mid];
+        if (chunk->base == base)
+            return &chunk->slabs[((const char *)block - base) / DICT_ARENA_SLAB_SIZE];
+        if (chunk->base < base)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return NULL;
+}
+/**
+ * @brief Assign a slab to a class, reusing a free one before carving a new one. Slabs whose
+ * pages are still backed go first, they cost no page faults.
+ *
+ * @param arena Arena.
+ * @param class Size class.
+ * @return arena_slab_t* Empty slab, already first in the class partial list. NULL if there is
+ * no memory.
+ */
+static arena_slab_t * arena_slab_get(dict_arena arena, int class) {
+    arena_slab_t * slab = arena->free_slabs;
+    if (slab != NULL) {
+        arena_list_remove(&arena->free_slabs, slab);
+        slab->chunk->free--;
+        arena->unreleased -= DICT_ARENA_SLAB_SIZE;
+    } else if ((slab = arena->released_slabs) != NULL) {
+        // Faulted back in, zeroed, on first touch.
+        arena_list_remove(&arena->released_slabs, slab);
+        slab->chunk->free--;
+        slab->released = 0;
+        arena->released -= DICT_ARENA_SLAB_SIZE;
+    } else {
+        if ((arena->carving == NULL || arena->carving->carved == ARENA_SLABS) &&
+            arena_chunk_add(arena) < 0)
+            return NULL;
+        arena_chunk_t * chunk = arena->carving;
+        slab = &chunk->slabs[chunk->carved];
+        slab->chunk = chunk;
+        slab->base = chunk->base + (size_t)chunk->carved * DICT_ARENA_SLAB_SIZE;
+        chunk->carved++;
+    }
+
+    size_t class_size = (size_t)DICT_ARENA_MIN_CLASS << class;
+    slab->class = class;
+    slab->live = 0;
+    slab->capacity = DICT_ARENA_SLAB_SIZE / class_size;
+    slab->hint = 0;
+    memset(slab->used, 0, sizeof(slab->used));
+    // Bits past the capacity look used, so they are never handed out.
+    if (slab->capacity < 64)
+        slab->used[0] = ~0ULL << slab->capacity;
+
+    arena->slab_bytes += DICT_ARENA_SLAB_SIZE;
+    arena_list_push(&arena->partial[class], slab);
+    return slab;
+}
+/**
+ * @brief Return a slab without blocks to the free list. Its pages stay backed until
+ * dict_arena_trim() gives them back, no system call is made here.
+ *
+ * @param arena Arena.
+ * @param slab Slab, already out of its partial list.
+ */
+static void arena_slab_put(dict_arena arena, arena_slab_t * slab) {
+    slab->class = ARENA_NO_CLASS;
+    arena->slab_bytes -= DICT_ARENA_SLAB_SIZE;
+    arena->unreleased += DICT_ARENA_SLAB_SIZE;
+    arena_list_push(&arena->free_slabs, slab);
+    slab->chunk->free++;
+}
+/**
+ * @brief Give the pages of a free slab back to the OS.
+ *
+ * madvise() on part of an explicit huge page fails, so hugetlb chunks are only given back
+ * whole, once every slab is free. Releasing part of a transparent huge page splits it.
+ *
+ * @param arena Arena.
+ * @param slab Slab in the free list.
+ * @return int Slabs moved to the released list, 0 if the slab has to stay backed.
+ */
+static int arena_slab_release(dict_arena arena, arena_slab_t * slab) {
+    arena_chunk_t * chunk = slab->chunk;
+
+    if (chunk->pages != DICT_ARENA_PAGES_HUGETLB) {
+        if (madvise(slab->base, DICT_ARENA_SLAB_SIZE, MADV_DONTNEED) < 0)
+            return 0;
+        arena_list_remove(&arena->free_slabs, slab);
+        arena_list_push(&arena->released_slabs, slab);
+        slab->released = 1;
+        arena->released += DICT_ARENA_SLAB_SIZE;
+        arena->unreleased -= DICT_ARENA_SLAB_SIZE;
+        return 1;
+    }
+
+    if (chunk->free != chunk->carved || chunk->carved != ARENA_SLABS ||
+        madvise(chunk->base, DICT_ARENA_CHUNK_SIZE, MADV_DONTNEED) < 0)
+        return 0;
+    int released = 0;
+    for (int i = 0; i < ARENA_SLABS; i++) {
+        arena_slab_t * free_slab = &chunk->slabs[i];
+        if (free_slab->released)
+            continue;
+        arena_list_remove(&arena->free_slabs, free_slab);
+        arena_list_push(&arena->released_slabs, free_slab);
+        free_slab->released = 1;
+        arena->released += DICT_ARENA_SLAB_SIZE;
+        arena->unreleased -= DICT_ARENA_SLAB_SIZE;
+        released++;
+    }
+    return released;
+}
+/**
+ * @brief Insert a slab at the head of a list.
+ */
+static void arena_list_push(arena_slab_t ** head, arena_slab_t * slab) {
+    slab->prev = NULL;
+    slab->next = *head;
+    if (*head != NULL)
+        (*head)->prev = slab;
+    *head = slab;
+}
+/**
+ * @brief Unlink a slab from a list.
+ */
+static void arena_list_remove(arena_slab_t ** head, arena_slab_t * slab) {
+    if (slab->prev != NULL)
+        slab->prev->next = slab->next;
+    else
+        *head = slab->next;
+    if (slab->next != NULL)
+        slab->next->prev = slab->prev;
+    slab->prev = NULL;
+    slab->next = NULL;
+}
+/**
+ * @brief Anonymous memory of the process currently backed by transparent huge pages.
+ *
+ * @return long Kilobytes, -1 if unknown.
+ */
+static long arena_anon_huge_kb(void) {
+    FILE * file = fopen("/proc/self/smaps_rollup", "r");
+    if (file == NULL)
+        return -1;
+
+    char line[128];
+    long kb = -1;
+    while (fgets(line, sizeof(line), file) != NULL) {
+        if (sscanf(line, "AnonHugePages: %ld kB", &kb) == 1)
+            break;
+    }
+    fclose(file);
+    return kb;
+}
+/**
+ * @brief Bytes dict_arena_map() really maps for a region.
+ *
+ * @param size Region size.
+ * @return size_t Size rounded to normal or huge pages.
+ */
+static size_t arena_map_size(size_t size) {
+    return ARENA_ROUND_UP(size, size < DICT_ARENA_CHUNK_SIZE ? 4096 : DICT_ARENA_CHUNK_SIZE);
+}
+
+/* === Public function implementation ========================================================== */
+
+dict_arena dict_arena_create(void) {
+    return calloc(1, sizeof(struct dict_arena));
+}
+
+void dict_arena_destroy(dict_arena arena) {
+    if (arena == NULL)
+        return;
+
+    for (size_t i = 0; i < arena->chunk_count; i++) {
+        dict_arena_unmap(arena->chunks[i]->base, DICT_ARENA_CHUNK_SIZE, arena->chunks[i]->pages);
+        free(arena->chunks[i]);
+    }
+    free(arena->chunks);
+    free(arena);
+}
+
+void * dict_arena_alloc(dict_arena arena, size_t size) {
+    if (arena == NULL)
+        return NULL;
+
+    if (size > DICT_ARENA_MAX_CLASS) {
+        dict_arena_pages pages;
+        char * region = dict_arena_map(size + ARENA_LARGE_HEADER, &pages);
+        if (region == NULL)
+            return NULL;
+        *(dict_arena_pages *)region = pages;
+        arena->large_count++;
+        arena->mapped += arena_map_size(size + ARENA_LARGE_HEADER);
+        arena->allocated += size;
+        arena->reserved += size + ARENA_LARGE_HEADER;
+        return region + ARENA_LARGE_HEADER;
+    }
+
+    int class = arena_class(size);
+    size_t class_size = (size_t)DICT_ARENA_MIN_CLASS << class;
+    arena_slab_t * slab = arena->partial[class];
+    if (slab == NULL && (slab = arena_slab_get(arena, class)) == NULL)
+        return NULL;
+
+    int word = slab->hint;
+    while (slab->used[word] == ~0ULL)
+        word++;
+    int bit = __builtin_ctzll(~slab->used[word]);
+    slab->used[word] |= 1ULL << bit;
+    slab->hint = word;
+    if (++slab->live == slab->capacity)
+        arena_list_remove(&arena->partial[class], slab);
+
+    arena->allocated += size;
+    arena->reserved += class_size;
+    arena->slab_reserved += class_size;
+    return slab->base + ((size_t)word * 64 + bit) * class_size;
+}
+
+void dict_arena_free(dict_arena arena, void * block, size_t size) {
+    if (arena == NULL || block == NULL)
+        return;
+
+    if (size > DICT_ARENA_MAX_CLASS) {
+        size_t region_size;
+        dict_arena_pages pages;
+        void * region = dict_arena_detach(arena, block, size, &region_size, &pages);
+        dict_arena_unmap(region, region_size, pages);
+        return;
+    }
+
+    arena_slab_t * slab = arena_slab_of(arena, block);
+    if (slab == NULL)
+        return;
+    int class = arena_class(size);
+    size_t class_size = (size_t)DICT_ARENA_MIN_CLASS << class;
+    size_t index = ((char *)block - slab->base) / class_size;
+    int word = index / 64;
+
+    slab->used[word] &= ~(1ULL << (index % 64));
+    if (word < slab->hint)
+        slab->hint = word;
+    // A slab leaving the full state is nearly full, the best target for new blocks.
+    if (slab->live-- == slab->capacity)
+        arena_list_push(&arena->partial[class], slab);
+    if (slab->live == 0) {
+        arena_list_remove(&arena->partial[class], slab);
+        arena_slab_put(arena, slab);
+    }
+
+    arena->allocated -= size;
+    arena->reserved -= class_size;
+    arena->slab_reserved -= class_size;
+}
+
+void * dict_arena_detach(dict_arena arena, void * block, size_t size, size_t * region_size,
+                        dict_arena_pages * pages) {
+    if (arena == NULL || block == NULL || size <= DICT_ARENA_MAX_CLASS)
+        return NULL;
+
+    char * region = (char *)block - ARENA_LARGE_HEADER;
+    *region_size = size + ARENA_LARGE_HEADER;
+    *pages = *(dict_arena_pages *)region;
+    arena->large_count--;
+    arena->mapped -= arena_map_size(size + ARENA_LARGE_HEADER);
+    arena->allocated -= size;
+    arena->reserved -= size + ARENA_LARGE_HEADER;
+    return region;
+}
+
+void dict_arena_defrag_begin(dict_arena arena) {
+    if (arena == NULL)
+        return;
+
+    // Densest slab first, the one relocated blocks are packed into.
+    for (int class = 0; class < ARENA_CLASSES; class++) {
+        arena_slab_t * best = arena->partial[class];
+        for (arena_slab_t * slab = best; slab != NULL; slab = slab->next) {
+            if (slab->live > best->live)
+                best = slab;
+        }
+        if (best != NULL && best != arena->partial[class]) {
+            arena_list_remove(&arena->partial[class], best);
+            arena_list_push(&arena->partial[class], best);
+        }
+    }
+}
+
+void * dict_arena_defrag(dict_arena arena, void * block, size_t size) {
+    if (arena == NULL || block == NULL || size > DICT_ARENA_MAX_CLASS)
+        return NULL;
+
+    arena_slab_t * slab = arena_slab_of(arena, block);
+    if (slab == NULL || slab->live * 2 > slab->capacity)
+        return NULL;
+
+    // Only worth it into a slab holding more blocks, otherwise the next pass moves it back.
+    arena_slab_t * target = arena->partial[slab->class];
+    if (target == NULL || target == slab || target->live < slab->live)
+        return NULL;
+
+    void * moved = dict_arena_alloc(arena, size);
+    if (moved == NULL)
+        return NULL;
+    memcpy(moved, block, size);
+    dict_arena_free(arena, block, size);
+    return moved;
+}
+
+int dict_arena_trim(dict_arena arena, int slabs) {
+    if (arena == NULL)
+        return 0;
+
+    // Hugetlb slabs of a chunk still in use can not be given back, they are passed over.
+    arena_slab_t * slab = arena->free_slabs;
+    while (slab != NULL && slabs > 0) {
+        arena_slab_t * next = slab->next;
+        int released = arena_slab_release(arena, slab);
+        // A whole chunk left the list, next may be one of its slabs.
+        if (released > 1)
+            next = arena->free_slabs;
+        slabs -= released;
+        slab = next;
+    }
+    return slab != NULL && slabs <= 0;
+}
+
+size_t dict_arena_block_size(size_t size) {
+    if (size > DICT_ARENA_MAX_CLASS)
+        return arena_map_size(size + ARENA_LARGE_HEADER);
+    return (size_t)DICT_ARENA_MIN_CLASS << arena_class(size);
+}
+
+void dict_arena_usage(dict_arena arena, dict_arena_usage_t * usage) {
+    usage->allocated = arena->allocated;
+    usage->reserved = arena->reserved;
+    usage->mapped = arena->mapped;
+    usage->slab_free = arena->slab_bytes - arena->slab_reserved;
+    usage->released = arena->released;
+}
+
+void * dict_arena_map(size_t size, dict_arena_pages * pages) {
+    const int prot = PROT_READ | PROT_WRITE;
+    const int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+    dict_arena_pages kind = DICT_ARENA_PAGES_NORMAL;
+    char * region;
+
+    if (size < DICT_ARENA_CHUNK_SIZE) {
+        size = ARENA_ROUND_UP(size, 4096);
+        region = mmap(NULL, size, prot, flags, -1, 0);
+        if (region == MAP_FAILED)
+            return NULL;
+        goto finish;
+    }
+
+    size = ARENA_ROUND_UP(size, DICT_ARENA_CHUNK_SIZE);
+    region = mmap(NULL, size, prot, flags | MAP_HUGETLB, -1, 0);
+    if (region != MAP_FAILED) {
+        kind = DICT_ARENA_PAGES_HUGETLB;
+        goto finish;
+    }
+
+    // No reserved huge pages. Over map to align the region, so THP can back all of it.
+    char * raw = mmap(NULL, size + DICT_ARENA_CHUNK_SIZE, prot, flags, -1, 0);
+    if (raw == MAP_FAILED)
+        return NULL;
+    region = (char *)ARENA_ROUND_UP((uintptr_t)raw, DICT_ARENA_CHUNK_SIZE);
+    if (region > raw)
+        munmap(raw, region - raw);
+    if (raw + DICT_ARENA_CHUNK_SIZE > region)
+        munmap(region + size, raw + DICT_ARENA_CHUNK_SIZE - region);
+    if (madvise(region, size, MADV_HUGEPAGE) == 0)
+        kind = DICT_ARENA_PAGES_THP;
+
+finish:
+    atomic_fetch_add(&arena_mapped[kind], size);
+    if (pages != NULL)
+        *pages = kind;
+    return region;
+}
+
+void dict_arena_unmap(void * region, size_t size, dict_arena_pages pages) {
+    if (region == NULL)
+        return;
+    size = arena_map_size(size);
+    munmap(region, size);
+    atomic_fetch_sub(&arena_mapped[pages], size);
+}
+
+const char * dict_arena_pages_name(dict_arena_pages pages) {
+    return pages < DICT_ARENA_PAGES_COUNT ? arena_pages_name[pages] : "unknown";
+}
+
+int dict_arena_stats(dict_arena arena, char * buffer, int buffer_size) {
+    size_t chunks[DICT_ARENA_PAGES_COUNT] = {0};
+    size_t slabs = 0;
+    int length = 0;
+
+    for (size_t i = 0; i < arena->chunk_count; i++) {
+        chunks[arena->chunks[i]->pages]++;
+        slabs += arena->chunks[i]->carved;
+    }
+
+    length += snprintf(buffer + length, buffer_size - length,
+                       "arena_chunks:%zu\narena_allocated_bytes:%zu\narena_reserved_bytes:%zu\n"
+                       "arena_large_blocks:%zu\narena_slabs:%zu\narena_slabs_in_use:%zu\n"
+                       "arena_slab_free_bytes:%zu\narena_released_bytes:%zu\n"
+                       "arena_unreleased_bytes:%zu\n",
+                       arena->chunk_count, arena->allocated, arena->reserved, arena->large_count,
+                       slabs, arena->slab_bytes / DICT_ARENA_SLAB_SIZE,
+                       arena->slab_bytes - arena->slab_reserved, arena->released,
+                       arena->unreleased);
+    for (int i = 0; i < DICT_ARENA_PAGES_COUNT && length < buffer_size; i++)
+        length += snprintf(buffer + length, buffer_size - length,
+                           "arena_chunks_%s:%zu\nmapped_%s_bytes:%zu\n", arena_pages_name[i],
+                           chunks[i], arena_pages_name[i], atomic_load(&arena_mapped[i]));
+    if (length < buffer_size)
+        length += snprintf(buffer + length, buffer_size - length, "anon_huge_pages_kb:%ld\n",
+                           arena_anon_huge_kb());
+
+    return length;
+}
+
+/* === End of documentation ==================================================================== */
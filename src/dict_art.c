@@ -0,0 +1,940 @@
+/************************************************************************************************
+Copyright (c) 2024, Guido Ramirez <guidoramirez7@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute,
+sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial
+portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+SPDX-License-Identifier: MIT
+*************************************************************************************************/
+
+/** @file dict_art.c
+ ** @brief Adaptive radix tree keyed by strings.
+ **
+ ** Keys are stored with their terminator, so no key is a prefix of another and every key ends in
+ ** a leaf. Leaves are tagged pointers with the low bit set. Nodes keep the first ART_PREFIX bytes
+ ** of their compressed path; longer paths are compared against the leftmost leaf below them.
+ **/
+
+/* === Headers files inclusions =============================================================== */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dict_art.h"
+#include "dict_config.h"
+
+#if DICT_CONFIG_ENGINE_ART
+
+/* === Macros definitions ====================================================================== */
+
+#define ART_NODE4   (0)  /**< Up to 4 children, sorted keys */
+#define ART_NODE16  (1)  /**< Up to 16 children, sorted keys */
+#define ART_NODE48  (2)  /**< Up to 48 children, indexed by key byte */
+#define ART_NODE256 (3)  /**< One child per key byte */
+#define ART_PREFIX  (10) /**< Bytes of the compressed path kept in every node */
+
+#define ART_IS_LEAF(node) (((uintptr_t)(node)) & 1)
+#define ART_LEAF(node)    ((art_leaf_t *)((uintptr_t)(node) & ~(uintptr_t)1))
+#define ART_TAG(leaf)     ((art_node_t *)((uintptr_t)(leaf) | 1))
+
+#define ART_MIN(a, b) ((a) < (b) ? (a) : (b))
+
+/* === Private data type declarations ========================================================== */
+
+typedef struct {
+    uint8_t type;                       /**< ART_NODE4 to ART_NODE256 */
+    uint16_t count;                     /**< Children */
+    uint32_t prefix_len;                /**< Bytes compressed into the node, can pass ART_PREFIX */
+    unsigned char prefix[ART_PREFIX];   /**< First bytes of the compressed path */
+} art_node_t;
+
+typedef struct {
+    art_node_t node;
+    unsigned char keys[4];
+    art_node_t * children[4];
+} art_node4_t;
+
+typedef struct {
+    art_node_t node;
+    unsigned char keys[16];
+    art_node_t * children[16];
+} art_node16_t;
+
+typedef struct {
+    art_node_t node;
+    unsigned char index[256];           /**< Slot plus one of every key byte, 0 if missing */
+    art_node_t * children[48];
+} art_node48_t;
+
+typedef struct {
+    art_node_t node;
+    art_node_t * children[256];
+} art_node256_t;
+
+typedef struct {
+    void * value;                       /**< Value stored with the key */
+    uint32_t length;                    /**< Key length, terminator included */
+    unsigned char key[];                /**< Key name */
+} art_leaf_t;
+
+struct dict_art {
+    art_node_t * root;                  /**< Root node or leaf, NULL if empty */
+    dict_art_usage_t usage;             /**< Tree size */
+};
+
+/* === Private variable declarations =========================================================== */
+
+/* === Private function declarations =========================================================== */
+
+static unsigned char * art_keys(art_node_t * node);
+
+static art_node_t ** art_children(art_node_t * node);
+
+static art_node_t * art_node_new(dict_art tree, int type);
+
+static void art_node_free(dict_art tree, art_node_t * node);
+
+static art_leaf_t * art_leaf_new(dict_art tree, const unsigned char * key, uint32_t length,
+                                 void * value);
+
+static void art_leaf_free(dict_art tree, art_leaf_t * leaf);
+
+static int art_leaf_matches(const art_leaf_t * leaf, const unsigned char * key, uint32_t length);
+
+static art_node_t ** art_child(art_node_t * node, unsigned char byte);
+
+static art_node_t * art_first(art_node_t * node, unsigned char * byte);
+
+static art_leaf_t * art_minimum(art_node_t * node);
+
+static uint32_t art_prefix_check(const art_node_t * node, const unsigned char * key,
+                                 uint32_t length, uint32_t depth);
+
+static uint32_t art_prefix_mismatch(art_node_t * node, const unsigned char * key, uint32_t length,
+                                    uint32_t depth);
+
+static void art_copy_header(art_node_t * to, const art_node_t * from);
+
+static int art_add_child(dict_art tree, art_node_t ** ref, art_node_t * node, unsigned char byte,
+                         art_node_t * child);
+
+static void art_shrink(dict_art tree, art_node_t ** ref, art_node_t * node);
+
+static void art_collapse(dict_art tree, art_node_t ** ref, art_node_t * node);
+
+static void art_remove_child(dict_art tree, art_node_t ** ref, art_node_t * node,
+                             unsigned char byte);
+
+static int art_insert(dict_art tree, art_node_t ** ref, const unsigned char * key,
+                      uint32_t length, uint32_t depth, void * value, void ** old);
+
+static int art_walk(art_node_t * node, dict_art_visit visit, void * context);
+
+static void art_measure(art_node_t * node, dict_art_usage_t * usage);
+
+static void art_free(art_node_t * node, dict_art_visit release, void * context);
+
+/* === Public variable definitions ============================================================= */
+
+/* === Private variable definitions ============================================================ */
+
+static const size_t art_node_size[] = {
+    sizeof(art_node4_t), sizeof(art_node16_t), sizeof(art_node48_t), sizeof(art_node256_t)};
+
+static const uint16_t art_node_capacity[] = {4, 16, 48, 256};
+
+/* === Private function implementation ========================================================= */
+/**
+ * @brief Sorted key bytes of a node with up to 16 children.
+ *
+ * @param node Node.
+ * @return unsigned char* Key bytes, NULL for larger nodes.
+ */
+static unsigned char * art_keys(art_node_t * node) {
+    if (node->type == ART_NODE4)
+        return ((art_node4_t *)node)->keys;
+    if (node->type == ART_NODE16)
+        return ((art_node16_t *)node)->keys;
+    return NULL;
+}
+/**
+ * @brief Child slots of a node.
+ *
+ * @param node Node.
+ * @return art_node_t** Child slots.
+ */
+static art_node_t ** art_children(art_node_t * node) {
+    switch (node->type) {
+    case ART_NODE4:
+        return ((art_node4_t *)node)->children;
+    case ART_NODE16:
+        return ((art_node16_t *)node)->children;
+    case ART_NODE48:
+        return ((art_node48_t *)node)->children;
+    default:
+        return ((art_node256_t *)node)->children;
+    }
+}
+/**
+ * @brief Allocate an empty node.
+ *
+ * @param tree Tree the node is accounted to.
+ * @param type Node type.
+ * @return art_node_t* Node, NULL if out of memory.
+ */
+static art_node_t * art_node_new(dict_art tree, int type) {
+    art_node_t * node = calloc(1, art_node_size[type]);
+    if (node == NULL)
+        return NULL;
+    node->type = type;
+    tree->usage.nodes[type]++;
+    tree->usage.node_bytes += art_node_size[type];
+    return node;
+}
+/**
+ * @brief Free a node, not its children.
+ *
+ * @param tree Tree the node is accounted to.
+ * @param node Node.
+ */
+static void art_node_free(dict_art tree, art_node_t * node) {
+    tree->usage.nodes[node->type]--;
+    tree->usage.node_bytes -= art_node_size[node->type];
+    free(node);
+}
+/**
+ * @brief Allocate a leaf.
+ *
+ * @param tree Tree the leaf is accounted to.
+ * @param key Key name.
+ * @param length Key length, terminator included.
+ * @param value Value.
+ * @return art_leaf_t* Leaf, NULL if out of memory.
+ */
+static art_leaf_t * art_leaf_new(dict_art tree, const unsigned char * key, uint32_t length,
+                                 void * value) {
+    art_leaf_t * leaf = malloc(sizeof(*leaf) + length);
+    if (leaf == NULL)
+        return NULL;
+    leaf->value = value;
+    leaf->length = length;
+    memcpy(leaf->key, key, length);
+    tree->usage.keys++;
+    tree->usage.key_bytes += length;
+    tree->usage.leaf_bytes += sizeof(*leaf) + length;
+    return leaf;
+}
+/**
+ * @brief Free a leaf, not its value.
+ *
+ * @param tree Tree the leaf is accounted to.
+ * @param leaf Leaf.
+ */
+static void art_leaf_free(dict_art tree, art_leaf_t * leaf) {
+    tree->usage.keys--;
+    tree->usage.key_bytes -= leaf->length;
+    tree->usage.leaf_bytes -= sizeof(*leaf) + leaf->length;
+    free(leaf);
+}
+/**
+ * @brief Check whether a leaf holds a key.
+ *
+ * @param leaf Leaf.
+ * @param key Key name.
+ * @param length Key length, terminator included.
+ * @return int Non zero if it does.
+ */
+static int art_leaf_matches(const art_leaf_t * leaf, const unsigned char * key, uint32_t length) {
+    return leaf->length == length && memcmp(leaf->key, key, length) == 0;
+}
+/**
+ * @brief Find the child of a node for a key byte.
+ *
+ * @param node Node.
+ * @param byte Key byte.
+ * @return art_node_t** Child slot, NULL if there is no such child.
+ */
+static art_node_t ** art_child(art_node_t * node, unsigned char byte) {
+    switch (node->type) {
+    case ART_NODE4:
+    case ART_NODE16: {
+        unsigned char * keys = art_keys(node);
+        for (int index = 0; index < node->count && keys[index] <= byte; index++) {
+            if (keys[index] == byte)
+                return &art_children(node)[index];
+        }
+        return NULL;
+    }
+    case ART_NODE48: {
+        art_node48_t * large = (art_node48_t *)node;
+        return large->index[byte] != 0 ? &large->children[large->index[byte] - 1] : NULL;
+    }
+    default: {
+        art_node256_t * full = (art_node256_t *)node;
+        return full->children[byte] != NULL ? &full->children[byte] : NULL;
+    }
+    }
+}
+/**
+ * @brief First child of a node in key order.
+ *
+ * @param node Node, with at least one child.
+ * @param byte Where its key byte is stored, may be NULL.
+ * @return art_node_t* Child.
+ */
+static art_node_t * art_first(art_node_t * node, unsigned char * byte) {
+    unsigned int index = 0;
+
+    switch (node->type) {
+    case ART_NODE4:
+    case ART_NODE16:
+        if (byte != NULL)
+            *byte = art_keys(node)[0];
+        return art_children(node)[0];
+    case ART_NODE48: {
+        art_node48_t * large = (art_node48_t *)node;
+        while (large->index[index] == 0)
+            index++;
+        if (byte != NULL)
+            *byte = index;
+        return large->children[large->index[index] - 1];
+    }
+    default: {
+        art_node256_t * full = (art_node256_t *)node;
+        while (full->children[index] == NULL)
+            index++;
+        if (byte != NULL)
+            *byte = index;
+        return full->children[index];
+    }
+    }
+}
+/**
+ * @brief Leftmost leaf below a node.
+ *
+ * @param node Node or leaf.
+ * @return art_leaf_t* Leaf.
+ */
+static art_leaf_t * art_minimum(art_node_t * node) {
+    while (!ART_IS_LEAF(node))
+        node = art_first(node, NULL);
+    return ART_LEAF(node);
+}
+/**
+ * @brief Count the bytes of the stored prefix of a node matching a key. Bytes past ART_PREFIX
+ * are not checked, the leaf reached at the end is.
+ *
+ * @param node Node.
+ * @param key Key name.
+ * @param length Key length.
+ * @param depth Key bytes already matched above the node.
+ * @return uint32_t Matching bytes.
+ */
+static uint32_t art_prefix_check(const art_node_t * node, const unsigned char * key,
+                                 uint32_t length, uint32_t depth) {
+    uint32_t limit = ART_MIN(ART_MIN(node->prefix_len, ART_PREFIX), length - depth);
+    uint32_t index = 0;
+
+    while (index < limit && node->prefix[index] == key[depth + index])
+        index++;
+    return index;
+}
+/**
+ * @brief Count the bytes of the whole compressed path of a node matching a key.
+ *
+ * @param node Node.
+ * @param key Key name.
+ * @param length Key length.
+ * @param depth Key bytes already matched above the node.
+ * @return uint32_t Matching bytes, at most the path length and the key bytes left.
+ */
+static uint32_t art_prefix_mismatch(art_node_t * node, const unsigned char * key, uint32_t length,
+                                    uint32_t depth) {
+    uint32_t index = art_prefix_check(node, key, length, depth);
+
+    if (index == ART_PREFIX && node->prefix_len > ART_PREFIX) {
+        const art_leaf_t * leaf = art_minimum(node);
+        uint32_t limit = ART_MIN(node->prefix_len, length - depth);
+        while (index < limit && leaf->key[depth + index] == key[depth + index])
+            index++;
+    }
+    return index;
+}
+/**
+ * @brief Copy the children count and compressed path of a node being resized.
+ *
+ * @param to New node.
+ * @param from Old node.
+ */
+static void art_copy_header(art_node_t * to, const art_node_t * from) {
+    to->count = from->count;
+    to->prefix_len = from->prefix_len;
+    memcpy(to->prefix, from->prefix, ART_MIN(from->prefix_len, ART_PREFIX));
+}
+/**
+ * @brief Add a child to a node, moving it to a larger node if it is full.
+ *
+ * @param tree Tree.
+ * @param ref Slot pointing to the node.
+ * @param node Node.
+ * @param byte Key byte of the child, not used yet in the node.
+ * @param child Child.
+ * @return int
+ *              - 0 if no error.
+ *              - -1 if out of memory, the node is unchanged.
+ */
+static int art_add_child(dict_art tree, art_node_t ** ref, art_node_t * node, unsigned char byte,
+                         art_node_t * child) {
+    if (node->count < art_node_capacity[node->type]) {
+        art_node_t ** children = art_children(node);
+        unsigned char * keys = art_keys(node);
+
+        if (keys != NULL) {
+            int index = 0;
+            while (index < node->count && keys[index] < byte)
+                index++;
+            memmove(&keys[index + 1], &keys[index], node->count - index);
+            memmove(&children[index + 1], &children[index],
+                    (node->count - index) * sizeof(*children));
+            keys[index] = byte;
+            children[index] = child;
+        } else if (node->type == ART_NODE48) {
+            art_node48_t * large = (art_node48_t *)node;
+            int slot = 0;
+            while (large->children[slot] != NULL)
+                slot++;
+            large->children[slot] = child;
+            large->index[byte] = slot + 1;
+        } else {
+            children[byte] = child;
+        }
+        node->count++;
+        return 0;
+    }
+
+    art_node_t * grown = art_node_new(tree, node->type + 1);
+    if (grown == NULL)
+        return -1;
+    art_copy_header(grown, node);
+
+    art_node_t ** from = art_children(node);
+    art_node_t ** to = art_children(grown);
+    if (node->type == ART_NODE4) {
+        memcpy(art_keys(grown), art_keys(node), node->count);
+        memcpy(to, from, node->count * sizeof(*to));
+    } else if (node->type == ART_NODE16) {
+        unsigned char * keys = art_keys(node);
+        for (int index = 0; index < node->count; index++) {
+            to[index] = from[index];
+            ((art_node48_t *)grown)->index[keys[index]] = index + 1;
+        }
+    } else {
+        art_node48_t * large = (art_node48_t *)node;
+        for (int index = 0; index < 256; index++) {
+            if (large->index[index] != 0)
+                to[index] = from[large->index[index] - 1];
+        }
+    }
+    *ref = grown;
+    art_node_free(tree, node);
+    return art_add_child(tree, ref, grown, byte, child);
+}
+/**
+ * @brief Move a node that became sparse to a smaller one. Left as it is if out of memory.
+ *
+ * @param tree Tree.
+ * @param ref Slot pointing to the node.
+ * @param node Node, ART_NODE16 or larger.
+ */
+static void art_shrink(dict_art tree, art_node_t ** ref, art_node_t * node) {
+    art_node_t * shrunk = art_node_new(tree, node->type - 1);
+    if (shrunk == NULL)
+        return;
+    art_copy_header(shrunk, node);
+
+    art_node_t ** from = art_children(node);
+    art_node_t ** to = art_children(shrunk);
+    int count = 0;
+    if (node->type == ART_NODE16) {
+        memcpy(art_keys(shrunk), art_keys(node), node->count);
+        memcpy(to, from, node->count * sizeof(*to));
+    } else if (node->type == ART_NODE48) {
+        art_node48_t * large = (art_node48_t *)node;
+        for (int index = 0; index < 256; index++) {
+            if (large->index[index] != 0) {
+                art_keys(shrunk)[count] = index;
+                to[count++] = from[large->index[index] - 1];
+            }
+        }
+    } else {
+        for (int index = 0; index < 256; index++) {
+            if (from[index] != NULL) {
+                ((art_node48_t *)shrunk)->index[index] = count + 1;
+                to[count++] = from[index];
+            }
+        }
+    }
+    *ref = shrunk;
+    art_node_free(tree, node);
+}
+/**
+ * @brief Replace a node left with a single child by that child, merging their paths.
+ *
+ * @param tree Tree.
+ * @param ref Slot pointing to the node.
+ * @param node Node.
+ */
+static void art_collapse(dict_art tree, art_node_t ** ref, art_node_t * node) {
+    unsigned char byte;
+    art_node_t * child = art_first(node, &byte);
+
+    if (!ART_IS_LEAF(child)) {
+        unsigned char prefix[ART_PREFIX];
+        uint32_t length = ART_MIN(node->prefix_len, ART_PREFIX);
+
+        memcpy(prefix, node->prefix, length);
+        if (length < ART_PREFIX)
+            prefix[length++] = byte;
+        if (length < ART_PREFIX) {
+            uint32_t more = ART_MIN(child->prefix_len, ART_PREFIX - length);
+            memcpy(&prefix[length], child->prefix, more);
+            length += more;
+        }
+        memcpy(child->prefix, prefix, length);
+        child->prefix_len += node->prefix_len + 1;
+    }
+    *ref = child;
+    art_node_free(tree, node);
+}
+/**
+ * @brief Remove a child from a node, moving it to a smaller node if it became sparse.
+ *
+ * @param tree Tree.
+ * @param ref Slot pointing to the node.
+ * @param node Node.
+ * @param byte Key byte of the child.
+ */
+static void art_remove_child(dict_art tree, art_node_t ** ref, art_node_t * node,
+                             unsigned char byte) {
+    art_node_t ** children = art_children(node);
+    unsigned char * keys = art_keys(node);
+
+    if (keys != NULL) {
+        int index = 0;
+        while (keys[index] != byte)
+            index++;
+        memmove(&keys[index], &keys[index + 1], node->count - index - 1);
+        memmove(&children[index], &children[index + 1],
+                (node->count - index - 1) * sizeof(*children));
+    } else if (node->type == ART_NODE48) {
+        art_node48_t * large = (art_node48_t *)node;
+        large->children[large->index[byte] - 1] = NULL;
+        large->index[byte] = 0;
+    } else {
+        children[byte] = NULL;
+    }
+    node->count--;
+
+    /* Shrink a little below the smaller capacity, so a key going and coming back does not
+     * resize the node every time. */
+    if (node->count == 1)
+        art_collapse(tree, ref, node);
+    else if ((node->type == ART_NODE16 && node->count == 3) ||
+             (node->type == ART_NODE48 && node->count == 12) ||
+             (node->type == ART_NODE256 && node->count == 37))
+        art_shrink(tree, ref, node);
+}
+/**
+ * @brief Store a value below a node.
+ *
+ * @param tree Tree.
+ * @param ref Slot pointing to the node, may point to NULL.
+ * @param key Key name.
+ * @param length Key length, terminator included.
+ * @param depth Key bytes already matched above the node.
+ * @param value Value.
+ * @param old Where the replaced value is stored, left untouched if the key is new.
+ * @return int
+ *              - 0 if no error.
+ *              - -1 if out of memory, the tree is unchanged.
+ */
+static int art_insert(dict_art tree, art_node_t ** ref, const unsigned char * key,
+                      uint32_t length, uint32_t depth, void * value, void ** old) {
+    art_node_t * node = *ref;
+    art_node_t * parent;
+    art_leaf_t * leaf;
+
+    if (node == NULL) {
+        leaf = art_leaf_new(tree, key, length, value);
+        if (leaf == NULL)
+            return -1;
+        *ref = ART_TAG(leaf);
+        return 0;
+    }
+
+    if (ART_IS_LEAF(node)) {
+        art_leaf_t * other = ART_LEAF(node);
+        if (art_leaf_matches(other, key, length)) {
+            *old = other->value;
+            other->value = value;
+            return 0;
+        }
+
+        /* Both keys end with the terminator, they differ before either ends */
+        uint32_t common = 0;
+        while (other->key[depth + common] == key[depth + common])
+            common++;
+
+        parent = art_node_new(tree, ART_NODE4);
+        leaf = parent != NULL ? art_leaf_new(tree, key, length, value) : NULL;
+        if (leaf == NULL) {
+            if (parent != NULL)
+                art_node_free(tree, parent);
+            return -1;
+        }
+        parent->prefix_len = common;
+        memcpy(parent->prefix, &key[depth], ART_MIN(common, ART_PREFIX));
+        art_add_child(tree, ref, parent, other->key[depth + common], node);
+        art_add_child(tree, ref, parent, key[depth + common], ART_TAG(leaf));
+        *ref = parent;
+        return 0;
+    }
+
+    if (node->prefix_len > 0) {
+        uint32_t same = art_prefix_mismatch(node, key, length, depth);
+        if (same < node->prefix_len) {
+            parent = art_node_new(tree, ART_NODE4);
+            leaf = parent != NULL ? art_leaf_new(tree, key, length, value) : NULL;
+            if (leaf == NULL) {
+                if (parent != NULL)
+                    art_node_free(tree, parent);
+                return -1;
+            }
+            parent->prefix_len = same;
+            memcpy(parent->prefix, node->prefix, ART_MIN(same, ART_PREFIX));
+
+            /* The node keeps the part of its path after the byte that now leads to it */
+            unsigned char byte;
+            if (node->prefix_len <= ART_PREFIX) {
+                byte = node->prefix[same];
+                node->prefix_len -= same + 1;
+                memmove(node->prefix, &node->prefix[same + 1], node->prefix_len);
+            } else {
+                const art_leaf_t * minimum = art_minimum(node);
+                byte = minimum->key[depth + same];
+                node->prefix_len -= same + 1;
+                memcpy(node->prefix, &minimum->key[depth + same + 1],
+                       ART_MIN(node->prefix_len, ART_PREFIX));
+            }
+            art_add_child(tree, ref, parent, byte, node);
+            art_add_child(tree, ref, parent, key[depth + same], ART_TAG(leaf));
+            *ref = parent;
+            return 0;
+        }
+        depth += node->prefix_len;
+    }
+
+    art_node_t ** child = art_child(node, key[depth]);
+    if (child != NULL)
+        return art_insert(tree, child, key, length, depth + 1, value, old);
+
+    leaf = art_leaf_new(tree, key, length, value);
+    if (leaf == NULL)
+        return -1;
+    if (art_add_child(tree, ref, node, key[depth], ART_TAG(leaf)) != 0) {
+        art_leaf_free(tree, leaf);
+        return -1;
+    }
+    return 0;
+}
+/**
+ * @brief Visit every leaf below a node, in key order.
+ *
+ * @param node Node or leaf.
+ * @param visit Callback.
+ * @param context User context given to the callback.
+ * @return int Value of the callback that stopped the walk, 0 if it went to the end.
+ */
+static int art_walk(art_node_t * node, dict_art_visit visit, void * context) {
+    int result = 0;
+
+    if (ART_IS_LEAF(node)) {
+        art_leaf_t * leaf = ART_LEAF(node);
+        return visit((const char *)leaf->key, leaf->value, context);
+    }
+
+    art_node_t ** children = art_children(node);
+    switch (node->type) {
+    case ART_NODE4:
+    case ART_NODE16:
+        for (int index = 0; index < node->count && result == 0; index++)
+            result = art_walk(children[index], visit, context);
+        break;
+    case ART_NODE48: {
+        const unsigned char * slots = ((art_node48_t *)node)->index;
+        for (int index = 0; index < 256 && result == 0; index++) {
+            if (slots[index] != 0)
+                result = art_walk(children[slots[index] - 1], visit, context);
+        }
+        break;
+    }
+    default:
+        for (int index = 0; index < 256 && result == 0; index++) {
+            if (children[index] != NULL)
+                result = art_walk(children[index], visit, context);
+        }
+        break;
+    }
+    return result;
+}
+/**
+ * @brief Add up the size of everything below a node.
+ *
+ * @param node Node or leaf.
+ * @param usage Size to add to.
+ */
+static void art_measure(art_node_t * node, dict_art_usage_t * usage) {
+    if (ART_IS_LEAF(node)) {
+        const art_leaf_t * leaf = ART_LEAF(node);
+        usage->keys++;
+        usage->key_bytes += leaf->length;
+        usage->leaf_bytes += sizeof(*leaf) + leaf->length;
+        return;
+    }
+
+    usage->nodes[node->type]++;
+    usage->node_bytes += art_node_size[node->type];
+    art_node_t ** children = art_children(node);
+    int slots = art_keys(node) != NULL ? node->count : art_node_capacity[node->type];
+    for (int index = 0; index < slots; index++) {
+        if (children[index] != NULL)
+            art_measure(children[index], usage);
+    }
+}
+/**
+ * @brief Free everything below a node.
+ *
+ * @param node Node or leaf.
+ * @param release Called for every value, may be NULL.
+ * @param context User context given to release.
+ */
+static void art_free(art_node_t * node, dict_art_visit release, void * context) {
+    if (ART_IS_LEAF(node)) {
+        art_leaf_t * leaf = ART_LEAF(node);
+        if (release != NULL)
+            release((const char *)leaf->key, leaf->value, context);
+        free(leaf);
+        return;
+    }
+
+    art_node_t ** children = art_children(node);
+    int slots = art_keys(node) != NULL ? node->count : art_node_capacity[node->type];
+    for (int index = 0; index < slots; index++) {
+        if (children[index] != NULL)
+            art_free(children[index], release, context);
+    }
+    free(node);
+}
+
+/* === Public function implementation ========================================================== */
+
+dict_art dict_art_create(void) {
+    return calloc(1, sizeof(struct dict_art));
+}
+
+void dict_art_destroy(dict_art tree, dict_art_visit release, void * context) {
+    if (tree == NULL)
+        return;
+    if (tree->root != NULL)
+        art_free(tree->root, release, context);
+    free(tree);
+}
+
+void * dict_art_get(dict_art tree, const char * key) {
+    const unsigned char * bytes = (const unsigned char *)key;
+    uint32_t length = strlen(key) + 1;
+    art_node_t * node = tree->root;
+    uint32_t depth = 0;
+
+    while (node != NULL) {
+        if (ART_IS_LEAF(node)) {
+            art_leaf_t * leaf = ART_LEAF(node);
+            return art_leaf_matches(leaf, bytes, length) ? leaf->value : NULL;
+        }
+        if (node->prefix_len > 0) {
+            if (art_prefix_check(node, bytes, length, depth) !=
+                ART_MIN(node->prefix_len, ART_PREFIX))
+                return NULL;
+            depth += node->prefix_len;
+        }
+        if (depth >= length)
+            return NULL;
+        art_node_t ** child = art_child(node, bytes[depth++]);
+        node = child != NULL ? *child : NULL;
+    }
+    return NULL;
+}
+
+int dict_art_put(dict_art tree, const char * key, void * value, void ** old) {
+    *old = NULL;
+    return art_insert(tree, &tree->root, (const unsigned char *)key, strlen(key) + 1, 0, value,
+                      old);
+}
+
+void * dict_art_del(dict_art tree, const char * key) {
+    const unsigned char * bytes = (const unsigned char *)key;
+    uint32_t length = strlen(key) + 1;
+    art_node_t ** ref = &tree->root;
+    uint32_t depth = 0;
+
+    while (*ref != NULL) {
+        art_node_t * node = *ref;
+        if (ART_IS_LEAF(node)) {
+            /* Only the root is reached as a leaf, children leaves are checked from the parent */
+            art_leaf_t * leaf = ART_LEAF(node);
+            if (!art_leaf_matches(leaf, bytes, length))
+                return NULL;
+            void * value = leaf->value;
+            *ref = NULL;
+            art_leaf_free(tree, leaf);
+            return value;
+        }
+        if (node->prefix_len > 0) {
+            if (art_prefix_check(node, bytes, length, depth) !=
+                ART_MIN(node->prefix_len, ART_PREFIX))
+                return NULL;
+            depth += node->prefix_len;
+        }
+        if (depth >= length)
+            return NULL;
+
+        art_node_t ** child = art_child(node, bytes[depth]);
+        if (child == NULL)
+            return NULL;
+        if (ART_IS_LEAF(*child)) {
+            art_leaf_t * leaf = ART_LEAF(*child);
+            if (!art_leaf_matches(leaf, bytes, length))
+                return NULL;
+            void * value = leaf->value;
+            art_remove_child(tree, ref, node, bytes[depth]);
+            art_leaf_free(tree, leaf);
+            return value;
+        }
+        ref = child;
+        depth++;
+    }
+    return NULL;
+}
+
+int dict_art_scan(dict_art tree, const char * prefix, dict_art_visit visit, void * context) {
+    const unsigned char * bytes = (const unsigned char *)prefix;
+    uint32_t length = strlen(prefix);
+    art_node_t * node = tree->root;
+    uint32_t depth = 0;
+
+    while (node != NULL) {
+        if (ART_IS_LEAF(node)) {
+            art_leaf_t * leaf = ART_LEAF(node);
+            if (leaf->length > length && memcmp(leaf->key, bytes, length) == 0)
+                return visit((const char *)leaf->key, leaf->value, context);
+            return 0;
+        }
+        if (depth == length)
+            return art_walk(node, visit, context);
+        if (node->prefix_len > 0) {
+            uint32_t same = art_prefix_mismatch(node, bytes, length, depth);
+            if (depth + same == length)
+                return art_walk(node, visit, context);
+            if (same < node->prefix_len)
+                return 0;
+            depth += node->prefix_len;
+        }
+        art_node_t ** child = art_child(node, bytes[depth++]);
+        node = child != NULL ? *child : NULL;
+    }
+    return 0;
+}
+
+int dict_art_split(dict_art tree, const char * prefix, dict_art * moved) {
+    const unsigned char * bytes = (const unsigned char *)prefix;
+    uint32_t length = strlen(prefix);
+    art_node_t ** ref = &tree->root;
+    art_node_t ** parent_ref = NULL;
+    art_node_t * parent = NULL;
+    unsigned char edge = 0;
+    uint32_t depth = 0;
+
+    *moved = NULL;
+    while (*ref != NULL) {
+        art_node_t * node = *ref;
+        if (ART_IS_LEAF(node)) {
+            art_leaf_t * leaf = ART_LEAF(node);
+            if (leaf->length <= length || memcmp(leaf->key, bytes, length) != 0)
+                return 0;
+            break;
+        }
+        if (depth == length)
+            break;
+        if (node->prefix_len > 0) {
+            uint32_t same = art_prefix_mismatch(node, bytes, length, depth);
+            if (depth + same == length)
+                break;
+            if (same < node->prefix_len)
+                return 0;
+            depth += node->prefix_len;
+        }
+        art_node_t ** child = art_child(node, bytes[depth]);
+        if (child == NULL)
+            return 0;
+        parent_ref = ref;
+        parent = node;
+        edge = bytes[depth++];
+        ref = child;
+    }
+    if (*ref == NULL)
+        return 0;
+
+    dict_art result = dict_art_create();
+    if (result == NULL)
+        return -1;
+    result->root = *ref;
+    art_measure(result->root, &result->usage);
+
+    tree->usage.keys -= result->usage.keys;
+    tree->usage.key_bytes -= result->usage.key_bytes;
+    tree->usage.node_bytes -= result->usage.node_bytes;
+    tree->usage.leaf_bytes -= result->usage.leaf_bytes;
+    for (int type = ART_NODE4; type <= ART_NODE256; type++)
+        tree->usage.nodes[type] -= result->usage.nodes[type];
+
+    if (parent == NULL)
+        tree->root = NULL;
+    else
+        art_remove_child(tree, parent_ref, parent, edge);
+    *moved = result;
+    return 0;
+}
+
+size_t dict_art_leaf_size(const char * key) {
+    return sizeof(art_leaf_t) + strlen(key) + 1;
+}
+
+void dict_art_usage(dict_art tree, dict_art_usage_t * usage) {
+    *usage = tree->usage;
+}
+
+#endif /* DICT_CONFIG_ENGINE_ART */
+
+/* === End of documentation ==================================================================== */
@@ -0,0 +1,444 @@
+/************************************************************************************************
+Copyright (c) 2024, Guido Ramirez <guidoramirez7@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute,
+sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial
+portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+SPDX-License-Identifier: MIT
+*************************************************************************************************/
+
+/** @file dict_backend_art.c
+ ** @brief In memory storage engine keyed by an adaptive radix tree, see dict_art.h.
+ **
+ ** Slower than the hash table of dict_backend_memory.c for point lookups, but keys come out in
+ ** order and the keys sharing a prefix form one subtree: a prefix scan only visits its matches
+ ** and a prefix delete detaches them under the write lock and frees them on the reclamation
+ ** thread. Suits namespaced keys such as "tenant:region:object:id".
+ **
+ ** Not persistent: nothing is written to storage and every key is lost when the server stops.
+ ** STATS reports backend_persistent:0. Use DUMP and LOAD to carry the keys over a restart, or
+ ** route only caches and other rebuildable data to it with DICT_NAMESPACES.
+ **/
+
+/* === Headers files inclusions =============================================================== */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dict_art.h"
+#include "dict_engine.h"
+#include "dict_reclaim.h"
+
+#if DICT_CONFIG_ENGINE_ART
+
+/* === Macros definitions ====================================================================== */
+
+#define BACKEND_ART_MAX_KEY (4096) /**< Longest key accepted, bounds the depth of the tree */
+
+/* === Private data type declarations ========================================================== */
+
+typedef struct {
+    int length;    /**< Value length */
+    char data[];   /**< Value bytes */
+} backend_art_value_t;
+
+typedef struct {
+    dict_art tree;                 /**< Keys and values */
+    size_t value_bytes;            /**< Bytes used by values */
+    atomic_ulong scans;            /**< Prefix scans, counted under the read lock */
+    unsigned long prefix_dels;     /**< Prefix deletes */
+    unsigned long prefix_del_keys; /**< Keys removed by prefix deletes */
+    pthread_rwlock_t lock;         /**< Writers are the request loop and the dump import */
+} backend_art_t;
+
+typedef struct {
+    dict_backend_key_visit visit; /**< Caller's callback */
+    void * context;               /**< Caller's context */
+} backend_art_walk_t;
+
+typedef struct {
+    dict_backend_value_visit visit; /**< Caller's callback */
+    void * context;                 /**< Caller's context */
+} backend_art_copy_t;
+
+/* === Private variable declarations =========================================================== */
+
+/* === Private function declarations =========================================================== */
+
+static int backend_art_value_free(const char * key, void * value, void * context);
+
+static int backend_art_value_size(const char * key, void * value, void * context);
+
+static int backend_art_visit(const char * key, void * value, void * context);
+
+static int backend_art_copy_visit(const char * key, void * value, void * context);
+
+static void backend_art_release(void * arg);
+
+static int backend_art_open(const dict_server_config_t * config);
+
+static void backend_art_close(void);
+
+DICT_ENGINE_ENTRY int backend_art_get(const char * key, char * buffer, int buffer_size,
+                                      int * length);
+
+DICT_ENGINE_ENTRY int backend_art_put(const char * key, const char * value, int length);
+
+DICT_ENGINE_ENTRY int backend_art_del(const char * key);
+
+static int backend_art_iterate(dict_backend_key_visit visit, void * context);
+
+static int backend_art_copy(dict_backend_value_visit visit, void * context);
+
+static int backend_art_scan(const char * prefix, dict_backend_key_visit visit, void * context);
+
+static int backend_art_del_prefix(const char * prefix, size_t * count);
+
+static int backend_art_stats(char * buffer, int buffer_size);
+
+static int backend_art_flush(void);
+
+static int backend_art_count(size_t * count);
+
+static int backend_art_clear(void);
+
+static int backend_art_defrag(int budget_us);
+
+static int backend_art_memory(dict_backend_memory_t * memory);
+
+DICT_ENGINE_ENTRY int backend_art_usage(const char * key, size_t * bytes);
+
+DICT_ENGINE_ENTRY int backend_art_prefetch(const char * key);
+
+/* === Public variable definitions ============================================================= */
+
+const dict_engine_t dict_engine_art = {
+    .name = "art",
+    .key_max = BACKEND_ART_MAX_KEY,
+    .open = backend_art_open,
+    .close = backend_art_close,
+    .get = backend_art_get,
+    .put = backend_art_put,
+    .del = backend_art_del,
+    .iterate = backend_art_iterate,
+    .copy = backend_art_copy,
+    .stats = backend_art_stats,
+    .flush = backend_art_flush,
+    .count = backend_art_count,
+    .clear = backend_art_clear,
+    .defrag = backend_art_defrag,
+    .memory = backend_art_memory,
+    .usage = backend_art_usage,
+    .prefetch = backend_art_prefetch,
+    .scan = backend_art_scan,
+    .del_prefix = backend_art_del_prefix,
+};
+
+/* === Private variable definitions ============================================================ */
+
+static backend_art_t backend_art = {.lock = PTHREAD_RWLOCK_INITIALIZER};
+
+/* === Private function implementation ========================================================= */
+/**
+ * @brief Free a value dropped with its tree.
+ *
+ * @param key Key name.
+ * @param value Value, backend_art_value_t.
+ * @param context Not used.
+ * @return int Always 0.
+ */
+static int backend_art_value_free(const char * key, void * value, void * context) {
+    free(value);
+    return 0;
+}
+/**
+ * @brief Add up the length of the values of a tree.
+ *
+ * @param key Key name.
+ * @param value Value, backend_art_value_t.
+ * @param context Running total, size_t.
+ * @return int Always 0.
+ */
+static int backend_art_value_size(const char * key, void * value, void * context) {
+    *(size_t *)context += ((backend_art_value_t *)value)->length;
+    return 0;
+}
+/**
+ * @brief Forward a key of a tree walk to a dict_backend_key_visit callback.
+ *
+ * @param key Key name.
+ * @param value Not used.
+ * @param context Walk, backend_art_walk_t.
+ * @return int Callback's result.
+ */
+static int backend_art_visit(const char * key, void * value, void * context) {
+    backend_art_walk_t * walk = context;
+    return walk->visit(key, walk->context);
+}
+/**
+ * @brief Forward a key of a tree walk and its value to a dict_backend_value_visit callback.
+ *
+ * @param key Key name.
+ * @param value Value, backend_art_value_t.
+ * @param context Walk, backend_art_copy_t.
+ * @return int Callback's result.
+ */
+static int backend_art_copy_visit(const char * key, void * value, void * context) {
+    backend_art_copy_t * copy = context;
+    const backend_art_value_t * stored = value;
+    return copy->visit(key, stored->data, stored->length, copy->context);
+}
+/**
+ * @brief Free a tree detached by a clear or a prefix delete. Runs on the reclamation thread,
+ * nothing else references the tree anymore.
+ *
+ * @param arg Tree, dict_art.
+ */
+static void backend_art_release(void * arg) {
+    dict_art_destroy(arg, backend_art_value_free, NULL);
+}
+
+/* === Public function implementation ========================================================== */
+
+static int backend_art_open(const dict_server_config_t * config) {
+    backend_art.tree = dict_art_create();
+    return backend_art.tree != NULL ? SERVER_OK : SERVER_E_OS;
+}
+
+static int backend_art_flush(void) {
+    // Writes are applied in memory before they are acknowledged, there is nothing pending.
+    return SERVER_OK;
+}
+
+static void backend_art_close(void) {
+    // The process exit releases the tree.
+}
+
+DICT_ENGINE_ENTRY int backend_art_get(const char * key, char * buffer, int buffer_size,
+                                      int * length) {
+    if (key == NULL || buffer == NULL || length == NULL)
+        return SERVER_E_NULL;
+
+    int err = SERVER_OK;
+    pthread_rwlock_rdlock(&backend_art.lock);
+    backend_art_value_t * value = dict_art_get(backend_art.tree, key);
+    if (value == NULL) {
+        err = SERVER_E_NOT_FOUND;
+    } else {
+        *length = value->length;
+        memcpy(buffer, value->data, value->length < buffer_size ? value->length : buffer_size);
+    }
+    pthread_rwlock_unlock(&backend_art.lock);
+    return err;
+}
+
+DICT_ENGINE_ENTRY int backend_art_put(const char * key, const char * value, int length) {
+    if (key == NULL || value == NULL)
+        return SERVER_E_NULL;
+    if (key[0] == '\0' || strlen(key) > BACKEND_ART_MAX_KEY || length < 0)
+        return SERVER_E_INVALID;
+
+    backend_art_value_t * copy = malloc(sizeof(*copy) + length);
+    if (copy == NULL)
+        return SERVER_E_OS;
+    copy->length = length;
+    memcpy(copy->data, value, length);
+
+    void * old;
+    pthread_rwlock_wrlock(&backend_art.lock);
+    int err = dict_art_put(backend_art.tree, key, copy, &old) == 0 ? SERVER_OK : SERVER_E_OS;
+    if (err == SERVER_OK) {
+        backend_art.value_bytes += length;
+        if (old != NULL)
+            backend_art.value_bytes -= ((backend_art_value_t *)old)->length;
+    }
+    pthread_rwlock_unlock(&backend_art.lock);
+
+    free(err == SERVER_OK ? old : copy);
+    return err;
+}
+
+DICT_ENGINE_ENTRY int backend_art_del(const char * key) {
+    if (key == NULL)
+        return SERVER_E_NULL;
+
+    pthread_rwlock_wrlock(&backend_art.lock);
+    backend_art_value_t * value = dict_art_del(backend_art.tree, key);
+    if (value != NULL)
+        backend_art.value_bytes -= value->length;
+    pthread_rwlock_unlock(&backend_art.lock);
+
+    free(value);
+    return value == NULL ? SERVER_E_NOT_FOUND : SERVER_OK;
+}
+
+static int backend_art_count(size_t * count) {
+    if (count == NULL)
+        return SERVER_E_NULL;
+
+    dict_art_usage_t usage;
+    pthread_rwlock_rdlock(&backend_art.lock);
+    dict_art_usage(backend_art.tree, &usage);
+    pthread_rwlock_unlock(&backend_art.lock);
+    *count = usage.keys;
+    return SERVER_OK;
+}
+
+static int backend_art_clear(void) {
+    dict_art tree = dict_art_create();
+    if (tree == NULL)
+        return SERVER_E_OS;
+
+    // Swap in an empty tree, the old one is released on the reclamation thread.
+    dict_art_usage_t usage;
+    pthread_rwlock_wrlock(&backend_art.lock);
+    dict_art retired = backend_art.tree;
+    dict_art_usage(retired, &usage);
+    size_t bytes = usage.node_bytes + usage.leaf_bytes + backend_art.value_bytes;
+    backend_art.tree = tree;
+    backend_art.value_bytes = 0;
+    pthread_rwlock_unlock(&backend_art.lock);
+
+    dict_reclaim_call(backend_art_release, retired, bytes);
+    return SERVER_OK;
+}
+
+static int backend_art_iterate(dict_backend_key_visit visit, void * context) {
+    return backend_art_scan("", visit, context);
+}
+
+static int backend_art_copy(dict_backend_value_visit visit, void * context) {
+    if (visit == NULL)
+        return SERVER_E_NULL;
+
+    // One read lock for the whole walk, no write lands in the middle of it.
+    backend_art_copy_t copy = {.visit = visit, .context = context};
+    pthread_rwlock_rdlock(&backend_art.lock);
+    dict_art_scan(backend_art.tree, "", backend_art_copy_visit, &copy);
+    pthread_rwlock_unlock(&backend_art.lock);
+    return SERVER_OK;
+}
+
+static int backend_art_scan(const char * prefix, dict_backend_key_visit visit, void * context) {
+    if (prefix == NULL || visit == NULL)
+        return SERVER_E_NULL;
+
+    // The callback runs under the read lock, writers wait until the walk ends.
+    backend_art_walk_t walk = {.visit = visit, .context = context};
+    pthread_rwlock_rdlock(&backend_art.lock);
+    dict_art_scan(backend_art.tree, prefix, backend_art_visit, &walk);
+    atomic_fetch_add(&backend_art.scans, 1);
+    pthread_rwlock_unlock(&backend_art.lock);
+    return SERVER_OK;
+}
+
+static int backend_art_del_prefix(const char * prefix, size_t * count) {
+    if (prefix == NULL || count == NULL)
+        return SERVER_E_NULL;
+
+    // Only the path down to the prefix changes, the detached keys are freed in the background.
+    dict_art moved;
+    dict_art_usage_t usage = {0};
+    size_t value_bytes = 0;
+    pthread_rwlock_wrlock(&backend_art.lock);
+    int err = dict_art_split(backend_art.tree, prefix, &moved) == 0 ? SERVER_OK : SERVER_E_OS;
+    if (moved != NULL) {
+        dict_art_usage(moved, &usage);
+        dict_art_scan(moved, "", backend_art_value_size, &value_bytes);
+        backend_art.value_bytes -= value_bytes;
+        backend_art.prefix_del_keys += usage.keys;
+    }
+    if (err == SERVER_OK)
+        backend_art.prefix_dels++;
+    pthread_rwlock_unlock(&backend_art.lock);
+
+    if (moved != NULL)
+        dict_reclaim_call(backend_art_release, moved,
+                          usage.node_bytes + usage.leaf_bytes + value_bytes);
+    *count = usage.keys;
+    return err;
+}
+
+static int backend_art_stats(char * buffer, int buffer_size) {
+    dict_art_usage_t usage;
+    pthread_rwlock_rdlock(&backend_art.lock);
+    dict_art_usage(backend_art.tree, &usage);
+    int len = snprintf(buffer, buffer_size,
+                       "backend:art\nbackend_persistent:0\n"
+                       "backend_keys:%zu\nbackend_value_bytes:%zu\n"
+                       "backend_nodes4:%zu\nbackend_nodes16:%zu\nbackend_nodes48:%zu\n"
+                       "backend_nodes256:%zu\nbackend_node_bytes:%zu\nbackend_leaf_bytes:%zu\n"
+                       "backend_scans:%lu\nbackend_prefix_dels:%lu\nbackend_prefix_del_keys:%lu\n",
+                       usage.keys, backend_art.value_bytes, usage.nodes[0], usage.nodes[1],
+                       usage.nodes[2], usage.nodes[3], usage.node_bytes, usage.leaf_bytes,
+                       atomic_load(&backend_art.scans),
+                       backend_art.prefix_dels, backend_art.prefix_del_keys);
+    pthread_rwlock_unlock(&backend_art.lock);
+    return len;
+}
+
+static int backend_art_defrag(int budget_us) {
+    // Nodes and values come from malloc, there is no arena to compact.
+    return 0;
+}
+
+static int backend_art_memory(dict_backend_memory_t * memory) {
+    if (memory == NULL)
+        return SERVER_E_NULL;
+
+    dict_art_usage_t usage;
+    pthread_rwlock_rdlock(&backend_art.lock);
+    dict_art_usage(backend_art.tree, &usage);
+    memset(memory, 0, sizeof(*memory));
+    memory->key_bytes = usage.key_bytes;
+    memory->value_bytes = backend_art.value_bytes;
+    memory->index_bytes = usage.node_bytes + usage.leaf_bytes - usage.key_bytes +
+                          usage.keys * sizeof(backend_art_value_t);
+    memory->allocated_bytes = memory->key_bytes + memory->value_bytes + memory->index_bytes;
+    pthread_rwlock_unlock(&backend_art.lock);
+    return SERVER_OK;
+}
+
+DICT_ENGINE_ENTRY int backend_art_usage(const char * key, size_t * bytes) {
+    if (key == NULL || bytes == NULL)
+        return SERVER_E_NULL;
+
+    int err = SERVER_OK;
+    pthread_rwlock_rdlock(&backend_art.lock);
+    backend_art_value_t * value = dict_art_get(backend_art.tree, key);
+    if (value == NULL)
+        err = SERVER_E_NOT_FOUND;
+    else
+        *bytes = dict_art_leaf_size(key) + sizeof(*value) + value->length;
+    pthread_rwlock_unlock(&backend_art.lock);
+    return err;
+}
+
+DICT_ENGINE_ENTRY int backend_art_prefetch(const char * key) {
+    if (key == NULL)
+        return SERVER_E_NULL;
+
+    // Values are in process memory already, there is nothing to load.
+    pthread_rwlock_rdlock(&backend_art.lock);
+    int err = dict_art_get(backend_art.tree, key) != NULL ? SERVER_OK : SERVER_E_NOT_FOUND;
+    pthread_rwlock_unlock(&backend_art.lock);
+    return err;
+}
+
+#endif /* DICT_CONFIG_ENGINE_ART */
+
+/* === End of documentation ==================================================================== */
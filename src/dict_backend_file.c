@@ -0,0 +1,864 @@
+/************************************************************************************************
+Copyright (c) 2024, Guido Ramirez <guidoramirez7@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute,
+sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial
+portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+SPDX-License-Identifier: MIT
+*************************************************************************************************/
+
+/** @file dict_backend_file.c
+ ** @brief File per key storage backend. Every key is a file inside BACKEND_FILE_DIR.
+ **
+ ** Before DUMP and LOAD were added, key files were stored straight in the working directory.
+ ** Keys of that layout are not seen until they are moved: start once with migrate_keys set
+ ** (DICT_MIGRATE_KEYS=1) and every regular, non executable file of the working directory whose
+ ** name is a valid key is moved into BACKEND_FILE_DIR. Files already there are kept.
+ **/
+
+/* === Headers files inclusions =============================================================== */
+
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "dict_engine.h"
+#include "dict_log.h"
+#include "dict_mapcache.h"
+#include "dict_reclaim.h"
+#include "dict_trace.h"
+#include "dict_warmup.h"
+#include "dict_writeback.h"
+
+#if DICT_CONFIG_ENGINE_FILE
+
+/* === Macros definitions ====================================================================== */
+
+#define BACKEND_FILE_DIR       "data"       /**< Directory where every key is stored as a file. */
+#define BACKEND_FILE_TEMP      ".set."      /**< Prefix of the file a SET writes before renaming it */
+#define BACKEND_FILE_TRASH     "data.trash." /**< Prefix of directories retired by FLUSHALL */
+#define BACKEND_FILE_MAP_AGE_S (1)          /**< Files written more recently are read, not mapped */
+
+/* === Private data type declarations ========================================================== */
+
+/* === Private variable declarations =========================================================== */
+
+/* === Private function declarations =========================================================== */
+
+static int backend_file_path(const char * key, char * path, size_t path_size);
+
+static int backend_file_retire(const char * path, off_t * size);
+
+static int backend_file_write(const char * path, const char * value, int length);
+
+static int backend_file_remove(const char * path);
+
+static int backend_file_store(const char * key, const char * value, int length);
+
+static int backend_file_exists(const char * key);
+
+static void backend_file_release_dir(void * arg);
+
+static int backend_file_fsync_dir(const char * path);
+
+static unsigned long backend_file_sync_request(void);
+
+static int backend_file_sync_wait(unsigned long first, unsigned long change);
+
+static int backend_file_sync_dir(void);
+
+static int backend_file_sync_change(void);
+
+static void backend_file_scan(void);
+
+static void backend_file_migrate(void);
+
+static int backend_file_open(const dict_server_config_t * config);
+
+static void backend_file_close(void);
+
+DICT_ENGINE_ENTRY int backend_file_get(const char * key, char * buffer, int buffer_size,
+                                       int * length);
+
+DICT_ENGINE_ENTRY int backend_file_put(const char * key, const char * value, int length);
+
+DICT_ENGINE_ENTRY int backend_file_del(const char * key);
+
+static int backend_file_iterate(dict_backend_key_visit visit, void * context);
+
+static int backend_file_stats(char * buffer, int buffer_size);
+
+static int backend_file_flush(void);
+
+static int backend_file_count(size_t * count);
+
+static int backend_file_clear(void);
+
+static int backend_file_defrag(int budget_us);
+
+static int backend_file_memory(dict_backend_memory_t * memory);
+
+static int backend_file_batch_begin(void);
+
+static int backend_file_batch_commit(void);
+
+DICT_ENGINE_ENTRY int backend_file_usage(const char * key, size_t * bytes);
+
+DICT_ENGINE_ENTRY int backend_file_prefetch(const char * key);
+
+/* === Public variable definitions ============================================================= */
+
+const dict_engine_t dict_engine_file = {
+    .name = "file",
+    .key_max = NAME_MAX,
+    .open = backend_file_open,
+    .close = backend_file_close,
+    .get = backend_file_get,
+    .put = backend_file_put,
+    .del = backend_file_del,
+    .iterate = backend_file_iterate,
+    .stats = backend_file_stats,
+    .flush = backend_file_flush,
+    .count = backend_file_count,
+    .clear = backend_file_clear,
+    .defrag = backend_file_defrag,
+    .memory = backend_file_memory,
+    .usage = backend_file_usage,
+    .prefetch = backend_file_prefetch,
+    .batch_begin = backend_file_batch_begin,
+    .batch_commit = backend_file_batch_commit,
+};
+
+/* === Private variable definitions ============================================================ */
+
+static int backend_file_buffered;        /**< Writes go through the write back buffer */
+static atomic_long backend_file_key_count;   /**< Key files in BACKEND_FILE_DIR */
+static atomic_ulong backend_file_clears; /**< Directories retired, names the next one */
+static int backend_file_sync;            /**< Writes are durable before they are acknowledged */
+static int backend_file_mapped;          /**< Reads go through the mapping cache */
+
+static pthread_mutex_t backend_file_sync_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t backend_file_sync_done = PTHREAD_COND_INITIALIZER;
+static unsigned long backend_file_sync_requested; /**< Directory changes waiting for a sync */
+static unsigned long backend_file_sync_covered;   /**< Changes covered by finished syncs */
+static unsigned long backend_file_sync_fail_from; /**< Last failed sync covered changes above... */
+static unsigned long backend_file_sync_fail_to;   /**< ...and up to this one */
+static int backend_file_sync_running;             /**< A thread is syncing the directory */
+static __thread int backend_file_batching;        /**< This thread's changes wait for the commit */
+static __thread unsigned long backend_file_batch_first; /**< Its first change, 0 if none */
+static __thread unsigned long backend_file_batch_last;  /**< Its last change */
+
+static atomic_ulong backend_file_file_syncs; /**< fdatasync() calls */
+static atomic_ulong backend_file_dir_syncs;  /**< Directory fsync() calls */
+static atomic_ulong backend_file_dir_waits;  /**< Directory changes made durable */
+
+/* === Private function implementation ========================================================= */
+/**
+ * @brief Build the file path where a key is stored.
+ *
+ * Names starting with a dot are reserved for backend internal files.
+ *
+ * @param key Key name.
+ * @param path Buffer where the path will be stored.
+ * @param path_size Path buffer's size.
+ * @return int
+ *              - SERVER_OK if no error.
+ *              - SERVER_E_INVALID if the key can not be used as a file name.
+ */
+static int backend_file_path(const char * key, char * path, size_t path_size) {
+    if (key == NULL || path == NULL)
+        return SERVER_E_NULL;
+    if (key[0] == '\0' || key[0] == '.' || strchr(key, '/') != NULL)
+        return SERVER_E_INVALID;
+
+    int len = snprintf(path, path_size, "%s/%s", BACKEND_FILE_DIR, key);
+    if (len < 0 || (size_t)len >= path_size)
+        return SERVER_E_SIZE;
+
+    return SERVER_OK;
+}
+/**
+ * @brief Open a key file about to lose its name if it is large enough to be released by the
+ * reclamation thread. Holding it open keeps its blocks allocated after the rename or unlink.
+ *
+ * @param path Key file path.
+ * @param size Where the file size is stored, -1 if the file is missing.
+ * @return int Descriptor to give dict_reclaim_file(), -1 if the file is small or missing.
+ */
+static int backend_file_retire(const char * path, off_t * size) {
+    struct stat st;
+    *size = stat(path, &st) < 0 ? -1 : st.st_size;
+    if (*size < DICT_RECLAIM_MIN_SIZE)
+        return -1;
+
+    int fd = open(path, O_WRONLY);
+    DICT_TRACE_SYSCALL(DICT_TRACE_OPEN);
+    return fd;
+}
+
+/**
+ * @brief Write a value to its key file. A fresh file is renamed over the old one.
+ *
+ * @param path Key file path.
+ * @param value Value to store.
+ * @param length Value length.
+ * @return int
+ *              - SERVER_OK if no error.
+ *              - SERVER_E_OS if the file could not be written.
+ */
+static int backend_file_write(const char * path, const char * value, int length) {
+    int fd;
+    int cnt;
+    int err = SERVER_OK;
+    char temp[PATH_MAX];
+
+    // Each thread has at most one write in flight, so its id makes the temporary name unique.
+    snprintf(temp, sizeof(temp), "%s/%s%d", BACKEND_FILE_DIR, BACKEND_FILE_TEMP, gettid());
+    fd = open(temp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    DICT_TRACE_SYSCALL(DICT_TRACE_OPEN);
+    if (fd < 0) {
+        LOG_ERROR("Can not open file [%s] to write key", path);
+        return SERVER_E_OS;
+    }
+
+    while (length > 0) {
+        cnt = write(fd, value, length);
+        DICT_TRACE_SYSCALL(DICT_TRACE_WRITE);
+        if (cnt <= 0) {
+            err = SERVER_E_OS;
+            break;
+        }
+        value += cnt;
+        length -= cnt;
+    }
+
+    // The data must be on disk before the rename can make it visible.
+    if (err == SERVER_OK && backend_file_sync) {
+        atomic_fetch_add_explicit(&backend_file_file_syncs, 1, memory_order_relaxed);
+        if (fdatasync(fd) < 0)
+            err = SERVER_E_OS;
+    }
+
+    close(fd);
+    DICT_TRACE_SYSCALL(DICT_TRACE_CLOSE);
+    if (err != SERVER_OK) {
+        unlink(temp);
+        return err;
+    }
+
+    // A new key needs nothing else, and the kernel tells it apart from a replacement.
+    if (renameat2(AT_FDCWD, temp, AT_FDCWD, path, RENAME_NOREPLACE) == 0) {
+        atomic_fetch_add(&backend_file_key_count, 1);
+        return SERVER_OK;
+    }
+
+    // The rename replaces the old value at once. A large one stays open so its blocks are
+    // released by the reclamation thread instead of here.
+    off_t old_size;
+    int old_fd = backend_file_retire(path, &old_size);
+    if (rename(temp, path) < 0) {
+        LOG_ERROR("Can not rename file [%s] to write key", path);
+        unlink(temp);
+        err = SERVER_E_OS;
+    } else if (old_size < 0) {
+        // No RENAME_NOREPLACE in this file system, or the key was deleted meanwhile.
+        atomic_fetch_add(&backend_file_key_count, 1);
+    }
+    if (old_fd >= 0) {
+        if (err == SERVER_OK) {
+            dict_reclaim_file(old_fd, old_size);
+        } else {
+            close(old_fd);
+            DICT_TRACE_SYSCALL(DICT_TRACE_CLOSE);
+        }
+    }
+    return err;
+}
+/**
+ * @brief Remove a key file.
+ *
+ * @param path Key file path.
+ * @return int
+ *              - SERVER_OK if no error.
+ *              - SERVER_E_NOT_FOUND if the file does not exist.
+ */
+static int backend_file_remove(const char * path) {
+    int err = SERVER_OK;
+
+    off_t size;
+    int fd = backend_file_retire(path, &size);
+    if (remove(path)) {
+        LOG_ERROR("Can not delete [%s] file", path);
+        err = SERVER_E_NOT_FOUND;
+    } else {
+        atomic_fetch_sub(&backend_file_key_count, 1);
+    }
+    if (fd >= 0) {
+        if (err == SERVER_OK) {
+            dict_reclaim_file(fd, size);
+        } else {
+            close(fd);
+            DICT_TRACE_SYSCALL(DICT_TRACE_CLOSE);
+        }
+    }
+    return err;
+}
+/**
+ * @brief Write back buffer store, called by its flushes.
+ *
+ * @param key Key name.
+ * @param value Latest value, NULL if the key was deleted.
+ * @param length Value length.
+ * @return int
+ *              - SERVER_OK if no error.
+ */
+static int backend_file_store(const char * key, const char * value, int length) {
+    char path[PATH_MAX];
+    int err = backend_file_path(key, path, sizeof(path));
+    if (err != SERVER_OK)
+        return err;
+
+    if (value != NULL) {
+        err = backend_file_write(path, value, length);
+    } else {
+        // Deleted while buffered, it may never have reached the disk.
+        err = backend_file_remove(path);
+        err = err == SERVER_E_NOT_FOUND ? SERVER_OK : err;
+    }
+    if (backend_file_mapped)
+        dict_mapcache_invalidate(key);
+    return err;
+}
+
+/**
+ * @brief Write back buffer probe, called when a key enters it.
+ *
+ * @param key Key name.
+ * @return int Non zero if the key has a file.
+ */
+static int backend_file_exists(const char * key) {
+    char path[PATH_MAX];
+    struct stat st;
+    return backend_file_path(key, path, sizeof(path)) == SERVER_OK && stat(path, &st) == 0;
+}
+
+/**
+ * @brief Delete a directory retired by dict_backend_clear() and everything in it. Runs on the
+ * reclamation thread.
+ *
+ * @param arg Directory path, allocated with malloc().
+ */
+static void backend_file_release_dir(void * arg) {
+    char * path = arg;
+
+    DIR * dir = opendir(path);
+    if (dir != NULL) {
+        struct dirent * entry;
+        while ((entry = readdir(dir)) != NULL)
+            if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0)
+                unlinkat(dirfd(dir), entry->d_name, 0);
+        closedir(dir);
+    }
+    if (rmdir(path) < 0)
+        LOG_ERROR("Can not remove retired directory [%s]", path);
+    free(path);
+}
+/**
+ * @brief Prepare the directories at startup. Counts the keys, removes temporary files left by
+ * a crash and queues the release of directories a FLUSHALL had not finished deleting.
+ */
+static void backend_file_scan(void) {
+    struct dirent * entry;
+    long count = 0;
+
+    DIR * dir = opendir(BACKEND_FILE_DIR);
+    if (dir != NULL) {
+        while ((entry = readdir(dir)) != NULL) {
+            if (strncmp(entry->d_name, BACKEND_FILE_TEMP, strlen(BACKEND_FILE_TEMP)) == 0)
+                unlinkat(dirfd(dir), entry->d_name, 0);
+            else if (entry->d_name[0] != '.')
+                count++;
+        }
+        closedir(dir);
+    }
+    atomic_store(&backend_file_key_count, count);
+
+    dir = opendir(".");
+    if (dir != NULL) {
+        while ((entry = readdir(dir)) != NULL) {
+            char * path;
+            if (strncmp(entry->d_name, BACKEND_FILE_TRASH, strlen(BACKEND_FILE_TRASH)) == 0 &&
+                (path = strdup(entry->d_name)) != NULL)
+                dict_reclaim_call(backend_file_release_dir, path, 0);
+        }
+        closedir(dir);
+    }
+}
+/**
+ * @brief Move the key files of the old layout, straight in the working directory, into
+ * BACKEND_FILE_DIR. The server's own files and anything that can not be a key stay.
+ */
+static void backend_file_migrate(void) {
+    struct dirent * entry;
+    long moved = 0;
+    long kept = 0;
+
+    DIR * dir = opendir(".");
+    int data_fd = open(BACKEND_FILE_DIR, O_RDONLY | O_DIRECTORY);
+    if (dir == NULL || data_fd < 0) {
+        LOG_ERROR("Can not migrate key files into [%s]", BACKEND_FILE_DIR);
+        goto finish;
+    }
+
+    while ((entry = readdir(dir)) != NULL) {
+        struct stat st;
+        if (entry->d_name[0] == '.' ||
+            strncmp(entry->d_name, DICT_WARMUP_FILE, sizeof(DICT_WARMUP_FILE) - 1) == 0 ||
+            fstatat(dirfd(dir), entry->d_name, &st, AT_SYMLINK_NOFOLLOW) < 0 ||
+            !S_ISREG(st.st_mode) || (st.st_mode & (S_IXUSR | S_IXGRP | S_IXOTH)) != 0)
+            continue;
+        if (renameat2(dirfd(dir), entry->d_name, data_fd, entry->d_name, RENAME_NOREPLACE) < 0) {
+            LOG_ERROR("Can not migrate key file [%s]", entry->d_name);
+            kept++;
+            continue;
+        }
+        moved++;
+    }
+    if (moved > 0 && (fsync(data_fd) < 0 || fsync(dirfd(dir)) < 0))
+        LOG_ERROR("Can not sync migrated key files");
+    LOG_INFO("Migrated %ld key files into [%s], %ld left in place", moved, BACKEND_FILE_DIR,
+             kept);
+
+finish:
+    if (dir != NULL)
+        closedir(dir);
+    if (data_fd >= 0)
+        close(data_fd);
+}
+
+/**
+ * @brief fsync() a directory, so the renames and unlinks done in it are durable.
+ *
+ * @param path Directory path.
+ * @return int
+ *              - SERVER_OK if no error.
+ *              - SERVER_E_OS otherwise.
+ */
+static int backend_file_fsync_dir(const char * path) {
+    int fd = open(path, O_RDONLY | O_DIRECTORY);
+    if (fd < 0)
+        return SERVER_E_OS;
+    int rt = fsync(fd);
+    close(fd);
+    atomic_fetch_add_explicit(&backend_file_dir_syncs, 1, memory_order_relaxed);
+    return rt < 0 ? SERVER_E_OS : SERVER_OK;
+}
+/**
+ * @brief Number a change of BACKEND_FILE_DIR that must become durable.
+ *
+ * @return unsigned long Change number, for backend_file_sync_wait().
+ */
+static unsigned long backend_file_sync_request(void) {
+    pthread_mutex_lock(&backend_file_sync_lock);
+    unsigned long change = ++backend_file_sync_requested;
+    pthread_mutex_unlock(&backend_file_sync_lock);
+    atomic_fetch_add_explicit(&backend_file_dir_waits, 1, memory_order_relaxed);
+    return change;
+}
+/**
+ * @brief Wait until a change of BACKEND_FILE_DIR, and every change numbered before it, is
+ * durable.
+ *
+ * Group commit: the first caller syncs the directory, the ones arriving meanwhile wait and are
+ * all covered by the next single sync, however many changes they made.
+ *
+ * @param first First change the caller made since it last waited, change if it made one.
+ * @param change Change number from backend_file_sync_request().
+ * @return int
+ *              - SERVER_OK if no error.
+ *              - SERVER_E_OS if a sync covering one of the changes failed.
+ */
+static int backend_file_sync_wait(unsigned long first, unsigned long change) {
+    pthread_mutex_lock(&backend_file_sync_lock);
+    while (backend_file_sync_covered < change) {
+        if (backend_file_sync_running) {
+            pthread_cond_wait(&backend_file_sync_done, &backend_file_sync_lock);
+            continue;
+        }
+
+        unsigned long from = backend_file_sync_covered;
+        unsigned long to = backend_file_sync_requested;
+        backend_file_sync_running = 1;
+        pthread_mutex_unlock(&backend_file_sync_lock);
+        int err = backend_file_fsync_dir(BACKEND_FILE_DIR);
+        pthread_mutex_lock(&backend_file_sync_lock);
+        backend_file_sync_running = 0;
+        backend_file_sync_covered = to;
+        if (err != SERVER_OK) {
+            backend_file_sync_fail_from = from;
+            backend_file_sync_fail_to = to;
+        }
+        pthread_cond_broadcast(&backend_file_sync_done);
+    }
+
+    int failed = change > backend_file_sync_fail_from && first <= backend_file_sync_fail_to;
+    pthread_mutex_unlock(&backend_file_sync_lock);
+    return failed ? SERVER_E_OS : SERVER_OK;
+}
+/**
+ * @brief Make the caller's last change of BACKEND_FILE_DIR durable.
+ *
+ * @return int
+ *              - SERVER_OK if no error.
+ *              - SERVER_E_OS if the sync covering the change failed.
+ */
+static int backend_file_sync_dir(void) {
+    unsigned long change = backend_file_sync_request();
+    return backend_file_sync_wait(change, change);
+}
+/**
+ * @brief Make a SET or DEL durable, or leave it to the commit of the caller's batch.
+ *
+ * @return int
+ *              - SERVER_OK if no error, or if the change waits for the batch commit.
+ *              - SERVER_E_OS if the sync covering the change failed.
+ */
+static int backend_file_sync_change(void) {
+    if (!backend_file_batching)
+        return backend_file_sync_dir();
+    // The sync covering the last change covers the earlier ones too.
+    backend_file_batch_last = backend_file_sync_request();
+    if (backend_file_batch_first == 0)
+        backend_file_batch_first = backend_file_batch_last;
+    return SERVER_OK;
+}
+
+/* === Public function implementation ========================================================== */
+
+static int backend_file_open(const dict_server_config_t * config) {
+    if (mkdir(BACKEND_FILE_DIR, 0755) < 0 && errno != EEXIST) {
+        LOG_ERROR("Can not create data directory [%s]", BACKEND_FILE_DIR);
+        return SERVER_E_OS;
+    }
+
+    if (config != NULL && config->migrate_keys)
+        backend_file_migrate();
+    backend_file_scan();
+
+    backend_file_sync = config != NULL && config->sync_writes;
+    if (config != NULL && config->write_back_ms > 0)
+        backend_file_buffered =
+            dict_writeback_start(config->write_back_ms, config->write_back_bytes,
+                                 backend_file_store,
+                                 backend_file_sync ? backend_file_sync_dir : NULL,
+                                 backend_file_exists) == 0;
+    backend_file_mapped =
+        config != NULL && config->mmap_cache_entries > 0 &&
+        dict_mapcache_start(config->mmap_cache_entries) == 0;
+    return SERVER_OK;
+}
+
+static int backend_file_flush(void) {
+    return dict_writeback_flush();
+}
+
+static void backend_file_close(void) {
+    dict_writeback_stop();
+    backend_file_buffered = 0;
+    dict_mapcache_stop();
+    backend_file_mapped = 0;
+}
+
+DICT_ENGINE_ENTRY int backend_file_get(const char * key, char * buffer, int buffer_size,
+                                       int * length) {
+    if (buffer == NULL || length == NULL)
+        return SERVER_E_NULL;
+
+    int fd;
+    int cnt;
+    int err = SERVER_OK;
+    char path[PATH_MAX];
+
+    err = backend_file_path(key, path, sizeof(path));
+    if (err != SERVER_OK)
+        return err;
+
+    if (backend_file_buffered) {
+        int state = dict_writeback_get(key, buffer, buffer_size, length);
+        if (state != 0)
+            return state > 0 ? SERVER_OK : SERVER_E_NOT_FOUND;
+    }
+
+    // A mapped value costs no file system call at all.
+    if (backend_file_mapped && dict_mapcache_get(key, buffer, buffer_size, length))
+        return SERVER_OK;
+    // Taken before the open, a write that replaces the file meanwhile keeps it out of the cache.
+    unsigned long generation = backend_file_mapped ? dict_mapcache_generation(key) : 0;
+
+    fd = open(path, O_RDONLY);
+    DICT_TRACE_SYSCALL(DICT_TRACE_OPEN);
+    if (fd < 0) {
+        LOG_ERROR("Can not open file [%s] to read key", key);
+        return SERVER_E_NOT_FOUND;
+    }
+
+    // Keys written a moment ago are likely written again, only settled ones are mapped.
+    struct stat st;
+    if (backend_file_mapped && fstat(fd, &st) == 0 &&
+        time(NULL) - st.st_mtime >= BACKEND_FILE_MAP_AGE_S &&
+        dict_mapcache_load(key, generation, fd, st.st_size, buffer, buffer_size, length)) {
+        LOG_INFO("Mapped %ld byte from [%s] file", (long)st.st_size, key);
+        goto finish;
+    }
+
+    cnt = read(fd, buffer, buffer_size);
+    DICT_TRACE_SYSCALL(DICT_TRACE_READ);
+    if (cnt < 0) {
+        err = SERVER_E_OS;
+        goto finish;
+    }
+    *length = cnt;
+
+    // Only a full buffer can mean a truncated value, ask for the real size.
+    if (cnt == buffer_size && fstat(fd, &st) == 0 && st.st_size > cnt)
+        *length = st.st_size;
+
+    LOG_INFO("Read %d byte from [%s] file", cnt, key);
+
+finish:
+    close(fd);
+    DICT_TRACE_SYSCALL(DICT_TRACE_CLOSE);
+    return err;
+}
+
+DICT_ENGINE_ENTRY int backend_file_put(const char * key, const char * value, int length) {
+    if (value == NULL)
+        return SERVER_E_NULL;
+
+    char path[PATH_MAX];
+    int err = backend_file_path(key, path, sizeof(path));
+    if (err != SERVER_OK)
+        return err;
+
+    if (backend_file_buffered && dict_writeback_put(key, value, length))
+        return SERVER_OK;
+    err = backend_file_write(path, value, length);
+    if (backend_file_mapped)
+        dict_mapcache_invalidate(key);
+    if (err == SERVER_OK && backend_file_sync)
+        err = backend_file_sync_change();
+    return err;
+}
+
+DICT_ENGINE_ENTRY int backend_file_del(const char * key) {
+    char path[PATH_MAX];
+    int err = backend_file_path(key, path, sizeof(path));
+    if (err != SERVER_OK)
+        return err;
+
+    if (backend_file_buffered) {
+        // The reply needs to know whether the key existed, buffered or on disk.
+        struct stat st;
+        int state = dict_writeback_get(key, NULL, 0, NULL);
+        if (state < 0 || (state == 0 && stat(path, &st) < 0))
+            return SERVER_E_NOT_FOUND;
+        if (dict_writeback_put(key, NULL, 0))
+            return SERVER_OK;
+    }
+    err = backend_file_remove(path);
+    if (backend_file_mapped)
+        dict_mapcache_invalidate(key);
+    if (err == SERVER_OK && backend_file_sync)
+        err = backend_file_sync_change();
+    return err;
+}
+
+static int backend_file_count(size_t * count) {
+    if (count == NULL)
+        return SERVER_E_NULL;
+
+    // Buffered writes count as the keys they will create or delete, nothing is flushed.
+    long files = atomic_load(&backend_file_key_count);
+    if (backend_file_buffered)
+        files += dict_writeback_gain();
+    *count = files > 0 ? files : 0;
+    return SERVER_OK;
+}
+
+static int backend_file_clear(void) {
+    char trash[PATH_MAX];
+    snprintf(trash, sizeof(trash), "%s%d.%lu", BACKEND_FILE_TRASH, getpid(),
+             atomic_fetch_add(&backend_file_clears, 1));
+    char * path = strdup(trash);
+    if (path == NULL)
+        return SERVER_E_OS;
+
+    if (backend_file_buffered)
+        dict_writeback_discard();
+
+    // Exchanging with an empty directory swaps the whole keyspace in one step. Without
+    // RENAME_EXCHANGE requests see no directory for a moment and fail.
+    if (mkdir(trash, 0755) < 0) {
+        free(path);
+        return SERVER_E_OS;
+    }
+    if (renameat2(AT_FDCWD, trash, AT_FDCWD, BACKEND_FILE_DIR, RENAME_EXCHANGE) < 0 &&
+        (rmdir(trash) < 0 || rename(BACKEND_FILE_DIR, trash) < 0 ||
+         mkdir(BACKEND_FILE_DIR, 0755) < 0)) {
+        LOG_ERROR("Can not retire data directory [%s]", BACKEND_FILE_DIR);
+        free(path);
+        return SERVER_E_OS;
+    }
+    atomic_store(&backend_file_key_count, 0);
+    if (backend_file_mapped)
+        dict_mapcache_clear();
+
+    dict_reclaim_call(backend_file_release_dir, path, 0);
+    return backend_file_sync ? backend_file_fsync_dir(".") : SERVER_OK;
+}
+
+static int backend_file_iterate(dict_backend_key_visit visit, void * context) {
+    if (visit == NULL)
+        return SERVER_E_NULL;
+
+    // Buffered writes are keys too, put them where the walk sees them. The flush writes the
+    // whole buffer on this thread, a KEYS costs that on top of its directory walk.
+    if (backend_file_buffered)
+        dict_writeback_flush();
+
+    DIR * dir = opendir(BACKEND_FILE_DIR);
+    if (dir == NULL)
+        return SERVER_E_OS;
+
+    struct dirent * entry;
+    while ((entry = readdir(dir)) != NULL) {
+        // Hidden names are backend internal files, not keys.
+        if (entry->d_name[0] == '.')
+            continue;
+        if (entry->d_type != DT_REG && entry->d_type != DT_UNKNOWN)
+            continue;
+        if (visit(entry->d_name, context))
+            break;
+    }
+
+    closedir(dir);
+    return SERVER_OK;
+}
+
+static int backend_file_stats(char * buffer, int buffer_size) {
+    // Directory changes per sync show how well the group commit batches.
+    int length = snprintf(buffer, buffer_size,
+                          "backend:file\nbackend_persistent:1\n"
+                          "backend_dir:%s\nbackend_sync:%d\nbackend_file_syncs:%lu\n"
+                          "backend_dir_syncs:%lu\nbackend_dir_sync_changes:%lu\n",
+                          BACKEND_FILE_DIR, backend_file_sync, atomic_load(&backend_file_file_syncs),
+                          atomic_load(&backend_file_dir_syncs),
+                          atomic_load(&backend_file_dir_waits));
+    if (length < buffer_size)
+        length += dict_writeback_stats(buffer + length, buffer_size - length);
+    if (length < buffer_size)
+        length += dict_mapcache_stats(buffer + length, buffer_size - length);
+    return length;
+}
+
+static int backend_file_defrag(int budget_us) {
+    // Values live in files, there is no process memory to compact.
+    return 0;
+}
+
+static int backend_file_memory(dict_backend_memory_t * memory) {
+    if (memory == NULL)
+        return SERVER_E_NULL;
+
+    // Keys and values live on disk and in the kernel page cache, the mapped ones are also in the
+    // process address space. Writes still in the write back buffer are reported by its own
+    // statistics.
+    memset(memory, 0, sizeof(*memory));
+    memory->cache_bytes = dict_mapcache_bytes();
+    return SERVER_OK;
+}
+
+DICT_ENGINE_ENTRY int backend_file_usage(const char * key, size_t * bytes) {
+    if (bytes == NULL)
+        return SERVER_E_NULL;
+
+    char path[PATH_MAX];
+    int err = backend_file_path(key, path, sizeof(path));
+    if (err != SERVER_OK)
+        return err;
+
+    // A buffered value costs its length in process memory until flushed.
+    int length;
+    int state = backend_file_buffered ? dict_writeback_get(key, NULL, 0, &length) : 0;
+    if (state != 0) {
+        *bytes = state > 0 ? (size_t)length : 0;
+        return state > 0 ? SERVER_OK : SERVER_E_NOT_FOUND;
+    }
+
+    // Blocks taken on disk, what the value costs in the page cache once read.
+    struct stat st;
+    if (stat(path, &st) < 0)
+        return SERVER_E_NOT_FOUND;
+    *bytes = (size_t)st.st_blocks * 512;
+    return SERVER_OK;
+}
+
+DICT_ENGINE_ENTRY int backend_file_prefetch(const char * key) {
+    char path[PATH_MAX];
+    int err = backend_file_path(key, path, sizeof(path));
+    if (err != SERVER_OK)
+        return err;
+
+    // A buffered value is already in memory, and its file may not exist yet.
+    int length;
+    if (backend_file_buffered && dict_writeback_get(key, NULL, 0, &length) != 0)
+        return SERVER_OK;
+
+    // The lookup warms the dentry and inode caches, the advice queues the data reads.
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return SERVER_E_NOT_FOUND;
+    err = posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED) == 0 ? SERVER_OK : SERVER_E_OS;
+    close(fd);
+    return err;
+}
+
+static int backend_file_batch_begin(void) {
+    // Only the directory sync of durable writes is worth deferring.
+    backend_file_batching = backend_file_sync;
+    return backend_file_batching;
+}
+
+static int backend_file_batch_commit(void) {
+    backend_file_batching = 0;
+    if (backend_file_batch_first == 0)
+        return SERVER_OK;
+    int err = backend_file_sync_wait(backend_file_batch_first, backend_file_batch_last);
+    backend_file_batch_first = 0;
+    return err;
+}
+
+#endif /* DICT_CONFIG_ENGINE_FILE */
+
+/* === End of documentation ==================================================================== */
@@ -0,0 +1,1172 @@
+/************************************************************************************************
+Copyright (c) 2024, Guido Ramirez <guidoramirez7@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute,
+sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial
+portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+SPDX-License-Identifier: MIT
+*************************************************************************************************/
+
+/** @file dict_backend_log.c
+ ** @brief Durable log structured storage backend.
+ **
+ ** Keys are spread over BACKEND_LOG_SHARDS shards. Every shard is an append only log file of
+ ** checksummed records plus an in memory index from key to value offset, so GET is one pread().
+ ** SET and DEL append a record, DEL a tombstone, under the shard's write lock only.
+ **
+ ** Recovery replays the shard logs on a pool of threads, each rebuilding the index of the shards
+ ** it takes. The server starts serving as soon as init returns: shards already recovered answer
+ ** at once, the others reply SERVER_E_BUSY until their log is replayed. A record cut short or
+ ** failing its checksum marks the end of a log, anything after it is truncated.
+ **
+ ** Overwritten values and tombstones stay in the log until dict_backend_defrag() compacts a
+ ** shard whose log is mostly garbage. The compaction walks the old log a time budget at a time
+ ** under the shard's read lock, copying the records still needed to a new log. Only the last
+ ** step holds the write lock, to copy what was appended meanwhile and rename the new log over
+ ** the old one.
+ **/
+
+/* === Headers files inclusions =============================================================== */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+#include "dict_engine.h"
+#include "dict_log.h"
+#include "dict_reclaim.h"
+#include "dict_trace.h"
+
+#if DICT_CONFIG_ENGINE_LOG
+
+/* === Macros definitions ====================================================================== */
+
+#define BACKEND_LOG_DIR           "log" /**< Directory of the shard logs */
+#define BACKEND_LOG_SHARDS        (16)  /**< Shards, a power of two */
+#define BACKEND_LOG_BUCKETS       (256) /**< Initial buckets of a shard index, a power of two */
+#define BACKEND_LOG_MAX_KEY       (4096)      /**< Longest key accepted, larger means corruption */
+#define BACKEND_LOG_MAX_VALUE     (1U << 30)  /**< Largest value accepted, same */
+#define BACKEND_LOG_TOMBSTONE     UINT32_MAX  /**< Value length of a DEL record */
+#define BACKEND_LOG_COMPACT_BYTES (1024 * 1024) /**< Garbage bytes before a shard is compacted */
+#define BACKEND_LOG_COMPACT_PCT   (50)        /**< Same, as a share of the log */
+#define BACKEND_LOG_COMPACT_CHECK (64)        /**< Records walked between clock reads */
+
+/* === Private data type declarations ========================================================== */
+
+/** Record header, followed by the key and the value bytes. Native endian. */
+typedef struct {
+    uint32_t crc;       /**< CRC-32C of the lengths, the key and the value */
+    uint32_t key_len;   /**< Key length */
+    uint32_t value_len; /**< Value length, BACKEND_LOG_TOMBSTONE for a DEL */
+} backend_log_header_t;
+
+typedef struct backend_log_entry {
+    struct backend_log_entry * next; /**< Next entry in the same bucket */
+    uint32_t hash;                   /**< Key hash */
+    uint32_t value_len;              /**< Value length */
+    off_t offset;                    /**< Value offset in the shard log */
+    off_t compact_offset;            /**< Value offset in the log being compacted into */
+    char key[];                      /**< Null terminated key */
+} backend_log_entry_t;
+
+typedef struct {
+    pthread_rwlock_t lock;            /**< Writers append, readers pread() */
+    atomic_int ready;                 /**< The log has been replayed */
+    int fd;                           /**< Shard log, opened for appending */
+    off_t size;                       /**< Log bytes */
+    off_t live;                       /**< Log bytes of the records the index points to */
+    backend_log_entry_t ** buckets;   /**< Chained buckets */
+    size_t bucket_count;              /**< Number of buckets */
+    size_t count;                     /**< Number of keys */
+    size_t key_bytes;                 /**< Key names, terminators included */
+    unsigned long records;            /**< Records replayed by the recovery */
+    off_t truncated;                  /**< Bytes cut from the log end by the recovery */
+    unsigned long generation;         /**< Changes when the log is replaced */
+} backend_log_shard_t;
+
+typedef struct {
+    int active;               /**< A shard is being compacted */
+    int index;                /**< Shard being compacted */
+    int fd;                   /**< New log, not in place yet */
+    off_t size;               /**< Bytes written to the new log */
+    off_t scanned;            /**< Bytes of the old log walked */
+    off_t start;              /**< Old log size when the compaction started */
+    unsigned long generation; /**< Shard generation when the compaction started */
+    char * buffer;            /**< Record being copied */
+    size_t buffer_size;       /**< Buffer's size */
+} backend_log_compaction_t;
+
+typedef struct {
+    backend_log_entry_t ** buckets; /**< Index retired by dict_backend_clear() */
+    size_t bucket_count;            /**< Number of buckets */
+} backend_log_retired_t;
+
+/* === Private variable declarations =========================================================== */
+
+/* === Private function declarations =========================================================== */
+
+static uint64_t backend_log_now_ns(void);
+
+static uint32_t backend_log_hash(const char * key, size_t length);
+
+static uint32_t backend_log_crc(uint32_t crc, const void * data, size_t length);
+
+static uint32_t backend_log_record_crc(const backend_log_header_t * header, const char * key,
+                                       const char * value);
+
+static backend_log_shard_t * backend_log_shard(uint32_t hash);
+
+static void backend_log_path(int index, const char * suffix, char * path, size_t path_size);
+
+static backend_log_entry_t ** backend_log_find(backend_log_shard_t * shard, const char * key,
+                                               uint32_t hash);
+
+static int backend_log_grow(backend_log_shard_t * shard);
+
+static int backend_log_index(backend_log_shard_t * shard, const char * key, size_t key_len,
+                             uint32_t hash, uint32_t value_len, off_t offset);
+
+static int backend_log_unindex(backend_log_shard_t * shard, const char * key, uint32_t hash);
+
+static off_t backend_log_append(backend_log_shard_t * shard, const char * key, size_t key_len,
+                                const char * value, uint32_t value_len);
+
+static void backend_log_replay(int index);
+
+static void * backend_log_recover(void * arg);
+
+static int backend_log_fsync_dir(void);
+
+static int backend_log_compact_begin(int index);
+
+static void backend_log_compact_abort(void);
+
+static int backend_log_compact_record(backend_log_shard_t * shard);
+
+static void backend_log_compact_finish(void);
+
+static int backend_log_compact_step(uint64_t deadline);
+
+static int backend_log_compactable(const backend_log_shard_t * shard);
+
+static void backend_log_release(void * arg);
+
+static int backend_log_open(const dict_server_config_t * config);
+
+static void backend_log_close(void);
+
+DICT_ENGINE_ENTRY int backend_log_get(const char * key, char * buffer, int buffer_size,
+                                      int * length);
+
+DICT_ENGINE_ENTRY int backend_log_put(const char * key, const char * value, int length);
+
+DICT_ENGINE_ENTRY int backend_log_del(const char * key);
+
+static int backend_log_iterate(dict_backend_key_visit visit, void * context);
+
+static int backend_log_stats(char * buffer, int buffer_size);
+
+static int backend_log_flush(void);
+
+static int backend_log_count(size_t * count);
+
+static int backend_log_clear(void);
+
+static int backend_log_defrag(int budget_us);
+
+static int backend_log_memory(dict_backend_memory_t * memory);
+
+DICT_ENGINE_ENTRY int backend_log_usage(const char * key, size_t * bytes);
+
+DICT_ENGINE_ENTRY int backend_log_prefetch(const char * key);
+
+/* === Public variable definitions ============================================================= */
+
+const dict_engine_t dict_engine_log = {
+    .name = "log",
+    .key_max = BACKEND_LOG_MAX_KEY,
+    .open = backend_log_open,
+    .close = backend_log_close,
+    .get = backend_log_get,
+    .put = backend_log_put,
+    .del = backend_log_del,
+    .iterate = backend_log_iterate,
+    .stats = backend_log_stats,
+    .flush = backend_log_flush,
+    .count = backend_log_count,
+    .clear = backend_log_clear,
+    .defrag = backend_log_defrag,
+    .memory = backend_log_memory,
+    .usage = backend_log_usage,
+    .prefetch = backend_log_prefetch,
+};
+
+/* === Private variable definitions ============================================================ */
+
+static backend_log_shard_t backend_log_shards[BACKEND_LOG_SHARDS];
+static uint32_t backend_log_crc_table[256]; /**< CRC-32C lookup table */
+static int backend_log_sync;                /**< fdatasync() every record before acknowledging */
+
+static pthread_t * backend_log_threads;  /**< Recovery threads */
+static int backend_log_thread_count;     /**< Number of recovery threads */
+static atomic_int backend_log_next;      /**< Next shard a recovery thread takes */
+static atomic_int backend_log_pending;   /**< Shards not replayed yet */
+static uint64_t backend_log_start_ns;    /**< When the recovery started */
+static atomic_ulong backend_log_first_ns; /**< Recovery time of the first shard served */
+static atomic_ulong backend_log_done_ns; /**< Recovery time of the whole store */
+
+static int backend_log_compact_cursor;           /**< Next shard checked for compaction */
+static backend_log_compaction_t backend_log_compaction; /**< Compaction in progress, if any */
+static unsigned long backend_log_compactions;    /**< Shards compacted */
+static unsigned long backend_log_compacted_bytes; /**< Garbage bytes removed by compaction */
+
+/* === Private function implementation ========================================================= */
+/**
+ * @brief Monotonic clock.
+ *
+ * @return uint64_t Nanoseconds.
+ */
+static uint64_t backend_log_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+/**
+ * @brief FNV-1a hash of a key. The low bits pick the shard, the rest the bucket.
+ *
+ * @param key Key bytes.
+ * @param length Key length.
+ * @return uint32_t Hash.
+ */
+static uint32_t backend_log_hash(const char * key, size_t length) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++)
+        hash = (hash ^ (unsigned char)key[i]) * 16777619u;
+    return hash;
+}
+/**
+ * @brief Continue a CRC-32C.
+ *
+ * @param crc CRC so far, 0 to start.
+ * @param data Bytes to add.
+ * @param length Number of bytes.
+ * @return uint32_t Updated CRC.
+ */
+static uint32_t backend_log_crc(uint32_t crc, const void * data, size_t length) {
+    const unsigned char * bytes = data;
+    crc = ~crc;
+    for (size_t i = 0; i < length; i++)
+        crc = backend_log_crc_table[(crc ^ bytes[i]) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+/**
+ * @brief Checksum of a record.
+ *
+ * @param header Record header, its crc field is not covered.
+ * @param key Key bytes.
+ * @param value Value bytes, unused for a tombstone.
+ * @return uint32_t CRC-32C.
+ */
+static uint32_t backend_log_record_crc(const backend_log_header_t * header, const char * key,
+                                       const char * value) {
+    uint32_t crc = backend_log_crc(0, &header->key_len, 2 * sizeof(uint32_t));
+    crc = backend_log_crc(crc, key, header->key_len);
+    if (header->value_len != BACKEND_LOG_TOMBSTONE)
+        crc = backend_log_crc(crc, value, header->value_len);
+    return crc;
+}
+/**
+ * @brief Shard a key belongs to.
+ *
+ * @param hash Key hash.
+ * @return backend_log_shard_t* Shard.
+ */
+static backend_log_shard_t * backend_log_shard(uint32_t hash) {
+    return &backend_log_shards[hash & (BACKEND_LOG_SHARDS - 1)];
+}
+/**
+ * @brief Build the path of a shard log.
+ *
+ * @param index Shard index.
+ * @param suffix Appended to the name, "" for the log itself.
+ * @param path Buffer where the path will be stored.
+ * @param path_size Path buffer's size.
+ */
+static void backend_log_path(int index, const char * suffix, char * path, size_t path_size) {
+    snprintf(path, path_size, "%s/shard.%02d.log%s", BACKEND_LOG_DIR, index, suffix);
+}
+/**
+ * @brief Find the link pointing to a key. The shard lock must be held.
+ *
+ * @param shard Shard.
+ * @param key Key name.
+ * @param hash Key hash.
+ * @return backend_log_entry_t** Link to the entry, it points to NULL if the key is missing.
+ */
+static backend_log_entry_t ** backend_log_find(backend_log_shard_t * shard, const char * key,
+                                               uint32_t hash) {
+    backend_log_entry_t ** link =
+        &shard->buckets[(hash / BACKEND_LOG_SHARDS) & (shard->bucket_count - 1)];
+    while (*link != NULL && ((*link)->hash != hash || strcmp((*link)->key, key) != 0))
+        link = &(*link)->next;
+    return link;
+}
+/**
+ * @brief Double the buckets of a shard index. The write lock must be held.
+ *
+ * @param shard Shard.
+ * @return int 0 if no error, -1 if out of memory.
+ */
+static int backend_log_grow(backend_log_shard_t * shard) {
+    size_t count = shard->bucket_count * 2;
+    backend_log_entry_t ** buckets = calloc(count, sizeof(*buckets));
+    if (buckets == NULL)
+        return -1;
+
+    for (size_t i = 0; i < shard->bucket_count; i++) {
+        backend_log_entry_t * entry = shard->buckets[i];
+        while (entry != NULL) {
+            backend_log_entry_t * next = entry->next;
+            size_t bucket = (entry->hash / BACKEND_LOG_SHARDS) & (count - 1);
+            entry->next = buckets[bucket];
+            buckets[bucket] = entry;
+            entry = next;
+        }
+    }
+    free(shard->buckets);
+    shard->buckets = buckets;
+    shard->bucket_count = count;
+    return 0;
+}
+/**
+ * @brief Point a key at a value in the log. The write lock must be held.
+ *
+ * @param shard Shard.
+ * @param key Key name, null terminated.
+ * @param key_len Key length.
+ * @param hash Key hash.
+ * @param value_len Value length.
+ * @param offset Value offset in the log.
+ * @return int 0 if no error, -1 if out of memory.
+ */
+static int backend_log_index(backend_log_shard_t * shard, const char * key, size_t key_len,
+                             uint32_t hash, uint32_t value_len, off_t offset) {
+    backend_log_entry_t ** link = backend_log_find(shard, key, hash);
+    backend_log_entry_t * entry = *link;
+    if (entry != NULL) {
+        shard->live -= sizeof(backend_log_header_t) + key_len + entry->value_len;
+    } else {
+        entry = malloc(sizeof(*entry) + key_len + 1);
+        if (entry == NULL)
+            return -1;
+        memcpy(entry->key, key, key_len + 1);
+        entry->hash = hash;
+        entry->next = NULL;
+        *link = entry;
+        shard->count++;
+        shard->key_bytes += key_len + 1;
+        if (shard->count > shard->bucket_count)
+            backend_log_grow(shard);
+    }
+    entry->value_len = value_len;
+    entry->offset = offset;
+    shard->live += sizeof(backend_log_header_t) + key_len + value_len;
+    return 0;
+}
+/**
+ * @brief Remove a key from the index. The write lock must be held.
+ *
+ * @param shard Shard.
+ * @param key Key name.
+ * @param hash Key hash.
+ * @return int 1 if the key was indexed, 0 otherwise.
+ */
+static int backend_log_unindex(backend_log_shard_t * shard, const char * key, uint32_t hash) {
+    backend_log_entry_t ** link = backend_log_find(shard, key, hash);
+    backend_log_entry_t * entry = *link;
+    if (entry == NULL)
+        return 0;
+
+    size_t key_len = strlen(entry->key);
+    *link = entry->next;
+    shard->count--;
+    shard->key_bytes -= key_len + 1;
+    shard->live -= sizeof(backend_log_header_t) + key_len + entry->value_len;
+    free(entry);
+    return 1;
+}
+/**
+ * @brief Append a record to a shard log. The write lock must be held.
+ *
+ * A failed or short write is cut off again, so the log never holds a partial record that later
+ * records would hide from the recovery.
+ *
+ * @param shard Shard.
+ * @param key Key bytes.
+ * @param key_len Key length.
+ * @param value Value bytes, NULL for a tombstone.
+ * @param value_len Value length.
+ * @return off_t Offset of the value in the log, -1 on error.
+ */
+static off_t backend_log_append(backend_log_shard_t * shard, const char * key, size_t key_len,
+                                const char * value, uint32_t value_len) {
+    backend_log_header_t header = {
+        .key_len = key_len,
+        .value_len = value != NULL ? value_len : BACKEND_LOG_TOMBSTONE,
+    };
+    header.crc = backend_log_record_crc(&header, key, value);
+
+    struct iovec iov[3] = {
+        {.iov_base = &header, .iov_len = sizeof(header)},
+        {.iov_base = (void *)key, .iov_len = key_len},
+        {.iov_base = (void *)value, .iov_len = value != NULL ? value_len : 0},
+    };
+    size_t total = iov[0].iov_len + iov[1].iov_len + iov[2].iov_len;
+    ssize_t written = writev(shard->fd, iov, 3);
+    DICT_TRACE_SYSCALL(DICT_TRACE_WRITE);
+    if (written != (ssize_t)total || (backend_log_sync && fdatasync(shard->fd) < 0)) {
+        LOG_ERROR("Log : Can not append to shard, cutting it back");
+        if (ftruncate(shard->fd, shard->size) < 0)
+            LOG_ERROR("Log : Can not cut shard back, the recovery will");
+        return -1;
+    }
+
+    off_t offset = shard->size + sizeof(header) + key_len;
+    shard->size += total;
+    return offset;
+}
+/**
+ * @brief Rebuild the index of a shard from its log, cutting off a damaged end.
+ *
+ * @param index Shard index.
+ */
+static void backend_log_replay(int index) {
+    backend_log_shard_t * shard = &backend_log_shards[index];
+    char path[PATH_MAX];
+    char key[BACKEND_LOG_MAX_KEY + 1];
+
+    backend_log_path(index, "", path, sizeof(path));
+    shard->fd = open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    struct stat st;
+    if (shard->fd < 0 || fstat(shard->fd, &st) < 0) {
+        LOG_ERROR("Log : Can not open shard [%s]", path);
+        exit(EXIT_FAILURE);
+    }
+
+    const char * log = NULL;
+    if (st.st_size > 0) {
+        log = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, shard->fd, 0);
+        if (log == MAP_FAILED) {
+            LOG_ERROR("Log : Can not map shard [%s]", path);
+            exit(EXIT_FAILURE);
+        }
+        madvise((void *)log, st.st_size, MADV_SEQUENTIAL);
+    }
+
+    off_t offset = 0;
+    pthread_rwlock_wrlock(&shard->lock);
+    while (offset + (off_t)sizeof(backend_log_header_t) <= st.st_size) {
+        backend_log_header_t header;
+        memcpy(&header, log + offset, sizeof(header));
+        int tombstone = header.value_len == BACKEND_LOG_TOMBSTONE;
+        if (header.key_len == 0 || header.key_len > BACKEND_LOG_MAX_KEY ||
+            (!tombstone && header.value_len > BACKEND_LOG_MAX_VALUE))
+            break;
+
+        off_t length = sizeof(header) + header.key_len + (tombstone ? 0 : header.value_len);
+        const char * record_key = log + offset + sizeof(header);
+        if (offset + length > st.st_size ||
+            backend_log_record_crc(&header, record_key, record_key + header.key_len) != header.crc)
+            break;
+
+        memcpy(key, record_key, header.key_len);
+        key[header.key_len] = '\0';
+        uint32_t hash = backend_log_hash(key, header.key_len);
+        if (tombstone) {
+            backend_log_unindex(shard, key, hash);
+        } else if (backend_log_index(shard, key, header.key_len, hash, header.value_len,
+                                     offset + sizeof(header) + header.key_len) < 0) {
+            LOG_ERROR("Log : Out of memory replaying shard [%s]", path);
+            exit(EXIT_FAILURE);
+        }
+        shard->records++;
+        offset += length;
+    }
+
+    // A crash mid append leaves a partial record, new records must not land behind it.
+    if (offset < st.st_size) {
+        shard->truncated = st.st_size - offset;
+        LOG_ERROR("Log : Shard [%s] damaged at %ld, dropping %ld bytes", path, (long)offset,
+                  (long)shard->truncated);
+        if (ftruncate(shard->fd, offset) < 0) {
+            LOG_ERROR("Log : Can not truncate shard [%s]", path);
+            exit(EXIT_FAILURE);
+        }
+    }
+    shard->size = offset;
+    pthread_rwlock_unlock(&shard->lock);
+
+    if (log != NULL)
+        munmap((void *)log, st.st_size);
+}
+/**
+ * @brief Recovery thread. Replays shards until none is left.
+ *
+ * @param arg Not used.
+ * @return void* Always NULL.
+ */
+static void * backend_log_recover(void * arg) {
+    int index;
+    while ((index = atomic_fetch_add(&backend_log_next, 1)) < BACKEND_LOG_SHARDS) {
+        backend_log_replay(index);
+        atomic_store(&backend_log_shards[index].ready, 1);
+
+        uint64_t elapsed = backend_log_now_ns() - backend_log_start_ns;
+        unsigned long none = 0;
+        atomic_compare_exchange_strong(&backend_log_first_ns, &none, elapsed);
+        if (atomic_fetch_sub(&backend_log_pending, 1) == 1) {
+            atomic_store(&backend_log_done_ns, elapsed);
+            LOG_INFO("Log : Recovered %d shards in %lu ms with %d threads", BACKEND_LOG_SHARDS,
+                     (unsigned long)(elapsed / 1000000), backend_log_thread_count);
+        }
+    }
+    return NULL;
+}
+/**
+ * @brief Check if a shard log is mostly garbage. The shard lock must be held.
+ *
+ * @param shard Shard.
+ * @return int 1 if the shard should be compacted.
+ */
+static int backend_log_compactable(const backend_log_shard_t * shard) {
+    off_t garbage = shard->size - shard->live;
+    return atomic_load(&shard->ready) && garbage >= BACKEND_LOG_COMPACT_BYTES &&
+           garbage * 100 >= shard->size * BACKEND_LOG_COMPACT_PCT;
+}
+/**
+ * @brief fsync() the log directory, so a rename done in it is durable.
+ *
+ * @return int 0 if no error, -1 otherwise.
+ */
+static int backend_log_fsync_dir(void) {
+    int fd = open(BACKEND_LOG_DIR, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    int rt = fsync(fd);
+    close(fd);
+    return rt;
+}
+/**
+ * @brief Start compacting a shard: create the new log next to the old one.
+ *
+ * @param index Shard index.
+ * @return int
+ *              - SERVER_OK if no error.
+ *              - SERVER_E_OS if the new log can not be created.
+ */
+static int backend_log_compact_begin(int index) {
+    backend_log_compaction_t * job = &backend_log_compaction;
+    backend_log_shard_t * shard = &backend_log_shards[index];
+    char temp[PATH_MAX];
+
+    backend_log_path(index, ".compact", temp, sizeof(temp));
+    int fd = open(temp, O_RDWR | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        LOG_ERROR("Log : Can not create [%s]", temp);
+        return SERVER_E_OS;
+    }
+
+    pthread_rwlock_rdlock(&shard->lock);
+    job->start = shard->size;
+    job->generation = shard->generation;
+    pthread_rwlock_unlock(&shard->lock);
+    job->active = 1;
+    job->index = index;
+    job->fd = fd;
+    job->size = 0;
+    job->scanned = 0;
+    return SERVER_OK;
+}
+/**
+ * @brief Give up the running compaction, the shard keeps its old log.
+ */
+static void backend_log_compact_abort(void) {
+    backend_log_compaction_t * job = &backend_log_compaction;
+    char temp[PATH_MAX];
+
+    backend_log_path(job->index, ".compact", temp, sizeof(temp));
+    close(job->fd);
+    unlink(temp);
+    free(job->buffer);
+    job->buffer = NULL;
+    job->buffer_size = 0;
+    job->fd = -1;
+    job->active = 0;
+}
+/**
+ * @brief Walk the next record of the old log and copy it to the new one if it still matters.
+ *
+ * A value is copied while the index points to it, and the entry remembers where the copy is.
+ * A tombstone is dropped if it is older than the compaction, no copied record precedes it.
+ * Newer ones are copied, they may delete a key copied before. The shard lock must be held.
+ *
+ * @param shard Shard being compacted.
+ * @return int
+ *              - SERVER_OK if no error.
+ *              - SERVER_E_OS if a record can not be read or written.
+ */
+static int backend_log_compact_record(backend_log_shard_t * shard) {
+    backend_log_compaction_t * job = &backend_log_compaction;
+    backend_log_header_t header;
+
+    if (pread(shard->fd, &header, sizeof(header), job->scanned) != sizeof(header) ||
+        header.key_len == 0 || header.key_len > BACKEND_LOG_MAX_KEY ||
+        (header.value_len != BACKEND_LOG_TOMBSTONE && header.value_len > BACKEND_LOG_MAX_VALUE))
+        return SERVER_E_OS;
+    int tombstone = header.value_len == BACKEND_LOG_TOMBSTONE;
+    size_t value_len = tombstone ? 0 : header.value_len;
+    off_t value_offset = job->scanned + sizeof(header) + header.key_len;
+
+    size_t need = header.key_len + 1 + value_len;
+    if (need > job->buffer_size) {
+        char * grown = realloc(job->buffer, need);
+        if (grown == NULL)
+            return SERVER_E_OS;
+        job->buffer = grown;
+        job->buffer_size = need;
+    }
+    char * key = job->buffer;
+    if (pread(shard->fd, key, header.key_len, job->scanned + sizeof(header)) !=
+        (ssize_t)header.key_len)
+        return SERVER_E_OS;
+    key[header.key_len] = 0;
+
+    backend_log_shard_t compact = {.fd = job->fd, .size = job->size};
+    if (tombstone) {
+        if (job->scanned >= job->start &&
+            backend_log_append(&compact, key, header.key_len, NULL, 0) < 0)
+            return SERVER_E_OS;
+    } else {
+        uint32_t hash = backend_log_hash(key, header.key_len);
+        backend_log_entry_t * entry = *backend_log_find(shard, key, hash);
+        if (entry != NULL && entry->offset == value_offset) {
+            char * value = key + header.key_len + 1;
+            off_t offset;
+            if (pread(shard->fd, value, value_len, value_offset) != (ssize_t)value_len ||
+                (offset = backend_log_append(&compact, key, header.key_len, value, value_len)) < 0)
+                return SERVER_E_OS;
+            entry->compact_offset = offset;
+        }
+    }
+    job->size = compact.size;
+    job->scanned = value_offset + value_len;
+    return SERVER_OK;
+}
+/**
+ * @brief Put the new log of the running compaction in place.
+ *
+ * The records copied so far reach storage before the writers are held. Under the write lock
+ * only the records appended since the last step are copied, then the new log is renamed over
+ * the old one and the index switched to it, so a crash leaves one of the two complete.
+ */
+static void backend_log_compact_finish(void) {
+    backend_log_compaction_t * job = &backend_log_compaction;
+    backend_log_shard_t * shard = &backend_log_shards[job->index];
+    char path[PATH_MAX];
+    char temp[PATH_MAX];
+    int err = SERVER_OK;
+
+    backend_log_path(job->index, "", path, sizeof(path));
+    backend_log_path(job->index, ".compact", temp, sizeof(temp));
+    if (fdatasync(job->fd) < 0) {
+        LOG_ERROR("Log : Can not compact shard [%s]", path);
+        backend_log_compact_abort();
+        return;
+    }
+
+    pthread_rwlock_wrlock(&shard->lock);
+    if (shard->generation != job->generation) {
+        // Cleared meanwhile, the new log is stale.
+        pthread_rwlock_unlock(&shard->lock);
+        backend_log_compact_abort();
+        return;
+    }
+    while (job->scanned < shard->size && err == SERVER_OK)
+        err = backend_log_compact_record(shard);
+    if (err == SERVER_OK && (fdatasync(job->fd) < 0 || rename(temp, path) < 0))
+        err = SERVER_E_OS;
+    if (err != SERVER_OK) {
+        pthread_rwlock_unlock(&shard->lock);
+        LOG_ERROR("Log : Can not compact shard [%s]", path);
+        backend_log_compact_abort();
+        return;
+    }
+    if (backend_log_fsync_dir() < 0)
+        LOG_ERROR("Log : Can not sync [%s], the old log may come back after a crash", path);
+
+    for (size_t i = 0; i < shard->bucket_count; i++) {
+        for (backend_log_entry_t * entry = shard->buckets[i]; entry != NULL; entry = entry->next)
+            entry->offset = entry->compact_offset;
+    }
+
+    // The old log lost its name, its blocks are released in the background.
+    dict_reclaim_file(shard->fd, shard->size);
+    backend_log_compacted_bytes += shard->size - job->size;
+    backend_log_compactions++;
+    shard->fd = job->fd;
+    shard->size = job->size;
+    shard->generation++;
+    pthread_rwlock_unlock(&shard->lock);
+
+    free(job->buffer);
+    job->buffer = NULL;
+    job->buffer_size = 0;
+    job->fd = -1;
+    job->active = 0;
+}
+/**
+ * @brief Copy records of the running compaction until a deadline, and finish it once the old
+ * log was walked to its end.
+ *
+ * Each step holds the shard's read lock only: GETs go on, writers wait for one step at most.
+ * Records appended between steps are walked by the next ones.
+ *
+ * @param deadline backend_log_now_ns() time to stop at.
+ * @return int 1 if the compaction goes on, 0 if it ended.
+ */
+static int backend_log_compact_step(uint64_t deadline) {
+    backend_log_compaction_t * job = &backend_log_compaction;
+    backend_log_shard_t * shard = &backend_log_shards[job->index];
+    int err = SERVER_OK;
+
+    pthread_rwlock_rdlock(&shard->lock);
+    if (shard->generation != job->generation) {
+        pthread_rwlock_unlock(&shard->lock);
+        backend_log_compact_abort();
+        return 0;
+    }
+    for (int walked = 1; job->scanned < shard->size && err == SERVER_OK; walked++) {
+        err = backend_log_compact_record(shard);
+        if (walked % BACKEND_LOG_COMPACT_CHECK == 0 && backend_log_now_ns() >= deadline)
+            break;
+    }
+    int walked_all = job->scanned >= shard->size;
+    pthread_rwlock_unlock(&shard->lock);
+
+    if (err != SERVER_OK) {
+        LOG_ERROR("Log : Can not compact shard %d", job->index);
+        backend_log_compact_abort();
+        return 0;
+    }
+    if (!walked_all)
+        return 1;
+    backend_log_compact_finish();
+    return 0;
+}
+/**
+ * @brief Release an index retired by dict_backend_clear(). Runs on the reclamation thread.
+ *
+ * @param arg Retired index, backend_log_retired_t.
+ */
+static void backend_log_release(void * arg) {
+    backend_log_retired_t * retired = arg;
+    for (size_t i = 0; i < retired->bucket_count; i++) {
+        backend_log_entry_t * entry = retired->buckets[i];
+        while (entry != NULL) {
+            backend_log_entry_t * next = entry->next;
+            free(entry);
+            entry = next;
+        }
+    }
+    free(retired->buckets);
+    free(retired);
+}
+
+/* === Public function implementation ========================================================== */
+
+static int backend_log_open(const dict_server_config_t * config) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++)
+            crc = crc & 1 ? (crc >> 1) ^ 0x82f63b78u : crc >> 1;
+        backend_log_crc_table[i] = crc;
+    }
+
+    if (mkdir(BACKEND_LOG_DIR, 0755) < 0 && errno != EEXIST) {
+        LOG_ERROR("Can not create log directory [%s]", BACKEND_LOG_DIR);
+        return SERVER_E_OS;
+    }
+
+    for (int i = 0; i < BACKEND_LOG_SHARDS; i++) {
+        backend_log_shard_t * shard = &backend_log_shards[i];
+        pthread_rwlock_init(&shard->lock, NULL);
+        shard->fd = -1;
+        shard->bucket_count = BACKEND_LOG_BUCKETS;
+        shard->buckets = calloc(BACKEND_LOG_BUCKETS, sizeof(*shard->buckets));
+        if (shard->buckets == NULL)
+            return SERVER_E_OS;
+
+        // A compaction interrupted by a crash left the old log complete.
+        char temp[PATH_MAX];
+        backend_log_path(i, ".compact", temp, sizeof(temp));
+        unlink(temp);
+    }
+
+    backend_log_sync = config != NULL && config->sync_writes;
+    backend_log_thread_count = config != NULL && config->recovery_threads > 0
+                                   ? config->recovery_threads
+                                   : sysconf(_SC_NPROCESSORS_ONLN);
+    if (backend_log_thread_count < 1)
+        backend_log_thread_count = 1;
+    if (backend_log_thread_count > BACKEND_LOG_SHARDS)
+        backend_log_thread_count = BACKEND_LOG_SHARDS;
+
+    backend_log_threads = calloc(backend_log_thread_count, sizeof(*backend_log_threads));
+    if (backend_log_threads == NULL)
+        return SERVER_E_OS;
+    atomic_store(&backend_log_pending, BACKEND_LOG_SHARDS);
+    backend_log_start_ns = backend_log_now_ns();
+    for (int i = 0; i < backend_log_thread_count; i++) {
+        if (pthread_create(&backend_log_threads[i], NULL, backend_log_recover, NULL) != 0) {
+            LOG_ERROR("Log : Can not start recovery thread %d", i);
+            return SERVER_E_OS;
+        }
+        pthread_setname_np(backend_log_threads[i], "dict-recover");
+    }
+    return SERVER_OK;
+}
+
+static int backend_log_flush(void) {
+    int err = SERVER_OK;
+    for (int i = 0; i < BACKEND_LOG_SHARDS; i++) {
+        backend_log_shard_t * shard = &backend_log_shards[i];
+        if (!atomic_load(&shard->ready))
+            continue;
+        pthread_rwlock_rdlock(&shard->lock);
+        if (fdatasync(shard->fd) < 0)
+            err = SERVER_E_OS;
+        pthread_rwlock_unlock(&shard->lock);
+    }
+    return err;
+}
+
+static void backend_log_close(void) {
+    for (int i = 0; i < backend_log_thread_count; i++)
+        pthread_join(backend_log_threads[i], NULL);
+    if (backend_log_compaction.active)
+        backend_log_compact_abort();
+    backend_log_flush();
+    for (int i = 0; i < BACKEND_LOG_SHARDS; i++)
+        close(backend_log_shards[i].fd);
+}
+
+DICT_ENGINE_ENTRY int backend_log_get(const char * key, char * buffer, int buffer_size,
+                                      int * length) {
+    if (key == NULL || buffer == NULL || length == NULL)
+        return SERVER_E_NULL;
+
+    int err = SERVER_OK;
+    uint32_t hash = backend_log_hash(key, strlen(key));
+    backend_log_shard_t * shard = backend_log_shard(hash);
+    if (!atomic_load_explicit(&shard->ready, memory_order_acquire))
+        return SERVER_E_BUSY;
+
+    pthread_rwlock_rdlock(&shard->lock);
+    backend_log_entry_t * entry = *backend_log_find(shard, key, hash);
+    if (entry == NULL) {
+        err = SERVER_E_NOT_FOUND;
+    } else {
+        size_t wanted = entry->value_len < (uint32_t)buffer_size ? entry->value_len : buffer_size;
+        ssize_t got = pread(shard->fd, buffer, wanted, entry->offset);
+        DICT_TRACE_SYSCALL(DICT_TRACE_READ);
+        if (got != (ssize_t)wanted)
+            err = SERVER_E_OS;
+        *length = entry->value_len;
+    }
+    pthread_rwlock_unlock(&shard->lock);
+
+    return err;
+}
+
+DICT_ENGINE_ENTRY int backend_log_put(const char * key, const char * value, int length) {
+    if (key == NULL || value == NULL)
+        return SERVER_E_NULL;
+
+    size_t key_len = strlen(key);
+    if (key_len == 0 || key_len > BACKEND_LOG_MAX_KEY || length < 0 ||
+        (uint32_t)length > BACKEND_LOG_MAX_VALUE)
+        return SERVER_E_INVALID;
+
+    int err = SERVER_OK;
+    uint32_t hash = backend_log_hash(key, key_len);
+    backend_log_shard_t * shard = backend_log_shard(hash);
+    if (!atomic_load_explicit(&shard->ready, memory_order_acquire))
+        return SERVER_E_BUSY;
+
+    pthread_rwlock_wrlock(&shard->lock);
+    off_t offset = backend_log_append(shard, key, key_len, value, length);
+    if (offset < 0)
+        err = SERVER_E_OS;
+    else if (backend_log_index(shard, key, key_len, hash, length, offset) < 0)
+        err = SERVER_E_OS; // Stored, but only found again after a restart.
+    pthread_rwlock_unlock(&shard->lock);
+
+    return err;
+}
+
+DICT_ENGINE_ENTRY int backend_log_del(const char * key) {
+    if (key == NULL)
+        return SERVER_E_NULL;
+
+    int err = SERVER_OK;
+    size_t key_len = strlen(key);
+    uint32_t hash = backend_log_hash(key, key_len);
+    backend_log_shard_t * shard = backend_log_shard(hash);
+    if (!atomic_load_explicit(&shard->ready, memory_order_acquire))
+        return SERVER_E_BUSY;
+
+    pthread_rwlock_wrlock(&shard->lock);
+    if (*backend_log_find(shard, key, hash) == NULL)
+        err = SERVER_E_NOT_FOUND;
+    else if (backend_log_append(shard, key, key_len, NULL, 0) < 0)
+        err = SERVER_E_OS;
+    else
+        backend_log_unindex(shard, key, hash);
+    pthread_rwlock_unlock(&shard->lock);
+
+    return err;
+}
+
+static int backend_log_count(size_t * count) {
+    if (count == NULL)
+        return SERVER_E_NULL;
+    if (atomic_load(&backend_log_pending) > 0)
+        return SERVER_E_BUSY;
+
+    *count = 0;
+    for (int i = 0; i < BACKEND_LOG_SHARDS; i++) {
+        pthread_rwlock_rdlock(&backend_log_shards[i].lock);
+        *count += backend_log_shards[i].count;
+        pthread_rwlock_unlock(&backend_log_shards[i].lock);
+    }
+    return SERVER_OK;
+}
+
+static int backend_log_clear(void) {
+    if (atomic_load(&backend_log_pending) > 0)
+        return SERVER_E_BUSY;
+
+    // Shard by shard, a crash in between leaves the shards not reached yet.
+    for (int i = 0; i < BACKEND_LOG_SHARDS; i++) {
+        backend_log_shard_t * shard = &backend_log_shards[i];
+        char path[PATH_MAX];
+        backend_log_path(i, "", path, sizeof(path));
+
+        backend_log_retired_t * retired = malloc(sizeof(*retired));
+        backend_log_entry_t ** buckets = calloc(BACKEND_LOG_BUCKETS, sizeof(*buckets));
+        if (retired == NULL || buckets == NULL) {
+            free(retired);
+            free(buckets);
+            return SERVER_E_OS;
+        }
+
+        pthread_rwlock_wrlock(&shard->lock);
+        int fd = -1;
+        if (unlink(path) < 0 ||
+            (fd = open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644)) < 0) {
+            pthread_rwlock_unlock(&shard->lock);
+            free(retired);
+            free(buckets);
+            LOG_ERROR("Log : Can not replace shard [%s]", path);
+            return SERVER_E_OS;
+        }
+        dict_reclaim_file(shard->fd, shard->size);
+        retired->buckets = shard->buckets;
+        retired->bucket_count = shard->bucket_count;
+        shard->fd = fd;
+        shard->buckets = buckets;
+        shard->bucket_count = BACKEND_LOG_BUCKETS;
+        shard->size = 0;
+        shard->live = 0;
+        shard->count = 0;
+        shard->key_bytes = 0;
+        shard->generation++;
+        pthread_rwlock_unlock(&shard->lock);
+
+        dict_reclaim_call(backend_log_release, retired, 0);
+    }
+    return SERVER_OK;
+}
+
+static int backend_log_iterate(dict_backend_key_visit visit, void * context) {
+    if (visit == NULL)
+        return SERVER_E_NULL;
+    if (atomic_load(&backend_log_pending) > 0)
+        return SERVER_E_BUSY;
+
+    for (int s = 0; s < BACKEND_LOG_SHARDS; s++) {
+        backend_log_shard_t * shard = &backend_log_shards[s];
+        int stop = 0;
+        pthread_rwlock_rdlock(&shard->lock);
+        for (size_t i = 0; i < shard->bucket_count && !stop; i++)
+            for (backend_log_entry_t * entry = shard->buckets[i]; entry != NULL && !stop;
+                 entry = entry->next)
+                stop = visit(entry->key, context);
+        pthread_rwlock_unlock(&shard->lock);
+        if (stop)
+            break;
+    }
+    return SERVER_OK;
+}
+
+static int backend_log_stats(char * buffer, int buffer_size) {
+    size_t keys = 0;
+    off_t size = 0;
+    off_t live = 0;
+    off_t truncated = 0;
+    unsigned long records = 0;
+
+    for (int i = 0; i < BACKEND_LOG_SHARDS; i++) {
+        backend_log_shard_t * shard = &backend_log_shards[i];
+        pthread_rwlock_rdlock(&shard->lock);
+        keys += shard->count;
+        size += shard->size;
+        live += shard->live;
+        truncated += shard->truncated;
+        records += shard->records;
+        pthread_rwlock_unlock(&shard->lock);
+    }
+
+    // While recovering, the elapsed time so far.
+    int pending = atomic_load(&backend_log_pending);
+    uint64_t done = pending > 0 ? backend_log_now_ns() - backend_log_start_ns
+                                : atomic_load(&backend_log_done_ns);
+    return snprintf(buffer, buffer_size,
+                    "backend:log\nbackend_persistent:1\n"
+                    "backend_dir:%s\nbackend_shards:%d\nbackend_keys:%zu\n"
+                    "backend_sync:%d\nbackend_log_bytes:%ld\nbackend_log_live_bytes:%ld\n"
+                    "backend_compactions:%lu\nbackend_compacted_bytes:%lu\n"
+                    "backend_recovery_threads:%d\nbackend_recovery_pending_shards:%d\n"
+                    "backend_recovery_first_ms:%lu\nbackend_recovery_ms:%lu\n"
+                    "backend_recovery_records:%lu\nbackend_recovery_truncated_bytes:%ld\n",
+                    BACKEND_LOG_DIR, BACKEND_LOG_SHARDS, keys, backend_log_sync, (long)size,
+                    (long)live, backend_log_compactions, backend_log_compacted_bytes,
+                    backend_log_thread_count, pending,
+                    (unsigned long)(atomic_load(&backend_log_first_ns) / 1000000),
+                    (unsigned long)(done / 1000000), records, (long)truncated);
+}
+
+static int backend_log_defrag(int budget_us) {
+    uint64_t deadline = backend_log_now_ns() + (uint64_t)budget_us * 1000;
+
+    // One shard at a time, copied a budget at a time over as many calls as it takes.
+    for (int checked = 0; !backend_log_compaction.active && checked < BACKEND_LOG_SHARDS;
+         checked++) {
+        int index = backend_log_compact_cursor;
+        backend_log_compact_cursor = (index + 1) % BACKEND_LOG_SHARDS;
+
+        backend_log_shard_t * shard = &backend_log_shards[index];
+        pthread_rwlock_rdlock(&shard->lock);
+        int compactable = backend_log_compactable(shard);
+        pthread_rwlock_unlock(&shard->lock);
+        if (compactable && backend_log_compact_begin(index) != SERVER_OK)
+            return 0;
+    }
+    if (!backend_log_compaction.active)
+        return 0;
+    backend_log_compact_step(deadline);
+    return 1;
+}
+
+static int backend_log_memory(dict_backend_memory_t * memory) {
+    if (memory == NULL)
+        return SERVER_E_NULL;
+
+    // Values stay in the logs and the page cache, only the index is in process memory.
+    memset(memory, 0, sizeof(*memory));
+    for (int i = 0; i < BACKEND_LOG_SHARDS; i++) {
+        backend_log_shard_t * shard = &backend_log_shards[i];
+        pthread_rwlock_rdlock(&shard->lock);
+        memory->key_bytes += shard->key_bytes;
+        memory->index_bytes += shard->bucket_count * sizeof(*shard->buckets) +
+                               shard->count * sizeof(backend_log_entry_t);
+        pthread_rwlock_unlock(&shard->lock);
+    }
+    memory->allocated_bytes = memory->key_bytes + memory->index_bytes;
+    return SERVER_OK;
+}
+
+DICT_ENGINE_ENTRY int backend_log_usage(const char * key, size_t * bytes) {
+    if (key == NULL || bytes == NULL)
+        return SERVER_E_NULL;
+
+    int err = SERVER_OK;
+    size_t key_len = strlen(key);
+    uint32_t hash = backend_log_hash(key, key_len);
+    backend_log_shard_t * shard = backend_log_shard(hash);
+    if (!atomic_load(&shard->ready))
+        return SERVER_E_BUSY;
+
+    // The index entry plus the record in the log.
+    pthread_rwlock_rdlock(&shard->lock);
+    backend_log_entry_t * entry = *backend_log_find(shard, key, hash);
+    if (entry == NULL)
+        err = SERVER_E_NOT_FOUND;
+    else
+        *bytes = sizeof(*entry) + key_len + 1 + sizeof(backend_log_header_t) + key_len +
+                 entry->value_len;
+    pthread_rwlock_unlock(&shard->lock);
+    return err;
+}
+
+DICT_ENGINE_ENTRY int backend_log_prefetch(const char * key) {
+    if (key == NULL)
+        return SERVER_E_NULL;
+
+    int err = SERVER_OK;
+    uint32_t hash = backend_log_hash(key, strlen(key));
+    backend_log_shard_t * shard = backend_log_shard(hash);
+    if (!atomic_load_explicit(&shard->ready, memory_order_acquire))
+        return SERVER_E_BUSY;
+
+    // Only the value's range of the log, the rest of it may be cold for good.
+    pthread_rwlock_rdlock(&shard->lock);
+    backend_log_entry_t * entry = *backend_log_find(shard, key, hash);
+    if (entry == NULL) {
+        err = SERVER_E_NOT_FOUND;
+    } else {
+        // The advice queues the read of the value, so it is counted as one.
+        if (posix_fadvise(shard->fd, entry->offset, entry->value_len, POSIX_FADV_WILLNEED) != 0)
+            err = SERVER_E_OS;
+        DICT_TRACE_SYSCALL(DICT_TRACE_READ);
+    }
+    pthread_rwlock_unlock(&shard->lock);
+    return err;
+}
+
+#endif /* DICT_CONFIG_ENGINE_LOG */
+
+/* === End of documentation ==================================================================== */
@@ -0,0 +1,615 @@
+/************************************************************************************************
+Copyright (c) 2024, Guido Ramirez <guidoramirez7@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute,
+sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial
+portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+SPDX-License-Identifier: MIT
+*************************************************************************************************/
+
+/** @file dict_backend_memory.c
+ ** @brief In memory storage backend. Keys are kept in a chained hash table.
+ **
+ ** The bucket array, the entries and the values live in huge page backed memory from
+ ** dict_arena.h, so random lookups over a large keyspace touch few TLB entries.
+ **
+ ** The table holds the only references to entries and values, so dict_backend_defrag() can walk
+ ** it a few buckets at a time and relocate whatever dict_arena_defrag() moves out of sparse
+ ** slabs.
+ **/
+
+/* === Headers files inclusions =============================================================== */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "dict_arena.h"
+#include "dict_bufpool.h"
+#include "dict_engine.h"
+#include "dict_log.h"
+#include "dict_reclaim.h"
+
+#if DICT_CONFIG_ENGINE_MEMORY
+
+/* === Macros definitions ====================================================================== */
+
+#define BACKEND_MEMORY_BUCKETS (1024) /**< Initial bucket count, always a power of two. */
+#define BACKEND_MEMORY_MAX_KEY DICT_BUFPOOL_MAX_SIZE /**< Longest key, as long as a command */
+#define BACKEND_MEMORY_DEFRAG_MIN_BYTES (1024 * 1024) /**< Free slab bytes that start a pass */
+#define BACKEND_MEMORY_DEFRAG_PERCENT   (10)  /**< Same, as a share of the reserved bytes */
+#define BACKEND_MEMORY_DEFRAG_CHECK     (64)  /**< Buckets walked between clock reads */
+#define BACKEND_MEMORY_TRIM_SLABS       (16)  /**< Free slabs released between clock reads */
+
+/* === Private data type declarations ========================================================== */
+
+typedef struct backend_memory_entry {
+    struct backend_memory_entry * next; /**< Next entry in the same bucket */
+    uint32_t hash;                      /**< Key hash */
+    int value_len;                      /**< Value length */
+    char * value;                       /**< Value bytes */
+    char key[];                         /**< Null terminated key */
+} backend_memory_entry_t;
+
+typedef struct {
+    backend_memory_entry_t ** buckets; /**< Bucket array, from dict_arena_map() */
+    dict_arena_pages bucket_pages;     /**< Kind of pages backing the bucket array */
+    size_t bucket_count;               /**< Number of buckets */
+    size_t count;                      /**< Number of keys */
+    size_t value_bytes;                /**< Bytes used by values */
+    size_t key_bytes;                  /**< Bytes used by key names, terminators included */
+    dict_arena arena;                  /**< Entries and values */
+    int defrag_active;                 /**< A defragmentation pass is in progress */
+    size_t defrag_cursor;              /**< Next bucket of the pass */
+    unsigned long defrag_passes;       /**< Passes started */
+    unsigned long defrag_moves;        /**< Blocks relocated */
+    unsigned long defrag_moved_bytes;  /**< Bytes relocated */
+    unsigned long defrag_time_ns;      /**< Time spent in dict_backend_defrag() */
+    pthread_rwlock_t lock;             /**< Writers are the request loop and the dump import */
+} backend_memory_t;
+
+typedef struct {
+    backend_memory_entry_t ** buckets; /**< Bucket array of the retired store */
+    dict_arena_pages bucket_pages;     /**< Kind of pages backing the bucket array */
+    size_t bucket_count;               /**< Number of buckets */
+    dict_arena arena;                  /**< Entries and values of the retired store */
+} backend_memory_retired_t;
+
+/* === Private variable declarations =========================================================== */
+
+/* === Private function declarations =========================================================== */
+
+static uint32_t backend_memory_hash(const char * key);
+
+static backend_memory_entry_t ** backend_memory_find(const char * key, uint32_t hash);
+
+static void backend_memory_grow(void);
+
+static void backend_memory_value_free(char * value, size_t length);
+
+static void backend_memory_entry_free(backend_memory_entry_t * entry);
+
+static uint64_t backend_memory_now_ns(void);
+
+static void backend_memory_release(void * arg);
+
+static int backend_memory_open(const dict_server_config_t * config);
+
+static void backend_memory_close(void);
+
+DICT_ENGINE_ENTRY int backend_memory_get(const char * key, char * buffer, int buffer_size,
+                                         int * length);
+
+DICT_ENGINE_ENTRY int backend_memory_put(const char * key, const char * value, int length);
+
+DICT_ENGINE_ENTRY int backend_memory_del(const char * key);
+
+static int backend_memory_iterate(dict_backend_key_visit visit, void * context);
+
+static int backend_memory_copy(dict_backend_value_visit visit, void * context);
+
+static int backend_memory_stats(char * buffer, int buffer_size);
+
+static int backend_memory_flush(void);
+
+static int backend_memory_count(size_t * count);
+
+static int backend_memory_clear(void);
+
+static int backend_memory_defrag(int budget_us);
+
+static int backend_memory_memory(dict_backend_memory_t * memory);
+
+DICT_ENGINE_ENTRY int backend_memory_usage(const char * key, size_t * bytes);
+
+DICT_ENGINE_ENTRY int backend_memory_prefetch(const char * key);
+
+/* === Public variable definitions ============================================================= */
+
+const dict_engine_t dict_engine_memory = {
+    .name = "memory",
+    .key_max = BACKEND_MEMORY_MAX_KEY,
+    .open = backend_memory_open,
+    .close = backend_memory_close,
+    .get = backend_memory_get,
+    .put = backend_memory_put,
+    .del = backend_memory_del,
+    .iterate = backend_memory_iterate,
+    .copy = backend_memory_copy,
+    .stats = backend_memory_stats,
+    .flush = backend_memory_flush,
+    .count = backend_memory_count,
+    .clear = backend_memory_clear,
+    .defrag = backend_memory_defrag,
+    .memory = backend_memory_memory,
+    .usage = backend_memory_usage,
+    .prefetch = backend_memory_prefetch,
+};
+
+/* === Private variable definitions ============================================================ */
+
+static backend_memory_t backend_memory = {.lock = PTHREAD_RWLOCK_INITIALIZER};
+
+/* === Private function implementation ========================================================= */
+/**
+ * @brief FNV-1a hash of a key.
+ *
+ * @param key Key name.
+ * @return uint32_t Hash.
+ */
+static uint32_t backend_memory_hash(const char * key) {
+    uint32_t hash = 2166136261u;
+    while (*key) {
+        hash ^= (unsigned char)*key++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+/**
+ * @brief Find the link pointing to a key entry. The lock must be held.
+ *
+ * @param key Key name.
+ * @param hash Key hash.
+ * @return backend_memory_entry_t** Link to the entry, or to the bucket tail if not found.
+ */
+static backend_memory_entry_t ** backend_memory_find(const char * key, uint32_t hash) {
+    backend_memory_entry_t ** link =
+        &backend_memory.buckets[hash & (backend_memory.bucket_count - 1)];
+    while (*link != NULL && ((*link)->hash != hash || strcmp((*link)->key, key) != 0))
+        link = &(*link)->next;
+    return link;
+}
+/**
+ * @brief Double the bucket count. The write lock must be held. On allocation failure the table
+ * keeps working with longer chains.
+ */
+static void backend_memory_grow(void) {
+    size_t bucket_count = backend_memory.bucket_count * 2;
+    dict_arena_pages pages;
+    backend_memory_entry_t ** buckets = dict_arena_map(bucket_count * sizeof(*buckets), &pages);
+    if (buckets == NULL)
+        return;
+
+    for (size_t i = 0; i < backend_memory.bucket_count; i++) {
+        backend_memory_entry_t * entry = backend_memory.buckets[i];
+        while (entry != NULL) {
+            backend_memory_entry_t * next = entry->next;
+            entry->next = buckets[entry->hash & (bucket_count - 1)];
+            buckets[entry->hash & (bucket_count - 1)] = entry;
+            entry = next;
+        }
+    }
+
+    dict_reclaim_unmap(backend_memory.buckets, backend_memory.bucket_count * sizeof(*buckets),
+                       backend_memory.bucket_pages);
+    backend_memory.buckets = buckets;
+    backend_memory.bucket_pages = pages;
+    backend_memory.bucket_count = bucket_count;
+}
+/**
+ * @brief Release a value. Large values are unmapped by the reclamation thread, so the cost of
+ * dropping them is not paid under the write lock.
+ *
+ * @param value Value.
+ * @param length Value length.
+ */
+static void backend_memory_value_free(char * value, size_t length) {
+    size_t region_size;
+    dict_arena_pages pages;
+
+    void * region = NULL;
+    if (length >= DICT_RECLAIM_MIN_SIZE)
+        region = dict_arena_detach(backend_memory.arena, value, length, &region_size, &pages);
+    if (region != NULL)
+        dict_reclaim_unmap(region, region_size, pages);
+    else
+        dict_arena_free(backend_memory.arena, value, length);
+}
+/**
+ * @brief Release an entry and its value. The write lock must be held.
+ *
+ * @param entry Entry already unlinked from the table.
+ */
+static void backend_memory_entry_free(backend_memory_entry_t * entry) {
+    backend_memory_value_free(entry->value, entry->value_len);
+    dict_arena_free(backend_memory.arena, entry, sizeof(*entry) + strlen(entry->key) + 1);
+}
+
+/**
+ * @brief Monotonic clock, for the defragmentation budget.
+ *
+ * @return uint64_t Nanoseconds.
+ */
+static uint64_t backend_memory_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/**
+ * @brief Release a store retired by dict_backend_clear(). Runs on the reclamation thread, nothing
+ * else references the store anymore.
+ *
+ * @param arg Retired store, backend_memory_retired_t.
+ */
+static void backend_memory_release(void * arg) {
+    backend_memory_retired_t * retired = arg;
+
+    // Large values have their own mapping, the arena only knows its chunks.
+    for (size_t i = 0; i < retired->bucket_count; i++)
+        for (backend_memory_entry_t * entry = retired->buckets[i]; entry != NULL;
+             entry = entry->next)
+            if (entry->value_len > DICT_ARENA_MAX_CLASS)
+                dict_arena_free(retired->arena, entry->value, entry->value_len);
+
+    dict_arena_destroy(retired->arena);
+    dict_arena_unmap(retired->buckets, retired->bucket_count * sizeof(*retired->buckets),
+                     retired->bucket_pages);
+    free(retired);
+}
+
+/* === Public function implementation ========================================================== */
+
+static int backend_memory_open(const dict_server_config_t * config) {
+    backend_memory.arena = dict_arena_create();
+    backend_memory.buckets = dict_arena_map(BACKEND_MEMORY_BUCKETS * sizeof(*backend_memory.buckets),
+                                            &backend_memory.bucket_pages);
+    if (backend_memory.arena == NULL || backend_memory.buckets == NULL)
+        return SERVER_E_OS;
+    backend_memory.bucket_count = BACKEND_MEMORY_BUCKETS;
+    return SERVER_OK;
+}
+
+static int backend_memory_flush(void) {
+    // Writes are applied in memory before they are acknowledged, there is nothing pending.
+    return SERVER_OK;
+}
+
+static void backend_memory_close(void) {
+    // The process exit releases the arena.
+}
+
+DICT_ENGINE_ENTRY int backend_memory_get(const char * key, char * buffer, int buffer_size,
+                                         int * length) {
+    if (key == NULL || buffer == NULL || length == NULL)
+        return SERVER_E_NULL;
+
+    int err = SERVER_OK;
+    uint32_t hash = backend_memory_hash(key);
+
+    pthread_rwlock_rdlock(&backend_memory.lock);
+    backend_memory_entry_t * entry = *backend_memory_find(key, hash);
+    if (entry == NULL) {
+        err = SERVER_E_NOT_FOUND;
+    } else {
+        *length = entry->value_len;
+        memcpy(buffer, entry->value, entry->value_len < buffer_size ? entry->value_len : buffer_size);
+    }
+    pthread_rwlock_unlock(&backend_memory.lock);
+
+    return err;
+}
+
+DICT_ENGINE_ENTRY int backend_memory_put(const char * key, const char * value, int length) {
+    if (key == NULL || value == NULL)
+        return SERVER_E_NULL;
+    if (key[0] == '\0' || length < 0 || strlen(key) > BACKEND_MEMORY_MAX_KEY)
+        return SERVER_E_INVALID;
+
+    int err = SERVER_OK;
+    uint32_t hash = backend_memory_hash(key);
+
+    pthread_rwlock_wrlock(&backend_memory.lock);
+    char * copy = dict_arena_alloc(backend_memory.arena, length);
+    if (copy == NULL) {
+        err = SERVER_E_OS;
+        goto finish;
+    }
+    memcpy(copy, value, length);
+
+    backend_memory_entry_t ** link = backend_memory_find(key, hash);
+    backend_memory_entry_t * entry = *link;
+    if (entry != NULL) {
+        backend_memory.value_bytes -= entry->value_len;
+        backend_memory_value_free(entry->value, entry->value_len);
+    } else {
+        size_t key_len = strlen(key);
+        entry = dict_arena_alloc(backend_memory.arena, sizeof(*entry) + key_len + 1);
+        if (entry == NULL) {
+            err = SERVER_E_OS;
+            dict_arena_free(backend_memory.arena, copy, length);
+            goto finish;
+        }
+        memcpy(entry->key, key, key_len + 1);
+        entry->hash = hash;
+        entry->next = NULL;
+        *link = entry;
+        backend_memory.count++;
+        backend_memory.key_bytes += key_len + 1;
+    }
+    entry->value = copy;
+    entry->value_len = length;
+    backend_memory.value_bytes += length;
+
+    if (backend_memory.count > backend_memory.bucket_count)
+        backend_memory_grow();
+
+finish:
+    pthread_rwlock_unlock(&backend_memory.lock);
+    return err;
+}
+
+DICT_ENGINE_ENTRY int backend_memory_del(const char * key) {
+    if (key == NULL)
+        return SERVER_E_NULL;
+
+    backend_memory_entry_t * entry;
+    uint32_t hash = backend_memory_hash(key);
+
+    pthread_rwlock_wrlock(&backend_memory.lock);
+    backend_memory_entry_t ** link = backend_memory_find(key, hash);
+    entry = *link;
+    if (entry != NULL) {
+        *link = entry->next;
+        backend_memory.count--;
+        backend_memory.value_bytes -= entry->value_len;
+        backend_memory.key_bytes -= strlen(entry->key) + 1;
+        backend_memory_entry_free(entry);
+    }
+    pthread_rwlock_unlock(&backend_memory.lock);
+
+    return entry == NULL ? SERVER_E_NOT_FOUND : SERVER_OK;
+}
+
+static int backend_memory_count(size_t * count) {
+    if (count == NULL)
+        return SERVER_E_NULL;
+
+    pthread_rwlock_rdlock(&backend_memory.lock);
+    *count = backend_memory.count;
+    pthread_rwlock_unlock(&backend_memory.lock);
+    return SERVER_OK;
+}
+
+static int backend_memory_clear(void) {
+    backend_memory_retired_t * retired = malloc(sizeof(*retired));
+    dict_arena arena = dict_arena_create();
+    dict_arena_pages pages = DICT_ARENA_PAGES_NORMAL;
+    backend_memory_entry_t ** buckets =
+        dict_arena_map(BACKEND_MEMORY_BUCKETS * sizeof(*buckets), &pages);
+    if (retired == NULL || arena == NULL || buckets == NULL) {
+        free(retired);
+        dict_arena_destroy(arena);
+        dict_arena_unmap(buckets, BACKEND_MEMORY_BUCKETS * sizeof(*buckets), pages);
+        return SERVER_E_OS;
+    }
+
+    // Swap in an empty store, the old one is released on the reclamation thread.
+    pthread_rwlock_wrlock(&backend_memory.lock);
+    retired->buckets = backend_memory.buckets;
+    retired->bucket_pages = backend_memory.bucket_pages;
+    retired->bucket_count = backend_memory.bucket_count;
+    retired->arena = backend_memory.arena;
+    size_t bytes = backend_memory.key_bytes + backend_memory.value_bytes;
+    backend_memory.buckets = buckets;
+    backend_memory.bucket_pages = pages;
+    backend_memory.bucket_count = BACKEND_MEMORY_BUCKETS;
+    backend_memory.arena = arena;
+    backend_memory.count = 0;
+    backend_memory.key_bytes = 0;
+    backend_memory.value_bytes = 0;
+    backend_memory.defrag_active = 0;
+    pthread_rwlock_unlock(&backend_memory.lock);
+
+    dict_reclaim_call(backend_memory_release, retired, bytes);
+    return SERVER_OK;
+}
+
+static int backend_memory_iterate(dict_backend_key_visit visit, void * context) {
+    if (visit == NULL)
+        return SERVER_E_NULL;
+
+    // The callback runs under the read lock, writers wait until the walk ends.
+    pthread_rwlock_rdlock(&backend_memory.lock);
+    for (size_t i = 0; i < backend_memory.bucket_count; i++) {
+        for (backend_memory_entry_t * entry = backend_memory.buckets[i]; entry != NULL;
+             entry = entry->next) {
+            if (visit(entry->key, context))
+                goto finish;
+        }
+    }
+
+finish:
+    pthread_rwlock_unlock(&backend_memory.lock);
+    return SERVER_OK;
+}
+
+static int backend_memory_copy(dict_backend_value_visit visit, void * context) {
+    if (visit == NULL)
+        return SERVER_E_NULL;
+
+    // One read lock for the whole walk, no write lands in the middle of it.
+    pthread_rwlock_rdlock(&backend_memory.lock);
+    for (size_t i = 0; i < backend_memory.bucket_count; i++) {
+        for (backend_memory_entry_t * entry = backend_memory.buckets[i]; entry != NULL;
+             entry = entry->next) {
+            if (visit(entry->key, entry->value, entry->value_len, context))
+                goto finish;
+        }
+    }
+
+finish:
+    pthread_rwlock_unlock(&backend_memory.lock);
+    return SERVER_OK;
+}
+
+static int backend_memory_stats(char * buffer, int buffer_size) {
+    pthread_rwlock_rdlock(&backend_memory.lock);
+    int len = snprintf(buffer, buffer_size,
+                       "backend:memory\nbackend_persistent:0\n"
+                       "backend_keys:%zu\nbackend_buckets:%zu\n"
+                       "backend_bucket_pages:%s\nbackend_value_bytes:%zu\n",
+                       backend_memory.count, backend_memory.bucket_count,
+                       dict_arena_pages_name(backend_memory.bucket_pages), backend_memory.value_bytes);
+    if (len < buffer_size)
+        len += snprintf(buffer + len, buffer_size - len,
+                        "backend_defrag_active:%d\nbackend_defrag_progress_pct:%zu\n"
+                        "backend_defrag_passes:%lu\nbackend_defrag_moves:%lu\n"
+                        "backend_defrag_moved_bytes:%lu\nbackend_defrag_time_us:%lu\n",
+                        backend_memory.defrag_active,
+                        backend_memory.defrag_active
+                            ? backend_memory.defrag_cursor * 100 / backend_memory.bucket_count
+                            : 100,
+                        backend_memory.defrag_passes, backend_memory.defrag_moves,
+                        backend_memory.defrag_moved_bytes, backend_memory.defrag_time_ns / 1000);
+    if (len < buffer_size)
+        len += dict_arena_stats(backend_memory.arena, buffer + len, buffer_size - len);
+    pthread_rwlock_unlock(&backend_memory.lock);
+    return len;
+}
+
+static int backend_memory_defrag(int budget_us) {
+    uint64_t start = backend_memory_now_ns();
+    uint64_t deadline = start + (uint64_t)budget_us * 1000;
+    int more;
+
+    pthread_rwlock_wrlock(&backend_memory.lock);
+    // Slabs emptied by DEL or by the last pass go back to the OS here, not while freeing.
+    int trimming = 1;
+    while (trimming && backend_memory_now_ns() < deadline)
+        trimming = dict_arena_trim(backend_memory.arena, BACKEND_MEMORY_TRIM_SLABS);
+
+    if (!backend_memory.defrag_active) {
+        dict_arena_usage_t usage;
+        dict_arena_usage(backend_memory.arena, &usage);
+        if (usage.slab_free < BACKEND_MEMORY_DEFRAG_MIN_BYTES ||
+            usage.slab_free * 100 < usage.reserved * BACKEND_MEMORY_DEFRAG_PERCENT) {
+            pthread_rwlock_unlock(&backend_memory.lock);
+            return trimming;
+        }
+        backend_memory.defrag_active = 1;
+        backend_memory.defrag_cursor = 0;
+        backend_memory.defrag_passes++;
+        dict_arena_defrag_begin(backend_memory.arena);
+    }
+
+    // A table grown meanwhile is walked from the same index, some entries wait for next pass.
+    for (int walked = 1; backend_memory.defrag_cursor < backend_memory.bucket_count; walked++) {
+        backend_memory_entry_t ** link = &backend_memory.buckets[backend_memory.defrag_cursor++];
+        while (*link != NULL) {
+            backend_memory_entry_t * entry = *link;
+            size_t size = sizeof(*entry) + strlen(entry->key) + 1;
+            backend_memory_entry_t * moved = dict_arena_defrag(backend_memory.arena, entry, size);
+            if (moved != NULL) {
+                *link = entry = moved;
+                backend_memory.defrag_moves++;
+                backend_memory.defrag_moved_bytes += size;
+            }
+            char * value = dict_arena_defrag(backend_memory.arena, entry->value, entry->value_len);
+            if (value != NULL) {
+                entry->value = value;
+                backend_memory.defrag_moves++;
+                backend_memory.defrag_moved_bytes += entry->value_len;
+            }
+            link = &entry->next;
+        }
+        if (walked % BACKEND_MEMORY_DEFRAG_CHECK == 0 && backend_memory_now_ns() >= deadline)
+            break;
+    }
+
+    if (backend_memory.defrag_cursor >= backend_memory.bucket_count)
+        backend_memory.defrag_active = 0;
+    more = backend_memory.defrag_active || trimming;
+    backend_memory.defrag_time_ns += backend_memory_now_ns() - start;
+    pthread_rwlock_unlock(&backend_memory.lock);
+    return more;
+}
+
+static int backend_memory_memory(dict_backend_memory_t * memory) {
+    if (memory == NULL)
+        return SERVER_E_NULL;
+
+    dict_arena_usage_t usage;
+    pthread_rwlock_rdlock(&backend_memory.lock);
+    dict_arena_usage(backend_memory.arena, &usage);
+    memset(memory, 0, sizeof(*memory));
+    memory->key_bytes = backend_memory.key_bytes;
+    memory->value_bytes = backend_memory.value_bytes;
+    memory->index_bytes = backend_memory.bucket_count * sizeof(*backend_memory.buckets) +
+                          backend_memory.count * sizeof(backend_memory_entry_t);
+    // The bucket array is mapped apart from the arena, its power of two size fills whole pages.
+    size_t bucket_bytes = backend_memory.bucket_count * sizeof(*backend_memory.buckets);
+    memory->allocated_bytes = usage.allocated + bucket_bytes;
+    // Released slabs stay mapped but no longer take memory.
+    memory->mapped_bytes = usage.mapped - usage.released + bucket_bytes;
+    pthread_rwlock_unlock(&backend_memory.lock);
+    return SERVER_OK;
+}
+
+DICT_ENGINE_ENTRY int backend_memory_usage(const char * key, size_t * bytes) {
+    if (key == NULL || bytes == NULL)
+        return SERVER_E_NULL;
+
+    int err = SERVER_OK;
+    uint32_t hash = backend_memory_hash(key);
+
+    pthread_rwlock_rdlock(&backend_memory.lock);
+    backend_memory_entry_t * entry = *backend_memory_find(key, hash);
+    if (entry == NULL)
+        err = SERVER_E_NOT_FOUND;
+    else
+        *bytes = dict_arena_block_size(sizeof(*entry) + strlen(key) + 1) +
+                 dict_arena_block_size(entry->value_len);
+    pthread_rwlock_unlock(&backend_memory.lock);
+    return err;
+}
+
+DICT_ENGINE_ENTRY int backend_memory_prefetch(const char * key) {
+    if (key == NULL)
+        return SERVER_E_NULL;
+
+    // Values are in process memory already, there is nothing to load.
+    uint32_t hash = backend_memory_hash(key);
+    pthread_rwlock_rdlock(&backend_memory.lock);
+    int err = *backend_memory_find(key, hash) != NULL ? SERVER_OK : SERVER_E_NOT_FOUND;
+    pthread_rwlock_unlock(&backend_memory.lock);
+    return err;
+}
+
+#endif /* DICT_CONFIG_ENGINE_MEMORY */
+
+/* === End of documentation ==================================================================== */
@@ -0,0 +1,1664 @@
+/************************************************************************************************
+Copyright (c) 2024, Guido Ramirez <guidoramirez7@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute,
+sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial
+portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+SPDX-License-Identifier: MIT
+*************************************************************************************************/
+
+/** @file dict_backend_packed.c
+ ** @brief Packed storage backend. Small values share fixed size slotted pages.
+ **
+ ** Keys are spread over BACKEND_PACKED_SHARDS shards. Every shard is a single file of
+ ** BACKEND_PACKED_PAGE byte pages plus an in memory index from key to page and slot, so disk
+ ** usage and the number of files do not grow with the number of keys. A page holds a slot
+ ** directory growing from its start and records growing down from its end. Slots never move, so
+ ** compacting a page does not touch the index. Records too large for a page keep only their key
+ ** there and the value in a blob file of its own.
+ **
+ ** A free space map groups pages in BACKEND_PACKED_CLASSES lists by free bytes, a write takes
+ ** the first page of the smallest class sure to fit the record. A value that still fits its page
+ ** is replaced there with a single page write. Otherwise the new copy is written first and the
+ ** old one removed after: a crash in between leaves both, and the recovery keeps the one with
+ ** the higher sequence number.
+ **
+ ** A page is never overwritten in place by a write, it holds other keys a torn write would lose.
+ ** Its new image is appended to the shard journal and kept in memory, reads take it from there.
+ ** A checkpoint syncs the journal, writes the staged pages in place, syncs the page file and only
+ ** then empties the journal. It runs once BACKEND_PACKED_JOURNAL_PAGES images are journaled, on
+ ** dict_backend_flush(), on close and from the defragmentation slices. With DICT_SYNC the journal
+ ** is synced before a write is acknowledged.
+ **
+ ** Pages are checksummed. The recovery first writes back the journal, up to its first torn
+ ** record, so a page torn by a checkpoint is restored. It then reads every page, skips the ones
+ ** failing their checksum and never writes to them again, and removes the blob files no record
+ ** points to. Pages emptied by deletes stay in the file and are reused through the free space map.
+ **/
+
+/* === Headers files inclusions =============================================================== */
+
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+#include "dict_engine.h"
+#include "dict_log.h"
+#include "dict_reclaim.h"
+#include "dict_trace.h"
+
+#if DICT_CONFIG_ENGINE_PACKED
+
+/* === Macros definitions ====================================================================== */
+
+#define BACKEND_PACKED_DIR     "packed" /**< Directory of the page and blob files */
+#define BACKEND_PACKED_SHARDS  (16)     /**< Shards, a power of two */
+#define BACKEND_PACKED_BUCKETS (256)    /**< Initial buckets of a shard index, a power of two */
+#define BACKEND_PACKED_PAGE    (4096)   /**< Page size, the unit of every page read and write */
+#define BACKEND_PACKED_INLINE  (BACKEND_PACKED_PAGE / 4) /**< Largest record kept in a page */
+#define BACKEND_PACKED_MAX_KEY (512)    /**< Longest key accepted */
+#define BACKEND_PACKED_CLASSES (16)     /**< Free space classes, a power of two */
+#define BACKEND_PACKED_CLASS_BYTES (BACKEND_PACKED_PAGE / BACKEND_PACKED_CLASSES)
+#define BACKEND_PACKED_PAGES   (64)     /**< Initial free space map capacity of a shard */
+#define BACKEND_PACKED_JOURNAL_PAGES (256) /**< Page images journaled before a checkpoint */
+#define BACKEND_PACKED_BLOB    (1)      /**< Record flag: the value is in a blob file */
+#define BACKEND_PACKED_NONE    UINT32_MAX /**< No page, ends a free space list */
+
+/* === Private data type declarations ========================================================== */
+
+/** Slot directory entry. */
+typedef struct {
+    uint16_t offset; /**< Record offset in the page, 0 if the slot is free */
+    uint16_t length; /**< Record length */
+} backend_packed_slot_t;
+
+/** Page layout. Native endian. */
+typedef struct {
+    uint32_t crc;        /**< CRC-32C of the page after this field */
+    uint16_t slot_count; /**< Directory slots, free ones included */
+    uint16_t data_start; /**< Offset of the lowest record, BACKEND_PACKED_PAGE if none */
+    union {
+        backend_packed_slot_t slots[(BACKEND_PACKED_PAGE - 8) / sizeof(backend_packed_slot_t)];
+        unsigned char data[BACKEND_PACKED_PAGE - 8]; /**< Records, packed from the end down */
+    };
+} backend_packed_page_t;
+
+/** Record header, followed by the key and, unless in a blob file, the value. Native endian. */
+typedef struct {
+    uint64_t seq;       /**< Write sequence of the shard, the higher copy of a key wins */
+    uint32_t value_len; /**< Value length */
+    uint16_t key_len;   /**< Key length */
+    uint16_t flags;     /**< BACKEND_PACKED_BLOB if the value is in a blob file */
+} backend_packed_record_t;
+
+/** Journal record header, followed by the page image. Native endian. */
+typedef struct {
+    uint32_t crc;  /**< CRC-32C of the page number and the image */
+    uint32_t page; /**< Page number */
+} backend_packed_journal_t;
+
+typedef struct backend_packed_entry {
+    struct backend_packed_entry * next; /**< Next entry in the same bucket */
+    uint64_t seq;                       /**< Sequence of the record, names its blob file */
+    uint32_t hash;                      /**< Key hash */
+    uint32_t page;                      /**< Page holding the record */
+    uint32_t value_len;                 /**< Value length */
+    uint16_t slot;                      /**< Slot of the record in its page */
+    uint16_t flags;                     /**< Record flags */
+    char key[];                         /**< Null terminated key */
+} backend_packed_entry_t;
+
+typedef struct {
+    pthread_rwlock_t lock;            /**< Writers stage pages, readers read them */
+    int index;                        /**< Shard number, names its files */
+    int fd;                           /**< Page file */
+    int journal_fd;                   /**< Journal of the pages staged since the checkpoint */
+    off_t journal_size;               /**< Bytes in the journal */
+    backend_packed_page_t ** staged;  /**< Staged image of every page, NULL if none */
+    uint32_t staged_pages[BACKEND_PACKED_JOURNAL_PAGES]; /**< Numbers of the staged pages */
+    uint32_t staged_count;            /**< Pages staged */
+    uint64_t seq;                     /**< Last write sequence */
+    uint32_t page_count;              /**< Pages in the file */
+    uint32_t page_capacity;           /**< Pages the free space map can hold */
+    uint16_t * page_free;             /**< Free bytes of every page */
+    uint32_t * page_next;             /**< Next page in the same free space class */
+    uint32_t * page_prev;             /**< Previous page in the same class */
+    uint32_t class_head[BACKEND_PACKED_CLASSES]; /**< First page of every class */
+    backend_packed_entry_t ** buckets; /**< Chained buckets */
+    size_t bucket_count;              /**< Number of buckets */
+    size_t count;                     /**< Number of keys */
+    size_t key_bytes;                 /**< Key names, terminators included */
+    size_t value_bytes;               /**< Values, in pages and blob files */
+    size_t blob_count;                /**< Values in blob files */
+    size_t blob_bytes;                /**< Same, bytes */
+    unsigned long page_writes;        /**< Pages written */
+    unsigned long checkpoints;        /**< Checkpoints completed */
+    unsigned long replayed;           /**< Journal records written back by the recovery */
+    unsigned long corrupt_pages;      /**< Pages failing their checksum at recovery */
+    unsigned long duplicates;         /**< Older copies of a key removed by the recovery */
+} backend_packed_shard_t;
+
+typedef struct {
+    int index;                         /**< Shard the index belonged to */
+    backend_packed_entry_t ** buckets; /**< Index retired by dict_backend_clear() */
+    size_t bucket_count;               /**< Number of buckets */
+} backend_packed_retired_t;
+
+/* === Private variable declarations =========================================================== */
+
+/* === Private function declarations =========================================================== */
+
+static uint64_t backend_packed_now_ns(void);
+
+static uint32_t backend_packed_hash(const char * key, size_t length);
+
+static uint32_t backend_packed_crc(uint32_t crc, const void * data, size_t length);
+
+static backend_packed_shard_t * backend_packed_shard(uint32_t hash);
+
+static void backend_packed_path(int index, char * path, size_t path_size);
+
+static void backend_packed_journal_path(int index, char * path, size_t path_size);
+
+static void backend_packed_blob_path(int index, uint64_t seq, char * path, size_t path_size);
+
+static backend_packed_entry_t ** backend_packed_find(backend_packed_shard_t * shard,
+                                                     const char * key, uint32_t hash);
+
+static int backend_packed_grow(backend_packed_shard_t * shard);
+
+static backend_packed_entry_t * backend_packed_index(backend_packed_shard_t * shard,
+                                                     const char * key, size_t key_len,
+                                                     uint32_t hash);
+
+static void backend_packed_unindex(backend_packed_shard_t * shard, backend_packed_entry_t ** link);
+
+static size_t backend_packed_record_size(size_t key_len, uint32_t value_len, uint16_t flags);
+
+static void backend_packed_page_init(backend_packed_page_t * page);
+
+static size_t backend_packed_page_free(const backend_packed_page_t * page);
+
+static void backend_packed_page_compact(backend_packed_page_t * page);
+
+static int backend_packed_page_insert(backend_packed_page_t * page, const void * record,
+                                      size_t length);
+
+static void backend_packed_page_remove(backend_packed_page_t * page, uint16_t slot);
+
+static int backend_packed_page_read(backend_packed_shard_t * shard, uint32_t index,
+                                    backend_packed_page_t * page);
+
+static int backend_packed_page_write(backend_packed_shard_t * shard, uint32_t index,
+                                     backend_packed_page_t * page);
+
+static void backend_packed_unstage(backend_packed_shard_t * shard);
+
+static int backend_packed_checkpoint(backend_packed_shard_t * shard);
+
+static int backend_packed_replay(backend_packed_shard_t * shard);
+
+static void backend_packed_fsm_link(backend_packed_shard_t * shard, uint32_t page, size_t free);
+
+static void backend_packed_fsm_unlink(backend_packed_shard_t * shard, uint32_t page);
+
+static void backend_packed_fsm_set(backend_packed_shard_t * shard, uint32_t page, size_t free);
+
+static uint32_t backend_packed_fsm_find(backend_packed_shard_t * shard, size_t need);
+
+static int backend_packed_place(backend_packed_shard_t * shard, const backend_packed_entry_t * old,
+                                const void * record, size_t length, uint32_t * page_index,
+                                uint16_t * slot);
+
+static int backend_packed_blob_write(int index, uint64_t seq, const char * value, int length);
+
+static int backend_packed_blob_read(int index, const backend_packed_entry_t * entry,
+                                    char * buffer, int buffer_size);
+
+static int backend_packed_fsync_dir(void);
+
+static int backend_packed_recover(backend_packed_shard_t * shard);
+
+static int backend_packed_seq_compare(const void * a, const void * b);
+
+static void backend_packed_prune(void);
+
+static void backend_packed_release(void * arg);
+
+static int backend_packed_open(const dict_server_config_t * config);
+
+static void backend_packed_close(void);
+
+DICT_ENGINE_ENTRY int backend_packed_get(const char * key, char * buffer, int buffer_size,
+                                         int * length);
+
+DICT_ENGINE_ENTRY int backend_packed_put(const char * key, const char * value, int length);
+
+DICT_ENGINE_ENTRY int backend_packed_del(const char * key);
+
+static int backend_packed_iterate(dict_backend_key_visit visit, void * context);
+
+static int backend_packed_stats(char * buffer, int buffer_size);
+
+static int backend_packed_flush(void);
+
+static int backend_packed_count(size_t * count);
+
+static int backend_packed_clear(void);
+
+static int backend_packed_defrag(int budget_us);
+
+static int backend_packed_memory(dict_backend_memory_t * memory);
+
+DICT_ENGINE_ENTRY int backend_packed_usage(const char * key, size_t * bytes);
+
+DICT_ENGINE_ENTRY int backend_packed_prefetch(const char * key);
+
+/* === Public variable definitions ============================================================= */
+
+const dict_engine_t dict_engine_packed = {
+    .name = "packed",
+    .key_max = BACKEND_PACKED_MAX_KEY,
+    .open = backend_packed_open,
+    .close = backend_packed_close,
+    .get = backend_packed_get,
+    .put = backend_packed_put,
+    .del = backend_packed_del,
+    .iterate = backend_packed_iterate,
+    .stats = backend_packed_stats,
+    .flush = backend_packed_flush,
+    .count = backend_packed_count,
+    .clear = backend_packed_clear,
+    .defrag = backend_packed_defrag,
+    .memory = backend_packed_memory,
+    .usage = backend_packed_usage,
+    .prefetch = backend_packed_prefetch,
+};
+
+/* === Private variable definitions ============================================================ */
+
+static backend_packed_shard_t backend_packed_shards[BACKEND_PACKED_SHARDS];
+static uint32_t backend_packed_crc_table[256]; /**< CRC-32C lookup table */
+static int backend_packed_sync;                /**< Writes are durable before acknowledged */
+static unsigned long backend_packed_recovery_ms; /**< Time the recovery took */
+static unsigned long backend_packed_pruned;    /**< Unreferenced blob files removed */
+static int backend_packed_checkpoint_cursor;   /**< Next shard to checkpoint */
+
+/* === Private function implementation ========================================================= */
+/**
+ * @brief Monotonic clock.
+ *
+ * @return uint64_t Nanoseconds.
+ */
+static uint64_t backend_packed_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+/**
+ * @brief FNV-1a hash of a key. The low bits pick the shard, the rest the bucket.
+ *
+ * @param key Key bytes.
+ * @param length Key length.
+ * @return uint32_t Hash.
+ */
+static uint32_t backend_packed_hash(const char * key, size_t length) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++)
+        hash = (hash ^ (unsigned char)key[i]) * 16777619u;
+    return hash;
+}
+/**
+ * @brief Continue a CRC-32C.
+ *
+ * @param crc CRC so far, 0 to start.
+ * @param data Bytes to add.
+ * @param length Number of bytes.
+ * @return uint32_t Updated CRC.
+ */
+static uint32_t backend_packed_crc(uint32_t crc, const void * data, size_t length) {
+    const unsigned char * bytes = data;
+    crc = ~crc;
+    for (size_t i = 0; i < length; i++)
+        crc = backend_packed_crc_table[(crc ^ bytes[i]) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+/**
+ * @brief Shard a key belongs to.
+ *
+ * @param hash Key hash.
+ * @return backend_packed_shard_t* Shard.
+ */
+static backend_packed_shard_t * backend_packed_shard(uint32_t hash) {
+    return &backend_packed_shards[hash & (BACKEND_PACKED_SHARDS - 1)];
+}
+/**
+ * @brief Build the path of a shard page file.
+ *
+ * @param index Shard index.
+ * @param path Buffer where the path will be stored.
+ * @param path_size Path buffer's size.
+ */
+static void backend_packed_path(int index, char * path, size_t path_size) {
+    snprintf(path, path_size, "%s/shard.%02d.pages", BACKEND_PACKED_DIR, index);
+}
+/**
+ * @brief Build the path of a shard journal.
+ *
+ * @param index Shard index.
+ * @param path Buffer where the path will be stored.
+ * @param path_size Path buffer's size.
+ */
+static void backend_packed_journal_path(int index, char * path, size_t path_size) {
+    snprintf(path, path_size, "%s/shard.%02d.journal", BACKEND_PACKED_DIR, index);
+}
+/**
+ * @brief Build the path of a blob file. The sequence of the record makes the name unique.
+ *
+ * @param index Shard index.
+ * @param seq Record sequence.
+ * @param path Buffer where the path will be stored.
+ * @param path_size Path buffer's size.
+ */
+static void backend_packed_blob_path(int index, uint64_t seq, char * path, size_t path_size) {
+    snprintf(path, path_size, "%s/blob.%02d.%016llx", BACKEND_PACKED_DIR, index,
+             (unsigned long long)seq);
+}
+/**
+ * @brief Find the link pointing to a key. The shard lock must be held.
+ *
+ * @param shard Shard.
+ * @param key Key name.
+ * @param hash Key hash.
+ * @return backend_packed_entry_t** Link to the entry, it points to NULL if the key is missing.
+ */
+static backend_packed_entry_t ** backend_packed_find(backend_packed_shard_t * shard,
+                                                     const char * key, uint32_t hash) {
+    backend_packed_entry_t ** link =
+        &shard->buckets[(hash / BACKEND_PACKED_SHARDS) & (shard->bucket_count - 1)];
+    while (*link != NULL && ((*link)->hash != hash || strcmp((*link)->key, key) != 0))
+        link = &(*link)->next;
+    return link;
+}
+/**
+ * @brief Double the buckets of a shard index. The write lock must be held.
+ *
+ * @param shard Shard.
+ * @return int 0 if no error, -1 if out of memory.
+ */
+static int backend_packed_grow(backend_packed_shard_t * shard) {
+    size_t count = shard->bucket_count * 2;
+    backend_packed_entry_t ** buckets = calloc(count, sizeof(*buckets));
+    if (buckets == NULL)
+        return -1;
+
+    for (size_t i = 0; i < shard->bucket_count; i++) {
+        backend_packed_entry_t * entry = shard->buckets[i];
+        while (entry != NULL) {
+            backend_packed_entry_t * next = entry->next;
+            size_t bucket = (entry->hash / BACKEND_PACKED_SHARDS) & (count - 1);
+            entry->next = buckets[bucket];
+            buckets[bucket] = entry;
+            entry = next;
+        }
+    }
+    free(shard->buckets);
+    shard->buckets = buckets;
+    shard->bucket_count = count;
+    return 0;
+}
+/**
+ * @brief Add a key to the index, its location is set by the caller. The write lock must be held
+ * and the key must not be indexed.
+ *
+ * @param shard Shard.
+ * @param key Key bytes.
+ * @param key_len Key length.
+ * @param hash Key hash.
+ * @return backend_packed_entry_t* New entry, NULL if out of memory.
+ */
+static backend_packed_entry_t * backend_packed_index(backend_packed_shard_t * shard,
+                                                     const char * key, size_t key_len,
+                                                     uint32_t hash) {
+    backend_packed_entry_t * entry = calloc(1, sizeof(*entry) + key_len + 1);
+    if (entry == NULL)
+        return NULL;
+    memcpy(entry->key, key, key_len);
+    entry->hash = hash;
+
+    size_t bucket = (hash / BACKEND_PACKED_SHARDS) & (shard->bucket_count - 1);
+    entry->next = shard->buckets[bucket];
+    shard->buckets[bucket] = entry;
+    shard->count++;
+    shard->key_bytes += key_len + 1;
+    if (shard->count > shard->bucket_count)
+        backend_packed_grow(shard);
+    return entry;
+}
+/**
+ * @brief Remove a key from the index. The write lock must be held.
+ *
+ * @param shard Shard.
+ * @param link Link to the entry.
+ */
+static void backend_packed_unindex(backend_packed_shard_t * shard, backend_packed_entry_t ** link) {
+    backend_packed_entry_t * entry = *link;
+    *link = entry->next;
+    shard->count--;
+    shard->key_bytes -= strlen(entry->key) + 1;
+    shard->value_bytes -= entry->value_len;
+    if (entry->flags & BACKEND_PACKED_BLOB) {
+        shard->blob_count--;
+        shard->blob_bytes -= entry->value_len;
+    }
+    free(entry);
+}
+/**
+ * @brief Bytes a record takes in its page.
+ *
+ * @param key_len Key length.
+ * @param value_len Value length.
+ * @param flags Record flags.
+ * @return size_t Record length.
+ */
+static size_t backend_packed_record_size(size_t key_len, uint32_t value_len, uint16_t flags) {
+    return sizeof(backend_packed_record_t) + key_len +
+           (flags & BACKEND_PACKED_BLOB ? 0 : value_len);
+}
+/**
+ * @brief Make a page empty.
+ *
+ * @param page Page.
+ */
+static void backend_packed_page_init(backend_packed_page_t * page) {
+    memset(page, 0, sizeof(*page));
+    page->data_start = BACKEND_PACKED_PAGE;
+}
+/**
+ * @brief Bytes a page can still take, holes left by removed records included.
+ *
+ * @param page Page.
+ * @return size_t Free bytes.
+ */
+static size_t backend_packed_page_free(const backend_packed_page_t * page) {
+    size_t used = offsetof(backend_packed_page_t, slots) +
+                  page->slot_count * sizeof(backend_packed_slot_t);
+    for (int slot = 0; slot < page->slot_count; slot++)
+        if (page->slots[slot].offset != 0)
+            used += page->slots[slot].length;
+    return BACKEND_PACKED_PAGE - used;
+}
+/**
+ * @brief Pack the records of a page against its end, turning the holes into contiguous space.
+ * Slot numbers stay the same.
+ *
+ * @param page Page.
+ */
+static void backend_packed_page_compact(backend_packed_page_t * page) {
+    backend_packed_page_t copy = *page;
+    page->data_start = BACKEND_PACKED_PAGE;
+    for (int slot = 0; slot < page->slot_count; slot++) {
+        backend_packed_slot_t * entry = &page->slots[slot];
+        if (entry->offset == 0)
+            continue;
+        page->data_start -= entry->length;
+        memcpy((unsigned char *)page + page->data_start, (unsigned char *)&copy + entry->offset,
+               entry->length);
+        entry->offset = page->data_start;
+    }
+}
+/**
+ * @brief Add a record to a page, compacting it if the contiguous space is too short.
+ *
+ * @param page Page.
+ * @param record Record bytes.
+ * @param length Record length.
+ * @return int Slot of the record, -1 if the page has no room for it.
+ */
+static int backend_packed_page_insert(backend_packed_page_t * page, const void * record,
+                                      size_t length) {
+    int slot = 0;
+    while (slot < page->slot_count && page->slots[slot].offset != 0)
+        slot++;
+
+    size_t need = length + (slot == page->slot_count ? sizeof(backend_packed_slot_t) : 0);
+    size_t directory = offsetof(backend_packed_page_t, slots) +
+                       page->slot_count * sizeof(backend_packed_slot_t);
+    if (page->data_start - directory < need) {
+        backend_packed_page_compact(page);
+        if (page->data_start - directory < need)
+            return -1;
+    }
+
+    if (slot == page->slot_count)
+        page->slot_count++;
+    page->data_start -= length;
+    memcpy((unsigned char *)page + page->data_start, record, length);
+    page->slots[slot].offset = page->data_start;
+    page->slots[slot].length = length;
+    return slot;
+}
+/**
+ * @brief Remove a record from a page. Its bytes become a hole until the next compaction.
+ *
+ * @param page Page.
+ * @param slot Slot of the record.
+ */
+static void backend_packed_page_remove(backend_packed_page_t * page, uint16_t slot) {
+    if (slot >= page->slot_count)
+        return;
+    page->slots[slot].offset = 0;
+    page->slots[slot].length = 0;
+    while (page->slot_count > 0 && page->slots[page->slot_count - 1].offset == 0)
+        page->slot_count--;
+    if (page->slot_count == 0)
+        page->data_start = BACKEND_PACKED_PAGE;
+}
+/**
+ * @brief Read a page, its staged image if it has one. A page past the end of the file is new and
+ * read as empty.
+ *
+ * @param shard Shard.
+ * @param index Page number.
+ * @param page Where the page is stored.
+ * @return int 0 if no error, -1 otherwise.
+ */
+static int backend_packed_page_read(backend_packed_shard_t * shard, uint32_t index,
+                                    backend_packed_page_t * page) {
+    if (shard->staged[index] != NULL) {
+        memcpy(page, shard->staged[index], sizeof(*page));
+        return 0;
+    }
+    ssize_t read = pread(shard->fd, page, sizeof(*page), (off_t)index * BACKEND_PACKED_PAGE);
+    DICT_TRACE_SYSCALL(DICT_TRACE_READ);
+    if (read == 0) {
+        backend_packed_page_init(page);
+        return 0;
+    }
+    return read == sizeof(*page) ? 0 : -1;
+}
+/**
+ * @brief Checksum a page and stage it: its image is appended to the journal and read from memory
+ * until a checkpoint writes it in place. The write lock must be held.
+ *
+ * @param shard Shard.
+ * @param index Page number.
+ * @param page Page.
+ * @return int 0 if no error, -1 otherwise.
+ */
+static int backend_packed_page_write(backend_packed_shard_t * shard, uint32_t index,
+                                     backend_packed_page_t * page) {
+    page->crc = backend_packed_crc(0, (unsigned char *)page + sizeof(page->crc),
+                                   sizeof(*page) - sizeof(page->crc));
+
+    // Every page image is a record, so the journal also bounds the pages staged.
+    backend_packed_journal_t header = {.page = index};
+    if (shard->journal_size >=
+            BACKEND_PACKED_JOURNAL_PAGES * (off_t)(sizeof(header) + sizeof(*page)) &&
+        backend_packed_checkpoint(shard) < 0)
+        return -1;
+    backend_packed_page_t * staged = shard->staged[index];
+    if (staged == NULL && (staged = malloc(sizeof(*staged))) == NULL)
+        return -1;
+
+    // A record torn by a failed write is overwritten by the next one, the replay stops at it.
+    header.crc = backend_packed_crc(backend_packed_crc(0, &header.page, sizeof(header.page)), page,
+                                    sizeof(*page));
+    struct iovec iov[] = {{&header, sizeof(header)}, {page, sizeof(*page)}};
+    shard->page_writes++;
+    ssize_t written = pwritev(shard->journal_fd, iov, 2, shard->journal_size);
+    DICT_TRACE_SYSCALL(DICT_TRACE_WRITE);
+    if (written != sizeof(header) + sizeof(*page)) {
+        LOG_ERROR("Packed : Can not journal page %u of shard %d", index, shard->index);
+        if (staged != shard->staged[index])
+            free(staged);
+        return -1;
+    }
+    shard->journal_size += sizeof(header) + sizeof(*page);
+
+    if (shard->staged[index] == NULL) {
+        shard->staged[index] = staged;
+        shard->staged_pages[shard->staged_count++] = index;
+    }
+    memcpy(staged, page, sizeof(*page));
+    return 0;
+}
+/**
+ * @brief Drop the staged images of a shard. The write lock must be held.
+ *
+ * @param shard Shard.
+ */
+static void backend_packed_unstage(backend_packed_shard_t * shard) {
+    for (uint32_t i = 0; i < shard->staged_count; i++) {
+        free(shard->staged[shard->staged_pages[i]]);
+        shard->staged[shard->staged_pages[i]] = NULL;
+    }
+    shard->staged_count = 0;
+}
+/**
+ * @brief Write the staged pages of a shard in place. The journal is synced first, so the recovery
+ * restores a page torn here, and emptied once the pages are durable. The write lock must be held.
+ *
+ * @param shard Shard.
+ * @return int 0 if no error, -1 otherwise, the pages not yet durable then stay staged.
+ */
+static int backend_packed_checkpoint(backend_packed_shard_t * shard) {
+    if (shard->staged_count == 0)
+        return 0;
+    if (fdatasync(shard->journal_fd) < 0)
+        return -1;
+    for (uint32_t i = 0; i < shard->staged_count; i++) {
+        uint32_t index = shard->staged_pages[i];
+        ssize_t written = pwrite(shard->fd, shard->staged[index], sizeof(backend_packed_page_t),
+                                 (off_t)index * BACKEND_PACKED_PAGE);
+        DICT_TRACE_SYSCALL(DICT_TRACE_WRITE);
+        if (written != sizeof(backend_packed_page_t)) {
+            LOG_ERROR("Packed : Can not write page %u of shard %d", index, shard->index);
+            return -1;
+        }
+    }
+    if (fdatasync(shard->fd) < 0)
+        return -1;
+    backend_packed_unstage(shard);
+    shard->checkpoints++;
+
+    // Left as it is, the journal is only written back again: appends go on after its end.
+    if (ftruncate(shard->journal_fd, 0) < 0)
+        return -1;
+    shard->journal_size = 0;
+    return fsync(shard->journal_fd) < 0 ? -1 : 0;
+}
+/**
+ * @brief Write the journal of a shard back to its page file, up to its first torn record, and
+ * empty it. Restores the pages a checkpoint tore and writes the ones it did not reach.
+ *
+ * @param shard Shard, with its page file and journal open.
+ * @return int
+ *              - SERVER_OK if no error.
+ *              - SERVER_E_OS if the files could not be read or written.
+ */
+static int backend_packed_replay(backend_packed_shard_t * shard) {
+    backend_packed_journal_t header;
+    backend_packed_page_t page;
+    off_t offset = 0;
+    while (pread(shard->journal_fd, &header, sizeof(header), offset) == sizeof(header) &&
+           pread(shard->journal_fd, &page, sizeof(page), offset + sizeof(header)) ==
+               sizeof(page) &&
+           header.crc == backend_packed_crc(backend_packed_crc(0, &header.page,
+                                                               sizeof(header.page)),
+                                            &page, sizeof(page))) {
+        if (pwrite(shard->fd, &page, sizeof(page), (off_t)header.page * BACKEND_PACKED_PAGE) !=
+            sizeof(page))
+            return SERVER_E_OS;
+        shard->replayed++;
+        offset += sizeof(header) + sizeof(page);
+    }
+
+    if (shard->replayed > 0 && fdatasync(shard->fd) < 0)
+        return SERVER_E_OS;
+    if (ftruncate(shard->journal_fd, 0) < 0 || fsync(shard->journal_fd) < 0)
+        return SERVER_E_OS;
+    return SERVER_OK;
+}
+/**
+ * @brief Put a page in the free space list of its class. The write lock must be held.
+ *
+ * @param shard Shard.
+ * @param page Page number.
+ * @param free Free bytes of the page.
+ */
+static void backend_packed_fsm_link(backend_packed_shard_t * shard, uint32_t page, size_t free) {
+    int class = free / BACKEND_PACKED_CLASS_BYTES;
+    shard->page_free[page] = free;
+    shard->page_prev[page] = BACKEND_PACKED_NONE;
+    shard->page_next[page] = shard->class_head[class];
+    if (shard->class_head[class] != BACKEND_PACKED_NONE)
+        shard->page_prev[shard->class_head[class]] = page;
+    shard->class_head[class] = page;
+}
+/**
+ * @brief Take a page out of the free space list of its class. The write lock must be held.
+ *
+ * @param shard Shard.
+ * @param page Page number.
+ */
+static void backend_packed_fsm_unlink(backend_packed_shard_t * shard, uint32_t page) {
+    int class = shard->page_free[page] / BACKEND_PACKED_CLASS_BYTES;
+    uint32_t prev = shard->page_prev[page];
+    uint32_t next = shard->page_next[page];
+    if (prev != BACKEND_PACKED_NONE)
+        shard->page_next[prev] = next;
+    else
+        shard->class_head[class] = next;
+    if (next != BACKEND_PACKED_NONE)
+        shard->page_prev[next] = prev;
+}
+/**
+ * @brief Record the free bytes of a page after it was written. The write lock must be held.
+ *
+ * @param shard Shard.
+ * @param page Page number.
+ * @param free Free bytes of the page.
+ */
+static void backend_packed_fsm_set(backend_packed_shard_t * shard, uint32_t page, size_t free) {
+    if (shard->page_free[page] / BACKEND_PACKED_CLASS_BYTES == free / BACKEND_PACKED_CLASS_BYTES) {
+        shard->page_free[page] = free;
+        return;
+    }
+    backend_packed_fsm_unlink(shard, page);
+    backend_packed_fsm_link(shard, page, free);
+}
+/**
+ * @brief Choose the page for a record. Every page of the smallest class at or above the size
+ * has room for it, the file grows by one page when no class has any. The write lock must be held.
+ *
+ * @param shard Shard.
+ * @param need Record length plus a slot.
+ * @return uint32_t Page number, BACKEND_PACKED_NONE if out of memory.
+ */
+static uint32_t backend_packed_fsm_find(backend_packed_shard_t * shard, size_t need) {
+    for (int class = (need + BACKEND_PACKED_CLASS_BYTES - 1) / BACKEND_PACKED_CLASS_BYTES;
+         class < BACKEND_PACKED_CLASSES; class++)
+        if (shard->class_head[class] != BACKEND_PACKED_NONE)
+            return shard->class_head[class];
+
+    if (shard->page_count == shard->page_capacity) {
+        uint32_t capacity = shard->page_capacity * 2;
+        uint16_t * page_free = realloc(shard->page_free, capacity * sizeof(*page_free));
+        if (page_free != NULL)
+            shard->page_free = page_free;
+        uint32_t * page_next = realloc(shard->page_next, capacity * sizeof(*page_next));
+        if (page_next != NULL)
+            shard->page_next = page_next;
+        uint32_t * page_prev = realloc(shard->page_prev, capacity * sizeof(*page_prev));
+        if (page_prev != NULL)
+            shard->page_prev = page_prev;
+        backend_packed_page_t ** staged = realloc(shard->staged, capacity * sizeof(*staged));
+        if (staged != NULL)
+            shard->staged = staged;
+        if (page_free == NULL || page_next == NULL || page_prev == NULL || staged == NULL)
+            return BACKEND_PACKED_NONE;
+        memset(staged + shard->page_capacity, 0,
+               (capacity - shard->page_capacity) * sizeof(*staged));
+        shard->page_capacity = capacity;
+    }
+
+    // Only reaches the file at a checkpoint, a read before its first write sees an empty page.
+    uint32_t page = shard->page_count++;
+    backend_packed_fsm_link(shard, page, BACKEND_PACKED_PAGE - offsetof(backend_packed_page_t,
+                                                                        slots));
+    return page;
+}
+/**
+ * @brief Write a record to a page, replacing the previous copy of its key. The write lock must be
+ * held.
+ *
+ * @param shard Shard.
+ * @param old Entry of the previous copy, NULL for a new key.
+ * @param record Record bytes.
+ * @param length Record length.
+ * @param page_index Where the page of the new copy is stored.
+ * @param slot Where the slot of the new copy is stored.
+ * @return int 0 if no error, -1 if the new copy could not be written.
+ */
+static int backend_packed_place(backend_packed_shard_t * shard, const backend_packed_entry_t * old,
+                                const void * record, size_t length, uint32_t * page_index,
+                                uint16_t * slot) {
+    backend_packed_page_t page;
+
+    // Still fitting its page, the value is replaced with a single page write.
+    if (old != NULL &&
+        shard->page_free[old->page] +
+                backend_packed_record_size(strlen(old->key), old->value_len, old->flags) >=
+            length) {
+        if (backend_packed_page_read(shard, old->page, &page) < 0)
+            return -1;
+        backend_packed_page_remove(&page, old->slot);
+        int inserted = backend_packed_page_insert(&page, record, length);
+        if (inserted >= 0) {
+            if (backend_packed_page_write(shard, old->page, &page) < 0)
+                return -1;
+            backend_packed_fsm_set(shard, old->page, backend_packed_page_free(&page));
+            *page_index = old->page;
+            *slot = inserted;
+            return 0;
+        }
+    }
+
+    for (;;) {
+        uint32_t target = backend_packed_fsm_find(shard, length + sizeof(backend_packed_slot_t));
+        if (target == BACKEND_PACKED_NONE || backend_packed_page_read(shard, target, &page) < 0)
+            return -1;
+        int inserted = backend_packed_page_insert(&page, record, length);
+        if (inserted < 0) {
+            // The map was off after a failed write, correct it and look again.
+            backend_packed_fsm_set(shard, target, backend_packed_page_free(&page));
+            continue;
+        }
+        if (backend_packed_page_write(shard, target, &page) < 0)
+            return -1;
+        backend_packed_fsm_set(shard, target, backend_packed_page_free(&page));
+        *page_index = target;
+        *slot = inserted;
+        break;
+    }
+
+    // A crash before this write leaves both copies, the recovery keeps the newer one.
+    if (old != NULL && backend_packed_page_read(shard, old->page, &page) == 0) {
+        backend_packed_page_remove(&page, old->slot);
+        if (backend_packed_page_write(shard, old->page, &page) == 0)
+            backend_packed_fsm_set(shard, old->page, backend_packed_page_free(&page));
+    }
+    return 0;
+}
+/**
+ * @brief Write a value too large for a page to its own file.
+ *
+ * @param index Shard index.
+ * @param seq Sequence of the record pointing to it.
+ * @param value Value bytes.
+ * @param length Value length.
+ * @return int 0 if no error, -1 otherwise.
+ */
+static int backend_packed_blob_write(int index, uint64_t seq, const char * value, int length) {
+    char path[PATH_MAX];
+    backend_packed_blob_path(index, seq, path, sizeof(path));
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    DICT_TRACE_SYSCALL(DICT_TRACE_OPEN);
+    if (fd < 0) {
+        LOG_ERROR("Packed : Can not create blob [%s]", path);
+        return -1;
+    }
+
+    int err = 0;
+    while (length > 0) {
+        ssize_t written = write(fd, value, length);
+        DICT_TRACE_SYSCALL(DICT_TRACE_WRITE);
+        if (written <= 0) {
+            err = -1;
+            break;
+        }
+        value += written;
+        length -= written;
+    }
+    if (err == 0 && backend_packed_sync && fdatasync(fd) < 0)
+        err = -1;
+    close(fd);
+    DICT_TRACE_SYSCALL(DICT_TRACE_CLOSE);
+
+    // Its name must be durable before a record points to it.
+    if (err == 0 && backend_packed_sync && backend_packed_fsync_dir() != SERVER_OK)
+        err = -1;
+    if (err < 0)
+        unlink(path);
+    return err;
+}
+/**
+ * @brief Read a value from its blob file. The shard lock must be held.
+ *
+ * @param index Shard index.
+ * @param entry Entry of the key.
+ * @param buffer Buffer where the value will be stored.
+ * @param buffer_size Buffer's size.
+ * @return int
+ *              - SERVER_OK if no error.
+ *              - SERVER_E_OS if the file could not be read.
+ */
+static int backend_packed_blob_read(int index, const backend_packed_entry_t * entry,
+                                    char * buffer, int buffer_size) {
+    char path[PATH_MAX];
+    backend_packed_blob_path(index, entry->seq, path, sizeof(path));
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    DICT_TRACE_SYSCALL(DICT_TRACE_OPEN);
+    if (fd < 0) {
+        LOG_ERROR("Packed : Can not open blob [%s]", path);
+        return SERVER_E_OS;
+    }
+
+    size_t wanted = entry->value_len < (uint32_t)buffer_size ? entry->value_len : buffer_size;
+    ssize_t read = pread(fd, buffer, wanted, 0);
+    DICT_TRACE_SYSCALL(DICT_TRACE_READ);
+    close(fd);
+    DICT_TRACE_SYSCALL(DICT_TRACE_CLOSE);
+    return read == (ssize_t)wanted ? SERVER_OK : SERVER_E_OS;
+}
+/**
+ * @brief fsync() BACKEND_PACKED_DIR, so the files created and removed in it are durable.
+ *
+ * @return int
+ *              - SERVER_OK if no error.
+ *              - SERVER_E_OS otherwise.
+ */
+static int backend_packed_fsync_dir(void) {
+    int fd = open(BACKEND_PACKED_DIR, O_RDONLY | O_DIRECTORY);
+    if (fd < 0)
+        return SERVER_E_OS;
+    int rt = fsync(fd);
+    close(fd);
+    return rt < 0 ? SERVER_E_OS : SERVER_OK;
+}
+/**
+ * @brief Rebuild the index and the free space map of a shard from its page file. Older copies
+ * of a key left by a crash are removed from their pages.
+ *
+ * @param shard Shard, with its page file open.
+ * @return int
+ *              - SERVER_OK if no error.
+ *              - SERVER_E_OS if the file could not be read or memory is short.
+ */
+static int backend_packed_recover(backend_packed_shard_t * shard) {
+    struct stat st;
+    if (fstat(shard->fd, &st) < 0)
+        return SERVER_E_OS;
+
+    // A page cut short by a crash while the file grew never held an acknowledged write.
+    uint32_t pages = st.st_size / BACKEND_PACKED_PAGE;
+    if (st.st_size % BACKEND_PACKED_PAGE != 0 &&
+        ftruncate(shard->fd, (off_t)pages * BACKEND_PACKED_PAGE) < 0)
+        return SERVER_E_OS;
+
+    while (shard->page_capacity < pages)
+        shard->page_capacity *= 2;
+    shard->page_free = malloc(shard->page_capacity * sizeof(*shard->page_free));
+    shard->page_next = malloc(shard->page_capacity * sizeof(*shard->page_next));
+    shard->page_prev = malloc(shard->page_capacity * sizeof(*shard->page_prev));
+    shard->staged = calloc(shard->page_capacity, sizeof(*shard->staged));
+    if (shard->page_free == NULL || shard->page_next == NULL || shard->page_prev == NULL ||
+        shard->staged == NULL)
+        return SERVER_E_OS;
+
+    backend_packed_page_t page;
+    char key[BACKEND_PACKED_MAX_KEY + 1];
+    for (uint32_t index = 0; index < pages; index++) {
+        shard->page_count = index + 1;
+        if (backend_packed_page_read(shard, index, &page) < 0)
+            return SERVER_E_OS;
+
+        // Never written, only zeros from a crash while the file grew.
+        if (page.crc == 0 && page.slot_count == 0 && page.data_start == 0) {
+            backend_packed_page_init(&page);
+        } else if (page.crc != backend_packed_crc(0, (unsigned char *)&page + sizeof(page.crc),
+                                                  sizeof(page) - sizeof(page.crc))) {
+            LOG_ERROR("Packed : Page %u of shard %d fails its checksum, skipped", index,
+                      shard->index);
+            shard->corrupt_pages++;
+            backend_packed_fsm_link(shard, index, 0);
+            continue;
+        }
+
+        int dirty = 0;
+        for (int slot = 0; slot < page.slot_count; slot++) {
+            backend_packed_slot_t * entry = &page.slots[slot];
+            if (entry->offset == 0)
+                continue;
+
+            backend_packed_record_t record;
+            if (entry->length < sizeof(record) ||
+                entry->offset + entry->length > BACKEND_PACKED_PAGE) {
+                backend_packed_page_remove(&page, slot);
+                dirty = 1;
+                continue;
+            }
+            memcpy(&record, (unsigned char *)&page + entry->offset, sizeof(record));
+            if (record.key_len == 0 || record.key_len > BACKEND_PACKED_MAX_KEY ||
+                backend_packed_record_size(record.key_len, record.value_len, record.flags) !=
+                    entry->length) {
+                backend_packed_page_remove(&page, slot);
+                dirty = 1;
+                continue;
+            }
+            memcpy(key, (unsigned char *)&page + entry->offset + sizeof(record), record.key_len);
+            key[record.key_len] = '\0';
+            if (record.seq > shard->seq)
+                shard->seq = record.seq;
+
+            uint32_t hash = backend_packed_hash(key, record.key_len);
+            backend_packed_entry_t * found = *backend_packed_find(shard, key, hash);
+            if (found != NULL && found->seq > record.seq) {
+                backend_packed_page_remove(&page, slot);
+                dirty = 1;
+                shard->duplicates++;
+                continue;
+            }
+            if (found != NULL) {
+                // Replaced by this copy, the older one goes from its page.
+                shard->duplicates++;
+                shard->value_bytes -= found->value_len;
+                if (found->flags & BACKEND_PACKED_BLOB) {
+                    shard->blob_count--;
+                    shard->blob_bytes -= found->value_len;
+                }
+                if (found->page == index) {
+                    backend_packed_page_remove(&page, found->slot);
+                    dirty = 1;
+                } else {
+                    backend_packed_page_t other;
+                    if (backend_packed_page_read(shard, found->page, &other) < 0)
+                        return SERVER_E_OS;
+                    backend_packed_page_remove(&other, found->slot);
+                    if (backend_packed_page_write(shard, found->page, &other) < 0)
+                        return SERVER_E_OS;
+                    backend_packed_fsm_set(shard, found->page, backend_packed_page_free(&other));
+                }
+            } else {
+                found = backend_packed_index(shard, key, record.key_len, hash);
+                if (found == NULL)
+                    return SERVER_E_OS;
+            }
+            found->seq = record.seq;
+            found->page = index;
+            found->slot = slot;
+            found->value_len = record.value_len;
+            found->flags = record.flags;
+            shard->value_bytes += record.value_len;
+            if (record.flags & BACKEND_PACKED_BLOB) {
+                shard->blob_count++;
+                shard->blob_bytes += record.value_len;
+            }
+        }
+
+        if (dirty && backend_packed_page_write(shard, index, &page) < 0)
+            return SERVER_E_OS;
+        backend_packed_fsm_link(shard, index, backend_packed_page_free(&page));
+    }
+    return SERVER_OK;
+}
+/**
+ * @brief qsort() and bsearch() comparison of sequences.
+ *
+ * @param a First sequence.
+ * @param b Second sequence.
+ * @return int Order of the sequences.
+ */
+static int backend_packed_seq_compare(const void * a, const void * b) {
+    uint64_t first = *(const uint64_t *)a;
+    uint64_t second = *(const uint64_t *)b;
+    return first < second ? -1 : first > second;
+}
+/**
+ * @brief Remove the blob files no record points to: written by a SET that crashed before its
+ * record, replaced by a copy the recovery kept, or left by a dict_backend_clear().
+ */
+static void backend_packed_prune(void) {
+    uint64_t * seqs[BACKEND_PACKED_SHARDS] = {0};
+    size_t counts[BACKEND_PACKED_SHARDS] = {0};
+
+    for (int index = 0; index < BACKEND_PACKED_SHARDS; index++) {
+        backend_packed_shard_t * shard = &backend_packed_shards[index];
+        if (shard->blob_count == 0)
+            continue;
+        seqs[index] = malloc(shard->blob_count * sizeof(**seqs));
+        if (seqs[index] == NULL)
+            goto finish; // Nothing is removed rather than something still in use.
+        for (size_t i = 0; i < shard->bucket_count; i++)
+            for (backend_packed_entry_t * entry = shard->buckets[i]; entry != NULL;
+                 entry = entry->next)
+                if (entry->flags & BACKEND_PACKED_BLOB)
+                    seqs[index][counts[index]++] = entry->seq;
+        qsort(seqs[index], counts[index], sizeof(**seqs), backend_packed_seq_compare);
+    }
+
+    DIR * dir = opendir(BACKEND_PACKED_DIR);
+    if (dir == NULL)
+        goto finish;
+    struct dirent * entry;
+    while ((entry = readdir(dir)) != NULL) {
+        int index;
+        unsigned long long seq;
+        if (sscanf(entry->d_name, "blob.%d.%llx", &index, &seq) != 2 || index < 0 ||
+            index >= BACKEND_PACKED_SHARDS)
+            continue;
+        uint64_t wanted = seq;
+        if (counts[index] > 0 &&
+            bsearch(&wanted, seqs[index], counts[index], sizeof(**seqs),
+                    backend_packed_seq_compare) != NULL)
+            continue;
+        if (unlinkat(dirfd(dir), entry->d_name, 0) == 0)
+            backend_packed_pruned++;
+    }
+    closedir(dir);
+
+finish:
+    for (int index = 0; index < BACKEND_PACKED_SHARDS; index++)
+        free(seqs[index]);
+}
+/**
+ * @brief Release an index retired by dict_backend_clear() and its blob files. Runs on the
+ * reclamation thread.
+ *
+ * @param arg Retired index, backend_packed_retired_t.
+ */
+static void backend_packed_release(void * arg) {
+    backend_packed_retired_t * retired = arg;
+    char path[PATH_MAX];
+    for (size_t i = 0; i < retired->bucket_count; i++) {
+        backend_packed_entry_t * entry = retired->buckets[i];
+        while (entry != NULL) {
+            backend_packed_entry_t * next = entry->next;
+            if (entry->flags & BACKEND_PACKED_BLOB) {
+                backend_packed_blob_path(retired->index, entry->seq, path, sizeof(path));
+                unlink(path);
+            }
+            free(entry);
+            entry = next;
+        }
+    }
+    free(retired->buckets);
+    free(retired);
+}
+
+/* === Public function implementation ========================================================== */
+
+static int backend_packed_open(const dict_server_config_t * config) {
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; bit++)
+            crc = crc & 1 ? (crc >> 1) ^ 0x82f63b78u : crc >> 1;
+        backend_packed_crc_table[i] = crc;
+    }
+
+    if (mkdir(BACKEND_PACKED_DIR, 0755) < 0 && errno != EEXIST) {
+        LOG_ERROR("Can not create packed directory [%s]", BACKEND_PACKED_DIR);
+        return SERVER_E_OS;
+    }
+    backend_packed_sync = config != NULL && config->sync_writes;
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < BACKEND_PACKED_SHARDS; i++) {
+        backend_packed_shard_t * shard = &backend_packed_shards[i];
+        memset(shard, 0, sizeof(*shard));
+        pthread_rwlock_init(&shard->lock, NULL);
+        shard->index = i;
+        shard->page_capacity = BACKEND_PACKED_PAGES;
+        for (int class = 0; class < BACKEND_PACKED_CLASSES; class++)
+            shard->class_head[class] = BACKEND_PACKED_NONE;
+        shard->bucket_count = BACKEND_PACKED_BUCKETS;
+        shard->buckets = calloc(BACKEND_PACKED_BUCKETS, sizeof(*shard->buckets));
+        if (shard->buckets == NULL)
+            return SERVER_E_OS;
+
+        char path[PATH_MAX];
+        backend_packed_path(i, path, sizeof(path));
+        shard->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (shard->fd < 0) {
+            LOG_ERROR("Packed : Can not open shard [%s]", path);
+            return SERVER_E_OS;
+        }
+        char journal[PATH_MAX];
+        backend_packed_journal_path(i, journal, sizeof(journal));
+        shard->journal_fd = open(journal, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if (shard->journal_fd < 0) {
+            LOG_ERROR("Packed : Can not open journal [%s]", journal);
+            return SERVER_E_OS;
+        }
+        int err = backend_packed_replay(shard);
+        if (err != SERVER_OK) {
+            LOG_ERROR("Packed : Can not replay journal [%s]", journal);
+            return err;
+        }
+        err = backend_packed_recover(shard);
+        if (err != SERVER_OK) {
+            LOG_ERROR("Packed : Can not recover shard [%s]", path);
+            return err;
+        }
+    }
+    backend_packed_prune();
+
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    backend_packed_recovery_ms =
+        (end.tv_sec - start.tv_sec) * 1000 + (end.tv_nsec - start.tv_nsec) / 1000000;
+    return SERVER_OK;
+}
+
+static int backend_packed_flush(void) {
+    int err = SERVER_OK;
+    for (int i = 0; i < BACKEND_PACKED_SHARDS; i++) {
+        backend_packed_shard_t * shard = &backend_packed_shards[i];
+        pthread_rwlock_wrlock(&shard->lock);
+        if (backend_packed_checkpoint(shard) < 0)
+            err = SERVER_E_OS;
+        pthread_rwlock_unlock(&shard->lock);
+    }
+    return err;
+}
+
+static void backend_packed_close(void) {
+    backend_packed_flush();
+    for (int i = 0; i < BACKEND_PACKED_SHARDS; i++) {
+        close(backend_packed_shards[i].fd);
+        close(backend_packed_shards[i].journal_fd);
+    }
+}
+
+DICT_ENGINE_ENTRY int backend_packed_get(const char * key, char * buffer, int buffer_size,
+                                         int * length) {
+    if (key == NULL || buffer == NULL || length == NULL)
+        return SERVER_E_NULL;
+
+    int err = SERVER_OK;
+    uint32_t hash = backend_packed_hash(key, strlen(key));
+    backend_packed_shard_t * shard = backend_packed_shard(hash);
+
+    pthread_rwlock_rdlock(&shard->lock);
+    backend_packed_entry_t * entry = *backend_packed_find(shard, key, hash);
+    if (entry == NULL) {
+        err = SERVER_E_NOT_FOUND;
+    } else if (entry->flags & BACKEND_PACKED_BLOB) {
+        err = backend_packed_blob_read(shard->index, entry, buffer, buffer_size);
+        *length = entry->value_len;
+    } else {
+        // The whole page in one read, the record offset is in its slot.
+        backend_packed_page_t page;
+        if (backend_packed_page_read(shard, entry->page, &page) < 0 ||
+            entry->slot >= page.slot_count) {
+            err = SERVER_E_OS;
+        } else {
+            size_t offset = page.slots[entry->slot].offset + sizeof(backend_packed_record_t) +
+                            strlen(entry->key);
+            size_t wanted =
+                entry->value_len < (uint32_t)buffer_size ? entry->value_len : buffer_size;
+            memcpy(buffer, (unsigned char *)&page + offset, wanted);
+            *length = entry->value_len;
+        }
+    }
+    pthread_rwlock_unlock(&shard->lock);
+
+    return err;
+}
+
+DICT_ENGINE_ENTRY int backend_packed_put(const char * key, const char * value, int length) {
+    if (key == NULL || value == NULL)
+        return SERVER_E_NULL;
+
+    size_t key_len = strlen(key);
+    if (key_len == 0 || key_len > BACKEND_PACKED_MAX_KEY || length < 0)
+        return SERVER_E_INVALID;
+
+    backend_packed_record_t header = {
+        .value_len = length,
+        .key_len = key_len,
+    };
+    if (backend_packed_record_size(key_len, length, 0) > BACKEND_PACKED_INLINE)
+        header.flags = BACKEND_PACKED_BLOB;
+    size_t record_len = backend_packed_record_size(key_len, length, header.flags);
+
+    int err = SERVER_OK;
+    uint32_t hash = backend_packed_hash(key, key_len);
+    backend_packed_shard_t * shard = backend_packed_shard(hash);
+
+    pthread_rwlock_wrlock(&shard->lock);
+    header.seq = ++shard->seq;
+    if (header.flags & BACKEND_PACKED_BLOB &&
+        backend_packed_blob_write(shard->index, header.seq, value, length) < 0) {
+        pthread_rwlock_unlock(&shard->lock);
+        return SERVER_E_OS;
+    }
+
+    unsigned char record[BACKEND_PACKED_INLINE];
+    memcpy(record, &header, sizeof(header));
+    memcpy(record + sizeof(header), key, key_len);
+    if (!(header.flags & BACKEND_PACKED_BLOB))
+        memcpy(record + sizeof(header) + key_len, value, length);
+
+    backend_packed_entry_t * entry = *backend_packed_find(shard, key, hash);
+    uint32_t page;
+    uint16_t slot;
+    if (backend_packed_place(shard, entry, record, record_len, &page, &slot) < 0) {
+        err = SERVER_E_OS;
+        if (header.flags & BACKEND_PACKED_BLOB) {
+            char path[PATH_MAX];
+            backend_packed_blob_path(shard->index, header.seq, path, sizeof(path));
+            unlink(path);
+        }
+        goto finish;
+    }
+    // The pages now hold the new record and no longer the old one, the index must follow them
+    // even if the change is not known to be durable. The old blob is kept for the page images
+    // on disk, a restart prunes whichever blob ends up unused.
+    int synced = !backend_packed_sync || fdatasync(shard->journal_fd) == 0;
+    if (!synced)
+        err = SERVER_E_OS;
+
+    uint64_t old_seq = 0;
+    if (entry != NULL) {
+        if (entry->flags & BACKEND_PACKED_BLOB) {
+            old_seq = entry->seq;
+            shard->blob_count--;
+            shard->blob_bytes -= entry->value_len;
+        }
+        shard->value_bytes -= entry->value_len;
+    } else if ((entry = backend_packed_index(shard, key, key_len, hash)) == NULL) {
+        err = SERVER_E_OS; // Stored, but only found again after a restart.
+        goto finish;
+    }
+    entry->seq = header.seq;
+    entry->page = page;
+    entry->slot = slot;
+    entry->value_len = length;
+    entry->flags = header.flags;
+    shard->value_bytes += length;
+    if (header.flags & BACKEND_PACKED_BLOB) {
+        shard->blob_count++;
+        shard->blob_bytes += length;
+    }
+
+    // The previous value's blob, no record points to it any more.
+    if (old_seq != 0 && synced) {
+        char path[PATH_MAX];
+        backend_packed_blob_path(shard->index, old_seq, path, sizeof(path));
+        unlink(path);
+    }
+
+finish:
+    pthread_rwlock_unlock(&shard->lock);
+    return err;
+}
+
+DICT_ENGINE_ENTRY int backend_packed_del(const char * key) {
+    if (key == NULL)
+        return SERVER_E_NULL;
+
+    int err = SERVER_OK;
+    uint32_t hash = backend_packed_hash(key, strlen(key));
+    backend_packed_shard_t * shard = backend_packed_shard(hash);
+
+    pthread_rwlock_wrlock(&shard->lock);
+    backend_packed_entry_t ** link = backend_packed_find(shard, key, hash);
+    backend_packed_entry_t * entry = *link;
+    backend_packed_page_t page;
+    if (entry == NULL) {
+        err = SERVER_E_NOT_FOUND;
+    } else if (backend_packed_page_read(shard, entry->page, &page) < 0) {
+        err = SERVER_E_OS;
+    } else {
+        backend_packed_page_remove(&page, entry->slot);
+        if (backend_packed_page_write(shard, entry->page, &page) < 0) {
+            err = SERVER_E_OS;
+        } else {
+            // Staged, the index follows the page even if the journal could not be synced. The
+            // blob is then kept for the page image on disk, a restart prunes it if unused.
+            int synced = !backend_packed_sync || fdatasync(shard->journal_fd) == 0;
+            backend_packed_fsm_set(shard, entry->page, backend_packed_page_free(&page));
+            if (synced && entry->flags & BACKEND_PACKED_BLOB) {
+                char path[PATH_MAX];
+                backend_packed_blob_path(shard->index, entry->seq, path, sizeof(path));
+                unlink(path);
+            }
+            backend_packed_unindex(shard, link);
+            err = synced ? SERVER_OK : SERVER_E_OS;
+        }
+    }
+    pthread_rwlock_unlock(&shard->lock);
+
+    return err;
+}
+
+static int backend_packed_count(size_t * count) {
+    if (count == NULL)
+        return SERVER_E_NULL;
+
+    *count = 0;
+    for (int i = 0; i < BACKEND_PACKED_SHARDS; i++) {
+        pthread_rwlock_rdlock(&backend_packed_shards[i].lock);
+        *count += backend_packed_shards[i].count;
+        pthread_rwlock_unlock(&backend_packed_shards[i].lock);
+    }
+    return SERVER_OK;
+}
+
+static int backend_packed_clear(void) {
+    // Shard by shard, a crash in between leaves the shards not reached yet.
+    for (int i = 0; i < BACKEND_PACKED_SHARDS; i++) {
+        backend_packed_shard_t * shard = &backend_packed_shards[i];
+        char path[PATH_MAX];
+        backend_packed_path(i, path, sizeof(path));
+
+        backend_packed_retired_t * retired = malloc(sizeof(*retired));
+        backend_packed_entry_t ** buckets = calloc(BACKEND_PACKED_BUCKETS, sizeof(*buckets));
+        if (retired == NULL || buckets == NULL) {
+            free(retired);
+            free(buckets);
+            return SERVER_E_OS;
+        }
+
+        pthread_rwlock_wrlock(&shard->lock);
+        // The staged pages belong to the old file, the replay must not write them to the new one.
+        int fd = -1;
+        int truncated = ftruncate(shard->journal_fd, 0) == 0;
+        if (truncated)
+            shard->journal_size = 0;
+        if (!truncated || fsync(shard->journal_fd) < 0 || unlink(path) < 0 ||
+            (fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644)) < 0) {
+            pthread_rwlock_unlock(&shard->lock);
+            free(retired);
+            free(buckets);
+            LOG_ERROR("Packed : Can not replace shard [%s]", path);
+            return SERVER_E_OS;
+        }
+        backend_packed_unstage(shard);
+        dict_reclaim_file(shard->fd, (off_t)shard->page_count * BACKEND_PACKED_PAGE);
+        retired->index = i;
+        retired->buckets = shard->buckets;
+        retired->bucket_count = shard->bucket_count;
+        shard->fd = fd;
+        shard->buckets = buckets;
+        shard->bucket_count = BACKEND_PACKED_BUCKETS;
+        shard->count = 0;
+        shard->key_bytes = 0;
+        shard->value_bytes = 0;
+        shard->blob_count = 0;
+        shard->blob_bytes = 0;
+        shard->page_count = 0;
+        for (int class = 0; class < BACKEND_PACKED_CLASSES; class++)
+            shard->class_head[class] = BACKEND_PACKED_NONE;
+        pthread_rwlock_unlock(&shard->lock);
+
+        // The sequence goes on, new blob names never meet the ones being removed.
+        dict_reclaim_call(backend_packed_release, retired, 0);
+    }
+    return backend_packed_sync ? backend_packed_fsync_dir() : SERVER_OK;
+}
+
+static int backend_packed_iterate(dict_backend_key_visit visit, void * context) {
+    if (visit == NULL)
+        return SERVER_E_NULL;
+
+    for (int s = 0; s < BACKEND_PACKED_SHARDS; s++) {
+        backend_packed_shard_t * shard = &backend_packed_shards[s];
+        int stop = 0;
+        pthread_rwlock_rdlock(&shard->lock);
+        for (size_t i = 0; i < shard->bucket_count && !stop; i++)
+            for (backend_packed_entry_t * entry = shard->buckets[i]; entry != NULL && !stop;
+                 entry = entry->next)
+                stop = visit(entry->key, context);
+        pthread_rwlock_unlock(&shard->lock);
+        if (stop)
+            break;
+    }
+    return SERVER_OK;
+}
+
+static int backend_packed_stats(char * buffer, int buffer_size) {
+    size_t keys = 0;
+    size_t value_bytes = 0;
+    size_t blobs = 0;
+    size_t blob_bytes = 0;
+    unsigned long pages = 0;
+    unsigned long free_bytes = 0;
+    unsigned long page_writes = 0;
+    unsigned long staged = 0;
+    unsigned long checkpoints = 0;
+    unsigned long replayed = 0;
+    unsigned long corrupt = 0;
+    unsigned long duplicates = 0;
+
+    for (int i = 0; i < BACKEND_PACKED_SHARDS; i++) {
+        backend_packed_shard_t * shard = &backend_packed_shards[i];
+        pthread_rwlock_rdlock(&shard->lock);
+        keys += shard->count;
+        value_bytes += shard->value_bytes;
+        blobs += shard->blob_count;
+        blob_bytes += shard->blob_bytes;
+        pages += shard->page_count;
+        for (uint32_t page = 0; page < shard->page_count; page++)
+            free_bytes += shard->page_free[page];
+        page_writes += shard->page_writes;
+        staged += shard->staged_count;
+        checkpoints += shard->checkpoints;
+        replayed += shard->replayed;
+        corrupt += shard->corrupt_pages;
+        duplicates += shard->duplicates;
+        pthread_rwlock_unlock(&shard->lock);
+    }
+
+    // Files stay at two per shard plus the large values, whatever the number of keys.
+    return snprintf(buffer, buffer_size,
+                    "backend:packed\nbackend_persistent:1\n"
+                    "backend_dir:%s\nbackend_shards:%d\nbackend_keys:%zu\n"
+                    "backend_sync:%d\nbackend_value_bytes:%zu\nbackend_page_size:%d\n"
+                    "backend_pages:%lu\nbackend_page_free_bytes:%lu\nbackend_page_writes:%lu\n"
+                    "backend_staged_pages:%lu\nbackend_checkpoints:%lu\n"
+                    "backend_blobs:%zu\nbackend_blob_bytes:%zu\nbackend_files:%zu\n"
+                    "backend_recovery_ms:%lu\nbackend_recovery_journal_pages:%lu\n"
+                    "backend_recovery_duplicates:%lu\n"
+                    "backend_recovery_corrupt_pages:%lu\nbackend_recovery_pruned_blobs:%lu\n",
+                    BACKEND_PACKED_DIR, BACKEND_PACKED_SHARDS, keys, backend_packed_sync,
+                    value_bytes, BACKEND_PACKED_PAGE, pages, free_bytes, page_writes, staged,
+                    checkpoints, blobs, blob_bytes, 2 * BACKEND_PACKED_SHARDS + blobs,
+                    backend_packed_recovery_ms, replayed, duplicates, corrupt,
+                    backend_packed_pruned);
+}
+
+static int backend_packed_defrag(int budget_us) {
+    uint64_t deadline = backend_packed_now_ns() + (uint64_t)budget_us * 1000;
+
+    // Checkpoints, a shard at a time. Space freed in a page is taken again through the free space
+    // map, pages are never returned.
+    for (int checked = 0; checked < BACKEND_PACKED_SHARDS; checked++) {
+        if (backend_packed_now_ns() >= deadline)
+            return 1;
+        backend_packed_shard_t * shard = &backend_packed_shards[backend_packed_checkpoint_cursor];
+        backend_packed_checkpoint_cursor =
+            (backend_packed_checkpoint_cursor + 1) % BACKEND_PACKED_SHARDS;
+        pthread_rwlock_wrlock(&shard->lock);
+        backend_packed_checkpoint(shard);
+        pthread_rwlock_unlock(&shard->lock);
+    }
+    return 0;
+}
+
+static int backend_packed_memory(dict_backend_memory_t * memory) {
+    if (memory == NULL)
+        return SERVER_E_NULL;
+
+    // Values stay in the pages and the page cache, the index, the map and the staged pages are in
+    // process memory.
+    memset(memory, 0, sizeof(*memory));
+    for (int i = 0; i < BACKEND_PACKED_SHARDS; i++) {
+        backend_packed_shard_t * shard = &backend_packed_shards[i];
+        pthread_rwlock_rdlock(&shard->lock);
+        memory->key_bytes += shard->key_bytes;
+        memory->index_bytes += shard->bucket_count * sizeof(*shard->buckets) +
+                               shard->count * sizeof(backend_packed_entry_t) +
+                               shard->page_capacity * (sizeof(*shard->page_free) +
+                                                       sizeof(*shard->page_next) +
+                                                       sizeof(*shard->page_prev) +
+                                                       sizeof(*shard->staged));
+        memory->cache_bytes += shard->staged_count * sizeof(backend_packed_page_t);
+        pthread_rwlock_unlock(&shard->lock);
+    }
+    memory->allocated_bytes = memory->key_bytes + memory->index_bytes + memory->cache_bytes;
+    return SERVER_OK;
+}
+
+DICT_ENGINE_ENTRY int backend_packed_usage(const char * key, size_t * bytes) {
+    if (key == NULL || bytes == NULL)
+        return SERVER_E_NULL;
+
+    int err = SERVER_OK;
+    size_t key_len = strlen(key);
+    uint32_t hash = backend_packed_hash(key, key_len);
+    backend_packed_shard_t * shard = backend_packed_shard(hash);
+
+    // The index entry, the record and its slot in the page, and the blocks of a blob file.
+    pthread_rwlock_rdlock(&shard->lock);
+    backend_packed_entry_t * entry = *backend_packed_find(shard, key, hash);
+    if (entry == NULL) {
+        err = SERVER_E_NOT_FOUND;
+    } else {
+        *bytes = sizeof(*entry) + key_len + 1 + sizeof(backend_packed_slot_t) +
+                 backend_packed_record_size(key_len, entry->value_len, entry->flags);
+        if (entry->flags & BACKEND_PACKED_BLOB)
+            *bytes += (entry->value_len + BACKEND_PACKED_PAGE - 1) / BACKEND_PACKED_PAGE *
+                      BACKEND_PACKED_PAGE;
+    }
+    pthread_rwlock_unlock(&shard->lock);
+    return err;
+}
+
+DICT_ENGINE_ENTRY int backend_packed_prefetch(const char * key) {
+    if (key == NULL)
+        return SERVER_E_NULL;
+
+    int err = SERVER_OK;
+    uint32_t hash = backend_packed_hash(key, strlen(key));
+    backend_packed_shard_t * shard = backend_packed_shard(hash);
+
+    // Only the key's page, or its blob file.
+    pthread_rwlock_rdlock(&shard->lock);
+    backend_packed_entry_t * entry = *backend_packed_find(shard, key, hash);
+    if (entry == NULL) {
+        err = SERVER_E_NOT_FOUND;
+    } else if (entry->flags & BACKEND_PACKED_BLOB) {
+        char path[PATH_MAX];
+        backend_packed_blob_path(shard->index, entry->seq, path, sizeof(path));
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        DICT_TRACE_SYSCALL(DICT_TRACE_OPEN);
+        if (fd < 0) {
+            err = SERVER_E_OS;
+        } else {
+            // The advice queues the read of the value, so it is counted as one.
+            if (posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED) != 0)
+                err = SERVER_E_OS;
+            DICT_TRACE_SYSCALL(DICT_TRACE_READ);
+            close(fd);
+            DICT_TRACE_SYSCALL(DICT_TRACE_CLOSE);
+        }
+    } else {
+        if (posix_fadvise(shard->fd, (off_t)entry->page * BACKEND_PACKED_PAGE, BACKEND_PACKED_PAGE,
+                          POSIX_FADV_WILLNEED) != 0)
+            err = SERVER_E_OS;
+        DICT_TRACE_SYSCALL(DICT_TRACE_READ);
+    }
+    pthread_rwlock_unlock(&shard->lock);
+    return err;
+}
+
+#endif /* DICT_CONFIG_ENGINE_PACKED */
+
+/* === End of documentation ==================================================================== */
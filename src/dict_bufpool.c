@@ -0,0 +1,172 @@
+/************************************************************************************************
+Copyright (c) 2024, Guido Ramirez <guidoramirez7@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute,
+sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial
+portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+SPDX-License-Identifier: MIT
+*************************************************************************************************/
+
+/** @file dict_bufpool.c
+ ** @brief Size class pool of connection buffers.
+ **/
+
+/* === Headers files inclusions =============================================================== */
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dict_bufpool.h"
+
+/* === Macros definitions ====================================================================== */
+
+/* === Private data type declarations ========================================================== */
+
+/** Free buffers are linked through their first bytes. */
+typedef struct bufpool_free {
+    struct bufpool_free * next; /**< Next free buffer of the same class */
+} bufpool_free_t;
+
+struct dict_bufpool_s {
+    bufpool_free_t * free[DICT_BUFPOOL_CLASSES]; /**< Free lists, indexed by class */
+    size_t keep_bytes;                           /**< Budget of the free lists */
+    atomic_size_t used_bytes;                    /**< Buffers handed out */
+    atomic_size_t cached_bytes;                  /**< Buffers on the free lists */
+    atomic_ulong gets;                           /**< Buffers requested */
+    atomic_ulong hits;                           /**< Requests served from a free list */
+    atomic_ulong grows;                          /**< Buffers replaced by a larger one */
+    atomic_ulong frees;                          /**< Buffers handed back to malloc() */
+};
+
+/* === Private variable declarations =========================================================== */
+
+/* === Private function declarations =========================================================== */
+
+static int bufpool_class(size_t size);
+
+static void bufpool_add(atomic_size_t * counter, long value);
+
+/* === Public variable definitions ============================================================= */
+
+/* === Private variable definitions ============================================================ */
+
+/* === Private function implementation ========================================================= */
+/**
+ * @brief Smallest class holding a size.
+ *
+ * @param size Bytes needed.
+ * @return int Class index, -1 if the size is larger than every class.
+ */
+static int bufpool_class(size_t size) {
+    if (size > DICT_BUFPOOL_MAX_SIZE)
+        return -1;
+    if (size <= DICT_BUFPOOL_MIN_SIZE)
+        return 0;
+    return 64 - __builtin_clzll((size - 1) / DICT_BUFPOOL_MIN_SIZE);
+}
+/**
+ * @brief Update a counter only the owner writes, so others can read it.
+ *
+ * @param counter Counter.
+ * @param value Amount to add, negative to subtract.
+ */
+static void bufpool_add(atomic_size_t * counter, long value) {
+    atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + value,
+                          memory_order_relaxed);
+}
+
+/* === Public function implementation ========================================================== */
+
+dict_bufpool dict_bufpool_create(size_t keep_bytes) {
+    dict_bufpool pool = calloc(1, sizeof(*pool));
+    if (pool != NULL)
+        pool->keep_bytes = keep_bytes;
+    return pool;
+}
+
+char * dict_bufpool_get(dict_bufpool pool, size_t size, size_t * capacity) {
+    int class = bufpool_class(size);
+    size_t bytes = class < 0 ? size : (size_t)DICT_BUFPOOL_MIN_SIZE << class;
+    atomic_fetch_add_explicit(&pool->gets, 1, memory_order_relaxed);
+    char * buffer = class < 0 ? NULL : (char *)pool->free[class];
+    if (buffer != NULL) {
+        pool->free[class] = pool->free[class]->next;
+        bufpool_add(&pool->cached_bytes, -(long)bytes);
+        atomic_fetch_add_explicit(&pool->hits, 1, memory_order_relaxed);
+    } else {
+        buffer = malloc(bytes);
+        if (buffer == NULL)
+            return NULL;
+    }
+    bufpool_add(&pool->used_bytes, bytes);
+    *capacity = bytes;
+    return buffer;
+}
+
+char * dict_bufpool_grow(dict_bufpool pool, char * buffer, size_t length, size_t size,
+                         size_t * capacity) {
+    size_t bytes;
+    char * grown = dict_bufpool_get(pool, size, &bytes);
+    if (grown == NULL)
+        return NULL;
+    memcpy(grown, buffer, length);
+    dict_bufpool_put(pool, buffer, *capacity);
+    atomic_fetch_add_explicit(&pool->grows, 1, memory_order_relaxed);
+    *capacity = bytes;
+    return grown;
+}
+
+void dict_bufpool_put(dict_bufpool pool, char * buffer, size_t capacity) {
+    if (buffer == NULL)
+        return;
+
+    bufpool_add(&pool->used_bytes, -(long)capacity);
+    if (capacity > DICT_BUFPOOL_MAX_SIZE ||
+        atomic_load_explicit(&pool->cached_bytes, memory_order_relaxed) + capacity >
+            pool->keep_bytes) {
+        free(buffer);
+        atomic_fetch_add_explicit(&pool->frees, 1, memory_order_relaxed);
+        return;
+    }
+
+    int class = bufpool_class(capacity);
+    bufpool_free_t * entry = (bufpool_free_t *)buffer;
+    entry->next = pool->free[class];
+    pool->free[class] = entry;
+    bufpool_add(&pool->cached_bytes, capacity);
+}
+
+void dict_bufpool_trim(dict_bufpool pool) {
+    for (int class = 0; class < DICT_BUFPOOL_CLASSES; class++) {
+        while (pool->free[class] != NULL) {
+            bufpool_free_t * entry = pool->free[class];
+            pool->free[class] = entry->next;
+            free(entry);
+            bufpool_add(&pool->cached_bytes, -(long)(DICT_BUFPOOL_MIN_SIZE << class));
+            atomic_fetch_add_explicit(&pool->frees, 1, memory_order_relaxed);
+        }
+    }
+}
+
+void dict_bufpool_usage(dict_bufpool pool, dict_bufpool_usage_t * usage) {
+    usage->used_bytes += atomic_load_explicit(&pool->used_bytes, memory_order_relaxed);
+    usage->cached_bytes += atomic_load_explicit(&pool->cached_bytes, memory_order_relaxed);
+    usage->gets += atomic_load_explicit(&pool->gets, memory_order_relaxed);
+    usage->hits += atomic_load_explicit(&pool->hits, memory_order_relaxed);
+    usage->grows += atomic_load_explicit(&pool->grows, memory_order_relaxed);
+    usage->frees += atomic_load_explicit(&pool->frees, memory_order_relaxed);
+}
+
+/* === End of documentation ==================================================================== */
@@ -0,0 +1,627 @@
+/************************************************************************************************
+Copyright (c) 2024, Guido Ramirez <guidoramirez7@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute,
+sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial
+portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+SPDX-License-Identifier: MIT
+*************************************************************************************************/
+
+/** @file dict_dump.c
+ ** @brief Keyspace export and import function implementation.
+ **
+ ** The key list is taken first with dict_backend_copy(). Engines keeping values in process
+ ** memory (memory, art) hand over a copy of every value too, taken under their lock: their part
+ ** of the export is a point in time snapshot, paid for with a second copy of their values while
+ ** the export runs. The values of the other engines are read when their part reaches them, while
+ ** SET, DEL and FLUSHALL keep running: each record holds a value the key had at some moment of
+ ** the export, keys created after the list was taken are missing and keys deleted before their
+ ** value was read are left out.
+ **
+ ** Parts are written to temporary names and only renamed once every part is complete, so a
+ ** failed export leaves the previous dump of the same name whole.
+ **/
+
+/* === Headers files inclusions =============================================================== */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "dict_dump.h"
+#include "dict_engine.h"
+#include "dict_server.h"
+#include "dict_log.h"
+
+/* === Macros definitions ====================================================================== */
+
+#define DUMP_IO_BUFFER_SIZE (1 << 20) /**< stdio buffer of every part file. */
+#define DUMP_MAX_PARTS      (64)      /**< Maximum part files accepted by an import. */
+#define DUMP_KEYS_INITIAL   (256)     /**< Initial capacity of the key list. */
+#define DUMP_VALUE_INITIAL  (4096)    /**< Initial capacity of the value buffer. */
+
+/* === Private data type declarations ========================================================== */
+
+typedef enum {
+    DUMP_JOB_SAVE = 0, /**< Export keys to part files */
+    DUMP_JOB_LOAD,     /**< Import keys from part files */
+} dump_job_kind;
+
+typedef struct {
+    char * key;   /**< Key name */
+    char * value; /**< Value copied with the key list, NULL if it is read when written */
+    int length;   /**< Value length */
+} dump_key_t;
+
+typedef struct {
+    dump_job_kind kind;  /**< Job kind */
+    char path[PATH_MAX]; /**< Path prefix of the part files */
+    dump_key_t * keys;   /**< Keys to export, only for DUMP_JOB_SAVE */
+    size_t key_count;    /**< Number of keys to export */
+    size_t key_capacity; /**< Capacity of the key list */
+    int key_err;         /**< Set if the key list is incomplete */
+} dump_job_t;
+
+typedef struct {
+    dump_job_t * job; /**< Job this part belongs to */
+    int index;        /**< Part number */
+    size_t first;     /**< First key of this part, only for DUMP_JOB_SAVE */
+    size_t count;     /**< Number of keys of this part, only for DUMP_JOB_SAVE */
+    size_t records;   /**< Records written or read */
+    int err;          /**< 0 if the part was processed without error */
+} dump_part_t;
+
+typedef enum {
+    DUMP_STATE_IDLE = 0, /**< No job since the start */
+    DUMP_STATE_RUNNING,  /**< A job is running */
+    DUMP_STATE_DONE,     /**< The last job completed */
+    DUMP_STATE_FAILED,   /**< The last job stopped on an error, see the log */
+} dump_state;
+
+typedef struct {
+    uint32_t key_len;   /**< Key length in bytes */
+    uint32_t value_len; /**< Value length in bytes */
+} dump_record_t;
+
+/* === Private variable declarations =========================================================== */
+
+/* === Private function declarations =========================================================== */
+
+static int dump_name_valid(const char * name);
+
+static int dump_job_start(dump_job_kind kind, const char * name);
+
+static void * dump_job_run(void * arg);
+
+static int dump_collect_key(const char * key, const char * value, int length, void * context);
+
+static int dump_publish(dump_job_t * job, int complete);
+
+static int dump_read_value(const char * key, char ** buffer, size_t * capacity);
+
+static void * dump_save_part(void * arg);
+
+static void * dump_load_part(void * arg);
+
+static uint64_t dump_now_ns(void);
+
+static void dump_status_finish(int failed, int parts);
+
+/* === Public variable definitions ============================================================= */
+
+/* === Private variable definitions ============================================================ */
+
+static atomic_int dump_busy; /**< Set while an export or import is running */
+
+static const char * const dump_state_names[] = {"idle", "running", "done", "failed"};
+
+static pthread_mutex_t dump_status_lock = PTHREAD_MUTEX_INITIALIZER; /**< Guards the last job */
+static dump_state dump_last_state;              /**< State of the last job */
+static dump_job_kind dump_last_kind;            /**< Kind of the last job */
+static char dump_last_name[DICT_DUMP_NAME_MAX + 1]; /**< Dump name of the last job */
+static int dump_last_parts;                     /**< Part files of the last finished job */
+static uint64_t dump_started_ns;                /**< Start of the last job */
+static uint64_t dump_finished_ns;               /**< End of the last job, 0 while running */
+static atomic_ulong dump_keys;                  /**< Records written or read by the last job */
+static atomic_ulong dump_bytes;                 /**< Bytes of those records */
+
+/* === Private function implementation ========================================================= */
+/**
+ * @brief Check that a dump name is a plain file name, so it stays inside DICT_DUMP_DIR.
+ *
+ * @param name Dump name.
+ * @return int Non zero if it can be used.
+ */
+static int dump_name_valid(const char * name) {
+    return name != NULL && name[0] != '\0' && name[0] != '.' && strchr(name, '/') == NULL &&
+           strlen(name) <= DICT_DUMP_NAME_MAX;
+}
+/**
+ * @brief Create the job and its coordinator thread.
+ *
+ * @param kind Job kind.
+ * @param name Dump name.
+ * @return int
+ *              - 0 if no error.
+ *              - -1 otherwise, with errno set.
+ */
+static int dump_job_start(dump_job_kind kind, const char * name) {
+    if (!dump_name_valid(name)) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (atomic_exchange(&dump_busy, 1)) {
+        errno = EBUSY;
+        return -1;
+    }
+    pthread_mutex_lock(&dump_status_lock);
+    dump_last_state = DUMP_STATE_RUNNING;
+    dump_last_kind = kind;
+    snprintf(dump_last_name, sizeof(dump_last_name), "%s", name);
+    dump_last_parts = 0;
+    dump_started_ns = dump_now_ns();
+    dump_finished_ns = 0;
+    atomic_store(&dump_keys, 0);
+    atomic_store(&dump_bytes, 0);
+    pthread_mutex_unlock(&dump_status_lock);
+
+    if (mkdir(DICT_DUMP_DIR, 0755) < 0 && errno != EEXIST)
+        goto error;
+
+    dump_job_t * job = calloc(1, sizeof(*job));
+    if (job == NULL)
+        goto error;
+    job->kind = kind;
+    snprintf(job->path, sizeof(job->path), "%s/%s", DICT_DUMP_DIR, name);
+
+    pthread_t thread;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    int rt = pthread_create(&thread, &attr, dump_job_run, job);
+    pthread_attr_destroy(&attr);
+    if (rt != 0) {
+        free(job);
+        errno = rt;
+        goto error;
+    }
+    return 0;
+
+error:
+    dump_status_finish(1, 0);
+    atomic_store(&dump_busy, 0);
+    return -1;
+}
+/**
+ * @brief Coordinator thread. Splits the job in parts and waits for every worker.
+ *
+ * @param arg Job to run.
+ * @return void* Always NULL.
+ */
+static void * dump_job_run(void * arg) {
+    dump_job_t * job = arg;
+    dump_part_t parts[DUMP_MAX_PARTS] = {0};
+    pthread_t threads[DUMP_MAX_PARTS];
+    int started[DUMP_MAX_PARTS] = {0};
+    int part_count = 0;
+    size_t records = 0;
+    int failed = 1;
+
+    if (job->kind == DUMP_JOB_SAVE) {
+        if (dict_backend_copy(dump_collect_key, job) != SERVER_OK || job->key_err) {
+            LOG_ERROR("Can not list keys to dump");
+            goto finish;
+        }
+        // Contiguous ranges, the last part takes the remainder.
+        size_t per_part = job->key_count / DICT_DUMP_THREADS;
+        for (int i = 0; i < DICT_DUMP_THREADS; i++) {
+            parts[i].first = i * per_part;
+            parts[i].count = i == DICT_DUMP_THREADS - 1 ? job->key_count - parts[i].first
+                                                         : per_part;
+        }
+        part_count = DICT_DUMP_THREADS;
+    } else {
+        char name[PATH_MAX + 16];
+        while (part_count < DUMP_MAX_PARTS) {
+            snprintf(name, sizeof(name), "%s.%d", job->path, part_count);
+            if (access(name, R_OK) < 0)
+                break;
+            part_count++;
+        }
+        if (part_count == 0) {
+            LOG_ERROR("No dump found at [%s]", job->path);
+            goto finish;
+        }
+    }
+
+    for (int i = 0; i < part_count; i++) {
+        parts[i].job = job;
+        parts[i].index = i;
+        int rt = pthread_create(&threads[i], NULL,
+                                job->kind == DUMP_JOB_SAVE ? dump_save_part : dump_load_part,
+                                &parts[i]);
+        if (rt != 0) {
+            // Run it inline, it is slower but the job is still complete.
+            if (job->kind == DUMP_JOB_SAVE)
+                dump_save_part(&parts[i]);
+            else
+                dump_load_part(&parts[i]);
+        } else {
+            started[i] = 1;
+        }
+    }
+
+    failed = 0;
+    for (int i = 0; i < part_count; i++) {
+        if (started[i])
+            pthread_join(threads[i], NULL);
+        records += parts[i].records;
+        failed |= parts[i].err;
+    }
+    if (job->kind == DUMP_JOB_SAVE)
+        failed = dump_publish(job, !failed) < 0 || failed;
+
+    if (failed)
+        LOG_ERROR("%s of [%s] finished with errors", job->kind == DUMP_JOB_SAVE ? "Dump" : "Load",
+                  job->path);
+    else
+        LOG_INFO("%s of [%s] finished. %zu keys in %d parts",
+                 job->kind == DUMP_JOB_SAVE ? "Dump" : "Load", job->path, records, part_count);
+
+finish:
+    for (size_t i = 0; i < job->key_count; i++) {
+        free(job->keys[i].key);
+        free(job->keys[i].value);
+    }
+    free(job->keys);
+    free(job);
+    dump_status_finish(failed, part_count);
+    atomic_store(&dump_busy, 0);
+    return NULL;
+}
+/**
+ * @brief Backend copy callback. Appends a key, and its value if the engine gave it, to the job's
+ * key list.
+ *
+ * @param key Key name.
+ * @param value Value bytes, NULL if the part reads it when written.
+ * @param length Value length.
+ * @param context Job where the list is stored.
+ * @return int 0 to continue, 1 to stop on allocation failure.
+ */
+static int dump_collect_key(const char * key, const char * value, int length, void * context) {
+    dump_job_t * job = context;
+
+    if (job->key_count == job->key_capacity) {
+        size_t capacity = job->key_capacity ? job->key_capacity * 2 : DUMP_KEYS_INITIAL;
+        dump_key_t * keys = realloc(job->keys, capacity * sizeof(*keys));
+        if (keys == NULL)
+            goto error;
+        job->keys = keys;
+        job->key_capacity = capacity;
+    }
+    dump_key_t * entry = &job->keys[job->key_count];
+    entry->key = strdup(key);
+    entry->value = value != NULL ? malloc(length > 0 ? length : 1) : NULL;
+    entry->length = length;
+    if (entry->key == NULL || (value != NULL && entry->value == NULL)) {
+        free(entry->key);
+        free(entry->value);
+        goto error;
+    }
+    if (value != NULL)
+        memcpy(entry->value, value, length);
+    job->key_count++;
+    return 0;
+
+error:
+    job->key_err = 1;
+    return 1;
+}
+/**
+ * @brief Put the parts of an export in place of the previous dump of the same name, or drop
+ * them. Parts the previous dump had beyond the new ones are removed, so a load never mixes two
+ * exports. If a rename fails, the dump is removed rather than left half replaced.
+ *
+ * @param job Export.
+ * @param complete Non zero if every part was written, zero to drop them.
+ * @return int 0 if no error, -1 otherwise.
+ */
+static int dump_publish(dump_job_t * job, int complete) {
+    char temp_name[PATH_MAX + 16];
+    char final_name[PATH_MAX + 16];
+    int err = 0;
+
+    for (int i = 0; i < DICT_DUMP_THREADS && complete && err == 0; i++) {
+        snprintf(temp_name, sizeof(temp_name), "%s.%d.tmp", job->path, i);
+        snprintf(final_name, sizeof(final_name), "%s.%d", job->path, i);
+        if (rename(temp_name, final_name) < 0) {
+            LOG_ERROR("Can not rename dump part [%s], removing the dump", temp_name);
+            err = -1;
+        }
+    }
+    for (int i = 0; i < DUMP_MAX_PARTS; i++) {
+        snprintf(temp_name, sizeof(temp_name), "%s.%d.tmp", job->path, i);
+        snprintf(final_name, sizeof(final_name), "%s.%d", job->path, i);
+        if (i < DICT_DUMP_THREADS)
+            unlink(temp_name);
+        if ((i >= DICT_DUMP_THREADS && complete) || err < 0)
+            unlink(final_name);
+    }
+    if (!complete)
+        return 0;
+
+    // The renames are only durable once the directory is.
+    int fd = open(DICT_DUMP_DIR, O_RDONLY | O_DIRECTORY);
+    if (fd < 0 || fsync(fd) < 0)
+        err = -1;
+    if (fd >= 0)
+        close(fd);
+    return err;
+}
+/**
+ * @brief Read the whole value of a key, growing the buffer as needed.
+ *
+ * @param key Key name.
+ * @param buffer Buffer where the value will be stored. It can be reallocated.
+ * @param capacity Buffer's capacity. It is updated if the buffer is reallocated.
+ * @return int
+ *              - Value length if no error.
+ *              - -1 if the key was deleted since the key list was built.
+ *              - -2 on any other error.
+ */
+static int dump_read_value(const char * key, char ** buffer, size_t * capacity) {
+    int length;
+
+    for (;;) {
+        int err = dict_backend_get(key, *buffer, *capacity, &length);
+        if (err == SERVER_E_NOT_FOUND)
+            return -1;
+        if (err != SERVER_OK)
+            return -2;
+        if ((size_t)length <= *capacity)
+            return length;
+
+        // Truncated, grow and read again. The value can change in between, so loop.
+        char * temp = realloc(*buffer, length);
+        if (temp == NULL)
+            return -2;
+        *buffer = temp;
+        *capacity = length;
+    }
+}
+/**
+ * @brief Export worker. Writes a range of the key list to its own temporary part file, renamed
+ * by dump_publish() once every part is complete.
+ *
+ * @param arg Part to write.
+ * @return void* Always NULL.
+ */
+static void * dump_save_part(void * arg) {
+    dump_part_t * part = arg;
+    dump_job_t * job = part->job;
+    char temp_name[PATH_MAX + 16];
+    char * io_buffer = NULL;
+    size_t capacity = DUMP_VALUE_INITIAL;
+    char * value = malloc(capacity);
+    FILE * file = NULL;
+
+    part->err = 1;
+    snprintf(temp_name, sizeof(temp_name), "%s.%d.tmp", job->path, part->index);
+
+    io_buffer = malloc(DUMP_IO_BUFFER_SIZE);
+    if (value == NULL || io_buffer == NULL)
+        goto finish;
+    file = fopen(temp_name, "wb");
+    if (file == NULL) {
+        LOG_ERROR("Can not create dump part [%s]", temp_name);
+        goto finish;
+    }
+    setvbuf(file, io_buffer, _IOFBF, DUMP_IO_BUFFER_SIZE);
+
+    if (fwrite(DICT_DUMP_MAGIC, 1, sizeof(DICT_DUMP_MAGIC) - 1, file) != sizeof(DICT_DUMP_MAGIC) - 1)
+        goto finish;
+
+    for (size_t i = part->first; i < part->first + part->count; i++) {
+        const char * key = job->keys[i].key;
+        const char * bytes = job->keys[i].value;
+        int length = job->keys[i].length;
+        if (bytes == NULL) {
+            length = dump_read_value(key, &value, &capacity);
+            if (length == -1)
+                continue;
+            if (length < 0) {
+                LOG_ERROR("Can not read key [%s] to dump", key);
+                goto finish;
+            }
+            bytes = value;
+        }
+
+        // LOAD refuses what no engine can store, so such a dump must not report success.
+        dump_record_t record = {.key_len = strlen(key), .value_len = length};
+        if (record.key_len > dict_engine_key_max()) {
+            LOG_ERROR("Key [%.64s...] is too long to dump", key);
+            goto finish;
+        }
+        if (fwrite(&record, sizeof(record), 1, file) != 1 ||
+            fwrite(key, 1, record.key_len, file) != record.key_len ||
+            fwrite(bytes, 1, record.value_len, file) != record.value_len)
+            goto finish;
+        part->records++;
+        atomic_fetch_add(&dump_keys, 1);
+        atomic_fetch_add(&dump_bytes, sizeof(record) + record.key_len + record.value_len);
+    }
+
+    if (fflush(file) != 0 || fsync(fileno(file)) < 0)
+        goto finish;
+    part->err = 0;
+
+finish:
+    if (file != NULL && fclose(file) != 0)
+        part->err = 1;
+    free(io_buffer);
+    free(value);
+    return NULL;
+}
+/**
+ * @brief Import worker. Stores every record of its part file through the backend.
+ *
+ * @param arg Part to read.
+ * @return void* Always NULL.
+ */
+static void * dump_load_part(void * arg) {
+    dump_part_t * part = arg;
+    dump_job_t * job = part->job;
+    char name[PATH_MAX + 16];
+    char magic[sizeof(DICT_DUMP_MAGIC) - 1];
+    char * io_buffer = NULL;
+    char * key = NULL;
+    size_t key_capacity = 0;
+    size_t key_max = dict_engine_key_max();
+    char * value = NULL;
+    size_t capacity = 0;
+    FILE * file = NULL;
+
+    part->err = 1;
+    snprintf(name, sizeof(name), "%s.%d", job->path, part->index);
+
+    io_buffer = malloc(DUMP_IO_BUFFER_SIZE);
+    if (io_buffer == NULL)
+        goto finish;
+    file = fopen(name, "rb");
+    if (file == NULL) {
+        LOG_ERROR("Can not open dump part [%s]", name);
+        goto finish;
+    }
+    setvbuf(file, io_buffer, _IOFBF, DUMP_IO_BUFFER_SIZE);
+
+    if (fread(magic, 1, sizeof(magic), file) != sizeof(magic) ||
+        memcmp(magic, DICT_DUMP_MAGIC, sizeof(magic)) != 0) {
+        LOG_ERROR("Invalid dump part [%s]", name);
+        goto finish;
+    }
+
+    dump_record_t record;
+    while (fread(&record, sizeof(record), 1, file) == 1) {
+        if (record.key_len == 0 || record.key_len > key_max || record.value_len > INT32_MAX)
+            goto corrupt;
+        if (record.key_len >= key_capacity) {
+            char * temp = realloc(key, record.key_len + 1);
+            if (temp == NULL)
+                goto finish;
+            key = temp;
+            key_capacity = record.key_len + 1;
+        }
+        if (fread(key, 1, record.key_len, file) != record.key_len)
+            goto corrupt;
+        key[record.key_len] = '\0';
+        if (strlen(key) != record.key_len)
+            goto corrupt;
+
+        if (record.value_len > capacity) {
+            char * temp = realloc(value, record.value_len);
+            if (temp == NULL)
+                goto finish;
+            value = temp;
+            capacity = record.value_len;
+        }
+        if (fread(value, 1, record.value_len, file) != record.value_len)
+            goto corrupt;
+
+        if (dict_backend_set(key, value, record.value_len) != SERVER_OK) {
+            LOG_ERROR("Can not load key [%s]", key);
+            goto finish;
+        }
+        part->records++;
+        atomic_fetch_add(&dump_keys, 1);
+        atomic_fetch_add(&dump_bytes, sizeof(record) + record.key_len + record.value_len);
+    }
+
+    if (ferror(file))
+        goto finish;
+    part->err = 0;
+    goto finish;
+
+corrupt:
+    LOG_ERROR("Corrupt record in dump part [%s] after %zu keys", name, part->records);
+
+finish:
+    if (file != NULL)
+        fclose(file);
+    free(io_buffer);
+    free(key);
+    free(value);
+    return NULL;
+}
+
+/**
+ * @brief Monotonic clock, for the job duration.
+ *
+ * @return uint64_t Nanoseconds.
+ */
+static uint64_t dump_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+/**
+ * @brief Record the end of the running job.
+ *
+ * @param failed Non zero if the job stopped on an error.
+ * @param parts Part files written or read.
+ */
+static void dump_status_finish(int failed, int parts) {
+    pthread_mutex_lock(&dump_status_lock);
+    dump_last_state = failed ? DUMP_STATE_FAILED : DUMP_STATE_DONE;
+    dump_last_parts = parts;
+    dump_finished_ns = dump_now_ns();
+    pthread_mutex_unlock(&dump_status_lock);
+}
+
+/* === Public function implementation ========================================================== */
+
+int dict_dump_save(const char * name) {
+    return dump_job_start(DUMP_JOB_SAVE, name);
+}
+
+int dict_dump_load(const char * name) {
+    return dump_job_start(DUMP_JOB_LOAD, name);
+}
+
+int dict_dump_stats(char * buffer, int buffer_size) {
+    pthread_mutex_lock(&dump_status_lock);
+    uint64_t end = dump_finished_ns != 0 ? dump_finished_ns : dump_now_ns();
+    int length = snprintf(buffer, buffer_size,
+                          "dump_state:%s\ndump_kind:%s\ndump_name:%s\ndump_parts:%d\n"
+                          "dump_keys:%lu\ndump_bytes:%lu\ndump_elapsed_ms:%lu\n",
+                          dump_state_names[dump_last_state],
+                          dump_last_kind == DUMP_JOB_SAVE ? "save" : "load", dump_last_name,
+                          dump_last_parts, atomic_load(&dump_keys), atomic_load(&dump_bytes),
+                          dump_last_state == DUMP_STATE_IDLE
+                              ? 0UL
+                              : (unsigned long)((end - dump_started_ns) / 1000000));
+    pthread_mutex_unlock(&dump_status_lock);
+    return length;
+}
+
+/* === End of documentation ==================================================================== */
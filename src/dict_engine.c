@@ -0,0 +1,568 @@
+/************************************************************************************************
+Copyright (c) 2024, Guido Ramirez <guidoramirez7@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute,
+sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial
+portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+SPDX-License-Identifier: MIT
+*************************************************************************************************/
+
+/** @file dict_engine.c
+ ** @brief Storage engine selection. Implements the dict_backend_* calls of dict_server.h by
+ ** routing every key to the engine of its namespace.
+ **
+ ** The routing tables are filled by dict_backend_init(), before any worker runs, and only read
+ ** afterwards, so requests look them up without a lock. A build with a single engine skips them
+ ** for the per key calls and calls the engine directly.
+ **/
+
+/* === Headers files inclusions =============================================================== */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "dict_engine.h"
+#include "dict_log.h"
+
+/* === Macros definitions ====================================================================== */
+
+#define ENGINE_NAME_MAX (32) /**< Longest namespace name, terminator included */
+#define ENGINE_SPEC_MAX (1024) /**< Longest namespace configuration */
+
+#if DICT_CONFIG_BACKEND == DICT_CONFIG_BACKEND_MEMORY
+#define ENGINE_DEFAULT dict_engine_memory
+#elif DICT_CONFIG_BACKEND == DICT_CONFIG_BACKEND_LOG
+#define ENGINE_DEFAULT dict_engine_log
+#elif DICT_CONFIG_BACKEND == DICT_CONFIG_BACKEND_PACKED
+#define ENGINE_DEFAULT dict_engine_packed
+#elif DICT_CONFIG_BACKEND == DICT_CONFIG_BACKEND_ART
+#define ENGINE_DEFAULT dict_engine_art
+#else
+#define ENGINE_DEFAULT dict_engine_file
+#endif
+
+#if DICT_CONFIG_ENGINE_COUNT == 1
+#define ENGINE_KEY_CALL(key, op) DICT_ENGINE_ONLY(op) /**< Per key call, to the only engine */
+#else
+#define ENGINE_KEY_CALL(key, op) dict_engine_route(key)->op /**< Per key call, routed */
+#endif
+
+/* === Private data type declarations ========================================================== */
+
+typedef struct {
+    char name[ENGINE_NAME_MAX];   /**< Namespace, the key part before DICT_ENGINE_SEPARATOR */
+    size_t length;                /**< Name length */
+    const dict_engine_t * engine; /**< Engine storing its keys */
+} engine_namespace_t;
+
+typedef struct {
+    dict_backend_key_visit visit; /**< Caller's callback */
+    void * context;               /**< Caller's context */
+    int stopped;                  /**< The callback asked to stop, later engines are skipped */
+} engine_walk_t;
+
+typedef struct {
+    dict_backend_value_visit visit; /**< Caller's callback */
+    void * context;                 /**< Caller's context */
+    int stopped;                    /**< The callback asked to stop, later engines are skipped */
+} engine_copy_t;
+
+typedef struct {
+    const char * prefix;          /**< Keys kept */
+    size_t length;                /**< Prefix length */
+    engine_walk_t * walk;         /**< Walk the kept keys are forwarded to */
+    char ** keys;                 /**< Copies of the kept keys, when collecting */
+    size_t count;                 /**< Keys collected */
+    size_t capacity;              /**< Room in keys */
+    int err;                      /**< SERVER_E_OS if a key could not be collected */
+} engine_filter_t;
+
+/* === Private variable declarations =========================================================== */
+
+/* === Private function declarations =========================================================== */
+
+static void engine_use(const dict_engine_t * engine);
+
+static int engine_parse(const char * spec);
+
+static int engine_visit(const char * key, void * context);
+
+static int engine_copy_value(const char * key, const char * value, int length, void * context);
+
+static int engine_copy_key(const char * key, void * context);
+
+static int engine_filter(const char * key, void * context);
+
+static int engine_collect(const char * key, void * context);
+
+static int engine_del_each(const dict_engine_t * engine, const char * prefix, size_t * count);
+
+static int engine_prefix_engines(const char * prefix, const dict_engine_t ** engines);
+
+/* === Public variable definitions ============================================================= */
+
+/* === Private variable definitions ============================================================ */
+
+static const dict_engine_t * const engine_table[] = {
+#if DICT_CONFIG_ENGINE_FILE
+    &dict_engine_file,
+#endif
+#if DICT_CONFIG_ENGINE_MEMORY
+    &dict_engine_memory,
+#endif
+#if DICT_CONFIG_ENGINE_LOG
+    &dict_engine_log,
+#endif
+#if DICT_CONFIG_ENGINE_PACKED
+    &dict_engine_packed,
+#endif
+#if DICT_CONFIG_ENGINE_ART
+    &dict_engine_art,
+#endif
+};
+
+#define ENGINE_COUNT ((int)(sizeof(engine_table) / sizeof(engine_table[0])))
+
+static const dict_engine_t * engine_default = &ENGINE_DEFAULT; /**< Keys outside any namespace */
+static engine_namespace_t engine_namespaces[DICT_ENGINE_MAX_NAMESPACES];
+static int engine_namespace_count;
+static const dict_engine_t * engine_used[ENGINE_COUNT]; /**< Opened engines, in opening order */
+static int engine_used_count;
+
+/* === Private function implementation ========================================================= */
+/**
+ * @brief Add an engine to the ones opened, once.
+ *
+ * @param engine Engine.
+ */
+static void engine_use(const dict_engine_t * engine) {
+    for (int i = 0; i < engine_used_count; i++)
+        if (engine_used[i] == engine)
+            return;
+    engine_used[engine_used_count++] = engine;
+}
+/**
+ * @brief Fill the namespace table from its configuration.
+ *
+ * @param spec Comma separated "namespace=engine" pairs.
+ * @return int
+ *              - SERVER_OK if no error.
+ *              - SERVER_E_INVALID if a pair is malformed, repeated or names no engine.
+ */
+static int engine_parse(const char * spec) {
+    char copy[ENGINE_SPEC_MAX];
+    if (strlen(spec) >= sizeof(copy))
+        return SERVER_E_INVALID;
+    strcpy(copy, spec);
+
+    char * save;
+    for (char * pair = strtok_r(copy, ",", &save); pair != NULL;
+         pair = strtok_r(NULL, ",", &save)) {
+        char * engine_name = strchr(pair, '=');
+        if (engine_name == NULL)
+            return SERVER_E_INVALID;
+        *engine_name++ = '\0';
+
+        size_t length = strlen(pair);
+        const dict_engine_t * engine = dict_engine_find(engine_name);
+        if (engine == NULL || length == 0 || length >= ENGINE_NAME_MAX ||
+            strchr(pair, DICT_ENGINE_SEPARATOR) != NULL ||
+            engine_namespace_count == DICT_ENGINE_MAX_NAMESPACES)
+            return SERVER_E_INVALID;
+        for (int i = 0; i < engine_namespace_count; i++)
+            if (strcmp(engine_namespaces[i].name, pair) == 0)
+                return SERVER_E_INVALID;
+
+        engine_namespace_t * namespace = &engine_namespaces[engine_namespace_count++];
+        memcpy(namespace->name, pair, length + 1);
+        namespace->length = length;
+        namespace->engine = engine;
+        engine_use(engine);
+    }
+    return SERVER_OK;
+}
+/**
+ * @brief Forward a key of one engine's walk to the caller, remembering a request to stop.
+ *
+ * @param key Key name.
+ * @param context Walk state.
+ * @return int Callback's result.
+ */
+static int engine_visit(const char * key, void * context) {
+    engine_walk_t * walk = context;
+    walk->stopped = walk->visit(key, walk->context);
+    return walk->stopped;
+}
+/**
+ * @brief Forward a key and its value to the caller of dict_backend_copy().
+ *
+ * @param key Key name.
+ * @param value Value bytes.
+ * @param length Value length.
+ * @param context Copy walk.
+ * @return int Callback's result.
+ */
+static int engine_copy_value(const char * key, const char * value, int length, void * context) {
+    engine_copy_t * copy = context;
+    copy->stopped = copy->visit(key, value, length, copy->context);
+    return copy->stopped;
+}
+/**
+ * @brief Forward a key without its value, for engines without copy.
+ *
+ * @param key Key name.
+ * @param context Copy walk.
+ * @return int Callback's result.
+ */
+static int engine_copy_key(const char * key, void * context) {
+    return engine_copy_value(key, NULL, 0, context);
+}
+/**
+ * @brief Forward the keys of a full walk starting with a prefix, for engines without scan.
+ *
+ * @param key Key name.
+ * @param context Filter.
+ * @return int Callback's result, 0 for skipped keys.
+ */
+static int engine_filter(const char * key, void * context) {
+    engine_filter_t * filter = context;
+    if (strncmp(key, filter->prefix, filter->length) != 0)
+        return 0;
+    return engine_visit(key, filter->walk);
+}
+/**
+ * @brief Copy the keys of a full walk starting with a prefix, for engines without del_prefix.
+ * The keys are deleted once the walk is over, engines may not allow changes during it.
+ *
+ * @param key Key name.
+ * @param context Filter.
+ * @return int 0 to continue, 1 if out of memory.
+ */
+static int engine_collect(const char * key, void * context) {
+    engine_filter_t * filter = context;
+    if (strncmp(key, filter->prefix, filter->length) != 0)
+        return 0;
+
+    if (filter->count == filter->capacity) {
+        size_t capacity = filter->capacity != 0 ? filter->capacity * 2 : 64;
+        char ** keys = realloc(filter->keys, capacity * sizeof(*keys));
+        if (keys == NULL) {
+            filter->err = SERVER_E_OS;
+            return 1;
+        }
+        filter->keys = keys;
+        filter->capacity = capacity;
+    }
+    filter->keys[filter->count] = strdup(key);
+    if (filter->keys[filter->count] == NULL) {
+        filter->err = SERVER_E_OS;
+        return 1;
+    }
+    filter->count++;
+    return 0;
+}
+/**
+ * @brief Delete the keys of an engine starting with a prefix one by one.
+ *
+ * @param engine Engine without del_prefix.
+ * @param prefix Prefix.
+ * @param count Where the number of deleted keys is stored.
+ * @return int
+ *              - SERVER_OK if no error.
+ *              - SERVER_E_OS if the keys could not all be collected, those that were are deleted.
+ */
+static int engine_del_each(const dict_engine_t * engine, const char * prefix, size_t * count) {
+    engine_filter_t filter = {.prefix = prefix, .length = strlen(prefix), .err = SERVER_OK};
+    int err = engine->iterate(engine_collect, &filter);
+    if (err == SERVER_OK)
+        err = filter.err;
+
+    *count = 0;
+    for (size_t i = 0; i < filter.count; i++) {
+        if (engine->del(filter.keys[i]) == SERVER_OK)
+            (*count)++;
+        free(filter.keys[i]);
+    }
+    free(filter.keys);
+    return err;
+}
+/**
+ * @brief Engines that may store keys starting with a prefix. A prefix naming a namespace only
+ * reaches the engine of that namespace, a shorter one may match keys of every engine.
+ *
+ * @param prefix Prefix.
+ * @param engines Where the engines are stored, room for ENGINE_COUNT.
+ * @return int Number of engines.
+ */
+static int engine_prefix_engines(const char * prefix, const dict_engine_t ** engines) {
+    if (strchr(prefix, DICT_ENGINE_SEPARATOR) != NULL) {
+        engines[0] = dict_engine_route(prefix);
+        return 1;
+    }
+    memcpy(engines, engine_used, engine_used_count * sizeof(*engines));
+    return engine_used_count;
+}
+
+/* === Public function implementation ========================================================== */
+
+const dict_engine_t * dict_engine_find(const char * name) {
+    for (int i = 0; name != NULL && i < ENGINE_COUNT; i++)
+        if (strcmp(engine_table[i]->name, name) == 0)
+            return engine_table[i];
+    return NULL;
+}
+
+const dict_engine_t * dict_engine_route(const char * key) {
+    if (engine_namespace_count == 0 || key == NULL)
+        return engine_default;
+
+    const char * end = strchr(key, DICT_ENGINE_SEPARATOR);
+    if (end == NULL)
+        return engine_default;
+    size_t length = end - key;
+    for (int i = 0; i < engine_namespace_count; i++) {
+        const engine_namespace_t * namespace = &engine_namespaces[i];
+        if (namespace->length == length && memcmp(namespace->name, key, length) == 0)
+            return namespace->engine;
+    }
+    return engine_default;
+}
+
+size_t dict_engine_key_max(void) {
+    size_t key_max = 0;
+    for (int i = 0; i < ENGINE_COUNT; i++) {
+        if (engine_table[i]->key_max > key_max)
+            key_max = engine_table[i]->key_max;
+    }
+    return key_max;
+}
+
+int dict_backend_init(const dict_server_config_t * config) {
+    engine_default = &ENGINE_DEFAULT;
+    if (config != NULL && config->engine != NULL) {
+        engine_default = dict_engine_find(config->engine);
+        if (engine_default == NULL) {
+            LOG_ERROR("Unknown storage engine [%s]", config->engine);
+            engine_default = &ENGINE_DEFAULT;
+            return SERVER_E_INVALID;
+        }
+    }
+
+    engine_namespace_count = 0;
+    engine_used_count = 0;
+    engine_use(engine_default);
+    if (config != NULL && config->namespaces != NULL &&
+        engine_parse(config->namespaces) != SERVER_OK) {
+        LOG_ERROR("Invalid storage namespaces [%s]", config->namespaces);
+        engine_namespace_count = 0;
+        return SERVER_E_INVALID;
+    }
+
+    for (int i = 0; i < engine_used_count; i++) {
+        int err = engine_used[i]->open(config);
+        if (err != SERVER_OK) {
+            LOG_ERROR("Can not open storage engine [%s]", engine_used[i]->name);
+            while (--i >= 0)
+                engine_used[i]->close();
+            return err;
+        }
+    }
+    return SERVER_OK;
+}
+
+int dict_backend_flush(void) {
+    int result = SERVER_OK;
+    for (int i = 0; i < engine_used_count; i++) {
+        int err = engine_used[i]->flush();
+        if (result == SERVER_OK)
+            result = err;
+    }
+    return result;
+}
+
+void dict_backend_close(void) {
+    for (int i = engine_used_count - 1; i >= 0; i--)
+        engine_used[i]->close();
+}
+
+int dict_backend_batch_begin(void) {
+    int deferred = 0;
+    for (int i = 0; i < engine_used_count; i++) {
+        if (engine_used[i]->batch_begin != NULL)
+            deferred |= engine_used[i]->batch_begin();
+    }
+    return deferred;
+}
+
+int dict_backend_batch_commit(void) {
+    int result = SERVER_OK;
+    for (int i = 0; i < engine_used_count; i++) {
+        int err = engine_used[i]->batch_commit != NULL ? engine_used[i]->batch_commit() : SERVER_OK;
+        if (result == SERVER_OK)
+            result = err;
+    }
+    return result;
+}
+
+int dict_backend_get(const char * key, char * buffer, int buffer_size, int * length) {
+    return ENGINE_KEY_CALL(key, get)(key, buffer, buffer_size, length);
+}
+
+int dict_backend_set(const char * key, const char * value, int length) {
+    return ENGINE_KEY_CALL(key, put)(key, value, length);
+}
+
+int dict_backend_del(const char * key) {
+    return ENGINE_KEY_CALL(key, del)(key);
+}
+
+int dict_backend_count(size_t * count) {
+    if (count == NULL)
+        return SERVER_E_NULL;
+
+    *count = 0;
+    for (int i = 0; i < engine_used_count; i++) {
+        size_t keys;
+        int err = engine_used[i]->count(&keys);
+        if (err != SERVER_OK)
+            return err;
+        *count += keys;
+    }
+    return SERVER_OK;
+}
+
+int dict_backend_clear(void) {
+    int result = SERVER_OK;
+    for (int i = 0; i < engine_used_count; i++) {
+        int err = engine_used[i]->clear();
+        if (result == SERVER_OK)
+            result = err;
+    }
+    return result;
+}
+
+int dict_backend_keys(dict_backend_key_visit visit, void * context) {
+    if (visit == NULL)
+        return SERVER_E_NULL;
+
+    engine_walk_t walk = {.visit = visit, .context = context, .stopped = 0};
+    for (int i = 0; i < engine_used_count && !walk.stopped; i++) {
+        int err = engine_used[i]->iterate(engine_visit, &walk);
+        if (err != SERVER_OK)
+            return err;
+    }
+    return SERVER_OK;
+}
+
+int dict_backend_copy(dict_backend_value_visit visit, void * context) {
+    if (visit == NULL)
+        return SERVER_E_NULL;
+
+    engine_copy_t copy = {.visit = visit, .context = context, .stopped = 0};
+    for (int i = 0; i < engine_used_count && !copy.stopped; i++) {
+        const dict_engine_t * engine = engine_used[i];
+        int err = engine->copy != NULL ? engine->copy(engine_copy_value, &copy)
+                                       : engine->iterate(engine_copy_key, &copy);
+        if (err != SERVER_OK)
+            return err;
+    }
+    return SERVER_OK;
+}
+
+int dict_backend_scan(const char * prefix, dict_backend_key_visit visit, void * context) {
+    if (prefix == NULL || visit == NULL)
+        return SERVER_E_NULL;
+
+    const dict_engine_t * engines[ENGINE_COUNT];
+    int count = engine_prefix_engines(prefix, engines);
+    engine_walk_t walk = {.visit = visit, .context = context, .stopped = 0};
+    engine_filter_t filter = {.prefix = prefix, .length = strlen(prefix), .walk = &walk};
+    for (int i = 0; i < count && !walk.stopped; i++) {
+        int err = engines[i]->scan != NULL ? engines[i]->scan(prefix, engine_visit, &walk)
+                                           : engines[i]->iterate(engine_filter, &filter);
+        if (err != SERVER_OK)
+            return err;
+    }
+    return SERVER_OK;
+}
+
+int dict_backend_del_prefix(const char * prefix, size_t * count) {
+    if (prefix == NULL || count == NULL)
+        return SERVER_E_NULL;
+    if (prefix[0] == '\0')
+        return SERVER_E_INVALID;
+
+    const dict_engine_t * engines[ENGINE_COUNT];
+    int engine_count = engine_prefix_engines(prefix, engines);
+    int result = SERVER_OK;
+    *count = 0;
+    for (int i = 0; i < engine_count; i++) {
+        size_t deleted = 0;
+        int err = engines[i]->del_prefix != NULL ? engines[i]->del_prefix(prefix, &deleted)
+                                                 : engine_del_each(engines[i], prefix, &deleted);
+        *count += deleted;
+        if (result == SERVER_OK)
+            result = err;
+    }
+    return result;
+}
+
+int dict_backend_stats(char * buffer, int buffer_size) {
+    int length = snprintf(buffer, buffer_size, "engine_default:%s\n", engine_default->name);
+    for (int i = 0; i < engine_namespace_count && length < buffer_size; i++)
+        length += snprintf(buffer + length, buffer_size - length, "engine_namespace_%s:%s\n",
+                           engine_namespaces[i].name, engine_namespaces[i].engine->name);
+    for (int i = 0; i < engine_used_count && length < buffer_size; i++)
+        length += engine_used[i]->stats(buffer + length, buffer_size - length);
+    return length;
+}
+
+int dict_backend_defrag(int budget_us) {
+    // Every engine gets the budget. One with nothing to compact returns at once.
+    int more = 0;
+    for (int i = 0; i < engine_used_count; i++)
+        more |= engine_used[i]->defrag(budget_us);
+    return more;
+}
+
+int dict_backend_memory(dict_backend_memory_t * memory) {
+    if (memory == NULL)
+        return SERVER_E_NULL;
+
+    memset(memory, 0, sizeof(*memory));
+    for (int i = 0; i < engine_used_count; i++) {
+        dict_backend_memory_t usage;
+        int err = engine_used[i]->memory(&usage);
+        if (err != SERVER_OK)
+            return err;
+        memory->key_bytes += usage.key_bytes;
+        memory->value_bytes += usage.value_bytes;
+        memory->index_bytes += usage.index_bytes;
+        memory->cache_bytes += usage.cache_bytes;
+        memory->allocated_bytes += usage.allocated_bytes;
+        memory->mapped_bytes += usage.mapped_bytes;
+    }
+    return SERVER_OK;
+}
+
+int dict_backend_usage(const char * key, size_t * bytes) {
+    return ENGINE_KEY_CALL(key, usage)(key, bytes);
+}
+
+int dict_backend_prefetch(const char * key) {
+    return ENGINE_KEY_CALL(key, prefetch)(key);
+}
+
+/* === End of documentation ==================================================================== */
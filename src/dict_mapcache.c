@@ -0,0 +1,424 @@
+/************************************************************************************************
+Copyright (c) 2024, Guido Ramirez <guidoramirez7@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute,
+sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial
+portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+SPDX-License-Identifier: MIT
+*************************************************************************************************/
+
+/** @file dict_mapcache.c
+ ** @brief Cache of read only mappings of key files.
+ **
+ ** Keys are spread over shards, each a hash table under its own read write lock. Hits only take
+ ** the read lock, so mappings are dropped under the write lock and unmapped once it is released:
+ ** no reader can be copying from them by then. A CLOCK list per shard picks the victims, reads
+ ** only set a flag on the entry.
+ **/
+
+/* === Headers files inclusions =============================================================== */
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "dict_config.h"
+#include "dict_mapcache.h"
+
+#if DICT_CONFIG_ENGINE_FILE
+
+/* === Macros definitions ====================================================================== */
+
+#define MAPCACHE_SHARDS      (64) /**< Independent tables, a power of two */
+#define MAPCACHE_MIN_BUCKETS (16) /**< Smallest table of a shard */
+
+/* === Private data type declarations ========================================================== */
+
+typedef struct mapcache_entry {
+    struct mapcache_entry * next;  /**< Next entry in the bucket */
+    struct mapcache_entry * older; /**< Previous entry in the CLOCK list */
+    struct mapcache_entry * newer; /**< Next entry in the CLOCK list */
+    char * map;                    /**< Value mapping, NULL for an empty value */
+    size_t length;                 /**< Value length */
+    uint32_t hash;                 /**< Key hash */
+    atomic_int referenced;         /**< Read since the CLOCK hand last passed */
+    char key[];                    /**< Key name */
+} mapcache_entry_t;
+
+typedef struct {
+    pthread_rwlock_t lock;           /**< Write held to change the table */
+    mapcache_entry_t ** buckets;     /**< Chained buckets */
+    atomic_ulong * generations;      /**< Changes of the keys in every bucket */
+    size_t bucket_count;             /**< Buckets, a power of two */
+    mapcache_entry_t * oldest;       /**< CLOCK hand */
+    mapcache_entry_t * newest;       /**< Last entry added */
+    size_t count;                    /**< Entries */
+    atomic_ulong hits;               /**< Lookups served from a mapping */
+    atomic_ulong misses;             /**< Lookups left to the file */
+} mapcache_shard_t;
+
+/* === Private variable declarations =========================================================== */
+
+/* === Private function declarations =========================================================== */
+
+static uint32_t mapcache_hash(const char * key);
+
+static mapcache_shard_t * mapcache_shard(uint32_t hash);
+
+static size_t mapcache_bucket(const mapcache_shard_t * shard, uint32_t hash);
+
+static mapcache_entry_t ** mapcache_find(mapcache_shard_t * shard, const char * key,
+                                         uint32_t hash);
+
+static void mapcache_unlink(mapcache_shard_t * shard, mapcache_entry_t * entry);
+
+static void mapcache_release(mapcache_entry_t * entry);
+
+/* === Public variable definitions ============================================================= */
+
+/* === Private variable definitions ============================================================ */
+
+static mapcache_shard_t mapcache_shards[MAPCACHE_SHARDS];
+static int mapcache_enabled;          /**< Lookups and loads use the cache */
+static size_t mapcache_shard_entries; /**< Mappings kept per shard */
+
+static atomic_size_t mapcache_bytes;         /**< Value bytes mapped */
+static atomic_size_t mapcache_count;         /**< Mappings kept */
+static atomic_ulong mapcache_loads;          /**< Files mapped and kept */
+static atomic_ulong mapcache_races;          /**< Mappings dropped, the key changed meanwhile */
+static atomic_ulong mapcache_invalidations;  /**< Mappings dropped by a write */
+static atomic_ulong mapcache_evictions;      /**< Mappings dropped to make room */
+
+/* === Private function implementation ========================================================= */
+/**
+ * @brief FNV-1a hash of a key.
+ *
+ * @param key Key name.
+ * @return uint32_t Hash.
+ */
+static uint32_t mapcache_hash(const char * key) {
+    uint32_t hash = 2166136261u;
+    while (*key != '\0')
+        hash = (hash ^ (unsigned char)*key++) * 16777619u;
+    return hash;
+}
+/**
+ * @brief Shard holding a key.
+ *
+ * @param hash Key hash.
+ * @return mapcache_shard_t* Shard.
+ */
+static mapcache_shard_t * mapcache_shard(uint32_t hash) {
+    return &mapcache_shards[hash & (MAPCACHE_SHARDS - 1)];
+}
+/**
+ * @brief Bucket of a key inside its shard. The low bits already chose the shard.
+ *
+ * @param shard Shard.
+ * @param hash Key hash.
+ * @return size_t Bucket index.
+ */
+static size_t mapcache_bucket(const mapcache_shard_t * shard, uint32_t hash) {
+    return (hash / MAPCACHE_SHARDS) & (shard->bucket_count - 1);
+}
+/**
+ * @brief Find the link pointing to a key. The lock must be held.
+ *
+ * @param shard Shard.
+ * @param key Key name.
+ * @param hash Key hash.
+ * @return mapcache_entry_t** Link to the entry, it points to NULL if the key is missing.
+ */
+static mapcache_entry_t ** mapcache_find(mapcache_shard_t * shard, const char * key,
+                                         uint32_t hash) {
+    mapcache_entry_t ** link = &shard->buckets[mapcache_bucket(shard, hash)];
+    while (*link != NULL && ((*link)->hash != hash || strcmp((*link)->key, key) != 0))
+        link = &(*link)->next;
+    return link;
+}
+/**
+ * @brief Take an entry out of its bucket and the CLOCK list. The write lock must be held.
+ *
+ * @param shard Shard.
+ * @param entry Entry to remove.
+ */
+static void mapcache_unlink(mapcache_shard_t * shard, mapcache_entry_t * entry) {
+    mapcache_entry_t ** link = mapcache_find(shard, entry->key, entry->hash);
+    *link = entry->next;
+
+    if (entry->older != NULL)
+        entry->older->newer = entry->newer;
+    else
+        shard->oldest = entry->newer;
+    if (entry->newer != NULL)
+        entry->newer->older = entry->older;
+    else
+        shard->newest = entry->older;
+
+    shard->count--;
+    atomic_fetch_sub(&mapcache_count, 1);
+    atomic_fetch_sub(&mapcache_bytes, entry->length);
+}
+/**
+ * @brief Unmap and free entries already unlinked, chained through next. Called without the lock.
+ *
+ * @param entry First entry, may be NULL.
+ */
+static void mapcache_release(mapcache_entry_t * entry) {
+    while (entry != NULL) {
+        mapcache_entry_t * next = entry->next;
+        if (entry->map != NULL)
+            munmap(entry->map, entry->length);
+        free(entry);
+        entry = next;
+    }
+}
+
+/* === Public function implementation ========================================================== */
+
+int dict_mapcache_start(int entries) {
+    if (entries <= 0 || mapcache_enabled)
+        return -1;
+
+    mapcache_shard_entries = ((size_t)entries + MAPCACHE_SHARDS - 1) / MAPCACHE_SHARDS;
+    size_t buckets = MAPCACHE_MIN_BUCKETS;
+    while (buckets < mapcache_shard_entries)
+        buckets *= 2;
+
+    for (int index = 0; index < MAPCACHE_SHARDS; index++) {
+        mapcache_shard_t * shard = &mapcache_shards[index];
+        memset(shard, 0, sizeof(*shard));
+        shard->buckets = calloc(buckets, sizeof(*shard->buckets));
+        shard->generations = calloc(buckets, sizeof(*shard->generations));
+        if (shard->buckets == NULL || shard->generations == NULL) {
+            for (; index >= 0; index--) {
+                free(mapcache_shards[index].buckets);
+                free(mapcache_shards[index].generations);
+                memset(&mapcache_shards[index], 0, sizeof(mapcache_shards[index]));
+            }
+            return -1;
+        }
+        shard->bucket_count = buckets;
+        pthread_rwlock_init(&shard->lock, NULL);
+    }
+    mapcache_enabled = 1;
+    return 0;
+}
+
+void dict_mapcache_stop(void) {
+    if (!mapcache_enabled)
+        return;
+
+    dict_mapcache_clear();
+    mapcache_enabled = 0;
+    for (int index = 0; index < MAPCACHE_SHARDS; index++) {
+        mapcache_shard_t * shard = &mapcache_shards[index];
+        free(shard->buckets);
+        free(shard->generations);
+        pthread_rwlock_destroy(&shard->lock);
+        memset(shard, 0, sizeof(*shard));
+    }
+}
+
+int dict_mapcache_get(const char * key, char * buffer, int buffer_size, int * length) {
+    if (!mapcache_enabled)
+        return 0;
+
+    uint32_t hash = mapcache_hash(key);
+    mapcache_shard_t * shard = mapcache_shard(hash);
+
+    pthread_rwlock_rdlock(&shard->lock);
+    mapcache_entry_t * entry = *mapcache_find(shard, key, hash);
+    if (entry != NULL) {
+        size_t copy = entry->length < (size_t)buffer_size ? entry->length : (size_t)buffer_size;
+        if (copy > 0)
+            memcpy(buffer, entry->map, copy);
+        *length = entry->length;
+        // Plain load first, so hot entries already flagged do not bounce their cache line.
+        if (!atomic_load_explicit(&entry->referenced, memory_order_relaxed))
+            atomic_store_explicit(&entry->referenced, 1, memory_order_relaxed);
+    }
+    pthread_rwlock_unlock(&shard->lock);
+
+    atomic_fetch_add_explicit(entry != NULL ? &shard->hits : &shard->misses, 1,
+                              memory_order_relaxed);
+    return entry != NULL;
+}
+
+unsigned long dict_mapcache_generation(const char * key) {
+    if (!mapcache_enabled)
+        return 0;
+
+    uint32_t hash = mapcache_hash(key);
+    mapcache_shard_t * shard = mapcache_shard(hash);
+    return atomic_load(&shard->generations[mapcache_bucket(shard, hash)]);
+}
+
+int dict_mapcache_load(const char * key, unsigned long generation, int fd, size_t size,
+                       char * buffer, int buffer_size, int * length) {
+    // Files handed to the reclamation thread are truncated there, a mapping of one would fault.
+    if (!mapcache_enabled || size >= DICT_MAPCACHE_MAX_VALUE)
+        return 0;
+
+    size_t key_length = strlen(key) + 1;
+    mapcache_entry_t * entry = malloc(sizeof(*entry) + key_length);
+    if (entry == NULL)
+        return 0;
+
+    // Populated now, the first copy and every later one find the pages in place.
+    char * map = NULL;
+    if (size > 0) {
+        map = mmap(NULL, size, PROT_READ, MAP_SHARED | MAP_POPULATE, fd, 0);
+        if (map == MAP_FAILED) {
+            free(entry);
+            return 0;
+        }
+    }
+    memset(entry, 0, sizeof(*entry));
+    memcpy(entry->key, key, key_length);
+    entry->map = map;
+    entry->length = size;
+    entry->hash = mapcache_hash(key);
+    atomic_init(&entry->referenced, 1);
+
+    size_t copy = size < (size_t)buffer_size ? size : (size_t)buffer_size;
+    if (copy > 0)
+        memcpy(buffer, map, copy);
+    *length = size;
+
+    mapcache_shard_t * shard = mapcache_shard(entry->hash);
+    mapcache_entry_t * victims = NULL;
+
+    pthread_rwlock_wrlock(&shard->lock);
+    size_t bucket = mapcache_bucket(shard, entry->hash);
+    mapcache_entry_t ** link = mapcache_find(shard, key, entry->hash);
+    if (atomic_load(&shard->generations[bucket]) != generation || *link != NULL) {
+        // Written since the file was opened, or another reader was first.
+        entry->next = NULL;
+        victims = entry;
+        atomic_fetch_add_explicit(&mapcache_races, 1, memory_order_relaxed);
+    } else {
+        *link = entry;
+        entry->older = shard->newest;
+        if (shard->newest != NULL)
+            shard->newest->newer = entry;
+        else
+            shard->oldest = entry;
+        shard->newest = entry;
+        shard->count++;
+        atomic_fetch_add(&mapcache_count, 1);
+        atomic_fetch_add(&mapcache_bytes, size);
+        atomic_fetch_add_explicit(&mapcache_loads, 1, memory_order_relaxed);
+
+        // CLOCK: entries read since the hand passed get another round at the newest end.
+        while (shard->count > mapcache_shard_entries) {
+            mapcache_entry_t * oldest = shard->oldest;
+            if (atomic_exchange(&oldest->referenced, 0)) {
+                // Moved to the newest end, its bucket chain stays as it is.
+                shard->oldest = oldest->newer;
+                shard->oldest->older = NULL;
+                oldest->newer = NULL;
+                oldest->older = shard->newest;
+                shard->newest->newer = oldest;
+                shard->newest = oldest;
+                continue;
+            }
+            mapcache_unlink(shard, oldest);
+            oldest->next = victims;
+            victims = oldest;
+            atomic_fetch_add_explicit(&mapcache_evictions, 1, memory_order_relaxed);
+        }
+    }
+    pthread_rwlock_unlock(&shard->lock);
+
+    mapcache_release(victims);
+    return 1;
+}
+
+void dict_mapcache_invalidate(const char * key) {
+    if (!mapcache_enabled)
+        return;
+
+    uint32_t hash = mapcache_hash(key);
+    mapcache_shard_t * shard = mapcache_shard(hash);
+
+    pthread_rwlock_wrlock(&shard->lock);
+    atomic_fetch_add(&shard->generations[mapcache_bucket(shard, hash)], 1);
+    mapcache_entry_t * entry = *mapcache_find(shard, key, hash);
+    if (entry != NULL) {
+        mapcache_unlink(shard, entry);
+        entry->next = NULL;
+        atomic_fetch_add_explicit(&mapcache_invalidations, 1, memory_order_relaxed);
+    }
+    pthread_rwlock_unlock(&shard->lock);
+
+    mapcache_release(entry);
+}
+
+void dict_mapcache_clear(void) {
+    if (!mapcache_enabled)
+        return;
+
+    for (int index = 0; index < MAPCACHE_SHARDS; index++) {
+        mapcache_shard_t * shard = &mapcache_shards[index];
+        mapcache_entry_t * victims = NULL;
+
+        pthread_rwlock_wrlock(&shard->lock);
+        for (size_t bucket = 0; bucket < shard->bucket_count; bucket++)
+            atomic_fetch_add(&shard->generations[bucket], 1);
+        while (shard->oldest != NULL) {
+            mapcache_entry_t * entry = shard->oldest;
+            mapcache_unlink(shard, entry);
+            entry->next = victims;
+            victims = entry;
+        }
+        pthread_rwlock_unlock(&shard->lock);
+
+        mapcache_release(victims);
+    }
+}
+
+size_t dict_mapcache_bytes(void) {
+    return atomic_load(&mapcache_bytes);
+}
+
+int dict_mapcache_stats(char * buffer, int buffer_size) {
+    if (!mapcache_enabled)
+        return snprintf(buffer, buffer_size, "mmap_cache:0\n");
+
+    unsigned long hits = 0;
+    unsigned long misses = 0;
+    for (int index = 0; index < MAPCACHE_SHARDS; index++) {
+        hits += atomic_load(&mapcache_shards[index].hits);
+        misses += atomic_load(&mapcache_shards[index].misses);
+    }
+    return snprintf(buffer, buffer_size,
+                    "mmap_cache:1\nmmap_cache_capacity:%zu\nmmap_cache_entries:%zu\n"
+                    "mmap_cache_bytes:%zu\nmmap_cache_hits:%lu\nmmap_cache_misses:%lu\n"
+                    "mmap_cache_loads:%lu\nmmap_cache_races:%lu\nmmap_cache_invalidations:%lu\n"
+                    "mmap_cache_evictions:%lu\n",
+                    mapcache_shard_entries * MAPCACHE_SHARDS, atomic_load(&mapcache_count),
+                    atomic_load(&mapcache_bytes), hits, misses, atomic_load(&mapcache_loads),
+                    atomic_load(&mapcache_races), atomic_load(&mapcache_invalidations),
+                    atomic_load(&mapcache_evictions));
+}
+
+#endif /* DICT_CONFIG_ENGINE_FILE */
+
+/* === End of documentation ==================================================================== */
@@ -0,0 +1,536 @@
+/************************************************************************************************
+Copyright (c) 2024, Guido Ramirez <guidoramirez7@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute,
+sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial
+portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+SPDX-License-Identifier: MIT
+*************************************************************************************************/
+
+/** @file dict_profile.c
+ ** @brief Built in sampling profiler function implementation.
+ **/
+
+/* === Headers files inclusions =============================================================== */
+
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <elf.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <link.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <time.h>
+#include <ucontext.h>
+#include <unistd.h>
+#include "dict_profile.h"
+#include "dict_log.h"
+
+/* === Macros definitions ====================================================================== */
+
+#define PROFILE_MAX_FRAMES  (64)              /**< Deepest stack sampled */
+#define PROFILE_STACK_SPAN  (8 * 1024 * 1024) /**< Frame pointers followed above the handler */
+#define PROFILE_SETTLE_MS   (20)              /**< Wait for handlers still running at the end */
+#define PROFILE_TEXT_SIZE   (64 * 1024)       /**< Initial room for the folded stacks */
+#define PROFILE_THREADS     (128)             /**< Thread names cached while folding */
+
+#if defined(__x86_64__) || defined(__aarch64__)
+#define PROFILE_UNWIND 1
+#else
+#define PROFILE_UNWIND 0
+#endif
+
+/* === Private data type declarations ========================================================== */
+
+typedef struct {
+    atomic_int ready;                   /**< Set once the sample is complete */
+    int tid;                            /**< Kernel id of the interrupted thread */
+    int depth;                          /**< Frames stored */
+    uintptr_t pcs[PROFILE_MAX_FRAMES];  /**< Interrupted pc, then return addresses, leaf first */
+} profile_sample_t;
+
+typedef struct {
+    int seconds;            /**< Profile length */
+    dict_profile_done done; /**< Receives the folded stacks */
+    void * context;         /**< Passed to done */
+} profile_job_t;
+
+typedef struct {
+    char * data;   /**< Folded stacks, NULL once out of memory */
+    size_t length; /**< Bytes written */
+    size_t size;   /**< Room in data */
+} profile_writer_t;
+
+typedef struct {
+    int tid;       /**< Kernel thread id */
+    char name[16]; /**< Thread name from /proc */
+} profile_thread_t;
+
+typedef struct {
+    uintptr_t start;    /**< Function address, as loaded */
+    uintptr_t end;      /**< Past its last byte */
+    const char * name;  /**< In the mapped string table */
+} profile_symbol_t;
+
+/** Functions of the executable's .symtab, static ones included, which dladdr() does not see. */
+typedef struct {
+    void * image;               /**< Executable mapped read only, MAP_FAILED if not mapped */
+    size_t image_size;          /**< Bytes mapped */
+    uintptr_t base;             /**< Load address of the executable, from dladdr() */
+    profile_symbol_t * symbols; /**< Sorted by start */
+    size_t count;               /**< Entries in symbols */
+} profile_symtab_t;
+
+/* === Private variable declarations =========================================================== */
+
+/* === Private function declarations =========================================================== */
+
+static void profile_signal_handler(int signal, siginfo_t * info, void * context);
+
+static void * profile_run(void * arg);
+
+static int profile_sample_compare(const void * a, const void * b);
+
+static const char * profile_thread_name(profile_thread_t * threads, int * count, int tid);
+
+static void profile_symtab_load(profile_symtab_t * symtab);
+
+static int profile_symbol_compare(const void * a, const void * b);
+
+static const char * profile_symtab_find(const profile_symtab_t * symtab, uintptr_t pc);
+
+static void profile_symtab_free(profile_symtab_t * symtab);
+
+static void profile_write_frame(profile_writer_t * writer, const profile_symtab_t * symtab,
+                                uintptr_t pc, int leaf);
+
+static void profile_write(profile_writer_t * writer, const char * format, ...);
+
+/* === Public variable definitions ============================================================= */
+
+/* === Private variable definitions ============================================================ */
+
+static atomic_int profile_busy;              /**< Set while a profile is running */
+static profile_sample_t * profile_samples;   /**< Sample storage, only while running */
+static unsigned long profile_capacity;       /**< Samples that fit in profile_samples */
+static atomic_ulong profile_next;            /**< Next free sample, may pass the capacity */
+
+/* === Private function implementation ========================================================= */
+/**
+ * @brief SIGPROF handler. Stores the stack of the interrupted thread.
+ *
+ * Only async signal safe work: a lock free slot reservation and reads of the thread's own
+ * stack, bounded so a frame pointer used as a general register is never followed out of it.
+ *
+ * @param signal Received signal.
+ * @param info Not used.
+ * @param context Interrupted thread's registers.
+ */
+static void profile_signal_handler(int signal, siginfo_t * info, void * context) {
+#if PROFILE_UNWIND
+    int saved_errno = errno;
+    unsigned long slot = atomic_fetch_add_explicit(&profile_next, 1, memory_order_relaxed);
+    if (slot >= profile_capacity) {
+        errno = saved_errno;
+        return;
+    }
+
+    profile_sample_t * sample = &profile_samples[slot];
+    const ucontext_t * uc = context;
+#if defined(__x86_64__)
+    uintptr_t pc = uc->uc_mcontext.gregs[REG_RIP];
+    uintptr_t fp = uc->uc_mcontext.gregs[REG_RBP];
+#else
+    uintptr_t pc = uc->uc_mcontext.pc;
+    uintptr_t fp = uc->uc_mcontext.regs[29];
+#endif
+
+    // The handler runs on the same stack, below every frame of the interrupted code.
+    uintptr_t low = (uintptr_t)__builtin_frame_address(0);
+    uintptr_t high = low + PROFILE_STACK_SPAN;
+    int depth = 0;
+
+    sample->pcs[depth++] = pc;
+    while (depth < PROFILE_MAX_FRAMES && fp >= low && fp < high - 2 * sizeof(uintptr_t) &&
+           (fp & (sizeof(uintptr_t) - 1)) == 0) {
+        const uintptr_t * frame = (const uintptr_t *)fp;
+        if (frame[1] == 0)
+            break;
+        sample->pcs[depth++] = frame[1];
+        // Frames only go up the stack, anything else is not a frame chain.
+        if (frame[0] <= fp)
+            break;
+        fp = frame[0];
+    }
+
+    sample->tid = syscall(SYS_gettid);
+    sample->depth = depth;
+    atomic_store_explicit(&sample->ready, 1, memory_order_release);
+    errno = saved_errno;
+#endif
+}
+/**
+ * @brief Profiler thread. Samples for the requested time, then folds the stacks and hands them
+ * to the job's callback.
+ *
+ * @param arg Job to run.
+ * @return void* Always NULL.
+ */
+static void * profile_run(void * arg) {
+    profile_job_t * job = arg;
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_sigaction = profile_signal_handler;
+    action.sa_flags = SA_SIGINFO | SA_RESTART;
+    sigemptyset(&action.sa_mask);
+
+    struct itimerval timer = {0};
+    timer.it_interval.tv_usec = 1000000 / DICT_PROFILE_HZ;
+    timer.it_value = timer.it_interval;
+
+    if (sigaction(SIGPROF, &action, NULL) < 0 || setitimer(ITIMER_PROF, &timer, NULL) < 0) {
+        LOG_ERROR("Profile : Can not arm the sampler");
+    } else {
+        struct timespec end;
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        end.tv_sec += job->seconds;
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &end, NULL) == EINTR)
+            ;
+    }
+
+    // Ignored, not default: a SIGPROF already pending must not terminate the process.
+    memset(&timer, 0, sizeof(timer));
+    setitimer(ITIMER_PROF, &timer, NULL);
+    action.sa_handler = SIG_IGN;
+    action.sa_flags = 0;
+    sigaction(SIGPROF, &action, NULL);
+    struct timespec settle = {.tv_sec = 0, .tv_nsec = PROFILE_SETTLE_MS * 1000000L};
+    nanosleep(&settle, NULL);
+
+    unsigned long taken = atomic_load(&profile_next);
+    unsigned long count = taken < profile_capacity ? taken : profile_capacity;
+    unsigned long stored = 0;
+    for (unsigned long i = 0; i < count; i++) {
+        if (atomic_load_explicit(&profile_samples[i].ready, memory_order_acquire))
+            profile_samples[stored++] = profile_samples[i];
+    }
+    qsort(profile_samples, stored, sizeof(*profile_samples), profile_sample_compare);
+    LOG_INFO("Profile : %lu samples, %lu dropped", stored, taken - stored);
+
+    profile_symtab_t symtab;
+    profile_symtab_load(&symtab);
+    profile_writer_t writer = {.data = malloc(PROFILE_TEXT_SIZE), .size = PROFILE_TEXT_SIZE};
+    profile_thread_t threads[PROFILE_THREADS];
+    int thread_count = 0;
+    for (unsigned long i = 0; i < stored && writer.data != NULL;) {
+        unsigned long j = i + 1;
+        while (j < stored && profile_sample_compare(&profile_samples[i], &profile_samples[j]) == 0)
+            j++;
+
+        const profile_sample_t * sample = &profile_samples[i];
+        profile_write(&writer, "%s", profile_thread_name(threads, &thread_count, sample->tid));
+        for (int f = sample->depth - 1; f >= 0; f--)
+            profile_write_frame(&writer, &symtab, sample->pcs[f], f == 0);
+        profile_write(&writer, " %lu\n", j - i);
+        i = j;
+    }
+    profile_symtab_free(&symtab);
+
+    free(profile_samples);
+    profile_samples = NULL;
+    atomic_store(&profile_busy, 0);
+    job->done(writer.data, writer.data != NULL ? writer.length : 0, job->context);
+    free(job);
+    return NULL;
+}
+/**
+ * @brief Order samples by thread and stack, so equal stacks end up together.
+ */
+static int profile_sample_compare(const void * a, const void * b) {
+    const profile_sample_t * x = a;
+    const profile_sample_t * y = b;
+    if (x->tid != y->tid)
+        return x->tid < y->tid ? -1 : 1;
+    if (x->depth != y->depth)
+        return x->depth < y->depth ? -1 : 1;
+    // Root first, so stacks sharing callers sort next to each other.
+    for (int f = x->depth - 1; f >= 0; f--) {
+        if (x->pcs[f] != y->pcs[f])
+            return x->pcs[f] < y->pcs[f] ? -1 : 1;
+    }
+    return 0;
+}
+/**
+ * @brief Name of a thread, read once from /proc.
+ *
+ * @param threads Names already read.
+ * @param count Number of names already read, updated.
+ * @param tid Kernel thread id.
+ * @return const char* Thread name, or a placeholder if the thread is gone.
+ */
+static const char * profile_thread_name(profile_thread_t * threads, int * count, int tid) {
+    for (int i = 0; i < *count; i++) {
+        if (threads[i].tid == tid)
+            return threads[i].name;
+    }
+
+    static char unknown[16];
+    profile_thread_t * thread = *count < PROFILE_THREADS ? &threads[(*count)++] : NULL;
+    char * name = thread != NULL ? thread->name : unknown;
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/self/task/%d/comm", tid);
+
+    snprintf(name, 16, "thread-%d", tid);
+    FILE * file = fopen(path, "r");
+    if (file != NULL) {
+        if (fgets(name, 16, file) != NULL)
+            name[strcspn(name, "\n")] = 0;
+        fclose(file);
+    }
+    // Separators of the folded format can not appear in a frame.
+    for (char * c = name; *c; c++) {
+        if (*c == ';' || *c == ' ')
+            *c = '_';
+    }
+    if (thread != NULL)
+        thread->tid = tid;
+    return name;
+}
+/**
+ * @brief Read the function symbols of the executable's .symtab. Left empty if the executable
+ * was stripped or can not be read, frames then fall back to dladdr() alone.
+ *
+ * @param symtab Symbols read, released with profile_symtab_free().
+ */
+static void profile_symtab_load(profile_symtab_t * symtab) {
+    memset(symtab, 0, sizeof(*symtab));
+    symtab->image = MAP_FAILED;
+
+    // This file is linked into the executable, its load address is the executable's.
+    Dl_info self;
+    if (dladdr((void *)profile_symtab_load, &self) == 0)
+        return;
+    int fd = open("/proc/self/exe", O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(ElfW(Ehdr))) {
+        symtab->image_size = st.st_size;
+        symtab->image = mmap(NULL, symtab->image_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (symtab->image == MAP_FAILED)
+        return;
+
+    const char * image = symtab->image;
+    const ElfW(Ehdr) * header = symtab->image;
+    if (memcmp(header->e_ident, ELFMAG, SELFMAG) != 0 ||
+        header->e_shentsize != sizeof(ElfW(Shdr)) ||
+        header->e_shoff + (size_t)header->e_shnum * sizeof(ElfW(Shdr)) > symtab->image_size)
+        return;
+    // Symbol values of a position independent executable are relative to its load address.
+    symtab->base = header->e_type == ET_DYN ? (uintptr_t)self.dli_fbase : 0;
+
+    const ElfW(Shdr) * sections = (const ElfW(Shdr) *)(image + header->e_shoff);
+    for (int i = 0; i < header->e_shnum; i++) {
+        const ElfW(Shdr) * table = &sections[i];
+        if (table->sh_type != SHT_SYMTAB || table->sh_link >= header->e_shnum)
+            continue;
+        const ElfW(Shdr) * strings = &sections[table->sh_link];
+        if (table->sh_offset + table->sh_size > symtab->image_size ||
+            strings->sh_offset + strings->sh_size > symtab->image_size || strings->sh_size == 0 ||
+            image[strings->sh_offset + strings->sh_size - 1] != 0)
+            return;
+
+        const ElfW(Sym) * symbols = (const ElfW(Sym) *)(image + table->sh_offset);
+        size_t count = table->sh_size / sizeof(ElfW(Sym));
+        symtab->symbols = malloc(count * sizeof(*symtab->symbols));
+        if (symtab->symbols == NULL)
+            return;
+        for (size_t s = 0; s < count; s++) {
+            const ElfW(Sym) * symbol = &symbols[s];
+            if (ELF64_ST_TYPE(symbol->st_info) != STT_FUNC || symbol->st_value == 0 ||
+                symbol->st_size == 0 || symbol->st_name >= strings->sh_size)
+                continue;
+            // Every name ends within the table, its last byte is a NUL.
+            profile_symbol_t * entry = &symtab->symbols[symtab->count++];
+            entry->start = symtab->base + symbol->st_value;
+            entry->end = entry->start + symbol->st_size;
+            entry->name = image + strings->sh_offset + symbol->st_name;
+        }
+        qsort(symtab->symbols, symtab->count, sizeof(*symtab->symbols), profile_symbol_compare);
+        return;
+    }
+}
+/**
+ * @brief Order symbols by address.
+ */
+static int profile_symbol_compare(const void * a, const void * b) {
+    const profile_symbol_t * x = a;
+    const profile_symbol_t * y = b;
+    return x->start < y->start ? -1 : x->start > y->start;
+}
+/**
+ * @brief Name of the executable's function holding an address.
+ *
+ * @param symtab Symbols read by profile_symtab_load().
+ * @param pc Address looked up.
+ * @return const char* Function name, NULL if no function of the .symtab holds it.
+ */
+static const char * profile_symtab_find(const profile_symtab_t * symtab, uintptr_t pc) {
+    // Last symbol starting at or before pc.
+    size_t low = 0, high = symtab->count;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (symtab->symbols[middle].start <= pc)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    if (low == 0 || pc >= symtab->symbols[low - 1].end)
+        return NULL;
+    return symtab->symbols[low - 1].name;
+}
+/**
+ * @brief Release the symbols read by profile_symtab_load().
+ *
+ * @param symtab Symbols to release.
+ */
+static void profile_symtab_free(profile_symtab_t * symtab) {
+    free(symtab->symbols);
+    if (symtab->image != MAP_FAILED)
+        munmap(symtab->image, symtab->image_size);
+}
+/**
+ * @brief Write one frame of a folded stack.
+ *
+ * @param writer Folded stacks being built.
+ * @param symtab Executable symbols, for the functions dladdr() does not name.
+ * @param pc Frame address.
+ * @param leaf Set for the interrupted pc, other frames hold return addresses.
+ */
+static void profile_write_frame(profile_writer_t * writer, const profile_symtab_t * symtab,
+                                uintptr_t pc, int leaf) {
+    // A return address may already be past the end of its caller.
+    uintptr_t lookup = leaf ? pc : pc - 1;
+    const char * name;
+    Dl_info info;
+
+    if (dladdr((void *)lookup, &info) == 0 || info.dli_fname == NULL) {
+        profile_write(writer, ";0x%lx", (unsigned long)pc);
+    } else if (info.dli_sname != NULL) {
+        profile_write(writer, ";%s", info.dli_sname);
+    } else if ((name = profile_symtab_find(symtab, lookup)) != NULL) {
+        profile_write(writer, ";%s", name);
+    } else {
+        const char * module = strrchr(info.dli_fname, '/');
+        module = module != NULL ? module + 1 : info.dli_fname;
+        profile_write(writer, ";%s+0x%lx", module,
+                      (unsigned long)(lookup - (uintptr_t)info.dli_fbase));
+    }
+}
+/**
+ * @brief Append formatted text to the folded stacks, growing them as needed. Out of memory, they
+ * are released and the rest is dropped.
+ *
+ * @param writer Folded stacks being built.
+ * @param format printf format.
+ */
+static void profile_write(profile_writer_t * writer, const char * format, ...) {
+    va_list args;
+    while (writer->data != NULL) {
+        size_t room = writer->size - writer->length;
+        va_start(args, format);
+        int len = vsnprintf(writer->data + writer->length, room, format, args);
+        va_end(args);
+        if (len < 0)
+            return;
+        if ((size_t)len < room) {
+            writer->length += len;
+            return;
+        }
+
+        char * data = realloc(writer->data, writer->size * 2);
+        if (data == NULL) {
+            LOG_ERROR("Profile : No memory for the folded stacks");
+            free(writer->data);
+        }
+        writer->data = data;
+        writer->size *= 2;
+    }
+}
+
+/* === Public function implementation ========================================================== */
+
+int dict_profile_start(int seconds, dict_profile_done done, void * context) {
+    if (!PROFILE_UNWIND) {
+        errno = ENOTSUP;
+        return -1;
+    }
+    if (seconds <= 0 || seconds > DICT_PROFILE_MAX_SECONDS || done == NULL) {
+        errno = EINVAL;
+        return -1;
+    }
+    if (atomic_exchange(&profile_busy, 1)) {
+        errno = EBUSY;
+        return -1;
+    }
+
+    // ITIMER_PROF runs on process CPU time, every busy CPU adds its own samples.
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    profile_capacity = (unsigned long)seconds * DICT_PROFILE_HZ * (cpus > 0 ? cpus : 1);
+    atomic_store(&profile_next, 0);
+    profile_samples = calloc(profile_capacity, sizeof(*profile_samples));
+
+    profile_job_t * job = malloc(sizeof(*job));
+    if (profile_samples == NULL || job == NULL)
+        goto error;
+    job->seconds = seconds;
+    job->done = done;
+    job->context = context;
+
+    pthread_t thread;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    int rt = pthread_create(&thread, &attr, profile_run, job);
+    pthread_attr_destroy(&attr);
+    if (rt != 0) {
+        errno = rt;
+        goto error;
+    }
+    pthread_setname_np(thread, "dict-profile");
+    return 0;
+
+error:
+    free(job);
+    free(profile_samples);
+    profile_samples = NULL;
+    atomic_store(&profile_busy, 0);
+    return -1;
+}
+
+/* === End of documentation ==================================================================== */
@@ -0,0 +1,215 @@
+/************************************************************************************************
+Copyright (c) 2024, Guido Ramirez <guidoramirez7@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute,
+sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial
+portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+SPDX-License-Identifier: MIT
+*************************************************************************************************/
+
+/** @file dict_reclaim.c
+ ** @brief Background reclamation of large retired storage.
+ **/
+
+/* === Headers files inclusions =============================================================== */
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <unistd.h>
+#include "dict_reclaim.h"
+#include "dict_log.h"
+
+/* === Macros definitions ====================================================================== */
+
+#define RECLAIM_QUEUE      (1024)              /**< Jobs waiting, more are done in the caller */
+#define RECLAIM_TRUNC_STEP (64 * 1024 * 1024)  /**< Bytes freed per ftruncate() */
+
+/* === Private data type declarations ========================================================== */
+
+typedef enum {
+    RECLAIM_FILE,   /**< Truncate and close a descriptor */
+    RECLAIM_UNMAP,  /**< Unmap a region */
+    RECLAIM_CALL,   /**< Run a release function */
+} reclaim_kind;
+
+typedef struct {
+    reclaim_kind kind;            /**< What to release */
+    int fd;                       /**< RECLAIM_FILE descriptor */
+    void * region;                /**< RECLAIM_UNMAP region, RECLAIM_CALL argument */
+    size_t size;                  /**< Bytes released */
+    dict_arena_pages pages;       /**< RECLAIM_UNMAP page kind */
+    dict_reclaim_release release; /**< RECLAIM_CALL function */
+} reclaim_job_t;
+
+/* === Private variable declarations =========================================================== */
+
+/* === Private function declarations =========================================================== */
+
+static void reclaim_submit(const reclaim_job_t * job);
+
+static void reclaim_run_job(const reclaim_job_t * job);
+
+static void * reclaim_run(void * arg);
+
+/* === Public variable definitions ============================================================= */
+
+/* === Private variable definitions ============================================================ */
+
+static pthread_mutex_t reclaim_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t reclaim_ready = PTHREAD_COND_INITIALIZER;
+static reclaim_job_t reclaim_queue[RECLAIM_QUEUE]; /**< Ring of pending jobs */
+static int reclaim_head;                           /**< Next job to run */
+static int reclaim_count;                          /**< Jobs pending */
+static int reclaim_running;                        /**< The thread takes jobs */
+static pthread_t reclaim_thread;                   /**< Reclamation thread */
+
+static atomic_ulong reclaim_queued;       /**< Jobs handed to the thread */
+static atomic_ulong reclaim_inline;       /**< Jobs done in the caller, queue full or stopped */
+static atomic_ulong reclaim_done;         /**< Jobs finished by the thread */
+static atomic_ulong reclaim_done_bytes;   /**< Bytes released by the thread */
+
+/* === Private function implementation ========================================================= */
+/**
+ * @brief Queue a job, or run it in the caller when that is not possible.
+ *
+ * @param job Job to run.
+ */
+static void reclaim_submit(const reclaim_job_t * job) {
+    pthread_mutex_lock(&reclaim_lock);
+    if (reclaim_running && reclaim_count < RECLAIM_QUEUE) {
+        reclaim_queue[(reclaim_head + reclaim_count) % RECLAIM_QUEUE] = *job;
+        reclaim_count++;
+        pthread_cond_signal(&reclaim_ready);
+        pthread_mutex_unlock(&reclaim_lock);
+        atomic_fetch_add_explicit(&reclaim_queued, 1, memory_order_relaxed);
+        return;
+    }
+    pthread_mutex_unlock(&reclaim_lock);
+
+    atomic_fetch_add_explicit(&reclaim_inline, 1, memory_order_relaxed);
+    reclaim_run_job(job);
+}
+/**
+ * @brief Release what a job holds.
+ *
+ * @param job Job to run.
+ */
+static void reclaim_run_job(const reclaim_job_t * job) {
+    if (job->kind == RECLAIM_UNMAP) {
+        dict_arena_unmap(job->region, job->size, job->pages);
+        return;
+    }
+    if (job->kind == RECLAIM_CALL) {
+        job->release(job->region);
+        return;
+    }
+
+    // Shrinking in steps keeps each call short, so the file system is never held for long.
+    off_t size = job->size;
+    while (size > RECLAIM_TRUNC_STEP) {
+        size -= RECLAIM_TRUNC_STEP;
+        if (ftruncate(job->fd, size) < 0)
+            break;
+    }
+    close(job->fd);
+}
+/**
+ * @brief Reclamation thread. Runs jobs until stopped and the queue is empty.
+ *
+ * @param arg Not used.
+ * @return void* Always NULL.
+ */
+static void * reclaim_run(void * arg) {
+    pthread_mutex_lock(&reclaim_lock);
+    for (;;) {
+        while (reclaim_running && reclaim_count == 0)
+            pthread_cond_wait(&reclaim_ready, &reclaim_lock);
+        if (reclaim_count == 0)
+            break;
+
+        reclaim_job_t job = reclaim_queue[reclaim_head];
+        reclaim_head = (reclaim_head + 1) % RECLAIM_QUEUE;
+        reclaim_count--;
+        pthread_mutex_unlock(&reclaim_lock);
+
+        reclaim_run_job(&job);
+        atomic_fetch_add_explicit(&reclaim_done, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&reclaim_done_bytes, job.size, memory_order_relaxed);
+
+        pthread_mutex_lock(&reclaim_lock);
+    }
+    pthread_mutex_unlock(&reclaim_lock);
+    return NULL;
+}
+
+/* === Public function implementation ========================================================== */
+
+int dict_reclaim_start(void) {
+    pthread_mutex_lock(&reclaim_lock);
+    reclaim_running = 1;
+    pthread_mutex_unlock(&reclaim_lock);
+
+    if (pthread_create(&reclaim_thread, NULL, reclaim_run, NULL) != 0) {
+        pthread_mutex_lock(&reclaim_lock);
+        reclaim_running = 0;
+        pthread_mutex_unlock(&reclaim_lock);
+        LOG_ERROR("Reclaim : Can not start thread, releasing inline");
+        return -1;
+    }
+    pthread_setname_np(reclaim_thread, "dict-reclaim");
+    return 0;
+}
+
+void dict_reclaim_stop(void) {
+    pthread_mutex_lock(&reclaim_lock);
+    int running = reclaim_running;
+    reclaim_running = 0;
+    pthread_cond_signal(&reclaim_ready);
+    pthread_mutex_unlock(&reclaim_lock);
+
+    if (running)
+        pthread_join(reclaim_thread, NULL);
+}
+
+void dict_reclaim_file(int fd, off_t size) {
+    reclaim_job_t job = {.kind = RECLAIM_FILE, .fd = fd, .size = size};
+    reclaim_submit(&job);
+}
+
+void dict_reclaim_unmap(void * region, size_t size, dict_arena_pages pages) {
+    reclaim_job_t job = {.kind = RECLAIM_UNMAP, .region = region, .size = size, .pages = pages};
+    reclaim_submit(&job);
+}
+
+void dict_reclaim_call(dict_reclaim_release release, void * arg, size_t size) {
+    reclaim_job_t job = {.kind = RECLAIM_CALL, .release = release, .region = arg, .size = size};
+    reclaim_submit(&job);
+}
+
+int dict_reclaim_stats(char * buffer, int buffer_size) {
+    pthread_mutex_lock(&reclaim_lock);
+    int pending = reclaim_count;
+    pthread_mutex_unlock(&reclaim_lock);
+
+    return snprintf(buffer, buffer_size,
+                    "reclaim_pending:%d\nreclaim_queued:%lu\nreclaim_inline:%lu\nreclaim_done:%lu\n"
+                    "reclaim_done_bytes:%lu\n",
+                    pending, atomic_load(&reclaim_queued), atomic_load(&reclaim_inline),
+                    atomic_load(&reclaim_done), atomic_load(&reclaim_done_bytes));
+}
+
+/* === End of documentation ==================================================================== */
@@ -25,6 +25,7 @@ SPDX-License-Identifier: MIT
 
 /* === Headers files inclusions =============================================================== */
 
+#define _GNU_SOURCE
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #include <stdio.h>
@@ -33,28 +34,82 @@ SPDX-License-Identifier: MIT
 #include <sys/socket.h>
 #include <unistd.h>
 #include <errno.h>
+#include <fnmatch.h>
 #include <string.h>
+#include <signal.h>
+#include <dirent.h>
 #include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+#include <linux/tcp.h>
+#include <malloc.h>
+#include <limits.h>
+#include <stdarg.h>
 #include "dict_server.h"
+#include "dict_bufpool.h"
+#include "dict_dump.h"
+#include "dict_log.h"
+#include "dict_profile.h"
+#include "dict_reclaim.h"
+#include "dict_trace.h"
+#include "dict_warmup.h"
+#include "dict_watchdog.h"
 
 /* === Macros definitions ====================================================================== */
 
 #define SERVER_IP                "127.0.0.1"
 #define SERVER_PORT              (5000)
-#define SERVER_CLIENTS           (1)
-#define SERVER_BUFFER_SIZE       (128)
+#define SERVER_BACKLOG           (4096) /**< Default listen backlog, capped by somaxconn. */
+#define SERVER_REPLY_SIZE        (4096) /**< Largest reply body, GET values grow the output. */
+#define SERVER_EVENTS            (64)   /**< Events handled per epoll_wait() call. */
+#define SERVER_POLL_TIMEOUT_MS   (100)  /**< Blocking wait, bounds the time to notice a stop. */
+#define SERVER_LOOP_TIME_BUCKETS (16)   /**< Loop time histogram, bucket i counts < 2^i us. */
+#define SERVER_LOOP_EVENT_BUCKETS (8)   /**< Events histogram, bucket i counts < 2^i events. */
+
+#define SERVER_DUMP_NAME         "dump" /**< Default dump name for DUMP and LOAD operations. */
+#define SERVER_DUMP_STATUS       "STATUS" /**< DUMP argument reporting the last job, not a name. */
+#define SERVER_CLIENT_SLOTS      (1024) /**< Clients tracked per worker, others are not listed. */
+#define SERVER_DEFRAG_SLICE_US   (500)  /**< Longest defragmentation slice. */
+#define SERVER_DEFRAG_CHECK_MS   (1000) /**< Pause before checking again when there was no work. */
+#define SERVER_UDP_BATCH         (32)   /**< Datagrams per recvmmsg() and sendmmsg() call. */
+#define SERVER_UDP_PAYLOAD       (1400) /**< Largest UDP reply, below a common path MTU. */
+#define SERVER_ACCEPT_WINDOW_NS  (1000000000UL) /**< Accept rate measurement window. */
+#define SERVER_UDP_REQUEST       (128)  /**< Largest UDP request, longer ones are cut. */
+#define SERVER_READ_MIN          (512)  /**< Smallest read into a connection's input buffer. */
+#define SERVER_READ_MAX          (65536) /**< Largest read, reached by clients that pipeline. */
+#define SERVER_COMMAND_MAX       DICT_BUFPOOL_MAX_SIZE /**< Longest command, terminator included. */
+#define SERVER_OUTPUT_HIGH       (262144) /**< Queued reply bytes that pause command processing. */
+#define SERVER_POOL_KEEP         (4194304) /**< Free buffer bytes each worker keeps for reuse. */
+#define SERVER_POOL_TRIM_NS      (1000000000UL) /**< Quiet time before free buffers are released. */
+#define SERVER_FLUSH_SAMPLE      (64)   /**< Flushes between two packet counts of a connection. */
 
 #define SERVER_MAX_ARGS          (2) /**< Only two because the SET operation requires key:value. */
 
-#define SERVER_GET_OP_STRING     "GET"
-#define SERVER_SET_OP_STRING     "SET"
-#define SERVER_DEL_OP_STRING     "DEL"
-
-#define SERVER_OK_RESPONSE       "OK\n"
-#define SERVER_NOTFOUND_RESPONSE "NOTFOUND\n"
-
-#define LOG_INFO(format, ...)    printf("INFO-> " format "\n", ##__VA_ARGS__)
-#define LOG_ERROR(format, ...)   fprintf(stderr, "ERROR -> " format "\n", ##__VA_ARGS__)
+#define SERVER_GET_OP_STRING      "GET"
+#define SERVER_SET_OP_STRING      "SET"
+#define SERVER_DEL_OP_STRING      "DEL"
+#define SERVER_DUMP_OP_STRING     "DUMP"
+#define SERVER_LOAD_OP_STRING     "LOAD"
+#define SERVER_STATS_OP_STRING    "STATS"
+#define SERVER_PROFILE_OP_STRING  "PROFILE"
+#define SERVER_CLIENT_OP_STRING   "CLIENT"
+#define SERVER_MEMORY_OP_STRING   "MEMORY"
+#define SERVER_FLUSH_OP_STRING    "FLUSH"
+#define SERVER_DBSIZE_OP_STRING   "DBSIZE"
+#define SERVER_FLUSHALL_OP_STRING "FLUSHALL"
+#define SERVER_KEYS_OP_STRING     "KEYS"
+#define SERVER_DELPREFIX_OP_STRING "DELPREFIX"
+
+#define SERVER_KEYS_SPECIAL       "*?[\\" /**< Glob characters, the KEYS prefix ends at the first */
+
+#define SERVER_OK_RESPONSE        "OK\n"
+#define SERVER_NOTFOUND_RESPONSE  "NOTFOUND\n"
+#define SERVER_TCP_RESPONSE       "TCP\n" /**< UDP reply: the value does not fit, ask over TCP */
 
 /* === Private data type declarations ========================================================== */
 
@@ -63,25 +118,172 @@ typedef enum {
     SERVER_OP_SET,      /**< Set key */
     SERVER_OP_GET,      /**< Get key */
     SERVER_OP_DEL,      /**< Delete key */
+    SERVER_OP_DUMP,     /**< Export the whole keyspace */
+    SERVER_OP_LOAD,     /**< Import a previous export */
+    SERVER_OP_STATS,    /**< Report server statistics */
+    SERVER_OP_PROFILE,  /**< Sample every thread's stack for a while */
+    SERVER_OP_CLIENT,   /**< List or close client connections */
+    SERVER_OP_MEMORY,   /**< Report where memory goes */
+    SERVER_OP_FLUSH,    /**< Write buffered writes to storage */
+    SERVER_OP_DBSIZE,   /**< Count keys */
+    SERVER_OP_FLUSHALL, /**< Delete every key */
+    SERVER_OP_KEYS,     /**< List the keys matching a pattern */
+    SERVER_OP_DELPREFIX, /**< Delete the keys starting with a prefix */
+    SERVER_OP_COUNT,    /**< Number of operations, not an operation */
 } server_op;
 
-typedef enum {
-    SERVER_OK = 0,
-    SERVER_E_OS,
-    SERVER_E_NULL,
-    SERVER_E_SIZE,
-    SERVER_E_BUFFER,
-    SERVER_E_INVALID,
-    SERVER_E_MISSING,
-    SERVER_E_TOO_MANY,
-    SERVER_E_NOT_FOUND,
-} server_err_t;
-
 typedef struct {
     server_op op;                 /**< Operation enum */
+    int argc;                     /**< Number of arguments received */
     char * args[SERVER_MAX_ARGS]; /**< Max arguments for all server's operations */
 } server_op_t;
 
+typedef struct {
+    const char * name; /**< Operation string as received from the client */
+    server_op op;      /**< Operation enum */
+    int min_args;      /**< Minimum arguments accepted */
+    int max_args;      /**< Maximum arguments accepted */
+} server_op_desc_t;
+
+#if DICT_CONFIG_STATS
+typedef struct {
+    atomic_ulong calls;  /**< Requests processed */
+    atomic_ulong errors; /**< Requests answered with an error */
+#if DICT_CONFIG_TRACE
+    atomic_ulong syscalls[DICT_TRACE_SYSCALL_COUNT]; /**< Syscalls issued, by dict_trace_syscall */
+    atomic_ulong cycles[DICT_TRACE_PHASE_COUNT];     /**< Cycles spent, by dict_trace_phase */
+#endif
+} server_op_stats_t;
+#endif
+
+/**
+ * Client connection. Both buffers come from the worker's pool and go back to it as soon as they
+ * are empty, an idle connection holds none.
+ */
+typedef struct server_conn {
+    int fd;                   /**< Client file descriptor */
+    int length;               /**< Bytes pending in the input buffer */
+    int read_size;            /**< Bytes asked per recv(), follows what the client sends */
+    int writing;              /**< Waiting for EPOLLOUT, reading is paused */
+    int more;                 /**< Complete commands wait behind the replies, sends are corked */
+    int corked;               /**< Bytes were sent with MSG_MORE and no push followed yet */
+    char * buffer;            /**< Received bytes not yet processed, NULL when empty */
+    size_t buffer_size;       /**< Input buffer's capacity */
+    char * output;            /**< Replies not yet sent, NULL when empty */
+    size_t output_size;       /**< Output buffer's capacity */
+    size_t output_length;     /**< Bytes queued in the output buffer */
+    size_t output_sent;       /**< Queued bytes already sent */
+    struct server_profile * profile; /**< PROFILE running, the commands after it wait unread */
+    int held;                 /**< Replies wait for the batch's writes to be durable */
+    struct server_conn * held_next; /**< Next connection held by the worker */
+    char ip[INET_ADDRSTRLEN]; /**< Peer address */
+#if DICT_CONFIG_STATS
+    struct server_client * client; /**< Introspection slot, NULL if the table was full */
+    int flushes;                   /**< Flushes since its packets were last counted */
+    uint32_t data_segs;            /**< Data segments sent when they were last counted */
+#endif
+} server_conn_t;
+
+#if DICT_CONFIG_STATS
+/**
+ * Introspection slot of a connection. Written only by the worker owning it and read by CLIENT
+ * from any worker: the id is published last and checked again after reading, so a reader
+ * skips a slot that was released or reused meanwhile.
+ */
+typedef struct server_client {
+    atomic_ulong id;         /**< Unique client id, 0 while the slot is free */
+    atomic_ulong kill;       /**< Id CLIENT KILL asked to close, 0 if none */
+    atomic_int pending;      /**< Bytes waiting in the input buffer */
+    atomic_int capacity;     /**< Input buffer's capacity, 0 if it has none */
+    atomic_int output;       /**< Reply bytes waiting to be sent */
+    atomic_ulong commands;   /**< Commands processed */
+    atomic_ulong bytes_in;   /**< Bytes received */
+    atomic_ulong bytes_out;  /**< Bytes sent */
+    atomic_ulong busy_ns;    /**< Time processing commands */
+    atomic_ulong active_ns;  /**< Last command completed, or connection time */
+    uint64_t created_ns;     /**< Connection time */
+    int port;                /**< Peer port */
+    char ip[INET_ADDRSTRLEN]; /**< Peer address */
+    server_conn_t * conn;    /**< Connection, owner only */
+} server_client_t;
+#endif
+
+typedef struct {
+    int index;        /**< Worker number */
+    int cpu;          /**< CPU the worker is pinned to, -1 if not pinned */
+    int numa;         /**< Place the worker's memory on the node of its CPU */
+    int node;         /**< NUMA node its memory is placed on, -1 if not placed */
+    int busy_poll;    /**< SO_BUSY_POLL microseconds, 0 to block in epoll_wait() */
+    int listen_fd;    /**< Listening socket, one per worker */
+    int udp_fd;       /**< UDP socket answering single datagram GETs, -1 if disabled */
+    int epoll_fd;     /**< Event queue of the listening socket and every connection */
+    pthread_t thread; /**< Worker thread, not used by worker 0 which runs in the caller */
+    dict_bufpool pool;       /**< Connection buffers, used by this worker only */
+    uint64_t active_ns;      /**< Last batch of events, the pool is trimmed after a quiet time */
+    int defrag_percent;      /**< Share of the loop given to dict_backend_defrag(), 0 disables */
+    int defrag_more;         /**< The backend asked for another slice */
+    uint64_t defrag_next_ns; /**< When the next slice may run */
+    int wake_fd;             /**< eventfd, a CLIENT KILL or a PROFILE result is pending */
+    _Atomic(struct server_profile *) profiles; /**< PROFILE results handed to the worker */
+    int batching;            /**< Writes of the batch are durable only once it commits */
+    server_conn_t * held;    /**< Connections whose replies wait for the commit */
+#if DICT_CONFIG_STATS
+    server_op_stats_t stats[SERVER_OP_COUNT]; /**< Indexed by server_op */
+    atomic_ulong invalid;                     /**< Requests rejected by the parser */
+    atomic_ulong connections;                 /**< Connections accepted */
+    atomic_ulong accept_batches;              /**< Readiness events that accepted connections */
+    atomic_ulong accept_max_batch;            /**< Most connections accepted for one event */
+    atomic_ulong accept_errors;               /**< accept4() failures, e.g. out of descriptors */
+    atomic_ulong accept_window_ns;            /**< Start of the accept rate window */
+    atomic_ulong accept_window_count;         /**< Connections accepted in the window */
+    atomic_ulong accept_rate;                 /**< Connections per second in the last window */
+    atomic_ulong polls;                       /**< epoll_wait() calls */
+    atomic_ulong idle_polls;                  /**< epoll_wait() calls without events */
+    atomic_ulong udp_requests;                /**< Datagrams received */
+    atomic_ulong udp_batches;                 /**< recvmmsg() calls that returned datagrams */
+    atomic_ulong udp_redirects;               /**< GETs sent back to TCP, value too large */
+    atomic_ulong flushes;                     /**< Flushes that sent replies */
+    atomic_ulong flush_bytes;                 /**< Reply bytes sent by them */
+    atomic_ulong flush_corked;                /**< Flushes sent with MSG_MORE, more to follow */
+    atomic_ulong flush_counted;               /**< Flushes whose packets were counted */
+    atomic_ulong flush_packets;               /**< Data segments sent by those flushes */
+    atomic_ulong loop_time[SERVER_LOOP_TIME_BUCKETS];    /**< Time handling one batch of events */
+    atomic_ulong loop_events[SERVER_LOOP_EVENT_BUCKETS]; /**< Events handled per iteration */
+    dict_watchdog_beat_t * beat;                         /**< Progress seen by the watchdog */
+    server_client_t * clients;                           /**< SERVER_CLIENT_SLOTS slots */
+    int * client_free;                                   /**< Free slots, owner only */
+    int client_free_count;                               /**< Entries in client_free */
+    atomic_ulong conn_bytes;                             /**< Memory of open connections */
+#endif
+} server_worker_t;
+
+typedef struct {
+    server_worker_t * worker; /**< Worker owning the connection */
+    server_conn_t * conn;     /**< Connection the keys are queued to */
+    const char * pattern;     /**< Pattern the keys must match, NULL if the prefix is enough */
+    int length;               /**< Bytes queued */
+    int err;                  /**< SERVER_E_BUFFER if a key could not be queued */
+} server_keys_t;
+
+/**
+ * PROFILE request. The profiler thread stores the result and hands the request to the worker,
+ * which alone reads and writes the connection.
+ */
+typedef struct server_profile {
+    server_worker_t * worker;     /**< Worker owning the connection */
+    server_conn_t * conn;         /**< Connection waiting for the reply, NULL once closed */
+    char * text;                  /**< Folded stacks, NULL if the profile had no memory */
+    size_t length;                /**< Bytes in text */
+    struct server_profile * next; /**< Next result handed to the same worker */
+} server_profile_t;
+
+typedef struct {
+    server_worker_t * worker; /**< Worker owning the connection */
+    server_conn_t * conn;     /**< Connection the report is queued to */
+    int length;               /**< Bytes queued */
+    int err;                  /**< SERVER_E_BUFFER if some text could not be queued */
+} server_report_t;
+
 struct dict_server {
     int client_fd;         /**< Client file descriptor */
     int server_fd;         /**< Server file descriptor */
@@ -96,16 +298,155 @@ static int server_op_check(char * buffer, int length, server_op_t * digest);
 
 static int server_write_key_value(server_op_t * digest);
 
-static int server_read_key_value(server_op_t * digest, char * buffer, int buffer_size);
+static int server_read_key_value(server_op_t * digest, char * buffer, int buffer_size,
+                                 int * length, int * value_length);
 
 static int server_delete_key_value(server_op_t * digest);
 
-static int server_op_process(int socket, server_op_t * digest);
+static int server_op_process(server_worker_t * worker, server_conn_t * conn, server_op_t * digest,
+                             int * sent);
+
+static int server_listen_socket(int type, int reuse_port, int backlog, int defer_accept_s,
+                                int nodelay);
+
+static int server_cpu_node(int cpu);
+
+static void server_worker_place(server_worker_t * worker);
+
+static void * server_worker_run(void * arg);
+
+static int server_worker_defrag(server_worker_t * worker, int timeout);
+
+static void server_conn_accept(server_worker_t * worker);
+
+static void server_conn_open(server_worker_t * worker, int newfd,
+                             const struct sockaddr_in * clientaddr);
+
+static void server_conn_read(server_worker_t * worker, server_conn_t * conn);
+
+static void server_conn_write(server_worker_t * worker, server_conn_t * conn);
+
+static void server_conn_serve(server_worker_t * worker, server_conn_t * conn);
+
+static int server_conn_process(server_worker_t * worker, server_conn_t * conn);
+
+static void server_conn_command(server_worker_t * worker, server_conn_t * conn, char * line,
+                                int length);
+
+static int server_conn_get(server_worker_t * worker, server_conn_t * conn, server_op_t * digest,
+                           int * sent);
+
+static int server_keys_visit(const char * key, void * context);
+
+static int server_conn_keys(server_worker_t * worker, server_conn_t * conn, server_op_t * digest,
+                            int * sent);
+
+static char * server_conn_reserve(server_worker_t * worker, server_conn_t * conn, size_t size);
+
+static int server_conn_reply(server_worker_t * worker, server_conn_t * conn, const char * data,
+                             size_t length);
+
+static int server_conn_flush(server_worker_t * worker, server_conn_t * conn);
+
+static void server_conn_close(server_worker_t * worker, server_conn_t * conn);
+
+static void server_worker_wake(server_worker_t * worker);
+
+static void server_worker_commit(server_worker_t * worker);
+
+static int server_profile_start(server_worker_t * worker, server_conn_t * conn, int seconds);
+
+static void server_profile_done(char * text, size_t length, void * context);
+
+static void server_profile_deliver(server_worker_t * worker);
+
+static void server_udp_read(server_worker_t * worker);
+
+static int server_udp_command(server_worker_t * worker, char * line, int length, char * reply);
+
+#if DICT_CONFIG_STATS
+static void server_report_printf(server_report_t * report, const char * format, ...);
+
+static void server_report_module(server_report_t * report, int (*stats)(char *, int));
+
+static int server_conn_report(server_worker_t * worker, server_conn_t * conn,
+                              void (*write)(server_report_t *), int * sent);
+
+static void server_stats_report(server_report_t * report);
+
+static void server_stats_update(server_worker_t * worker, server_op op, int err);
+
+static void server_stats_loop(server_worker_t * worker, uint64_t elapsed_ns, int events);
+
+static void server_stats_accept(server_worker_t * worker, int accepted);
+
+static void server_stats_listen_drops(unsigned long * overflows, unsigned long * drops);
+
+static void server_stats_flush(server_worker_t * worker, server_conn_t * conn, size_t bytes);
+
+static void server_stats_packets(server_worker_t * worker, server_conn_t * conn);
+
+static void server_client_open(server_worker_t * worker, server_conn_t * conn,
+                               const struct sockaddr_in * addr);
+
+static void server_client_close(server_worker_t * worker, server_conn_t * conn);
+
+static void server_client_list(server_report_t * report);
+
+static int server_client_kill(const char * target);
+
+static void server_client_reap(server_worker_t * worker);
+
+static int server_memory_report(char * buffer, int buffer_size);
+
+static int server_memory_usage(const char * key, char * buffer, int buffer_size, int * length);
+
+#define SERVER_STAT_INC(counter) atomic_fetch_add_explicit(&(counter), 1, memory_order_relaxed)
+#define SERVER_STAT_ADD(counter, value)                                                            \
+    atomic_fetch_add_explicit(&(counter), (value), memory_order_relaxed)
+#define SERVER_STAT_SUB(counter, value)                                                            \
+    atomic_fetch_sub_explicit(&(counter), (value), memory_order_relaxed)
+#define SERVER_STAT_SET(counter, value)                                                            \
+    atomic_store_explicit(&(counter), (value), memory_order_relaxed)
+#define SERVER_STAT_GET(counter) atomic_load_explicit(&(counter), memory_order_relaxed)
+#else
+#define server_stats_update(worker, op, err)         ((void)0)
+#define server_stats_loop(worker, elapsed_ns, events) ((void)0)
+#define server_stats_accept(worker, accepted)        ((void)0)
+#define SERVER_STAT_INC(counter)                    ((void)0)
+#define SERVER_STAT_ADD(counter, value)             ((void)0)
+#define server_stats_flush(worker, conn, bytes)     ((void)0)
+#endif
 
 /* === Public variable definitions ============================================================= */
 
 /* === Private variable definitions ============================================================ */
 
+static volatile sig_atomic_t server_stop_requested; /**< Set by dict_server_stop() */
+
+static server_worker_t * server_workers; /**< Every worker, read by STATS */
+static int server_worker_count;          /**< Number of workers */
+#if DICT_CONFIG_STATS
+static dict_watchdog_beat_t * server_beats; /**< Watchdog beat of every worker */
+#endif
+
+static const server_op_desc_t server_op_table[] = {
+    {SERVER_GET_OP_STRING, SERVER_OP_GET, 1, 1},   {SERVER_SET_OP_STRING, SERVER_OP_SET, 2, 2},
+    {SERVER_DEL_OP_STRING, SERVER_OP_DEL, 1, 1},   {SERVER_DUMP_OP_STRING, SERVER_OP_DUMP, 0, 1},
+    {SERVER_LOAD_OP_STRING, SERVER_OP_LOAD, 0, 1},
+    {SERVER_PROFILE_OP_STRING, SERVER_OP_PROFILE, 1, 1},
+    {SERVER_FLUSH_OP_STRING, SERVER_OP_FLUSH, 0, 0},
+    {SERVER_DBSIZE_OP_STRING, SERVER_OP_DBSIZE, 0, 0},
+    {SERVER_FLUSHALL_OP_STRING, SERVER_OP_FLUSHALL, 0, 0},
+    {SERVER_KEYS_OP_STRING, SERVER_OP_KEYS, 1, 1},
+    {SERVER_DELPREFIX_OP_STRING, SERVER_OP_DELPREFIX, 1, 1},
+#if DICT_CONFIG_STATS
+    {SERVER_STATS_OP_STRING, SERVER_OP_STATS, 0, 0},
+    {SERVER_CLIENT_OP_STRING, SERVER_OP_CLIENT, 1, 2},
+    {SERVER_MEMORY_OP_STRING, SERVER_OP_MEMORY, 1, 2},
+#endif
+};
+
 /* === Private function implementation ========================================================= */
 /**
  * @brief Check if an input buffer has the format for this server app.
@@ -125,54 +466,38 @@ static int server_op_check(char * buffer, int length, server_op_t * digest) {
     if (digest == NULL)
         return SERVER_E_NULL;
 
-    int err = SERVER_OK;
-    int op_args = 0;
-    char * op = NULL;
+    const server_op_desc_t * desc = NULL;
     memset(digest, 0, sizeof(*digest));
 
-    // Check if operation exists in the buffer.
-    if (digest->op == SERVER_OP_NONE) {
-        op = strstr(buffer, SERVER_GET_OP_STRING);
-        if (op != NULL)
-            digest->op = SERVER_OP_GET;
-    }
+    char * token = NULL;
+    char * temp = buffer;
+    const char * delim = " \r\n";
 
-    if (digest->op == SERVER_OP_NONE) {
-        op = strstr(buffer, SERVER_SET_OP_STRING);
-        if (op != NULL)
-            digest->op = SERVER_OP_SET;
-    }
+    // First token is always the operation.
+    token = strtok_r(temp, delim, &temp);
+    if (token == NULL)
+        return SERVER_E_INVALID;
 
-    if (digest->op == SERVER_OP_NONE) {
-        op = strstr(buffer, SERVER_DEL_OP_STRING);
-        if (op != NULL)
-            digest->op = SERVER_OP_DEL;
+    for (int i = 0; i < sizeof(server_op_table) / sizeof(server_op_table[0]); i++) {
+        if (strcmp(token, server_op_table[i].name) == 0) {
+            desc = &server_op_table[i];
+            break;
+        }
     }
 
     // Unknown operation.
-    if (digest->op == SERVER_OP_NONE)
+    if (desc == NULL)
         return SERVER_E_INVALID;
-
-    char * token = NULL;
-    char * temp = buffer;
-    const char * delim = " \n";
-
-    // First toke is always the operation which was detected before.
-    token = strtok_r(temp, delim, &temp);
+    digest->op = desc->op;
 
     while ((token = strtok_r(temp, delim, &temp))) {
-        if (op_args > SERVER_MAX_ARGS)
+        if (digest->argc >= desc->max_args)
             return SERVER_E_TOO_MANY;
-        digest->args[op_args] = token;
-        op_args++;
+        digest->args[digest->argc] = token;
+        digest->argc++;
     }
 
-    // If two arguments were no received, error.
-    if (digest->op == SERVER_OP_SET && op_args != SERVER_MAX_ARGS)
-        return SERVER_E_MISSING;
-
-    // For this operations we need one argument at least.
-    if ((digest->op == SERVER_OP_GET || digest->op == SERVER_OP_DEL) && op_args != 1)
+    if (digest->argc < desc->min_args)
         return SERVER_E_MISSING;
 
     return SERVER_OK;
@@ -188,26 +513,7 @@ static int server_write_key_value(server_op_t * digest) {
     if (digest == NULL)
         return SERVER_E_NULL;
 
-    int fd;
-    int cnt;
-    int err = SERVER_OK;
-
-    // Our first argument is the file's name.
-    fd = open(digest->args[0], O_WRONLY | O_CREAT | O_TRUNC, 0644);
-    if (fd < 0) {
-        LOG_ERROR("Can not open file [%s] to write key", digest->args[0]);
-        return SERVER_E_OS;
-    }
-
-    cnt = write(fd, digest->args[1], strlen(digest->args[1]));
-    if (cnt == 0) {
-        err = SERVER_E_OS;
-        goto finish;
-    }
-
-finish:
-    close(fd);
-    return err;
+    return dict_backend_set(digest->args[0], digest->args[1], strlen(digest->args[1]));
 }
 /**
  * @brief Read a key value.
@@ -215,35 +521,25 @@ finish:
  * @param digest Result of previous operation format check.
  * @param buffer Buffer where the reading will be stored.
  * @param buffer_size Buffer's size.
+ * @param length Number of bytes stored in the buffer.
+ * @param value_length Where the whole value's length will be stored, larger than length if it
+ *                     was cut to the buffer. NULL if not needed.
  * @return int
  *              - SERVER_OK if not error.
  *              - SERVER_E_NOTFOUND if the key does not exist.
  */
-static int server_read_key_value(server_op_t * digest, char * buffer, int buffer_size) {
-    if (digest == NULL)
+static int server_read_key_value(server_op_t * digest, char * buffer, int buffer_size,
+                                 int * length, int * value_length) {
+    if (digest == NULL || length == NULL)
         return SERVER_E_NULL;
 
-    int fd;
-    int cnt;
-    int err = SERVER_OK;
-
-    // Our first argument is the file's name.
-    fd = open(digest->args[0], O_RDONLY);
-    if (fd < 0) {
-        LOG_ERROR("Can not open file [%s] to read key", digest->args[0]);
-        return SERVER_E_NOT_FOUND;
-    }
-
-    cnt = read(fd, buffer, buffer_size);
-    if (cnt == 0) {
-        err = SERVER_E_NOT_FOUND;
-        goto finish;
-    }
-
-    LOG_INFO("Read %d byte from [%s] file", cnt, digest->args[0]);
-
-finish:
-    close(fd);
+    int err = dict_backend_get(digest->args[0], buffer, buffer_size, length);
+    if (err == SERVER_OK && value_length != NULL)
+        *value_length = *length;
+    if (err == SERVER_OK && *length > buffer_size)
+        *length = buffer_size;
+    if (err == SERVER_OK)
+        dict_warmup_touch(digest->args[0]);
     return err;
 }
 /**
@@ -257,100 +553,177 @@ static int server_delete_key_value(server_op_t * digest) {
     if (digest == NULL)
         return SERVER_E_NULL;
 
-    int status;
-    int cnt;
-    int err = SERVER_OK;
-
-    status = remove(digest->args[0]);
-
-    if (status) {
-        LOG_ERROR("Can not delete [%s] file", digest->args[0]);
-        err = SERVER_E_NOT_FOUND;
-    }
-
-    return err;
+    return dict_backend_del(digest->args[0]);
 }
 /**
- * @brief Process and responds to a previous operation format check.
+ * @brief Process a previous operation format check and queue its reply.
  *
- * @param socket Socket to send the response to.
+ * @param worker Worker owning the connection.
+ * @param conn Connection the operation came from, its output buffer gets the reply.
  * @param digest Result of previous operation format check.
+ * @param sent Bytes queued in reply.
  * @return int
  *              - SERVER_OK if no error.
  */
-static int server_op_process(int socket, server_op_t * digest) {
-    if (digest == NULL)
+static int server_op_process(server_worker_t * worker, server_conn_t * conn, server_op_t * digest,
+                             int * sent) {
+    if (conn == NULL || digest == NULL || sent == NULL)
         return SERVER_E_NULL;
 
+    *sent = 0;
     int err = SERVER_OK;
-    char buffer[128] = {0};
+    int length = 0; // Reply body length, 0 if the reply has no body.
+    char buffer[SERVER_REPLY_SIZE];
+#if DICT_CONFIG_TRACE
+    uint64_t start = dict_trace_cycles();
+#endif
 
     if (digest->op == SERVER_OP_SET) {
         err = server_write_key_value(digest);
     } else if (digest->op == SERVER_OP_GET) {
-        err = server_read_key_value(digest, buffer, sizeof(buffer));
+        // The whole reply is queued, the value is read straight into the output buffer.
+        err = server_conn_get(worker, conn, digest, sent);
+        if (err == SERVER_OK) {
+            DICT_TRACE_PHASE(DICT_TRACE_STORAGE, start);
+            return SERVER_OK;
+        }
     } else if (digest->op == SERVER_OP_DEL) {
         err = server_delete_key_value(digest);
+    } else if (digest->op == SERVER_OP_DUMP && digest->argc > 0 &&
+               strcmp(digest->args[0], SERVER_DUMP_STATUS) == 0) {
+        length = dict_dump_stats(buffer, sizeof(buffer));
+    } else if (digest->op == SERVER_OP_DUMP || digest->op == SERVER_OP_LOAD) {
+        const char * name = digest->argc > 0 ? digest->args[0] : SERVER_DUMP_NAME;
+        int rt;
+        if (digest->op == SERVER_OP_DUMP)
+            rt = dict_dump_save(name);
+        else
+            rt = dict_dump_load(name);
+        if (rt < 0)
+            err = errno == EBUSY ? SERVER_E_BUSY : errno == EINVAL ? SERVER_E_INVALID : SERVER_E_OS;
+    } else if (digest->op == SERVER_OP_PROFILE) {
+        char * end;
+        long seconds = strtol(digest->args[0], &end, 10);
+        if (*end != 0 || seconds <= 0 || seconds > DICT_PROFILE_MAX_SECONDS)
+            err = SERVER_E_INVALID;
+        else
+            err = server_profile_start(worker, conn, seconds);
+        if (err == SERVER_OK) {
+            *sent = 0; // Queued by server_profile_deliver() once the time is up.
+            return SERVER_OK;
+        }
+    } else if (digest->op == SERVER_OP_FLUSH) {
+        err = dict_backend_flush();
+    } else if (digest->op == SERVER_OP_DBSIZE) {
+        size_t count;
+        err = dict_backend_count(&count);
+        if (err == SERVER_OK)
+            length = snprintf(buffer, sizeof(buffer), "%zu\n", count);
+    } else if (digest->op == SERVER_OP_FLUSHALL) {
+        err = dict_backend_clear();
+    } else if (digest->op == SERVER_OP_KEYS) {
+        // The keys are queued as they are found, the reply may be larger than the buffer.
+        err = server_conn_keys(worker, conn, digest, sent);
+        if (err == SERVER_OK) {
+            DICT_TRACE_PHASE(DICT_TRACE_STORAGE, start);
+            return SERVER_OK;
+        }
+    } else if (digest->op == SERVER_OP_DELPREFIX) {
+        size_t count;
+        err = dict_backend_del_prefix(digest->args[0], &count);
+        if (err == SERVER_OK)
+            length = snprintf(buffer, sizeof(buffer), "%zu\n", count);
+#if DICT_CONFIG_STATS
+    } else if (digest->op == SERVER_OP_STATS) {
+        // The lines are queued as they are written, the reply may be larger than the buffer.
+        err = server_conn_report(worker, conn, server_stats_report, sent);
+        if (err == SERVER_OK) {
+            DICT_TRACE_PHASE(DICT_TRACE_STORAGE, start);
+            return SERVER_OK;
+        }
+    } else if (digest->op == SERVER_OP_CLIENT) {
+        if (strcmp(digest->args[0], "LIST") == 0 && digest->argc == 1) {
+            // Queued like STATS, one line per client whatever their number.
+            err = server_conn_report(worker, conn, server_client_list, sent);
+            if (err == SERVER_OK) {
+                DICT_TRACE_PHASE(DICT_TRACE_STORAGE, start);
+                return SERVER_OK;
+            }
+        } else if (strcmp(digest->args[0], "KILL") == 0 && digest->argc == 2)
+            err = server_client_kill(digest->args[1]);
+        else
+            err = SERVER_E_INVALID;
+    } else if (digest->op == SERVER_OP_MEMORY) {
+        if (strcmp(digest->args[0], "STATS") == 0 && digest->argc == 1)
+            length = server_memory_report(buffer, sizeof(buffer));
+        else if (strcmp(digest->args[0], "USAGE") == 0 && digest->argc == 2)
+            err = server_memory_usage(digest->args[1], buffer, sizeof(buffer), &length);
+        else
+            err = SERVER_E_INVALID;
+#endif
     } else {
         err = SERVER_E_NOT_FOUND;
     }
 
-    if (err == SERVER_OK) {
-        // Send response.
-        int rt;
-        rt = send(socket, SERVER_OK_RESPONSE, sizeof(SERVER_OK_RESPONSE), MSG_DONTWAIT);
-        if (rt <= 0) {
-            LOG_ERROR("Error sending OK response");
-            err = SERVER_E_OS;
-        }
+    DICT_TRACE_PHASE(DICT_TRACE_STORAGE, start);
+#if DICT_CONFIG_TRACE
+    start = dict_trace_cycles();
+#endif
 
-        if (digest->op == SERVER_OP_GET && rt > 0) {
-            strcat(buffer, "\n");
-            rt = send(socket, buffer, strlen(buffer), MSG_DONTWAIT);
-            if (rt <= 0) {
-                LOG_ERROR("Error sending GET response");
-                err = SERVER_E_OS;
-            }
-        }
+    // Queue response, sent with the other replies of the batch.
+    int rt;
+    if (err == SERVER_OK) {
+        rt = server_conn_reply(worker, conn, SERVER_OK_RESPONSE, sizeof(SERVER_OK_RESPONSE));
+        if (rt == SERVER_OK && length > 0)
+            rt = server_conn_reply(worker, conn, buffer, length);
+        if (rt == SERVER_OK)
+            *sent = sizeof(SERVER_OK_RESPONSE) + length;
+    } else if (err == SERVER_E_NOT_FOUND) {
+        rt = server_conn_reply(worker, conn, SERVER_NOTFOUND_RESPONSE,
+                               sizeof(SERVER_NOTFOUND_RESPONSE));
+        if (rt == SERVER_OK)
+            *sent = sizeof(SERVER_NOTFOUND_RESPONSE);
     } else {
-        // Send error message.
-        if (err == SERVER_E_NOT_FOUND) {
-            int rt;
-            rt = send(socket, SERVER_NOTFOUND_RESPONSE, sizeof(SERVER_NOTFOUND_RESPONSE),
-                      MSG_DONTWAIT);
-            if (rt <= 0) {
-                LOG_ERROR("Error sending NOTFOUND response");
-                err = SERVER_E_OS;
-            }
-        } else {
-            int rt;
-            sprintf(buffer, "ERROR:%d", err);
-            rt = send(socket, buffer, strlen(buffer), MSG_DONTWAIT);
-            if (rt <= 0) {
-                LOG_ERROR("Error sending ERROR response");
-                err = SERVER_E_OS;
-            }
-        }
+        length = sprintf(buffer, "ERROR:%d", err);
+        rt = server_conn_reply(worker, conn, buffer, length);
+        if (rt == SERVER_OK)
+            *sent = length;
+    }
+    if (rt != SERVER_OK) {
+        LOG_ERROR("Can not queue reply for [%s]", conn->ip);
+        err = rt;
     }
-    return err;
-}
-
-/* === Public function implementation ========================================================== */
 
-dict_server dict_server_init(void) {
-    dict_server server = malloc(sizeof(*server));
-    return server;
+    DICT_TRACE_PHASE(DICT_TRACE_REPLY, start);
+    return err;
 }
-
-int dict_server_start(void) {
+/**
+ * @brief Create, bind and listen the server socket.
+ *
+ * @param type SOCK_STREAM for the TCP listener, SOCK_DGRAM for the UDP socket, which is only
+ * bound.
+ * @param reuse_port Set SO_REUSEPORT, so every worker can bind its own socket to the same port
+ * and the kernel spreads the connections between them.
+ * @param backlog Connections the kernel queues until they are accepted.
+ * @param defer_accept_s TCP_DEFER_ACCEPT seconds, a connection is only reported once its first
+ * request arrived or this time passed. 0 disables.
+ * @param nodelay Set TCP_NODELAY, inherited by the accepted connections.
+ * @return int Socket file descriptor. The process exits on error.
+ */
+static int server_listen_socket(int type, int reuse_port, int backlog, int defer_accept_s,
+                                int nodelay) {
     // Create a server socket.
-    int s = socket(AF_INET, SOCK_STREAM, 0);
+    int s = socket(AF_INET, type | SOCK_NONBLOCK, 0);
 
     // Set REUSEADDR to server's socket.
     if (setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &(int){1}, sizeof(int)) < 0) {
         LOG_ERROR("setsockopt REUSEADDR failed");
         exit(EXIT_FAILURE);
     }
+    if (reuse_port && setsockopt(s, SOL_SOCKET, SO_REUSEPORT, &(int){1}, sizeof(int)) < 0) {
+        LOG_ERROR("setsockopt REUSEPORT failed");
+        exit(EXIT_FAILURE);
+    }
 
     // Load [ip:port] to server.
     struct sockaddr_in serveraddr;
@@ -368,60 +741,1788 @@ int dict_server_start(void) {
         exit(EXIT_FAILURE);
     }
 
+    // Connections that sent nothing yet stay in the kernel instead of costing a wakeup.
+    if (type == SOCK_STREAM && defer_accept_s > 0 &&
+        setsockopt(s, IPPROTO_TCP, TCP_DEFER_ACCEPT, &defer_accept_s, sizeof(int)) < 0)
+        LOG_ERROR("setsockopt DEFER_ACCEPT failed");
+
+    // A lone reply leaves at once. Batches are merged by the flush policy, not by Nagle.
+    if (type == SOCK_STREAM && nodelay &&
+        setsockopt(s, IPPROTO_TCP, TCP_NODELAY, &(int){1}, sizeof(int)) < 0)
+        LOG_ERROR("setsockopt NODELAY failed");
+
     // Socket in listening mode.
-    if (listen(s, SERVER_CLIENTS) == -1) { // backlog=10
+    if (type == SOCK_STREAM && listen(s, backlog) == -1) {
         LOG_ERROR("Listen");
         exit(EXIT_FAILURE);
     }
 
+    return s;
+}
+/**
+ * @brief Find the NUMA node a CPU belongs to.
+ *
+ * @param cpu CPU number.
+ * @return int NUMA node, -1 if unknown.
+ */
+static int server_cpu_node(int cpu) {
+    char path[64];
+    int node = -1;
+
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+    DIR * dir = opendir(path);
+    if (dir == NULL)
+        return -1;
+
+    struct dirent * entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strncmp(entry->d_name, "node", 4) == 0) {
+            node = atoi(entry->d_name + 4);
+            break;
+        }
+    }
+    closedir(dir);
+    return node;
+}
+/**
+ * @brief Pin the calling worker to its CPU and prefer its NUMA node for new memory.
+ *
+ * Runs in the worker thread before anything is allocated, so its connection buffers and the
+ * backend entries it creates are first touched on the local node.
+ *
+ * @param worker Worker to place. Its cpu and node fields are updated with what was applied.
+ */
+static void server_worker_place(server_worker_t * worker) {
+    worker->node = -1;
+    if (worker->cpu < 0)
+        return;
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(worker->cpu, &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+        LOG_ERROR("Worker %d can not be pinned to CPU %d", worker->index, worker->cpu);
+        worker->cpu = -1;
+        worker->node = -1;
+        return;
+    }
+
+    if (!worker->numa)
+        return;
+    worker->node = server_cpu_node(worker->cpu);
+    if (worker->node < 0 || worker->node >= (int)(8 * sizeof(unsigned long))) {
+        worker->node = -1;
+        return;
+    }
+
+    // Preferred, not bound: allocations fall back to other nodes instead of failing.
+    unsigned long mask = 1UL << worker->node;
+    if (syscall(SYS_set_mempolicy, MPOL_PREFERRED, &mask, 8 * sizeof(mask)) < 0) {
+        LOG_ERROR("Worker %d can not prefer NUMA node %d", worker->index, worker->node);
+        worker->node = -1;
+    }
+}
+/**
+ * @brief Worker event loop. Accepts connections on its own socket and serves them.
+ *
+ * @param arg Worker.
+ * @return void* Always NULL.
+ */
+static void * server_worker_run(void * arg) {
+    server_worker_t * worker = arg;
+    struct epoll_event events[SERVER_EVENTS];
+
+    server_worker_place(worker);
+
+    // Worker 0 keeps the process name, shown by ps and pkill. Thread names are 15 characters.
+    if (worker->index > 0) {
+        char name[32];
+        snprintf(name, sizeof(name), "dict-worker%d", worker->index);
+        name[15] = 0;
+        pthread_setname_np(pthread_self(), name);
+    }
+
+    // Busy polling never sleeps in the kernel, the loop spins on a zero timeout.
+    int timeout = worker->busy_poll > 0 ? 0 : SERVER_POLL_TIMEOUT_MS;
+
+#if DICT_CONFIG_STATS
+    dict_watchdog_attach(worker->beat);
+#endif
+
+    LOG_INFO("Server : Worker %d waiting for connections (cpu %d, node %d)", worker->index,
+             worker->cpu, worker->node);
+    while (!server_stop_requested) {
+        int wait = server_worker_defrag(worker, timeout);
+        int count = epoll_wait(worker->epoll_fd, events, SERVER_EVENTS, wait);
+        SERVER_STAT_INC(worker->polls);
+        if (count < 0) {
+            if (errno == EINTR)
+                continue;
+            LOG_ERROR("epoll_wait");
+            exit(EXIT_FAILURE);
+        }
+        if (count == 0) {
+            SERVER_STAT_INC(worker->idle_polls);
+            // Traffic stopped, buffers kept for it go back to malloc() until it resumes.
+            if (dict_watchdog_now_ns() - worker->active_ns > SERVER_POOL_TRIM_NS)
+                dict_bufpool_trim(worker->pool);
+            continue;
+        }
+
+        uint64_t start = dict_watchdog_now_ns();
+        worker->active_ns = start;
+#if DICT_CONFIG_STATS
+        dict_watchdog_busy(worker->beat, start);
+#endif
+        worker->batching = dict_backend_batch_begin();
+        int wake = 0;
+        for (int i = 0; i < count; i++) {
+            if (events[i].data.ptr == NULL)
+                server_conn_accept(worker);
+            else if (events[i].data.ptr == &worker->udp_fd)
+                server_udp_read(worker);
+            else if (events[i].data.ptr == &worker->wake_fd)
+                wake = 1;
+            else if (events[i].events & EPOLLOUT)
+                server_conn_write(worker, events[i].data.ptr);
+            else
+                server_conn_read(worker, events[i].data.ptr);
+        }
+        // After the batch, a killed connection may still have an event in it.
+        if (wake)
+            server_worker_wake(worker);
+        server_worker_commit(worker);
+#if DICT_CONFIG_STATS
+        dict_watchdog_idle(worker->beat);
+        server_stats_loop(worker, dict_watchdog_now_ns() - start, count);
+#endif
+    }
+
+    return NULL;
+}
+/**
+ * @brief Give the backend a defragmentation slice when its CPU share allows it.
+ *
+ * A slice of length t is followed by a pause of t * (100 - percent) / percent, so the loop
+ * spends at most defrag_percent of its time on it, between batches and never inside one.
+ *
+ * @param worker Worker running the loop.
+ * @param timeout Event wait the loop would use otherwise.
+ * @return int Event wait, shortened so the next slice is not late.
+ */
+static int server_worker_defrag(server_worker_t * worker, int timeout) {
+    if (worker->defrag_percent <= 0)
+        return timeout;
+
+    uint64_t now = dict_watchdog_now_ns();
+    if (now >= worker->defrag_next_ns) {
+        worker->defrag_more = dict_backend_defrag(SERVER_DEFRAG_SLICE_US);
+        uint64_t end = dict_watchdog_now_ns();
+        if (worker->defrag_more)
+            worker->defrag_next_ns =
+                end + (end - now) * (100 - worker->defrag_percent) / worker->defrag_percent;
+        else
+            worker->defrag_next_ns = end + (uint64_t)SERVER_DEFRAG_CHECK_MS * 1000000;
+        now = end;
+    }
+
+    if (!worker->defrag_more)
+        return timeout;
+    int wait = worker->defrag_next_ns > now ? (worker->defrag_next_ns - now + 999999) / 1000000 : 0;
+    return wait < timeout ? wait : timeout;
+}
+/**
+ * @brief Accept every pending connection and register them in the worker's event queue.
+ *
+ * Draining the queue at once keeps a reconnect storm from overflowing the backlog, one event
+ * per connection would leave the rest waiting behind the other ready connections.
+ *
+ * @param worker Worker owning the listening socket.
+ */
+static void server_conn_accept(server_worker_t * worker) {
+    int accepted = 0;
     for (;;) {
-        // Receive new connections.
         socklen_t addr_len = sizeof(struct sockaddr_in);
         struct sockaddr_in clientaddr;
-        int newfd;
-        LOG_INFO("Server : Waiting for connection...");
-        if ((newfd = accept(s, (struct sockaddr *)&clientaddr, &addr_len)) == -1) {
-            LOG_ERROR("Accept");
+        int newfd = accept4(worker->listen_fd, (struct sockaddr *)&clientaddr, &addr_len,
+                            SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (newfd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                // Usually out of descriptors, the connection stays queued for the next event.
+                LOG_ERROR("Accept");
+                SERVER_STAT_INC(worker->accept_errors);
+            }
+            break;
+        }
+        server_conn_open(worker, newfd, &clientaddr);
+        accepted++;
+    }
+    server_stats_accept(worker, accepted);
+}
+/**
+ * @brief Register an accepted connection in the worker's event queue.
+ *
+ * @param worker Worker that accepted the connection.
+ * @param newfd Connection socket, closed on error.
+ * @param clientaddr Peer address.
+ */
+static void server_conn_open(server_worker_t * worker, int newfd,
+                             const struct sockaddr_in * clientaddr) {
+    server_conn_t * conn = malloc(sizeof(*conn));
+    if (conn == NULL) {
+        close(newfd);
+        return;
+    }
+    conn->fd = newfd;
+    conn->length = 0;
+    conn->read_size = SERVER_READ_MIN;
+    conn->writing = 0;
+    conn->more = 0;
+    conn->corked = 0;
+    conn->buffer = NULL;
+    conn->buffer_size = 0;
+    conn->output = NULL;
+    conn->output_size = 0;
+    conn->output_length = 0;
+    conn->output_sent = 0;
+    conn->profile = NULL;
+    conn->held = 0;
+    inet_ntop(AF_INET, &(clientaddr->sin_addr), conn->ip, sizeof(conn->ip));
+    LOG_INFO("Server : Connection from  [%s] on worker %d", conn->ip, worker->index);
+
+    if (worker->busy_poll > 0 &&
+        setsockopt(newfd, SOL_SOCKET, SO_BUSY_POLL, &worker->busy_poll, sizeof(int)) < 0)
+        LOG_ERROR("setsockopt BUSY_POLL failed");
+
+    struct epoll_event event = {.events = EPOLLIN, .data.ptr = conn};
+    if (epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, newfd, &event) < 0) {
+        LOG_ERROR("epoll_ctl");
+        close(newfd);
+        free(conn);
+        return;
+    }
+    SERVER_STAT_INC(worker->connections);
+#if DICT_CONFIG_STATS
+    SERVER_STAT_ADD(worker->conn_bytes, sizeof(*conn));
+    conn->flushes = 0;
+    conn->data_segs = 0;
+    server_client_open(worker, conn, clientaddr);
+#endif
+}
+/**
+ * @brief Read what a client sent and process every complete line.
+ *
+ * An unterminated command is kept until the rest arrives, and processed as is if the client
+ * closes the connection after sending it. Reads grow while they fill the buffer, as a client
+ * pipelining commands does, and shrink back once it sends little.
+ *
+ * @param worker Worker owning the connection.
+ * @param conn Connection with data ready.
+ */
+static void server_conn_read(server_worker_t * worker, server_conn_t * conn) {
+    size_t need = conn->length + conn->read_size + 1;
+    if (need > SERVER_COMMAND_MAX)
+        need = SERVER_COMMAND_MAX;
+    if (conn->buffer == NULL) {
+        conn->buffer = dict_bufpool_get(worker->pool, need, &conn->buffer_size);
+        if (conn->buffer == NULL) {
+            LOG_ERROR("No input buffer for [%s]", conn->ip);
+            server_conn_close(worker, conn);
+            return;
+        }
+    } else if (conn->buffer_size - 1 - conn->length < (size_t)conn->read_size / 2 &&
+               conn->buffer_size < SERVER_COMMAND_MAX) {
+        // Most of the buffer is taken by a partial command, as long commands are.
+        char * grown = dict_bufpool_grow(worker->pool, conn->buffer, conn->length, need,
+                                         &conn->buffer_size);
+        if (grown != NULL) {
+            conn->buffer = grown;
+        } else if (conn->buffer_size - 1 == (size_t)conn->length) {
+            LOG_ERROR("No input buffer for [%s]", conn->ip);
+            server_conn_close(worker, conn);
+            return;
+        }
+    }
+
+    int room = conn->buffer_size - 1 - conn->length;
+    int len = recv(conn->fd, conn->buffer + conn->length, room, 0);
+    // Accounted to the next command completed, whatever number of reads it took to arrive.
+    DICT_TRACE_SYSCALL(DICT_TRACE_RECV);
+    if (len < 0) {
+        switch (errno) {
+        case EAGAIN:
+        case EINTR:
+            return;
+        case ENOTCONN:
+            LOG_ERROR("Client is disconnecting...");
+            break;
+        case ECONNRESET:
+            LOG_ERROR("Peer reset connection...");
+            break;
+        default:
+            break;
+        }
+        server_conn_close(worker, conn);
+        return;
+    }
+
+    if (len == 0) {
+        if (conn->length > 0) {
+            conn->buffer[conn->length] = 0;
+            server_conn_command(worker, conn, conn->buffer, conn->length);
+            server_conn_flush(worker, conn);
+        }
+        server_conn_close(worker, conn);
+        return;
+    }
+
+    conn->length += len;
+    conn->buffer[conn->length] = 0;
+    LOG_INFO("%d bytes arrived into server: %s", len, conn->buffer);
+#if DICT_CONFIG_STATS
+    if (conn->client != NULL)
+        SERVER_STAT_ADD(conn->client->bytes_in, len);
+#endif
+
+    if (len == room && conn->read_size < SERVER_READ_MAX)
+        conn->read_size *= 2;
+    else if (len < conn->read_size / 4 && conn->read_size > SERVER_READ_MIN)
+        conn->read_size /= 2;
+
+    server_conn_serve(worker, conn);
+}
+/**
+ * @brief Send what is left of the replies once the socket takes more.
+ *
+ * @param worker Worker owning the connection.
+ * @param conn Connection ready for writing.
+ */
+static void server_conn_write(server_worker_t * worker, server_conn_t * conn) {
+    int rt = server_conn_flush(worker, conn);
+    if (rt < 0)
+        server_conn_close(worker, conn);
+    else if (rt == 0)
+        server_conn_serve(worker, conn); // Commands paused behind the replies go on.
+}
+/**
+ * @brief Process the commands received and send their replies, one send() for all of them.
+ *
+ * @param worker Worker owning the connection.
+ * @param conn Connection with new input or less output pending. Closed if sending fails.
+ */
+static void server_conn_serve(server_worker_t * worker, server_conn_t * conn) {
+    for (;;) {
+        int more = server_conn_process(worker, conn);
+        int rt = server_conn_flush(worker, conn);
+        if (rt < 0) {
+            server_conn_close(worker, conn);
+            return;
+        }
+        // No new input will trigger the commands left behind, they go on once the socket
+        // took their predecessors' replies.
+        if (!more || rt > 0)
+            return;
+    }
+}
+/**
+ * @brief Process every complete command of the input buffer.
+ *
+ * Stops while SERVER_OUTPUT_HIGH reply bytes are waiting, so a client that does not read its
+ * replies keeps its commands, not their replies, in memory. Stops as well while a PROFILE runs,
+ * the commands after it are processed once its reply is queued.
+ *
+ * @param worker Worker owning the connection.
+ * @param conn Connection with input.
+ * @return int 1 if complete commands were left for later, 0 otherwise.
+ */
+static int server_conn_process(server_worker_t * worker, server_conn_t * conn) {
+    if (conn->buffer == NULL)
+        return 0;
+
+    int more = 0;
+    char * line = conn->buffer;
+    char * end;
+    while (conn->profile == NULL &&
+           (end = memchr(line, '\n', conn->length - (line - conn->buffer))) != NULL) {
+        if (conn->output_length - conn->output_sent >= SERVER_OUTPUT_HIGH) {
+            more = 1;
+            break;
+        }
+        *end = 0;
+        server_conn_command(worker, conn, line, end - line);
+        line = end + 1;
+    }
+    conn->more = more;
+
+    conn->length -= line - conn->buffer;
+    if (!more && conn->profile == NULL && conn->length == (int)conn->buffer_size - 1 &&
+        conn->buffer_size >= SERVER_COMMAND_MAX) {
+        // A command longer than the largest buffer can never be completed.
+        LOG_ERROR("Command too long from [%s]", conn->ip);
+        server_stats_update(worker, SERVER_OP_NONE, SERVER_E_SIZE);
+        conn->length = 0;
+    }
+
+    size_t need = conn->length + conn->read_size + 1;
+    if (conn->length == 0) {
+        dict_bufpool_put(worker->pool, conn->buffer, conn->buffer_size);
+        conn->buffer = NULL;
+        conn->buffer_size = 0;
+    } else if (conn->buffer_size >= 4 * need) {
+        // A pipeline is over, its buffer is too large for what is left.
+        size_t size;
+        char * buffer = dict_bufpool_get(worker->pool, need, &size);
+        if (buffer != NULL) {
+            memcpy(buffer, line, conn->length);
+            dict_bufpool_put(worker->pool, conn->buffer, conn->buffer_size);
+            conn->buffer = buffer;
+            conn->buffer_size = size;
+        } else {
+            memmove(conn->buffer, line, conn->length);
+        }
+    } else if (line != conn->buffer) {
+        memmove(conn->buffer, line, conn->length);
+    }
+#if DICT_CONFIG_STATS
+    if (conn->client != NULL) {
+        SERVER_STAT_SET(conn->client->pending, conn->length);
+        SERVER_STAT_SET(conn->client->capacity, conn->buffer_size);
+    }
+#endif
+    return more;
+}
+/**
+ * @brief Check and process a single command.
+ *
+ * @param worker Worker owning the connection.
+ * @param conn Connection the command came from.
+ * @param line Null terminated command.
+ * @param length Command length.
+ */
+static void server_conn_command(server_worker_t * worker, server_conn_t * conn, char * line,
+                                int length) {
+    server_op_t digest = {0};
+#if DICT_CONFIG_TRACE
+    uint64_t start = dict_trace_cycles();
+#endif
+    int err = server_op_check(line, length, &digest);
+    DICT_TRACE_PHASE(DICT_TRACE_PARSE, start);
+    if (err != 0) {
+        LOG_ERROR("Can not check input data. Returned [%d]", err);
+        server_stats_update(worker, SERVER_OP_NONE, err);
+    } else {
+#if DICT_CONFIG_STATS
+        uint64_t begin = conn->client != NULL ? dict_watchdog_now_ns() : 0;
+#endif
+        int sent;
+        err = server_op_process(worker, conn, &digest, &sent);
+        LOG_INFO("Server process finished. Returned [%d]", err);
+        server_stats_update(worker, digest.op, err);
+        // The reply acknowledges a write, it goes out once the batch made the write durable.
+        if (worker->batching && !conn->held &&
+            (digest.op == SERVER_OP_SET || digest.op == SERVER_OP_DEL ||
+             digest.op == SERVER_OP_DELPREFIX)) {
+            conn->held = 1;
+            conn->held_next = worker->held;
+            worker->held = conn;
+        }
+#if DICT_CONFIG_STATS
+        server_client_t * client = conn->client;
+        if (client != NULL) {
+            uint64_t end = dict_watchdog_now_ns();
+            SERVER_STAT_INC(client->commands);
+            SERVER_STAT_ADD(client->bytes_out, sent);
+            SERVER_STAT_ADD(client->busy_ns, end - begin);
+            SERVER_STAT_SET(client->active_ns, end);
+        }
+#endif
+    }
+}
+/**
+ * @brief Queue the reply of a GET, reading the value straight into the output buffer.
+ *
+ * The value is read into the room of a usual reply first. A larger one is read again once the
+ * buffer grew to its size, and again if it grew meanwhile. A value is never sent cut: if the
+ * buffer can not grow, the reply is an error.
+ *
+ * @param worker Worker owning the connection.
+ * @param conn Connection the GET came from.
+ * @param digest Result of previous operation format check.
+ * @param sent Bytes queued in reply.
+ * @return int
+ *              - SERVER_OK if the reply was queued.
+ *              - SERVER_E_NOT_FOUND if the key does not exist, nothing was queued.
+ *              - SERVER_E_BUFFER if there is no memory for the reply.
+ */
+static int server_conn_get(server_worker_t * worker, server_conn_t * conn, server_op_t * digest,
+                           int * sent) {
+    const int header = sizeof(SERVER_OK_RESPONSE);
+    // Room for the value and its line feed.
+    int room = SERVER_REPLY_SIZE - header - 1;
+    int length = 0;
+    int value_length = 0;
+
+    char * reply = server_conn_reserve(worker, conn, SERVER_REPLY_SIZE);
+    if (reply == NULL)
+        return SERVER_E_BUFFER;
+    int err = server_read_key_value(digest, reply + header, room, &length, &value_length);
+    while (err == SERVER_OK && value_length > room) {
+        reply = server_conn_reserve(worker, conn, (size_t)header + value_length + 1);
+        if (reply == NULL)
+            return SERVER_E_BUFFER;
+        room = value_length;
+        err = server_read_key_value(digest, reply + header, room, &length, &value_length);
+    }
+    if (err != SERVER_OK)
+        return err;
+
+    memcpy(reply, SERVER_OK_RESPONSE, header);
+    reply[header + length] = '\n';
+    *sent = header + length + 1;
+    conn->output_length += *sent;
+    return SERVER_OK;
+}
+/**
+ * @brief Queue a key of a KEYS reply, one per line.
+ *
+ * @param key Key name, starting with the pattern's prefix.
+ * @param context Reply being built, server_keys_t.
+ * @return int 0 to continue, 1 if the output buffer can not grow.
+ */
+static int server_keys_visit(const char * key, void * context) {
+    server_keys_t * keys = context;
+    if (keys->pattern != NULL && fnmatch(keys->pattern, key, 0) != 0)
+        return 0;
+
+    size_t length = strlen(key);
+    char * room = server_conn_reserve(keys->worker, keys->conn, length + 1);
+    if (room == NULL) {
+        keys->err = SERVER_E_BUFFER;
+        return 1;
+    }
+    memcpy(room, key, length);
+    room[length] = '\n';
+    keys->conn->output_length += length + 1;
+    keys->length += length + 1;
+    return 0;
+}
+/**
+ * @brief Queue the reply of a KEYS, the keys matching a glob pattern one per line.
+ *
+ * Only the keys starting with the pattern's literal prefix are walked, which engines with an
+ * ordered index do without looking at the others. "prefix*" needs no further match.
+ *
+ * @param worker Worker owning the connection.
+ * @param conn Connection the KEYS came from.
+ * @param digest Result of previous operation format check.
+ * @param sent Bytes queued in reply.
+ * @return int
+ *              - SERVER_OK if the reply was queued.
+ *              - SERVER_E_BUFFER if there is no memory for the reply, nothing was queued.
+ */
+static int server_conn_keys(server_worker_t * worker, server_conn_t * conn, server_op_t * digest,
+                            int * sent) {
+    const char * pattern = digest->args[0];
+    size_t prefix_length = strcspn(pattern, SERVER_KEYS_SPECIAL);
+    char * prefix = strndup(pattern, prefix_length);
+    if (prefix == NULL)
+        return SERVER_E_BUFFER;
+
+    // Queued bytes still to send, kept by server_conn_reserve() when it drops the sent ones.
+    size_t mark = conn->output_length - conn->output_sent;
+    server_keys_t keys = {.worker = worker, .conn = conn, .pattern = pattern, .err = SERVER_OK};
+    if (strcmp(pattern + prefix_length, "*") == 0)
+        keys.pattern = NULL;
+
+    int err = server_conn_reply(worker, conn, SERVER_OK_RESPONSE, sizeof(SERVER_OK_RESPONSE));
+    if (err == SERVER_OK)
+        err = dict_backend_scan(prefix, server_keys_visit, &keys);
+    if (err == SERVER_OK)
+        err = keys.err;
+    free(prefix);
+
+    if (err != SERVER_OK) {
+        conn->output_length = conn->output_sent + mark;
+        return err;
+    }
+    *sent = sizeof(SERVER_OK_RESPONSE) + keys.length;
+    return SERVER_OK;
+}
+/**
+ * @brief Make room at the end of the output buffer.
+ *
+ * @param worker Worker owning the connection.
+ * @param conn Connection.
+ * @param size Bytes needed.
+ * @return char* Where the bytes go, queued by adding their count to output_length. NULL if the
+ *         buffer can not grow to the size.
+ */
+static char * server_conn_reserve(server_worker_t * worker, server_conn_t * conn, size_t size) {
+    if (conn->output == NULL) {
+        conn->output = dict_bufpool_get(worker->pool, size, &conn->output_size);
+        return conn->output;
+    }
+    if (conn->output_length + size <= conn->output_size)
+        return conn->output + conn->output_length;
+
+    // A partial send left bytes already sent at the start.
+    if (conn->output_sent > 0) {
+        conn->output_length -= conn->output_sent;
+        memmove(conn->output, conn->output + conn->output_sent, conn->output_length);
+        conn->output_sent = 0;
+    }
+    if (conn->output_length + size > conn->output_size) {
+        // Past the pool's classes buffers are allocated to size, doubling keeps a long reply
+        // from being copied once per line.
+        size_t need = conn->output_length + size;
+        if (need > DICT_BUFPOOL_MAX_SIZE && need < 2 * conn->output_size)
+            need = 2 * conn->output_size;
+        char * grown = dict_bufpool_grow(worker->pool, conn->output, conn->output_length, need,
+                                         &conn->output_size);
+        if (grown == NULL)
+            return NULL;
+        conn->output = grown;
+    }
+    return conn->output + conn->output_length;
+}
+/**
+ * @brief Queue bytes of a reply.
+ *
+ * @param worker Worker owning the connection.
+ * @param conn Connection.
+ * @param data Bytes to queue.
+ * @param length Number of bytes.
+ * @return int
+ *              - SERVER_OK if no error.
+ *              - SERVER_E_BUFFER if there is no memory for them.
+ */
+static int server_conn_reply(server_worker_t * worker, server_conn_t * conn, const char * data,
+                             size_t length) {
+    char * room = server_conn_reserve(worker, conn, length);
+    if (room == NULL)
+        return SERVER_E_BUFFER;
+    memcpy(room, data, length);
+    conn->output_length += length;
+    return SERVER_OK;
+}
+/**
+ * @brief Send the queued replies.
+ *
+ * A flush in the middle of a batch, while complete commands still wait, is sent with MSG_MORE
+ * so the kernel only sends full segments. The flush ending the batch is sent without it, which
+ * pushes what was held back. With TCP_NODELAY, a client sending one request at a time gets
+ * every reply at once.
+ *
+ * What the socket does not take waits for EPOLLOUT, the connection is not read meanwhile. The
+ * output buffer goes back to the pool once empty.
+ *
+ * Nothing is sent while the connection is held, server_worker_commit() flushes it again.
+ *
+ * @param worker Worker owning the connection.
+ * @param conn Connection.
+ * @return int 0 if everything was sent, 1 if bytes wait for EPOLLOUT or for the batch commit,
+ * -1 if sending failed.
+ */
+static int server_conn_flush(server_worker_t * worker, server_conn_t * conn) {
+    if (conn->held)
+        return 1;
+    int flags = MSG_DONTWAIT | (conn->more ? MSG_MORE : 0);
+    size_t sent = 0;
+    while (conn->output_sent < conn->output_length) {
+        ssize_t rt = send(conn->fd, conn->output + conn->output_sent,
+                          conn->output_length - conn->output_sent, flags);
+        DICT_TRACE_SYSCALL(DICT_TRACE_SEND);
+        if (rt < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            LOG_ERROR("Error sending replies to [%s]", conn->ip);
+            return -1;
+        }
+        conn->output_sent += rt;
+        sent += rt;
+    }
+
+    if (sent > 0) {
+        conn->corked = conn->more;
+        server_stats_flush(worker, conn, sent);
+    } else if (conn->corked && !conn->more) {
+        // The batch ended without a send to push the bytes held back, as when the last
+        // commands had no reply.
+        if (setsockopt(conn->fd, IPPROTO_TCP, TCP_CORK, &(int){0}, sizeof(int)) < 0)
+            LOG_ERROR("setsockopt CORK failed");
+        conn->corked = 0;
+    }
+
+    int pending = conn->output_sent < conn->output_length;
+    if (!pending && conn->output != NULL) {
+        dict_bufpool_put(worker->pool, conn->output, conn->output_size);
+        conn->output = NULL;
+        conn->output_size = 0;
+        conn->output_length = 0;
+        conn->output_sent = 0;
+    }
+    if (pending != conn->writing) {
+        // Not read while a PROFILE runs, hang ups are still reported.
+        struct epoll_event event = {
+            .events = pending ? EPOLLOUT : conn->profile != NULL ? 0 : EPOLLIN,
+            .data.ptr = conn,
+        };
+        if (epoll_ctl(worker->epoll_fd, EPOLL_CTL_MOD, conn->fd, &event) < 0) {
+            LOG_ERROR("epoll_ctl");
+            return -1;
+        }
+        conn->writing = pending;
+    }
+#if DICT_CONFIG_STATS
+    if (conn->client != NULL)
+        SERVER_STAT_SET(conn->client->output, conn->output_length - conn->output_sent);
+#endif
+    return pending;
+}
+/**
+ * @brief Close a connection and release its state.
+ *
+ * @param worker Worker owning the connection.
+ * @param conn Connection to close.
+ */
+static void server_conn_close(server_worker_t * worker, server_conn_t * conn) {
+#if DICT_CONFIG_STATS
+    server_stats_packets(worker, conn);
+    server_client_close(worker, conn);
+    SERVER_STAT_SUB(worker->conn_bytes, sizeof(*conn));
+#endif
+    // The PROFILE result finds no connection and is dropped.
+    if (conn->profile != NULL)
+        conn->profile->conn = NULL;
+    if (conn->held) {
+        server_conn_t ** link = &worker->held;
+        while (*link != conn)
+            link = &(*link)->held_next;
+        *link = conn->held_next;
+    }
+    // Closing the socket also removes it from the event queue.
+    close(conn->fd);
+    dict_bufpool_put(worker->pool, conn->buffer, conn->buffer_size);
+    dict_bufpool_put(worker->pool, conn->output, conn->output_size);
+    free(conn);
+#if DICT_CONFIG_TRACE
+    // The read that saw the peer leave belongs to no request.
+    dict_trace_reset();
+#endif
+}
+/**
+ * @brief Do what other threads handed to the worker through its eventfd: close the connections
+ * marked by CLIENT KILL and queue the PROFILE results.
+ *
+ * @param worker Worker woken by its eventfd.
+ */
+static void server_worker_wake(server_worker_t * worker) {
+    uint64_t count;
+    if (read(worker->wake_fd, &count, sizeof(count)) < 0)
+        return;
+#if DICT_CONFIG_STATS
+    server_client_reap(worker);
+#endif
+    server_profile_deliver(worker);
+}
+/**
+ * @brief End the batch of events: make its writes durable with one sync, then send the replies
+ * held for it. If the sync failed, the held connections are closed instead, a client never gets
+ * an OK for a write that may be lost.
+ *
+ * @param worker Worker at the end of a batch.
+ */
+static void server_worker_commit(server_worker_t * worker) {
+    if (!worker->batching)
+        return;
+    int err = dict_backend_batch_commit();
+    worker->batching = 0;
+
+    server_conn_t * conn = worker->held;
+    worker->held = NULL;
+    while (conn != NULL) {
+        server_conn_t * next = conn->held_next;
+        conn->held = 0;
+        if (err != SERVER_OK) {
+            LOG_ERROR("Can not make the writes of [%s] durable", conn->ip);
+            server_conn_close(worker, conn);
+        } else {
+            server_conn_serve(worker, conn);
+        }
+        conn = next;
+    }
+}
+/**
+ * @brief Start a PROFILE for a connection. Until its reply is queued the connection is not read
+ * and the commands after it wait, so the replies keep the order of the commands.
+ *
+ * @param worker Worker owning the connection.
+ * @param conn Connection the PROFILE came from.
+ * @param seconds Profile length.
+ * @return int
+ *              - SERVER_OK if the profile was started.
+ *              - SERVER_E_BUSY if another one is running.
+ *              - SERVER_E_OS otherwise.
+ */
+static int server_profile_start(server_worker_t * worker, server_conn_t * conn, int seconds) {
+    server_profile_t * profile = calloc(1, sizeof(*profile));
+    if (profile == NULL)
+        return SERVER_E_OS;
+    profile->worker = worker;
+    profile->conn = conn;
+    if (dict_profile_start(seconds, server_profile_done, profile) < 0) {
+        int err = errno == EBUSY ? SERVER_E_BUSY : SERVER_E_OS;
+        free(profile);
+        return err;
+    }
+
+    // The result is delivered by this thread, never before the connection is parked.
+    conn->profile = profile;
+    if (!conn->writing) {
+        struct epoll_event event = {.events = 0, .data.ptr = conn};
+        if (epoll_ctl(worker->epoll_fd, EPOLL_CTL_MOD, conn->fd, &event) < 0)
+            LOG_ERROR("epoll_ctl");
+    }
+    return SERVER_OK;
+}
+/**
+ * @brief Hand a PROFILE result to the worker owning the connection. Runs on the profiler thread.
+ *
+ * @param text Folded stacks, NULL if the profile had no memory for them.
+ * @param length Bytes in text.
+ * @param context PROFILE request, server_profile_t.
+ */
+static void server_profile_done(char * text, size_t length, void * context) {
+    server_profile_t * profile = context;
+    server_worker_t * worker = profile->worker;
+    profile->text = text;
+    profile->length = length;
+
+    profile->next = atomic_load(&worker->profiles);
+    while (!atomic_compare_exchange_weak(&worker->profiles, &profile->next, profile))
+        ;
+    uint64_t one = 1;
+    if (write(worker->wake_fd, &one, sizeof(one)) < 0)
+        LOG_ERROR("Profile : Can not wake worker %d", worker->index);
+}
+/**
+ * @brief Queue the PROFILE results handed to the worker and go on with the commands that waited
+ * behind them.
+ *
+ * @param worker Worker woken by its eventfd.
+ */
+static void server_profile_deliver(server_worker_t * worker) {
+    server_profile_t * profile = atomic_exchange(&worker->profiles, NULL);
+    while (profile != NULL) {
+        server_profile_t * next = profile->next;
+        server_conn_t * conn = profile->conn;
+        if (conn != NULL) {
+            conn->profile = NULL;
+
+            // Queued bytes still to send, kept by server_conn_reserve() when it drops the sent
+            // ones.
+            size_t mark = conn->output_length - conn->output_sent;
+            int err = profile->text != NULL ? SERVER_OK : SERVER_E_OS;
+            if (err == SERVER_OK)
+                err = server_conn_reply(worker, conn, SERVER_OK_RESPONSE,
+                                        sizeof(SERVER_OK_RESPONSE));
+            if (err == SERVER_OK)
+                err = server_conn_reply(worker, conn, profile->text, profile->length);
+            size_t sent = sizeof(SERVER_OK_RESPONSE) + profile->length;
+            if (err != SERVER_OK) {
+                char reply[32];
+                conn->output_length = conn->output_sent + mark;
+                sent = snprintf(reply, sizeof(reply), "ERROR:%d", err);
+                server_conn_reply(worker, conn, reply, sent);
+            }
+#if DICT_CONFIG_STATS
+            if (conn->client != NULL)
+                SERVER_STAT_ADD(conn->client->bytes_out, sent);
+#endif
+
+            // Read again, and the commands that waited go on after the reply.
+            struct epoll_event event = {.events = EPOLLIN, .data.ptr = conn};
+            if (!conn->writing && epoll_ctl(worker->epoll_fd, EPOLL_CTL_MOD, conn->fd, &event) < 0)
+                server_conn_close(worker, conn);
+            else
+                server_conn_serve(worker, conn);
+        }
+        free(profile->text);
+        free(profile);
+        profile = next;
+    }
+}
+/**
+ * @brief Answer a batch of UDP requests, one recvmmsg() and one sendmmsg() for all of them.
+ *
+ * Every datagram is one GET and gets one reply datagram. Replies that can not be sent at once
+ * are dropped, as the network could have dropped them, and the client asks again.
+ *
+ * @param worker Worker owning the UDP socket.
+ */
+static void server_udp_read(server_worker_t * worker) {
+    char requests[SERVER_UDP_BATCH][SERVER_UDP_REQUEST];
+    char replies[SERVER_UDP_BATCH][SERVER_UDP_PAYLOAD];
+    struct sockaddr_in peers[SERVER_UDP_BATCH];
+    struct iovec in_iov[SERVER_UDP_BATCH];
+    struct iovec out_iov[SERVER_UDP_BATCH];
+    struct mmsghdr in[SERVER_UDP_BATCH];
+    struct mmsghdr out[SERVER_UDP_BATCH];
+
+    memset(in, 0, sizeof(in));
+    for (int i = 0; i < SERVER_UDP_BATCH; i++) {
+        // One byte left for the terminator.
+        in_iov[i] = (struct iovec){.iov_base = requests[i], .iov_len = SERVER_UDP_REQUEST - 1};
+        in[i].msg_hdr.msg_iov = &in_iov[i];
+        in[i].msg_hdr.msg_iovlen = 1;
+        in[i].msg_hdr.msg_name = &peers[i];
+        in[i].msg_hdr.msg_namelen = sizeof(peers[i]);
+    }
+
+    int count = recvmmsg(worker->udp_fd, in, SERVER_UDP_BATCH, MSG_DONTWAIT, NULL);
+    DICT_TRACE_SYSCALL(DICT_TRACE_RECV);
+    if (count <= 0) {
+        if (count < 0 && errno != EAGAIN && errno != EINTR)
+            LOG_ERROR("recvmmsg");
+        return;
+    }
+    SERVER_STAT_INC(worker->udp_batches);
+    SERVER_STAT_ADD(worker->udp_requests, count);
+
+    memset(out, 0, sizeof(out));
+    for (int i = 0; i < count; i++) {
+        int length = in[i].msg_len;
+        requests[i][length] = 0;
+        // A cut datagram is a command longer than any the parser accepts.
+        if (in[i].msg_hdr.msg_flags & MSG_TRUNC) {
+            server_stats_update(worker, SERVER_OP_NONE, SERVER_E_SIZE);
+            length = sprintf(replies[i], "ERROR:%d", SERVER_E_SIZE);
+        } else {
+            length = server_udp_command(worker, requests[i], length, replies[i]);
+        }
+        out_iov[i] = (struct iovec){.iov_base = replies[i], .iov_len = length};
+        out[i].msg_hdr.msg_iov = &out_iov[i];
+        out[i].msg_hdr.msg_iovlen = 1;
+        out[i].msg_hdr.msg_name = &peers[i];
+        out[i].msg_hdr.msg_namelen = in[i].msg_hdr.msg_namelen;
+    }
+
+    int sent = 0;
+    while (sent < count) {
+        int rt = sendmmsg(worker->udp_fd, out + sent, count - sent, MSG_DONTWAIT);
+        DICT_TRACE_SYSCALL(DICT_TRACE_SEND);
+        if (rt <= 0) {
+            if (rt < 0 && errno == EINTR)
+                continue;
+            LOG_ERROR("Dropped %d UDP replies", count - sent);
+            break;
+        }
+        sent += rt;
+    }
+}
+/**
+ * @brief Check and process a single UDP request. Only GET is served over UDP.
+ *
+ * @param worker Worker owning the UDP socket.
+ * @param line Null terminated request.
+ * @param length Request length.
+ * @param reply Buffer of SERVER_UDP_PAYLOAD bytes where the reply will be stored.
+ * @return int Reply length.
+ */
+static int server_udp_command(server_worker_t * worker, char * line, int length, char * reply) {
+    server_op_t digest = {0};
+    const int header = sizeof(SERVER_OK_RESPONSE);
+    // Room for the value and its line feed.
+    const int room = SERVER_UDP_PAYLOAD - header - 1;
+    int value_length = 0;
+    int full_length = 0;
+
+    int err = server_op_check(line, length, &digest);
+    if (err != SERVER_OK) {
+        server_stats_update(worker, SERVER_OP_NONE, err);
+        return sprintf(reply, "ERROR:%d", err);
+    }
+    if (digest.op != SERVER_OP_GET)
+        err = SERVER_E_INVALID;
+    else
+        err = server_read_key_value(&digest, reply + header, room, &value_length, &full_length);
+    server_stats_update(worker, digest.op, err);
+
+    if (err == SERVER_OK && full_length > room) {
+        SERVER_STAT_INC(worker->udp_redirects);
+        memcpy(reply, SERVER_TCP_RESPONSE, sizeof(SERVER_TCP_RESPONSE));
+        return sizeof(SERVER_TCP_RESPONSE);
+    }
+    if (err == SERVER_OK) {
+        memcpy(reply, SERVER_OK_RESPONSE, header);
+        reply[header + value_length] = '\n';
+        return header + value_length + 1;
+    }
+    if (err == SERVER_E_NOT_FOUND) {
+        memcpy(reply, SERVER_NOTFOUND_RESPONSE, sizeof(SERVER_NOTFOUND_RESPONSE));
+        return sizeof(SERVER_NOTFOUND_RESPONSE);
+    }
+    return sprintf(reply, "ERROR:%d", err);
+}
+#if DICT_CONFIG_STATS
+/**
+ * @brief Queue formatted text of a report, growing the output buffer as needed.
+ *
+ * @param report Report being built. Once an append failed the next ones do nothing.
+ * @param format printf() format.
+ */
+static void server_report_printf(server_report_t * report, const char * format, ...) {
+    if (report->err != SERVER_OK)
+        return;
+
+    va_list args;
+    size_t room = SERVER_REPLY_SIZE;
+    for (;;) {
+        // vsnprintf() writes the NUL too, it is not queued.
+        char * out = server_conn_reserve(report->worker, report->conn, room);
+        if (out == NULL) {
+            report->err = SERVER_E_BUFFER;
+            return;
+        }
+        va_start(args, format);
+        int length = vsnprintf(out, room, format, args);
+        va_end(args);
+        if (length < 0) {
+            report->err = SERVER_E_INVALID;
+            return;
+        }
+        if ((size_t)length < room) {
+            report->conn->output_length += length;
+            report->length += length;
+            return;
+        }
+        room = (size_t)length + 1;
+    }
+}
+/**
+ * @brief Queue the "name:value" lines of a module, growing the output buffer until they fit.
+ *
+ * @param report Report being built. Once an append failed the next ones do nothing.
+ * @param stats Module statistics writer, returns the characters written or that would be.
+ */
+static void server_report_module(server_report_t * report, int (*stats)(char *, int)) {
+    if (report->err != SERVER_OK)
+        return;
+
+    // A writer that ran out of room may stop short of the length it needed, so a reply filling
+    // the room is written again with twice as much.
+    size_t room = SERVER_REPLY_SIZE;
+    for (;;) {
+        char * out = server_conn_reserve(report->worker, report->conn, room);
+        if (out == NULL || room > INT_MAX) {
+            report->err = SERVER_E_BUFFER;
+            return;
+        }
+        int length = stats(out, (int)room);
+        if (length >= 0 && (size_t)length < room - 1) {
+            report->conn->output_length += length;
+            report->length += length;
+            return;
+        }
+        room *= 2;
+    }
+}
+/**
+ * @brief Queue a reply built by a report writer: OK and the text it writes.
+ *
+ * Like KEYS, the text is written straight into the output buffer, which grows as needed. A
+ * report that can not be queued whole leaves nothing of it.
+ *
+ * @param worker Worker owning the connection.
+ * @param conn Connection the command came from.
+ * @param write Report writer, appends with server_report_printf() and server_report_module().
+ * @param sent Bytes queued in reply.
+ * @return int
+ *              - SERVER_OK if the reply was queued.
+ *              - SERVER_E_BUFFER if there is no memory for the reply, nothing was queued.
+ */
+static int server_conn_report(server_worker_t * worker, server_conn_t * conn,
+                              void (*write)(server_report_t *), int * sent) {
+    // Queued bytes still to send, kept by server_conn_reserve() when it drops the sent ones.
+    size_t mark = conn->output_length - conn->output_sent;
+    server_report_t report = {.worker = worker, .conn = conn, .err = SERVER_OK};
+
+    report.err = server_conn_reply(worker, conn, SERVER_OK_RESPONSE, sizeof(SERVER_OK_RESPONSE));
+    if (report.err == SERVER_OK)
+        write(&report);
+    if (report.err != SERVER_OK) {
+        conn->output_length = conn->output_sent + mark;
+        return report.err;
+    }
+    *sent = sizeof(SERVER_OK_RESPONSE) + report.length;
+    return SERVER_OK;
+}
+/**
+ * @brief Write the server and backend statistics as "name:value" lines.
+ *
+ * Counters are owned by each worker and summed here without stopping them.
+ *
+ * @param report Report being built.
+ */
+static void server_stats_report(server_report_t * report) {
+    unsigned long invalid = 0;
+
+    for (int w = 0; w < server_worker_count; w++)
+        invalid += SERVER_STAT_GET(server_workers[w].invalid);
+    server_report_printf(report, "invalid:%lu\ndefrag_cpu_percent:%d\n", invalid,
+                         server_workers[0].defrag_percent);
+
+    for (int i = 0; i < sizeof(server_op_table) / sizeof(server_op_table[0]); i++) {
+        unsigned long calls = 0;
+        unsigned long errors = 0;
+        for (int w = 0; w < server_worker_count; w++) {
+            const server_op_stats_t * stats = &server_workers[w].stats[server_op_table[i].op];
+            calls += SERVER_STAT_GET(stats->calls);
+            errors += SERVER_STAT_GET(stats->errors);
+        }
+        server_report_printf(report, "%s_calls:%lu\n%s_errors:%lu\n", server_op_table[i].name,
+                             calls, server_op_table[i].name, errors);
+#if DICT_CONFIG_TRACE
+        // Totals, divide by the calls for the cost of one request.
+        server_op op = server_op_table[i].op;
+        for (int k = 0; k < DICT_TRACE_SYSCALL_COUNT && calls > 0; k++) {
+            unsigned long count = 0;
+            for (int w = 0; w < server_worker_count; w++)
+                count += SERVER_STAT_GET(server_workers[w].stats[op].syscalls[k]);
+            server_report_printf(report, "%s_sys_%s:%lu\n", server_op_table[i].name,
+                                 dict_trace_syscall_name(k), count);
+        }
+        for (int p = 0; p < DICT_TRACE_PHASE_COUNT && calls > 0; p++) {
+            unsigned long count = 0;
+            for (int w = 0; w < server_worker_count; w++)
+                count += SERVER_STAT_GET(server_workers[w].stats[op].cycles[p]);
+            server_report_printf(report, "%s_cycles_%s:%lu\n", server_op_table[i].name,
+                                 dict_trace_phase_name(p), count);
+        }
+#endif
+    }
+
+    for (int w = 0; w < server_worker_count; w++) {
+        server_worker_t * worker = &server_workers[w];
+        server_report_printf(report,
+                             "worker%d_cpu:%d\nworker%d_node:%d\nworker%d_connections:%lu\n"
+                             "worker%d_polls:%lu\nworker%d_idle_polls:%lu\n",
+                             w, worker->cpu, w, worker->node, w,
+                             SERVER_STAT_GET(worker->connections), w,
+                             SERVER_STAT_GET(worker->polls), w,
+                             SERVER_STAT_GET(worker->idle_polls));
+
+        // A young window is compared with the one just before it, an old one reports its own
+        // rate, which decays while no connection arrives to close it.
+        uint64_t now = dict_watchdog_now_ns();
+        uint64_t window = SERVER_STAT_GET(worker->accept_window_ns);
+        unsigned long count = SERVER_STAT_GET(worker->accept_window_count);
+        unsigned long rate = SERVER_STAT_GET(worker->accept_rate);
+        if (window != 0 && now - window < SERVER_ACCEPT_WINDOW_NS)
+            rate = count > rate ? count : rate;
+        else if (window != 0)
+            rate = count * 1000000000UL / (now - window);
+
+        // For a listening socket the kernel reports the accept queue in these two fields.
+        struct tcp_info info;
+        socklen_t info_len = sizeof(info);
+        memset(&info, 0, sizeof(info));
+        getsockopt(worker->listen_fd, IPPROTO_TCP, TCP_INFO, &info, &info_len);
+        server_report_printf(report,
+                             "worker%d_accept_rate:%lu\nworker%d_accept_batches:%lu\n"
+                             "worker%d_accept_max_batch:%lu\nworker%d_accept_errors:%lu\n"
+                             "worker%d_listen_queue:%u\nworker%d_listen_backlog:%u\n",
+                             w, rate, w, SERVER_STAT_GET(worker->accept_batches), w,
+                             SERVER_STAT_GET(worker->accept_max_batch), w,
+                             SERVER_STAT_GET(worker->accept_errors), w, info.tcpi_unacked, w,
+                             info.tcpi_sacked);
+        if (worker->udp_fd >= 0)
+            server_report_printf(report,
+                                 "worker%d_udp_requests:%lu\nworker%d_udp_batches:%lu\n"
+                                 "worker%d_udp_redirects:%lu\n",
+                                 w, SERVER_STAT_GET(worker->udp_requests), w,
+                                 SERVER_STAT_GET(worker->udp_batches), w,
+                                 SERVER_STAT_GET(worker->udp_redirects));
+
+        unsigned long flushes = SERVER_STAT_GET(worker->flushes);
+        unsigned long flush_bytes = SERVER_STAT_GET(worker->flush_bytes);
+        unsigned long counted = SERVER_STAT_GET(worker->flush_counted);
+        unsigned long packets = SERVER_STAT_GET(worker->flush_packets);
+        server_report_printf(report,
+                             "worker%d_flushes:%lu\nworker%d_flush_corked:%lu\n"
+                             "worker%d_bytes_per_flush:%.1f\nworker%d_packets_per_flush:%.2f\n",
+                             w, flushes, w, SERVER_STAT_GET(worker->flush_corked), w,
+                             flushes ? (double)flush_bytes / flushes : 0, w,
+                             counted ? (double)packets / counted : 0);
+    }
+
+    unsigned long overflows, drops;
+    server_stats_listen_drops(&overflows, &drops);
+    server_report_printf(report, "listen_overflows:%lu\nlisten_drops:%lu\n", overflows, drops);
+
+    dict_bufpool_usage_t buffers = {0};
+    for (int w = 0; w < server_worker_count; w++)
+        dict_bufpool_usage(server_workers[w].pool, &buffers);
+    server_report_printf(report,
+                         "conn_buffer_gets:%lu\nconn_buffer_hits:%lu\nconn_buffer_grows:%lu\n"
+                         "conn_buffer_frees:%lu\n",
+                         buffers.gets, buffers.hits, buffers.grows, buffers.frees);
+
+    unsigned long stalls = 0;
+    for (int w = 0; w < server_worker_count; w++)
+        stalls += SERVER_STAT_GET(server_workers[w].beat->stalls);
+    server_report_printf(report, "loop_stalls:%lu\n", stalls);
+
+    // Histograms of every worker together, buckets labeled by their exclusive upper bound.
+    for (int b = 0; b < SERVER_LOOP_TIME_BUCKETS; b++) {
+        unsigned long count = 0;
+        for (int w = 0; w < server_worker_count; w++)
+            count += SERVER_STAT_GET(server_workers[w].loop_time[b]);
+        if (b < SERVER_LOOP_TIME_BUCKETS - 1)
+            server_report_printf(report, "loop_us_lt_%lu:%lu\n", 1UL << b, count);
+        else
+            server_report_printf(report, "loop_us_ge_%lu:%lu\n", 1UL << (b - 1), count);
+    }
+    for (int b = 1; b < SERVER_LOOP_EVENT_BUCKETS; b++) {
+        unsigned long count = 0;
+        for (int w = 0; w < server_worker_count; w++)
+            count += SERVER_STAT_GET(server_workers[w].loop_events[b]);
+        if (b < SERVER_LOOP_EVENT_BUCKETS - 1)
+            server_report_printf(report, "loop_events_lt_%lu:%lu\n", 1UL << b, count);
+        else
+            server_report_printf(report, "loop_events_ge_%lu:%lu\n", 1UL << (b - 1), count);
+    }
+
+    server_report_module(report, dict_reclaim_stats);
+    server_report_module(report, dict_warmup_stats);
+    server_report_module(report, dict_dump_stats);
+    server_report_module(report, dict_backend_stats);
+}
+/**
+ * @brief Account a processed request in the worker's counters.
+ *
+ * @param worker Worker that processed the request.
+ * @param op Operation processed, SERVER_OP_NONE if the request was rejected by the parser.
+ * @param err Result of the operation.
+ */
+static void server_stats_update(server_worker_t * worker, server_op op, int err) {
+    if (op == SERVER_OP_NONE) {
+        SERVER_STAT_INC(worker->invalid);
+#if DICT_CONFIG_TRACE
+        dict_trace_reset();
+#endif
+        return;
+    }
+    SERVER_STAT_INC(worker->stats[op].calls);
+    if (err != SERVER_OK)
+        SERVER_STAT_INC(worker->stats[op].errors);
+
+#if DICT_CONFIG_TRACE
+    // Fold what the request cost the thread into its operation, then start over.
+    server_op_stats_t * stats = &worker->stats[op];
+    for (int k = 0; k < DICT_TRACE_SYSCALL_COUNT; k++)
+        atomic_fetch_add_explicit(&stats->syscalls[k], dict_trace_current.syscalls[k],
+                                  memory_order_relaxed);
+    for (int p = 0; p < DICT_TRACE_PHASE_COUNT; p++)
+        atomic_fetch_add_explicit(&stats->cycles[p], dict_trace_current.cycles[p],
+                                  memory_order_relaxed);
+    dict_trace_reset();
+#endif
+}
+/**
+ * @brief Account one loop iteration that handled events.
+ *
+ * @param worker Worker owning the loop.
+ * @param elapsed_ns Time spent handling the events.
+ * @param events Number of events handled.
+ */
+static void server_stats_loop(server_worker_t * worker, uint64_t elapsed_ns, int events) {
+    uint64_t us = elapsed_ns / 1000;
+    int time_bucket = us == 0 ? 0 : 64 - __builtin_clzll(us);
+    int event_bucket = 32 - __builtin_clz(events);
+
+    if (time_bucket >= SERVER_LOOP_TIME_BUCKETS)
+        time_bucket = SERVER_LOOP_TIME_BUCKETS - 1;
+    if (event_bucket >= SERVER_LOOP_EVENT_BUCKETS)
+        event_bucket = SERVER_LOOP_EVENT_BUCKETS - 1;
+
+    SERVER_STAT_INC(worker->loop_time[time_bucket]);
+    SERVER_STAT_INC(worker->loop_events[event_bucket]);
+}
+/**
+ * @brief Account the connections accepted for one readiness event.
+ *
+ * The rate is measured over windows of at least SERVER_ACCEPT_WINDOW_NS, closed by the first
+ * accept after the window ends.
+ *
+ * @param worker Worker owning the listening socket.
+ * @param accepted Connections accepted.
+ */
+static void server_stats_accept(server_worker_t * worker, int accepted) {
+    if (accepted == 0)
+        return;
+
+    SERVER_STAT_INC(worker->accept_batches);
+    if ((unsigned long)accepted > SERVER_STAT_GET(worker->accept_max_batch))
+        SERVER_STAT_SET(worker->accept_max_batch, accepted);
+
+    uint64_t now = dict_watchdog_now_ns();
+    uint64_t start = SERVER_STAT_GET(worker->accept_window_ns);
+    unsigned long count = SERVER_STAT_GET(worker->accept_window_count) + accepted;
+    if (start != 0 && now - start >= SERVER_ACCEPT_WINDOW_NS) {
+        SERVER_STAT_SET(worker->accept_rate, count * 1000000000UL / (now - start));
+        start = 0;
+        count = 0;
+    }
+    if (start == 0)
+        SERVER_STAT_SET(worker->accept_window_ns, now);
+    SERVER_STAT_SET(worker->accept_window_count, count);
+}
+/**
+ * @brief Read the kernel counters of connections lost because an accept queue was full.
+ *
+ * They cover every listening socket of the network namespace, not only the server's.
+ *
+ * @param overflows Where TcpExt ListenOverflows will be stored.
+ * @param drops Where TcpExt ListenDrops will be stored.
+ */
+static void server_stats_listen_drops(unsigned long * overflows, unsigned long * drops) {
+    char names[4096];
+    char values[4096];
+
+    *overflows = 0;
+    *drops = 0;
+    FILE * file = fopen("/proc/net/netstat", "r");
+    if (file == NULL)
+        return;
+
+    // Pairs of lines, the names and then the values of one group.
+    while (fgets(names, sizeof(names), file) != NULL && fgets(values, sizeof(values), file)) {
+        if (strncmp(names, "TcpExt:", 7) != 0)
+            continue;
+        char * name_save;
+        char * value_save;
+        char * name = strtok_r(names, " \n", &name_save);
+        char * value = strtok_r(values, " \n", &value_save);
+        while (name != NULL && value != NULL) {
+            if (strcmp(name, "ListenOverflows") == 0)
+                *overflows = strtoul(value, NULL, 10);
+            else if (strcmp(name, "ListenDrops") == 0)
+                *drops = strtoul(value, NULL, 10);
+            name = strtok_r(NULL, " \n", &name_save);
+            value = strtok_r(NULL, " \n", &value_save);
+        }
+        break;
+    }
+    fclose(file);
+}
+/**
+ * @brief Account a flush, and count the connection's packets every SERVER_FLUSH_SAMPLE of them.
+ *
+ * @param worker Worker owning the connection.
+ * @param conn Connection flushed.
+ * @param bytes Bytes sent.
+ */
+static void server_stats_flush(server_worker_t * worker, server_conn_t * conn, size_t bytes) {
+    SERVER_STAT_INC(worker->flushes);
+    SERVER_STAT_ADD(worker->flush_bytes, bytes);
+    if (conn->more)
+        SERVER_STAT_INC(worker->flush_corked);
+    if (++conn->flushes >= SERVER_FLUSH_SAMPLE)
+        server_stats_packets(worker, conn);
+}
+/**
+ * @brief Count the data segments a connection sent since the last count.
+ *
+ * One TCP_INFO read covers many flushes, packets per flush is the ratio of both sums.
+ *
+ * @param worker Worker owning the connection.
+ * @param conn Connection.
+ */
+static void server_stats_packets(server_worker_t * worker, server_conn_t * conn) {
+    if (conn->flushes == 0)
+        return;
+
+    struct tcp_info info;
+    socklen_t info_len = sizeof(info);
+    memset(&info, 0, sizeof(info));
+    // Kernels older than the field return a shorter structure, the flushes are not counted.
+    size_t needed = offsetof(struct tcp_info, tcpi_data_segs_out) + sizeof(info.tcpi_data_segs_out);
+    if (getsockopt(conn->fd, IPPROTO_TCP, TCP_INFO, &info, &info_len) == 0 && info_len >= needed) {
+        SERVER_STAT_ADD(worker->flush_counted, conn->flushes);
+        SERVER_STAT_ADD(worker->flush_packets, info.tcpi_data_segs_out - conn->data_segs);
+        conn->data_segs = info.tcpi_data_segs_out;
+    }
+    conn->flushes = 0;
+}
+/**
+ * @brief Give a new connection an introspection slot, if one is free.
+ *
+ * @param worker Worker owning the connection.
+ * @param conn New connection.
+ * @param addr Peer address.
+ */
+static void server_client_open(server_worker_t * worker, server_conn_t * conn,
+                               const struct sockaddr_in * addr) {
+    static atomic_ulong next_id = 1;
+
+    conn->client = NULL;
+    if (worker->client_free_count == 0)
+        return;
+
+    server_client_t * client = &worker->clients[worker->client_free[--worker->client_free_count]];
+    uint64_t now = dict_watchdog_now_ns();
+    client->conn = conn;
+    client->created_ns = now;
+    client->port = ntohs(addr->sin_port);
+    memcpy(client->ip, conn->ip, sizeof(client->ip));
+    SERVER_STAT_SET(client->kill, 0);
+    SERVER_STAT_SET(client->pending, 0);
+    SERVER_STAT_SET(client->capacity, 0);
+    SERVER_STAT_SET(client->output, 0);
+    SERVER_STAT_SET(client->commands, 0);
+    SERVER_STAT_SET(client->bytes_in, 0);
+    SERVER_STAT_SET(client->bytes_out, 0);
+    SERVER_STAT_SET(client->busy_ns, 0);
+    SERVER_STAT_SET(client->active_ns, now);
+    // Published last, readers ignore the slot until they see an id.
+    atomic_store_explicit(&client->id, atomic_fetch_add(&next_id, 1), memory_order_release);
+    conn->client = client;
+}
+/**
+ * @brief Release the introspection slot of a connection being closed.
+ *
+ * @param worker Worker owning the connection.
+ * @param conn Connection being closed.
+ */
+static void server_client_close(server_worker_t * worker, server_conn_t * conn) {
+    server_client_t * client = conn->client;
+    if (client == NULL)
+        return;
+
+    atomic_store_explicit(&client->id, 0, memory_order_release);
+    client->conn = NULL;
+    worker->client_free[worker->client_free_count++] = client - worker->clients;
+    conn->client = NULL;
+}
+/**
+ * @brief Write one line per tracked client of every worker.
+ *
+ * @param report Report being built.
+ */
+static void server_client_list(server_report_t * report) {
+    uint64_t now = dict_watchdog_now_ns();
+
+    for (int w = 0; w < server_worker_count; w++) {
+        for (int s = 0; s < SERVER_CLIENT_SLOTS; s++) {
+            server_client_t * client = &server_workers[w].clients[s];
+            unsigned long id = atomic_load_explicit(&client->id, memory_order_acquire);
+            if (id == 0)
+                continue;
+
+            char ip[INET_ADDRSTRLEN];
+            memcpy(ip, client->ip, sizeof(ip));
+            ip[sizeof(ip) - 1] = 0;
+            int port = client->port;
+            uint64_t created = client->created_ns;
+            uint64_t active = SERVER_STAT_GET(client->active_ns);
+            unsigned long commands = SERVER_STAT_GET(client->commands);
+            unsigned long busy_ns = SERVER_STAT_GET(client->busy_ns);
+            unsigned long in = SERVER_STAT_GET(client->bytes_in);
+            unsigned long out = SERVER_STAT_GET(client->bytes_out);
+            int pending = SERVER_STAT_GET(client->pending);
+            int capacity = SERVER_STAT_GET(client->capacity);
+            int output = SERVER_STAT_GET(client->output);
+            // Released or reused while being read.
+            if (atomic_load_explicit(&client->id, memory_order_acquire) != id)
+                continue;
+
+            server_report_printf(report,
+                                 "id=%lu addr=%s:%d worker=%d age=%lu idle=%lu cmds=%lu in=%lu "
+                                 "out=%lu avg_us=%lu qbuf=%d qbuf_cap=%d obuf=%d\n",
+                                 id, ip, port, w, (unsigned long)((now - created) / 1000000000),
+                                 (unsigned long)(now > active ? (now - active) / 1000000000 : 0),
+                                 commands, in, out, commands ? busy_ns / commands / 1000 : 0,
+                                 pending, capacity, output);
+        }
+    }
+}
+/**
+ * @brief Ask the worker owning a client to close its connection.
+ *
+ * @param target Client id, or peer address as ip:port.
+ * @return int
+ *              - SERVER_OK if the close was requested.
+ *              - SERVER_E_NOT_FOUND if no client matches.
+ */
+static int server_client_kill(const char * target) {
+    int by_addr = strchr(target, ':') != NULL;
+    char * end;
+    unsigned long wanted = by_addr ? 0 : strtoul(target, &end, 10);
+    if (!by_addr && (*end != 0 || wanted == 0))
+        return SERVER_E_INVALID;
+
+    for (int w = 0; w < server_worker_count; w++) {
+        server_worker_t * worker = &server_workers[w];
+        for (int s = 0; s < SERVER_CLIENT_SLOTS; s++) {
+            server_client_t * client = &worker->clients[s];
+            unsigned long id = atomic_load_explicit(&client->id, memory_order_acquire);
+            if (id == 0)
+                continue;
+            if (by_addr) {
+                char addr[INET_ADDRSTRLEN + 8];
+                snprintf(addr, sizeof(addr), "%.*s:%d", INET_ADDRSTRLEN - 1, client->ip,
+                         client->port);
+                if (strcmp(addr, target) != 0 ||
+                    atomic_load_explicit(&client->id, memory_order_acquire) != id)
+                    continue;
+            } else if (id != wanted) {
+                continue;
+            }
+
+            // The owner closes it, no other thread ever touches its socket. It compares the id
+            // with the slot's own, a slot released and reused meanwhile is left alone.
+            SERVER_STAT_SET(client->kill, id);
+            uint64_t one = 1;
+            if (write(worker->wake_fd, &one, sizeof(one)) < 0)
+                return SERVER_E_OS;
+            return SERVER_OK;
+        }
+    }
+    return SERVER_E_NOT_FOUND;
+}
+/**
+ * @brief Close every connection of the worker marked by CLIENT KILL.
+ *
+ * @param worker Worker woken by its eventfd.
+ */
+static void server_client_reap(server_worker_t * worker) {
+    for (int s = 0; s < SERVER_CLIENT_SLOTS; s++) {
+        server_client_t * client = &worker->clients[s];
+        unsigned long id = SERVER_STAT_GET(client->kill);
+        if (client->conn != NULL && id != 0 && id == SERVER_STAT_GET(client->id)) {
+            LOG_INFO("Server : Closing client %lu on request", id);
+            server_conn_close(worker, client->conn);
+        }
+    }
+}
+/**
+ * @brief Write where the process memory goes as "name:value" lines.
+ *
+ * Every figure comes from counters kept as data changes, nothing is walked.
+ *
+ * @param buffer Buffer where the report will be stored.
+ * @param buffer_size Buffer's size.
+ * @return int Number of characters written.
+ */
+static int server_memory_report(char * buffer, int buffer_size) {
+    dict_backend_memory_t memory;
+    if (dict_backend_memory(&memory) != SERVER_OK)
+        memset(&memory, 0, sizeof(memory));
+
+    // Connection buffers in use count with the connections, the ones kept for reuse apart.
+    unsigned long conn_bytes = 0;
+    dict_bufpool_usage_t buffers = {0};
+    for (int w = 0; w < server_worker_count; w++) {
+        conn_bytes += SERVER_STAT_GET(server_workers[w].conn_bytes);
+        dict_bufpool_usage(server_workers[w].pool, &buffers);
+    }
+    conn_bytes += buffers.used_bytes;
+    unsigned long client_bytes =
+        (unsigned long)server_worker_count * SERVER_CLIENT_SLOTS * sizeof(server_client_t);
+
+    // Backend allocator: what is mapped but not handed out is rounding, free blocks and holes.
+    size_t fragmentation = memory.mapped_bytes > memory.allocated_bytes
+                               ? memory.mapped_bytes - memory.allocated_bytes
+                               : 0;
+    double ratio = memory.allocated_bytes ? (double)memory.mapped_bytes / memory.allocated_bytes
+                                          : 0;
+
+    // malloc() keeps the counters of its own arenas.
+    struct mallinfo2 heap = mallinfo2();
+
+    long pages = 0;
+    FILE * statm = fopen("/proc/self/statm", "r");
+    if (statm != NULL) {
+        if (fscanf(statm, "%*d %ld", &pages) != 1)
+            pages = 0;
+        fclose(statm);
+    }
+
+    return snprintf(buffer, buffer_size,
+                    "memory_rss_bytes:%lu\nmemory_keys_bytes:%zu\nmemory_values_bytes:%zu\n"
+                    "memory_index_bytes:%zu\nmemory_cache_bytes:%zu\nmemory_conn_bytes:%lu\n"
+                    "memory_conn_buffer_bytes:%zu\nmemory_conn_pool_bytes:%zu\n"
+                    "memory_client_table_bytes:%lu\nmemory_allocator_allocated_bytes:%zu\n"
+                    "memory_allocator_mapped_bytes:%zu\nmemory_fragmentation_bytes:%zu\n"
+                    "memory_fragmentation_ratio:%.2f\nmemory_heap_used_bytes:%zu\n"
+                    "memory_heap_free_bytes:%zu\nmemory_heap_mapped_bytes:%zu\n",
+                    (unsigned long)pages * sysconf(_SC_PAGESIZE), memory.key_bytes,
+                    memory.value_bytes, memory.index_bytes, memory.cache_bytes, conn_bytes,
+                    buffers.used_bytes, buffers.cached_bytes, client_bytes, memory.allocated_bytes,
+                    memory.mapped_bytes, fragmentation, ratio, heap.uordblks, heap.fordblks,
+                    heap.hblkhd);
+}
+/**
+ * @brief Write the memory taken by a single key.
+ *
+ * @param key Key name.
+ * @param buffer Buffer where the size will be stored.
+ * @param buffer_size Buffer's size.
+ * @param length Number of characters written.
+ * @return int
+ *              - SERVER_OK if no error.
+ *              - SERVER_E_NOT_FOUND if the key does not exist.
+ */
+static int server_memory_usage(const char * key, char * buffer, int buffer_size, int * length) {
+    size_t bytes;
+    int err = dict_backend_usage(key, &bytes);
+    if (err == SERVER_OK)
+        *length = snprintf(buffer, buffer_size, "%zu\n", bytes);
+    return err;
+}
+#endif
+
+/* === Public function implementation ========================================================== */
+
+void dict_server_stop(void) {
+    server_stop_requested = 1;
+}
+
+dict_server dict_server_init(void) {
+    dict_server server = malloc(sizeof(*server));
+    return server;
+}
+
+int dict_server_start(const dict_server_config_t * config) {
+    dict_server_config_t defaults = {.workers = 1};
+    if (config == NULL)
+        config = &defaults;
+    if (config->workers < 1 || config->workers > DICT_SERVER_MAX_WORKERS) {
+        LOG_ERROR("Invalid number of workers [%d]", config->workers);
+        return EXIT_FAILURE;
+    }
+
+    // Large values are released off the request path. Without the thread they are released
+    // inline, so a failure only costs latency.
+    dict_reclaim_start();
+
+    // Prepare the storage backend selected at build time.
+    if (dict_backend_init(config) != SERVER_OK) {
+        LOG_ERROR("Can not initialize storage backend");
+        exit(EXIT_FAILURE);
+    }
+
+    // Hot keys of the last run are prefetched while the workers already serve requests.
+    dict_warmup_start(config->warmup_ms);
+
+    server_workers = calloc(config->workers, sizeof(*server_workers));
+    if (server_workers == NULL)
+        return EXIT_FAILURE;
+    server_worker_count = config->workers;
+
+    for (int i = 0; i < server_worker_count; i++) {
+        server_worker_t * worker = &server_workers[i];
+        worker->index = i;
+        worker->cpu = config->cpu_count > 0 ? config->cpus[i % config->cpu_count] : -1;
+        worker->numa = config->numa;
+        worker->node = -1;
+        worker->busy_poll = config->busy_poll_us;
+        worker->pool = dict_bufpool_create(SERVER_POOL_KEEP);
+        if (worker->pool == NULL)
+            return EXIT_FAILURE;
+        // The backend is shared, one loop is enough to defragment it.
+        worker->defrag_percent = i == 0 ? config->defrag_cpu_percent : 0;
+        worker->listen_fd =
+            server_listen_socket(SOCK_STREAM, server_worker_count > 1,
+                                 config->backlog > 0 ? config->backlog : SERVER_BACKLOG,
+                                 config->defer_accept_s, !config->nagle);
+        worker->epoll_fd = epoll_create1(0);
+        struct epoll_event event = {.events = EPOLLIN, .data.ptr = NULL};
+        if (worker->epoll_fd < 0 ||
+            epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, worker->listen_fd, &event) < 0) {
+            LOG_ERROR("epoll");
             exit(EXIT_FAILURE);
         }
 
-        char ipClient[32];
-        inet_ntop(AF_INET, &(clientaddr.sin_addr), ipClient, sizeof(ipClient));
-        LOG_INFO("Server : Connection from  [%s]", ipClient);
-
-        // Read the client's message.
-        int len = 0;
-        char buffer[SERVER_BUFFER_SIZE] = {0};
-
-        while (len = recv(newfd, buffer, SERVER_BUFFER_SIZE, MSG_DONTWAIT)) {
-            if (len < 0) {
-                switch (errno) {
-                case ENOTCONN:
-                    LOG_ERROR("Client is disconnecting...");
-                    break;
-                case ECONNRESET:
-                    LOG_ERROR("Peer reset connection...");
-                    break;
-                default:
-                    break;
-                }
-            } else if (len > 0) {
-                buffer[len] = 0;
-                server_op_t digest = {0};
-                LOG_INFO("%d bytes arrived into server: %s", len, buffer);
-                int err = server_op_check(buffer, len, &digest);
-                if (err != 0) {
-                    LOG_ERROR("Can not check input data. Returned [%d]", err);
-                } else {
-                    err = server_op_process(newfd, &digest);
-                    LOG_INFO("Server process finished. Returned [%d]", err);
-                }
+        // Other threads wake the worker for what only it may do with its connections.
+        worker->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        struct epoll_event wake_event = {.events = EPOLLIN, .data.ptr = &worker->wake_fd};
+        if (worker->wake_fd < 0 ||
+            epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, worker->wake_fd, &wake_event) < 0) {
+            LOG_ERROR("eventfd");
+            exit(EXIT_FAILURE);
+        }
+        atomic_init(&worker->profiles, NULL);
+
+        // Same port as TCP, the kernel spreads the datagrams between the workers too.
+        worker->udp_fd = -1;
+        if (config->udp) {
+            worker->udp_fd = server_listen_socket(SOCK_DGRAM, server_worker_count > 1, 0, 0, 0);
+            struct epoll_event udp_event = {.events = EPOLLIN, .data.ptr = &worker->udp_fd};
+            if (epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, worker->udp_fd, &udp_event) < 0) {
+                LOG_ERROR("epoll");
+                exit(EXIT_FAILURE);
             }
         }
-        // Close connection with client.
-        close(newfd);
     }
 
+#if DICT_CONFIG_STATS
+    server_beats = calloc(server_worker_count, sizeof(*server_beats));
+    if (server_beats == NULL)
+        return EXIT_FAILURE;
+    for (int i = 0; i < server_worker_count; i++) {
+        server_worker_t * worker = &server_workers[i];
+        server_beats[i].index = i;
+        worker->beat = &server_beats[i];
+
+        worker->clients = calloc(SERVER_CLIENT_SLOTS, sizeof(*worker->clients));
+        worker->client_free = malloc(SERVER_CLIENT_SLOTS * sizeof(*worker->client_free));
+        if (worker->clients == NULL || worker->client_free == NULL)
+            return EXIT_FAILURE;
+        // Lowest slots first, so CLIENT LIST finds them packed at the start.
+        for (int s = 0; s < SERVER_CLIENT_SLOTS; s++)
+            worker->client_free[s] = SERVER_CLIENT_SLOTS - 1 - s;
+        worker->client_free_count = SERVER_CLIENT_SLOTS;
+    }
+    if (config->watchdog_ms > 0 &&
+        dict_watchdog_start(server_beats, server_worker_count, config->watchdog_ms) < 0)
+        LOG_ERROR("Can not start the loop watchdog");
+#endif
+
+    // The caller's thread runs worker 0.
+    for (int i = 1; i < server_worker_count; i++) {
+        if (pthread_create(&server_workers[i].thread, NULL, server_worker_run,
+                           &server_workers[i]) != 0) {
+            LOG_ERROR("Can not start worker %d", i);
+            exit(EXIT_FAILURE);
+        }
+    }
+    server_worker_run(&server_workers[0]);
+
+    for (int i = 1; i < server_worker_count; i++)
+        pthread_join(server_workers[i].thread, NULL);
+#if DICT_CONFIG_STATS
+    dict_watchdog_stop();
+#endif
+    dict_warmup_stop();
+    dict_backend_close();
+    dict_reclaim_stop();
+
+    // Connections still open are released by the process exit.
+    for (int i = 0; i < server_worker_count; i++) {
+        close(server_workers[i].epoll_fd);
+        close(server_workers[i].listen_fd);
+        if (server_workers[i].udp_fd >= 0)
+            close(server_workers[i].udp_fd);
+        close(server_workers[i].wake_fd);
+    }
+
+    LOG_INFO("Server : Stopped");
     return EXIT_SUCCESS;
 }
 
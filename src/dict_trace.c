@@ -0,0 +1,71 @@
+/************************************************************************************************
+Copyright (c) 2024, Guido Ramirez <guidoramirez7@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute,
+sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial
+portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+SPDX-License-Identifier: MIT
+*************************************************************************************************/
+
+/** @file dict_trace.c
+ ** @brief Per request syscall and cycle accounting.
+ **/
+
+/* === Headers files inclusions =============================================================== */
+
+#include "dict_trace.h"
+
+#if DICT_CONFIG_TRACE
+
+/* === Macros definitions ====================================================================== */
+
+/* === Private data type declarations ========================================================== */
+
+/* === Private variable declarations =========================================================== */
+
+/* === Private function declarations =========================================================== */
+
+/* === Public variable definitions ============================================================= */
+
+__thread dict_trace_t dict_trace_current;
+
+/* === Private variable definitions ============================================================ */
+
+static const char * const trace_syscall_names[DICT_TRACE_SYSCALL_COUNT] = {
+    [DICT_TRACE_OPEN] = "open",   [DICT_TRACE_READ] = "read", [DICT_TRACE_WRITE] = "write",
+    [DICT_TRACE_CLOSE] = "close", [DICT_TRACE_SEND] = "send", [DICT_TRACE_RECV] = "recv",
+};
+
+static const char * const trace_phase_names[DICT_TRACE_PHASE_COUNT] = {
+    [DICT_TRACE_PARSE] = "parse",
+    [DICT_TRACE_STORAGE] = "storage",
+    [DICT_TRACE_REPLY] = "reply",
+};
+
+/* === Private function implementation ========================================================= */
+
+/* === Public function implementation ========================================================== */
+
+const char * dict_trace_syscall_name(dict_trace_syscall kind) {
+    return trace_syscall_names[kind];
+}
+
+const char * dict_trace_phase_name(dict_trace_phase phase) {
+    return trace_phase_names[phase];
+}
+
+#endif /* DICT_CONFIG_TRACE */
+
+/* === End of documentation ==================================================================== */
@@ -0,0 +1,347 @@
+/************************************************************************************************
+Copyright (c) 2024, Guido Ramirez <guidoramirez7@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute,
+sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial
+portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+SPDX-License-Identifier: MIT
+*************************************************************************************************/
+
+/** @file dict_warmup.c
+ ** @brief Cache warm-up from the access history of the previous run.
+ **
+ ** The sample is a direct mapped table. A sampled key that finds its slot taken by another key
+ ** wears the holder's count down by one and takes the slot once it reaches zero, so keys read
+ ** often keep their slot and one-off reads pass through. Every save after new samples halves
+ ** the counts, which keeps the sample about recent traffic without an idle server forgetting it.
+ **/
+
+/* === Headers files inclusions =============================================================== */
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "dict_warmup.h"
+#include "dict_log.h"
+#include "dict_server.h"
+
+/* === Macros definitions ====================================================================== */
+
+#define WARMUP_SLOTS     (4096) /**< Sample table slots, a power of two */
+#define WARMUP_KEY_MAX   (64)   /**< Longer keys are not sampled */
+#define WARMUP_SAMPLE    (8)    /**< One read out of this many is sampled */
+#define WARMUP_SAVE_KEYS (1024) /**< Hottest keys saved */
+#define WARMUP_RETRY_MS  (10)   /**< Wait before prefetching keys the backend could not reach */
+#define WARMUP_RETRIES   (1000) /**< Prefetch passes before unreachable keys are given up */
+
+/* === Private data type declarations ========================================================== */
+
+typedef struct {
+    char key[WARMUP_KEY_MAX]; /**< Null terminated key, valid while hits > 0 */
+    unsigned int hits;        /**< Sampled reads, halved by every save */
+} warmup_slot_t;
+
+/* === Private variable declarations =========================================================== */
+
+/* === Private function declarations =========================================================== */
+
+static uint32_t warmup_hash(const char * key, size_t length);
+
+static int warmup_compare(const void * a, const void * b);
+
+static void warmup_save(void);
+
+static void warmup_prefetch(void);
+
+static void * warmup_run(void * arg);
+
+/* === Public variable definitions ============================================================= */
+
+/* === Private variable definitions ============================================================ */
+
+static pthread_mutex_t warmup_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t warmup_wake;           /**< Wakes the thread to stop */
+static warmup_slot_t warmup_slots[WARMUP_SLOTS];
+static atomic_int warmup_enabled;            /**< Reads are sampled */
+static int warmup_running;                   /**< The thread has not been asked to stop */
+static int warmup_interval_ms;               /**< Time between saves */
+static pthread_t warmup_thread;              /**< Warm-up thread */
+static __thread unsigned int warmup_tick;    /**< Reads seen by the calling thread */
+
+static atomic_ulong warmup_samples;          /**< Reads sampled */
+static atomic_ulong warmup_contended;        /**< Samples dropped, the table was busy */
+static unsigned long warmup_loaded;          /**< Keys read from the file at start */
+static unsigned long warmup_prefetched;      /**< Keys the backend started loading */
+static unsigned long warmup_missing;         /**< Keys gone since the file was saved */
+static unsigned long warmup_failed;          /**< Keys the backend could not prefetch */
+static atomic_ulong warmup_ms;               /**< Time the prefetch took */
+static atomic_int warmup_done;               /**< The prefetch is over */
+static unsigned long warmup_saves;           /**< Saves of the sample */
+static unsigned long warmup_saved_keys;      /**< Keys in the last save */
+static unsigned long warmup_aged_samples;    /**< Samples taken when the counts were last halved */
+
+/* === Private function implementation ========================================================= */
+/**
+ * @brief FNV-1a hash of a key.
+ *
+ * @param key Key bytes.
+ * @param length Key length.
+ * @return uint32_t Hash.
+ */
+static uint32_t warmup_hash(const char * key, size_t length) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++)
+        hash = (hash ^ (unsigned char)key[i]) * 16777619u;
+    return hash;
+}
+/**
+ * @brief Order slots by decreasing hits, for qsort().
+ *
+ * @param a First slot.
+ * @param b Second slot.
+ * @return int Comparison result.
+ */
+static int warmup_compare(const void * a, const void * b) {
+    unsigned int hits_a = ((const warmup_slot_t *)a)->hits;
+    unsigned int hits_b = ((const warmup_slot_t *)b)->hits;
+    return hits_a < hits_b ? 1 : hits_a > hits_b ? -1 : 0;
+}
+/**
+ * @brief Save the hottest sampled keys, replacing the file at once so a crash keeps the old one.
+ */
+static void warmup_save(void) {
+    static warmup_slot_t hot[WARMUP_SLOTS];
+    int count = 0;
+
+    pthread_mutex_lock(&warmup_lock);
+    unsigned long samples = atomic_load(&warmup_samples);
+    int age = samples != warmup_aged_samples;
+    warmup_aged_samples = samples;
+    for (int i = 0; i < WARMUP_SLOTS; i++) {
+        if (warmup_slots[i].hits == 0)
+            continue;
+        hot[count++] = warmup_slots[i];
+        if (age)
+            warmup_slots[i].hits /= 2;
+    }
+    pthread_mutex_unlock(&warmup_lock);
+
+    qsort(hot, count, sizeof(*hot), warmup_compare);
+    if (count > WARMUP_SAVE_KEYS)
+        count = WARMUP_SAVE_KEYS;
+
+    FILE * file = fopen(DICT_WARMUP_FILE ".tmp", "w");
+    if (file == NULL) {
+        LOG_ERROR("Warmup : Can not save hot keys");
+        return;
+    }
+    for (int i = 0; i < count; i++)
+        fprintf(file, "%s\n", hot[i].key);
+    if (fclose(file) != 0 || rename(DICT_WARMUP_FILE ".tmp", DICT_WARMUP_FILE) < 0) {
+        LOG_ERROR("Warmup : Can not save hot keys");
+        remove(DICT_WARMUP_FILE ".tmp");
+        return;
+    }
+    pthread_mutex_lock(&warmup_lock);
+    warmup_saves++;
+    warmup_saved_keys = count;
+    pthread_mutex_unlock(&warmup_lock);
+}
+/**
+ * @brief Prefetch the keys saved by the previous run and seed the sample with them.
+ *
+ * Keys the backend can not reach yet, e.g. still recovering, are retried on later passes.
+ */
+static void warmup_prefetch(void) {
+    static char keys[WARMUP_SAVE_KEYS][WARMUP_KEY_MAX];
+    struct timespec start, end;
+    int count = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    FILE * file = fopen(DICT_WARMUP_FILE, "r");
+    if (file != NULL) {
+        while (count < WARMUP_SAVE_KEYS && fgets(keys[count], WARMUP_KEY_MAX, file) != NULL) {
+            keys[count][strcspn(keys[count], "\n")] = '\0';
+            if (keys[count][0] != '\0')
+                count++;
+        }
+        fclose(file);
+    }
+    warmup_loaded = count;
+
+    // Saved keys start with one hit, so a restart before the first save does not lose them.
+    pthread_mutex_lock(&warmup_lock);
+    for (int i = 0; i < count; i++) {
+        warmup_slot_t * slot = &warmup_slots[warmup_hash(keys[i], strlen(keys[i])) &
+                                             (WARMUP_SLOTS - 1)];
+        if (slot->hits == 0) {
+            strcpy(slot->key, keys[i]);
+            slot->hits = 1;
+        }
+    }
+    pthread_mutex_unlock(&warmup_lock);
+
+    for (int pass = 0; count > 0 && pass < WARMUP_RETRIES; pass++) {
+        int busy = 0;
+        for (int i = 0; i < count; i++) {
+            int err = dict_backend_prefetch(keys[i]);
+            if (err == SERVER_E_BUSY) {
+                memcpy(keys[busy++], keys[i], WARMUP_KEY_MAX);
+                continue;
+            }
+            if (err == SERVER_OK)
+                warmup_prefetched++;
+            else if (err == SERVER_E_NOT_FOUND)
+                warmup_missing++;
+            else
+                warmup_failed++;
+        }
+        count = busy;
+
+        pthread_mutex_lock(&warmup_lock);
+        int running = warmup_running;
+        pthread_mutex_unlock(&warmup_lock);
+        if (count == 0 || !running)
+            break;
+        nanosleep(&(struct timespec){.tv_nsec = WARMUP_RETRY_MS * 1000000L}, NULL);
+    }
+    warmup_failed += count;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    atomic_store(&warmup_ms, (end.tv_sec - start.tv_sec) * 1000 +
+                                 (end.tv_nsec - start.tv_nsec) / 1000000);
+    atomic_store(&warmup_done, 1);
+    LOG_INFO("Warmup : Prefetched %lu of %lu hot keys", warmup_prefetched, warmup_loaded);
+}
+/**
+ * @brief Warm-up thread. Prefetches, then saves the sample until stopped.
+ *
+ * @param arg Not used.
+ * @return void* Always NULL.
+ */
+static void * warmup_run(void * arg) {
+    warmup_prefetch();
+
+    pthread_mutex_lock(&warmup_lock);
+    while (warmup_running) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        deadline.tv_sec += warmup_interval_ms / 1000;
+        deadline.tv_nsec += (warmup_interval_ms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        if (pthread_cond_timedwait(&warmup_wake, &warmup_lock, &deadline) == 0)
+            continue;
+
+        pthread_mutex_unlock(&warmup_lock);
+        warmup_save();
+        pthread_mutex_lock(&warmup_lock);
+    }
+    pthread_mutex_unlock(&warmup_lock);
+    return NULL;
+}
+
+/* === Public function implementation ========================================================== */
+
+int dict_warmup_start(int interval_ms) {
+    if (interval_ms <= 0)
+        return 0;
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&warmup_wake, &attr);
+    pthread_condattr_destroy(&attr);
+
+    warmup_interval_ms = interval_ms;
+    warmup_running = 1;
+    if (pthread_create(&warmup_thread, NULL, warmup_run, NULL) != 0) {
+        warmup_running = 0;
+        LOG_ERROR("Warmup : Can not start thread, starting cold");
+        return -1;
+    }
+    pthread_setname_np(warmup_thread, "dict-warmup");
+    atomic_store(&warmup_enabled, 1);
+    return 0;
+}
+
+void dict_warmup_stop(void) {
+    if (!atomic_exchange(&warmup_enabled, 0))
+        return;
+
+    pthread_mutex_lock(&warmup_lock);
+    warmup_running = 0;
+    pthread_cond_signal(&warmup_wake);
+    pthread_mutex_unlock(&warmup_lock);
+    pthread_join(warmup_thread, NULL);
+
+    warmup_save();
+}
+
+void dict_warmup_touch(const char * key) {
+    if (!atomic_load_explicit(&warmup_enabled, memory_order_relaxed) ||
+        ++warmup_tick % WARMUP_SAMPLE != 0)
+        return;
+
+    size_t length = strlen(key);
+    if (length >= WARMUP_KEY_MAX)
+        return;
+    warmup_slot_t * slot = &warmup_slots[warmup_hash(key, length) & (WARMUP_SLOTS - 1)];
+
+    // Never wait on the request path, a lost sample does not matter.
+    if (pthread_mutex_trylock(&warmup_lock) != 0) {
+        atomic_fetch_add_explicit(&warmup_contended, 1, memory_order_relaxed);
+        return;
+    }
+    if (slot->hits > 0 && strcmp(slot->key, key) == 0) {
+        slot->hits++;
+    } else if (slot->hits > 0) {
+        slot->hits--;
+    } else {
+        memcpy(slot->key, key, length + 1);
+        slot->hits = 1;
+    }
+    pthread_mutex_unlock(&warmup_lock);
+    atomic_fetch_add_explicit(&warmup_samples, 1, memory_order_relaxed);
+}
+
+int dict_warmup_stats(char * buffer, int buffer_size) {
+    // The prefetch counters belong to the thread until it is done.
+    int done = atomic_load(&warmup_done);
+    pthread_mutex_lock(&warmup_lock);
+    unsigned long saves = warmup_saves;
+    unsigned long saved_keys = warmup_saved_keys;
+    pthread_mutex_unlock(&warmup_lock);
+
+    return snprintf(buffer, buffer_size,
+                    "warmup_interval_ms:%d\nwarmup_done:%d\nwarmup_loaded:%lu\n"
+                    "warmup_prefetched:%lu\nwarmup_missing:%lu\nwarmup_failed:%lu\nwarmup_ms:%lu\n"
+                    "warmup_samples:%lu\nwarmup_contended:%lu\nwarmup_saves:%lu\n"
+                    "warmup_saved_keys:%lu\n",
+                    warmup_interval_ms, done, done ? warmup_loaded : 0,
+                    done ? warmup_prefetched : 0, done ? warmup_missing : 0,
+                    done ? warmup_failed : 0, atomic_load(&warmup_ms),
+                    atomic_load(&warmup_samples), atomic_load(&warmup_contended), saves,
+                    saved_keys);
+}
+
+/* === End of documentation ==================================================================== */
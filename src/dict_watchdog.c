@@ -0,0 +1,171 @@
+/************************************************************************************************
+Copyright (c) 2024, Guido Ramirez <guidoramirez7@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute,
+sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial
+portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+SPDX-License-Identifier: MIT
+*************************************************************************************************/
+
+/** @file dict_watchdog.c
+ ** @brief Event loop stall watchdog function implementation.
+ **/
+
+/* === Headers files inclusions =============================================================== */
+
+#include <errno.h>
+#include <execinfo.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "dict_watchdog.h"
+#include "dict_log.h"
+
+/* === Macros definitions ====================================================================== */
+
+#define WATCHDOG_SIGNAL      SIGUSR2 /**< Asks a stalled thread for its backtrace */
+#define WATCHDOG_MAX_FRAMES  (64)    /**< Deepest backtrace written */
+#define WATCHDOG_CHECKS      (4)     /**< Checks per interval */
+#define WATCHDOG_MIN_SLEEP_MS (10)   /**< Shortest pause between checks */
+
+/* === Private data type declarations ========================================================== */
+
+/* === Private variable declarations =========================================================== */
+
+/* === Private function declarations =========================================================== */
+
+static void watchdog_signal_handler(int signal);
+
+static void * watchdog_run(void * arg);
+
+/* === Public variable definitions ============================================================= */
+
+/* === Private variable definitions ============================================================ */
+
+static dict_watchdog_beat_t * watchdog_beats; /**< Beats watched */
+static int watchdog_count;                    /**< Number of beats */
+static uint64_t watchdog_interval_ns;         /**< Busy time considered a stall */
+static atomic_int watchdog_running;           /**< Cleared to stop the thread */
+static pthread_t watchdog_thread;             /**< Watchdog thread */
+
+/* === Private function implementation ========================================================= */
+/**
+ * @brief Runs in the stalled thread. Writes its backtrace to stderr.
+ *
+ * Only async signal safe calls. backtrace() is warmed up by dict_watchdog_start(), so it does
+ * not load libgcc from here.
+ *
+ * @param signal Received signal.
+ */
+static void watchdog_signal_handler(int signal) {
+    static const char header[] = "WATCHDOG -> Backtrace of stalled loop:\n";
+    void * frames[WATCHDOG_MAX_FRAMES];
+    int saved_errno = errno;
+
+    int count = backtrace(frames, WATCHDOG_MAX_FRAMES);
+    if (write(STDERR_FILENO, header, sizeof(header) - 1) > 0)
+        backtrace_symbols_fd(frames, count, STDERR_FILENO);
+
+    errno = saved_errno;
+}
+/**
+ * @brief Watchdog thread. Checks every beat a few times per interval.
+ *
+ * @param arg Not used.
+ * @return void* Always NULL.
+ */
+static void * watchdog_run(void * arg) {
+    uint64_t sleep_ms = watchdog_interval_ns / 1000000 / WATCHDOG_CHECKS;
+    if (sleep_ms < WATCHDOG_MIN_SLEEP_MS)
+        sleep_ms = WATCHDOG_MIN_SLEEP_MS;
+    struct timespec pause = {.tv_sec = sleep_ms / 1000, .tv_nsec = (sleep_ms % 1000) * 1000000};
+
+    while (atomic_load(&watchdog_running)) {
+        nanosleep(&pause, NULL);
+
+        uint64_t now = dict_watchdog_now_ns();
+        for (int i = 0; i < watchdog_count; i++) {
+            dict_watchdog_beat_t * beat = &watchdog_beats[i];
+            uint64_t busy_since = atomic_load_explicit(&beat->busy_since, memory_order_acquire);
+            if (busy_since == 0 || busy_since == beat->reported ||
+                now - busy_since < watchdog_interval_ns)
+                continue;
+
+            beat->reported = busy_since;
+            atomic_fetch_add_explicit(&beat->stalls, 1, memory_order_relaxed);
+            LOG_ERROR("Watchdog : Loop %d stalled for %llu ms", beat->index,
+                      (unsigned long long)((now - busy_since) / 1000000));
+            pthread_kill(beat->thread, WATCHDOG_SIGNAL);
+        }
+    }
+    return NULL;
+}
+
+/* === Public function implementation ========================================================== */
+
+int dict_watchdog_start(dict_watchdog_beat_t * beats, int count, int interval_ms) {
+    if (beats == NULL || count <= 0 || interval_ms <= 0)
+        return -1;
+
+    // The first backtrace() call may allocate, do it here and not in the signal handler.
+    void * frame;
+    backtrace(&frame, 1);
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = watchdog_signal_handler;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    if (sigaction(WATCHDOG_SIGNAL, &action, NULL) < 0)
+        return -1;
+
+    watchdog_beats = beats;
+    watchdog_count = count;
+    watchdog_interval_ns = (uint64_t)interval_ms * 1000000;
+    atomic_store(&watchdog_running, 1);
+    if (pthread_create(&watchdog_thread, NULL, watchdog_run, NULL) != 0) {
+        atomic_store(&watchdog_running, 0);
+        return -1;
+    }
+    return 0;
+}
+
+void dict_watchdog_stop(void) {
+    if (atomic_exchange(&watchdog_running, 0))
+        pthread_join(watchdog_thread, NULL);
+}
+
+void dict_watchdog_attach(dict_watchdog_beat_t * beat) {
+    beat->thread = pthread_self();
+}
+
+void dict_watchdog_busy(dict_watchdog_beat_t * beat, uint64_t now_ns) {
+    // Release, so the watchdog sees the thread set by dict_watchdog_attach() before signaling.
+    atomic_store_explicit(&beat->busy_since, now_ns, memory_order_release);
+}
+
+void dict_watchdog_idle(dict_watchdog_beat_t * beat) {
+    atomic_store_explicit(&beat->busy_since, 0, memory_order_relaxed);
+}
+
+uint64_t dict_watchdog_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* === End of documentation ==================================================================== */
@@ -0,0 +1,510 @@
+/************************************************************************************************
+Copyright (c) 2024, Guido Ramirez <guidoramirez7@gmail.com>
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software and
+associated documentation files (the "Software"), to deal in the Software without restriction,
+including without limitation the rights to use, copy, modify, merge, publish, distribute,
+sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or substantial
+portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT
+NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES
+OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+
+SPDX-License-Identifier: MIT
+*************************************************************************************************/
+
+/** @file dict_writeback.c
+ ** @brief Write coalescing buffer in front of a slow store.
+ **
+ ** Two tables are kept: the one taking writes and the one a flush is writing out. Lookups check
+ ** both, newest first, so a key never reads older than its last write while it is in flight.
+ **/
+
+/* === Headers files inclusions =============================================================== */
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "dict_writeback.h"
+#include "dict_server.h"
+#include "dict_log.h"
+
+/* === Macros definitions ====================================================================== */
+
+#define WRITEBACK_BUCKETS (256) /**< Initial buckets of a table */
+
+/* === Private data type declarations ========================================================== */
+
+typedef struct writeback_entry {
+    struct writeback_entry * next; /**< Next entry in the bucket */
+    uint32_t hash;                 /**< Key hash */
+    int length;                    /**< Value length */
+    int stored;                    /**< The store holds the key before this write */
+    char * value;                  /**< Latest value, NULL if the key was deleted */
+    char key[];                    /**< Key name */
+} writeback_entry_t;
+
+typedef struct {
+    writeback_entry_t ** buckets; /**< Chained buckets, NULL until the first write */
+    size_t bucket_count;          /**< Buckets, a power of two */
+    size_t count;                 /**< Keys */
+    size_t bytes;                 /**< Value bytes */
+    uint64_t since_ns;            /**< When the oldest write went in */
+} writeback_table_t;
+
+/* === Private variable declarations =========================================================== */
+
+/* === Private function declarations =========================================================== */
+
+static uint64_t writeback_now_ns(void);
+
+static uint32_t writeback_hash(const char * key);
+
+static writeback_entry_t ** writeback_find(writeback_table_t * table, const char * key,
+                                           uint32_t hash);
+
+static int writeback_grow(writeback_table_t * table);
+
+static int writeback_insert(writeback_table_t * table, const char * key, const char * value,
+                            int length, int stored, uint64_t now);
+
+static long writeback_entry_gain(const writeback_entry_t * entry);
+
+static void writeback_clear(writeback_table_t * table);
+
+static void * writeback_run(void * arg);
+
+/* === Public variable definitions ============================================================= */
+
+/* === Private variable definitions ============================================================ */
+
+static pthread_mutex_t writeback_lock = PTHREAD_MUTEX_INITIALIZER;  /**< Guards both tables */
+static pthread_mutex_t writeback_flushing = PTHREAD_MUTEX_INITIALIZER; /**< One flush at once */
+static pthread_cond_t writeback_wake;       /**< Wakes the flusher thread */
+static writeback_table_t writeback_dirty;   /**< Takes writes */
+static writeback_table_t writeback_flight;  /**< Being written out by a flush */
+static int writeback_enabled;               /**< Writes are buffered */
+static int writeback_running;               /**< The flusher thread runs */
+static int writeback_interval_ms;           /**< Longest time a write stays buffered */
+static size_t writeback_threshold;          /**< Value bytes that trigger a flush */
+static dict_writeback_store writeback_store; /**< Store written by flushes */
+static dict_writeback_sync writeback_sync;   /**< Makes a flushed batch durable */
+static dict_writeback_exists writeback_exists; /**< Tells whether the store holds a key */
+static long writeback_gain;                 /**< Sum of the gains of the entries of both tables */
+static pthread_t writeback_thread;          /**< Flusher thread */
+
+static atomic_ulong writeback_puts;          /**< Writes buffered */
+static atomic_ulong writeback_absorbed;      /**< Writes that replaced a buffered one */
+static atomic_ulong writeback_flushes;       /**< Flushes that wrote something */
+static atomic_ulong writeback_flushed_keys;  /**< Keys written to the store */
+static atomic_ulong writeback_errors;        /**< Keys the store refused */
+static atomic_ulong writeback_window_max_ns; /**< Longest a write waited to be stored */
+
+/* === Private function implementation ========================================================= */
+/**
+ * @brief Monotonic clock.
+ *
+ * @return uint64_t Nanoseconds.
+ */
+static uint64_t writeback_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+/**
+ * @brief FNV-1a hash of a key.
+ *
+ * @param key Key name.
+ * @return uint32_t Hash.
+ */
+static uint32_t writeback_hash(const char * key) {
+    uint32_t hash = 2166136261u;
+    while (*key != '\0')
+        hash = (hash ^ (unsigned char)*key++) * 16777619u;
+    return hash;
+}
+/**
+ * @brief Find the link pointing to a key. The lock must be held.
+ *
+ * @param table Table.
+ * @param key Key name.
+ * @param hash Key hash.
+ * @return writeback_entry_t** Link to the entry, it points to NULL if the key is missing. NULL
+ * if the table has no buckets yet.
+ */
+static writeback_entry_t ** writeback_find(writeback_table_t * table, const char * key,
+                                           uint32_t hash) {
+    if (table->buckets == NULL)
+        return NULL;
+
+    writeback_entry_t ** link = &table->buckets[hash & (table->bucket_count - 1)];
+    while (*link != NULL && ((*link)->hash != hash || strcmp((*link)->key, key) != 0))
+        link = &(*link)->next;
+    return link;
+}
+/**
+ * @brief Double the buckets of a table, or create them. The lock must be held.
+ *
+ * @param table Table.
+ * @return int 0 if no error, -1 if out of memory.
+ */
+static int writeback_grow(writeback_table_t * table) {
+    size_t count = table->buckets == NULL ? WRITEBACK_BUCKETS : table->bucket_count * 2;
+    writeback_entry_t ** buckets = calloc(count, sizeof(*buckets));
+    if (buckets == NULL)
+        return -1;
+
+    for (size_t i = 0; i < table->bucket_count; i++) {
+        writeback_entry_t * entry = table->buckets[i];
+        while (entry != NULL) {
+            writeback_entry_t * next = entry->next;
+            entry->next = buckets[entry->hash & (count - 1)];
+            buckets[entry->hash & (count - 1)] = entry;
+            entry = next;
+        }
+    }
+    free(table->buckets);
+    table->buckets = buckets;
+    table->bucket_count = count;
+    return 0;
+}
+/**
+ * @brief Set the latest state of a key. The lock must be held.
+ *
+ * @param table Table.
+ * @param key Key name.
+ * @param value Value, NULL if the key was deleted.
+ * @param length Value length.
+ * @param stored Whether the store holds the key before this write, only used if it is added.
+ * @param now Current time, for the crash window.
+ * @return int
+ *              - 1 if a buffered write was replaced.
+ *              - 0 if the key was added.
+ *              - -1 if out of memory, the table is unchanged.
+ */
+static int writeback_insert(writeback_table_t * table, const char * key, const char * value,
+                            int length, int stored, uint64_t now) {
+    if (table->count >= table->bucket_count && writeback_grow(table) < 0)
+        return -1;
+
+    char * copy = NULL;
+    if (value != NULL) {
+        copy = malloc(length > 0 ? length : 1);
+        if (copy == NULL)
+            return -1;
+        memcpy(copy, value, length);
+    }
+
+    uint32_t hash = writeback_hash(key);
+    writeback_entry_t ** link = writeback_find(table, key, hash);
+    writeback_entry_t * entry = *link;
+    int replaced = entry != NULL;
+    if (entry == NULL) {
+        size_t key_len = strlen(key);
+        entry = malloc(sizeof(*entry) + key_len + 1);
+        if (entry == NULL) {
+            free(copy);
+            return -1;
+        }
+        memcpy(entry->key, key, key_len + 1);
+        entry->hash = hash;
+        entry->next = NULL;
+        entry->stored = stored;
+        entry->value = NULL;
+        entry->length = 0;
+        *link = entry;
+        if (table->count++ == 0)
+            table->since_ns = now;
+    }
+
+    writeback_gain -= replaced ? writeback_entry_gain(entry) : 0;
+    table->bytes -= entry->length;
+    free(entry->value);
+    entry->value = copy;
+    entry->length = copy != NULL ? length : 0;
+    table->bytes += entry->length;
+    writeback_gain += writeback_entry_gain(entry);
+    return replaced;
+}
+/**
+ * @brief Keys the store gains once an entry is stored.
+ *
+ * @param entry Buffered write.
+ * @return long 1 if it creates the key, -1 if it deletes it, 0 otherwise.
+ */
+static long writeback_entry_gain(const writeback_entry_t * entry) {
+    return (entry->value != NULL) - entry->stored;
+}
+/**
+ * @brief Release every entry of a table. The lock must be held.
+ *
+ * @param table Table.
+ */
+static void writeback_clear(writeback_table_t * table) {
+    for (size_t i = 0; i < table->bucket_count; i++) {
+        writeback_entry_t * entry = table->buckets[i];
+        while (entry != NULL) {
+            writeback_entry_t * next = entry->next;
+            free(entry->value);
+            free(entry);
+            entry = next;
+        }
+    }
+    free(table->buckets);
+    memset(table, 0, sizeof(*table));
+}
+/**
+ * @brief Flusher thread. Flushes once the oldest write reaches the interval or the buffer
+ * reaches the threshold.
+ *
+ * @param arg Not used.
+ * @return void* Always NULL.
+ */
+static void * writeback_run(void * arg) {
+    pthread_mutex_lock(&writeback_lock);
+    while (writeback_running) {
+        uint64_t now = writeback_now_ns();
+        uint64_t interval = (uint64_t)writeback_interval_ms * 1000000;
+        uint64_t due = writeback_dirty.count > 0 ? writeback_dirty.since_ns + interval
+                                                 : now + interval;
+
+        if (writeback_dirty.count > 0 &&
+            (now >= due || writeback_dirty.bytes >= writeback_threshold)) {
+            pthread_mutex_unlock(&writeback_lock);
+            dict_writeback_flush();
+            pthread_mutex_lock(&writeback_lock);
+            continue;
+        }
+
+        struct timespec deadline = {.tv_sec = due / 1000000000, .tv_nsec = due % 1000000000};
+        pthread_cond_timedwait(&writeback_wake, &writeback_lock, &deadline);
+    }
+    pthread_mutex_unlock(&writeback_lock);
+    return NULL;
+}
+
+/* === Public function implementation ========================================================== */
+
+int dict_writeback_start(int interval_ms, size_t threshold, dict_writeback_store store,
+                         dict_writeback_sync sync, dict_writeback_exists exists) {
+    if (interval_ms <= 0 || store == NULL || exists == NULL)
+        return -1;
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&writeback_wake, &attr);
+    pthread_condattr_destroy(&attr);
+
+    writeback_interval_ms = interval_ms;
+    writeback_threshold = threshold > 0 ? threshold : DICT_WRITEBACK_BYTES;
+    writeback_store = store;
+    writeback_sync = sync;
+    writeback_exists = exists;
+    writeback_running = 1;
+    if (pthread_create(&writeback_thread, NULL, writeback_run, NULL) != 0) {
+        writeback_running = 0;
+        LOG_ERROR("Writeback : Can not start flusher thread, writing through");
+        return -1;
+    }
+    pthread_setname_np(writeback_thread, "dict-flush");
+
+    pthread_mutex_lock(&writeback_lock);
+    writeback_enabled = 1;
+    pthread_mutex_unlock(&writeback_lock);
+    return 0;
+}
+
+void dict_writeback_stop(void) {
+    pthread_mutex_lock(&writeback_lock);
+    int running = writeback_running;
+    writeback_enabled = 0;
+    writeback_running = 0;
+    pthread_cond_signal(&writeback_wake);
+    pthread_mutex_unlock(&writeback_lock);
+
+    if (running) {
+        pthread_join(writeback_thread, NULL);
+        dict_writeback_flush();
+    }
+}
+
+int dict_writeback_get(const char * key, char * buffer, int buffer_size, int * length) {
+    int found = 0;
+    uint32_t hash = writeback_hash(key);
+
+    pthread_mutex_lock(&writeback_lock);
+    writeback_entry_t ** link = writeback_find(&writeback_dirty, key, hash);
+    if (link == NULL || *link == NULL)
+        link = writeback_find(&writeback_flight, key, hash);
+
+    if (link != NULL && *link != NULL) {
+        writeback_entry_t * entry = *link;
+        found = entry->value != NULL ? 1 : -1;
+        if (found > 0 && buffer != NULL)
+            memcpy(buffer, entry->value, entry->length < buffer_size ? entry->length : buffer_size);
+        if (found > 0 && length != NULL)
+            *length = entry->length;
+    }
+    pthread_mutex_unlock(&writeback_lock);
+
+    return found;
+}
+
+int dict_writeback_put(const char * key, const char * value, int length) {
+    pthread_mutex_lock(&writeback_lock);
+    if (!writeback_enabled) {
+        pthread_mutex_unlock(&writeback_lock);
+        return 0;
+    }
+
+    // A key entering the buffer lands on the state the flight leaves, or on the store's.
+    uint32_t hash = writeback_hash(key);
+    writeback_entry_t ** link = writeback_find(&writeback_dirty, key, hash);
+    int stored = 0;
+    if (link == NULL || *link == NULL) {
+        link = writeback_find(&writeback_flight, key, hash);
+        stored = link != NULL && *link != NULL ? (*link)->value != NULL : writeback_exists(key);
+    }
+
+    int replaced =
+        writeback_insert(&writeback_dirty, key, value, length, stored, writeback_now_ns());
+    size_t bytes = writeback_dirty.bytes;
+    if (replaced >= 0 && bytes >= writeback_threshold)
+        pthread_cond_signal(&writeback_wake);
+    pthread_mutex_unlock(&writeback_lock);
+
+    if (replaced < 0) {
+        // A buffered older state must reach the store first, or it would overwrite this one.
+        dict_writeback_flush();
+        return 0;
+    }
+
+    atomic_fetch_add_explicit(&writeback_puts, 1, memory_order_relaxed);
+    if (replaced)
+        atomic_fetch_add_explicit(&writeback_absorbed, 1, memory_order_relaxed);
+
+    // The flusher is behind, make writers wait for it instead of growing without bound.
+    if (bytes >= 2 * writeback_threshold)
+        dict_writeback_flush();
+    return 1;
+}
+
+int dict_writeback_flush(void) {
+    int err = SERVER_OK;
+
+    pthread_mutex_lock(&writeback_flushing);
+    pthread_mutex_lock(&writeback_lock);
+    writeback_flight = writeback_dirty;
+    memset(&writeback_dirty, 0, sizeof(writeback_dirty));
+    pthread_mutex_unlock(&writeback_lock);
+
+    // The flight table only changes here, so it is walked without the lock. Lookups keep
+    // finding its entries until the store has them.
+    size_t stored = 0;
+    for (size_t i = 0; i < writeback_flight.bucket_count; i++) {
+        for (writeback_entry_t * entry = writeback_flight.buckets[i]; entry != NULL;
+             entry = entry->next) {
+            if (writeback_store(entry->key, entry->value, entry->length) == SERVER_OK) {
+                // The store counts the key now.
+                pthread_mutex_lock(&writeback_lock);
+                writeback_gain -= writeback_entry_gain(entry);
+                pthread_mutex_unlock(&writeback_lock);
+                stored++;
+                continue;
+            }
+
+            // Keep it buffered, unless a newer write already replaced it. That one then lands
+            // on the store's state, not on this write's.
+            err = SERVER_E_OS;
+            atomic_fetch_add_explicit(&writeback_errors, 1, memory_order_relaxed);
+            pthread_mutex_lock(&writeback_lock);
+            writeback_gain -= writeback_entry_gain(entry);
+            writeback_entry_t ** link = writeback_find(&writeback_dirty, entry->key, entry->hash);
+            if (link == NULL || *link == NULL) {
+                writeback_insert(&writeback_dirty, entry->key, entry->value, entry->length,
+                                 entry->stored, writeback_flight.since_ns);
+            } else {
+                writeback_gain -= writeback_entry_gain(*link);
+                (*link)->stored = entry->stored;
+                writeback_gain += writeback_entry_gain(*link);
+            }
+            pthread_mutex_unlock(&writeback_lock);
+        }
+    }
+
+    if (stored > 0 && writeback_sync != NULL && writeback_sync() != SERVER_OK)
+        err = SERVER_E_OS;
+
+    pthread_mutex_lock(&writeback_lock);
+    if (writeback_flight.count > 0) {
+        uint64_t window = writeback_now_ns() - writeback_flight.since_ns;
+        if (window > atomic_load(&writeback_window_max_ns))
+            atomic_store(&writeback_window_max_ns, window);
+        atomic_fetch_add_explicit(&writeback_flushes, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&writeback_flushed_keys, stored, memory_order_relaxed);
+    }
+    writeback_clear(&writeback_flight);
+    pthread_mutex_unlock(&writeback_lock);
+    pthread_mutex_unlock(&writeback_flushing);
+
+    return err;
+}
+
+void dict_writeback_discard(void) {
+    // Waiting for a flush in flight keeps it from writing after the caller's clear.
+    pthread_mutex_lock(&writeback_flushing);
+    pthread_mutex_lock(&writeback_lock);
+    writeback_clear(&writeback_dirty);
+    writeback_gain = 0;
+    pthread_mutex_unlock(&writeback_lock);
+    pthread_mutex_unlock(&writeback_flushing);
+}
+
+long dict_writeback_gain(void) {
+    pthread_mutex_lock(&writeback_lock);
+    long gain = writeback_gain;
+    pthread_mutex_unlock(&writeback_lock);
+    return gain;
+}
+
+int dict_writeback_stats(char * buffer, int buffer_size) {
+    pthread_mutex_lock(&writeback_lock);
+    int enabled = writeback_enabled;
+    size_t keys = writeback_dirty.count + writeback_flight.count;
+    size_t bytes = writeback_dirty.bytes + writeback_flight.bytes;
+    uint64_t since = writeback_flight.count > 0  ? writeback_flight.since_ns
+                     : writeback_dirty.count > 0 ? writeback_dirty.since_ns
+                                                 : 0;
+    pthread_mutex_unlock(&writeback_lock);
+
+    if (!enabled)
+        return snprintf(buffer, buffer_size, "write_back:0\n");
+
+    // Writes buffered now are lost on a crash, the oldest one sets the window.
+    uint64_t window = since > 0 ? writeback_now_ns() - since : 0;
+    return snprintf(buffer, buffer_size,
+                    "write_back:1\nwrite_back_interval_ms:%d\nwrite_back_threshold_bytes:%zu\n"
+                    "write_back_keys:%zu\nwrite_back_bytes:%zu\nwrite_back_puts:%lu\n"
+                    "write_back_absorbed:%lu\nwrite_back_flushes:%lu\nwrite_back_flushed_keys:%lu\n"
+                    "write_back_errors:%lu\nwrite_back_crash_window_ms:%lu\n"
+                    "write_back_crash_window_max_ms:%lu\n",
+                    writeback_interval_ms, writeback_threshold, keys, bytes,
+                    atomic_load(&writeback_puts), atomic_load(&writeback_absorbed),
+                    atomic_load(&writeback_flushes), atomic_load(&writeback_flushed_keys),
+                    atomic_load(&writeback_errors), (unsigned long)(window / 1000000),
+                    (unsigned long)(atomic_load(&writeback_window_max_ns) / 1000000));
+}
+
+/* === End of documentation ==================================================================== */
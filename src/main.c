@@ -25,13 +25,20 @@ SPDX-License-Identifier: MIT
 
 /* === Headers files inclusions =============================================================== */
 
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
 #include "main.h"
 #include "dict_server.h"
+#include "dict_log.h"
 
 /* === Macros definitions ====================================================================== */
 
-#define LOG_INFO(format, ...)  printf("INFO-> " format "\n", ##__VA_ARGS__)
-#define LOG_ERROR(format, ...) fprintf(stderr, "ERROR -> " format "\n", ##__VA_ARGS__)
+#define MAIN_WATCHDOG_MS (1000)  /**< Default loop stall threshold */
+#define MAIN_DEFRAG_CPU  (5)     /**< Default share of worker 0 spent defragmenting, percent */
+#define MAIN_WARMUP_MS   (60000) /**< Default time between saves of the hot keys */
+#define MAIN_DEFER_S     (5)     /**< Default wait for the first request of a new connection */
+#define MAIN_MMAP_CACHE  (16384) /**< Default key files kept mapped by the file engine */
 
 /* === Private data type declarations ========================================================== */
 
@@ -39,17 +46,161 @@ SPDX-License-Identifier: MIT
 
 /* === Private function declarations =========================================================== */
 
+static void main_signal_handler(int signal);
+
+static int main_config_load(dict_server_config_t * config);
+
 /* === Public variable definitions ============================================================= */
 
 /* === Private variable definitions ============================================================ */
 
 /* === Private function implementation ========================================================= */
+/**
+ * @brief Stop the server on SIGINT and SIGTERM, so it exits through main().
+ *
+ * @param signal Received signal.
+ */
+static void main_signal_handler(int signal) {
+    dict_server_stop();
+}
+/**
+ * @brief Load the server configuration from the environment.
+ *
+ * - DICT_WORKERS: number of worker threads, 1 by default.
+ * - DICT_CPUS: comma separated CPUs the workers are pinned to, round robin.
+ * - DICT_NUMA: 1 to place each pinned worker's memory on its CPU's node.
+ * - DICT_BUSY_POLL: SO_BUSY_POLL microseconds, enables spinning on the event queue.
+ * - DICT_WATCHDOG_MS: busy loop time reported as a stall, MAIN_WATCHDOG_MS by default, 0 disables.
+ * - DICT_DEFRAG_CPU: percent of worker 0 spent defragmenting memory and giving the memory
+ *   engine's empty slabs back to the OS, MAIN_DEFRAG_CPU by default. 0 disables both, empty
+ *   slabs are then only kept for reuse.
+ * - DICT_WRITE_BACK_MS: longest time a write is buffered before reaching storage, 0 by default
+ *   writes through.
+ * - DICT_WRITE_BACK_BYTES: buffered bytes that trigger an early flush.
+ * - DICT_SYNC: 1 to fdatasync() every value and fsync() the data directory before a write is
+ *   acknowledged, or before a write back flush completes.
+ * - DICT_RECOVERY_THREADS: threads replaying the store at start, one per CPU by default.
+ * - DICT_WARMUP_MS: time between saves of the hot keys prefetched at the next start,
+ *   MAIN_WARMUP_MS by default, 0 disables.
+ * - DICT_UDP: 1 to also answer GETs sent as single UDP datagrams to the server port.
+ * - DICT_BACKLOG: connections queued by the kernel until accepted, capped by
+ *   net.core.somaxconn. The server default when unset.
+ * - DICT_DEFER_ACCEPT: seconds a new connection waits in the kernel for its first request,
+ *   MAIN_DEFER_S by default, 0 disables.
+ * - DICT_NAGLE: 1 to keep Nagle's algorithm on connections instead of setting TCP_NODELAY.
+ * - DICT_MMAP_CACHE: key files the file engine keeps mapped to serve GETs without file system
+ *   calls, MAIN_MMAP_CACHE by default, 0 disables.
+ * - DICT_MIGRATE_KEYS: 1 to move key files left in the working directory by releases before
+ *   the data directory into it, see dict_backend_file.c. Needed once after such an upgrade.
+ * - DICT_ENGINE: storage engine of keys outside any namespace, file, memory, log, packed or
+ *   art, among the build's ENGINES. The build's BACKEND by default. memory and art keep keys only
+ *   in memory, they are lost when the server stops unless saved with DUMP and restored with LOAD.
+ * - DICT_NAMESPACES: comma separated namespace=engine pairs. A key "namespace:name" is stored by
+ *   the engine of its namespace, e.g. DICT_NAMESPACES=cache=memory,events=log.
+ *
+ * @param config Configuration to fill.
+ * @return int
+ *              - 0 if no error.
+ *              - -1 if a variable is invalid.
+ */
+static int main_config_load(dict_server_config_t * config) {
+    const char * value;
+
+    memset(config, 0, sizeof(*config));
+    config->workers = 1;
+    config->watchdog_ms = MAIN_WATCHDOG_MS;
+    config->defrag_cpu_percent = MAIN_DEFRAG_CPU;
+    config->warmup_ms = MAIN_WARMUP_MS;
+    config->defer_accept_s = MAIN_DEFER_S;
+    config->mmap_cache_entries = MAIN_MMAP_CACHE;
+
+    if ((value = getenv("DICT_WORKERS")) != NULL)
+        config->workers = atoi(value);
+    if ((value = getenv("DICT_NUMA")) != NULL)
+        config->numa = atoi(value);
+    if ((value = getenv("DICT_BUSY_POLL")) != NULL)
+        config->busy_poll_us = atoi(value);
+    if ((value = getenv("DICT_WATCHDOG_MS")) != NULL)
+        config->watchdog_ms = atoi(value);
+    if ((value = getenv("DICT_DEFRAG_CPU")) != NULL)
+        config->defrag_cpu_percent = atoi(value);
+    if ((value = getenv("DICT_WRITE_BACK_MS")) != NULL)
+        config->write_back_ms = atoi(value);
+    if ((value = getenv("DICT_WRITE_BACK_BYTES")) != NULL)
+        config->write_back_bytes = strtoul(value, NULL, 10);
+    if ((value = getenv("DICT_SYNC")) != NULL)
+        config->sync_writes = atoi(value);
+    if ((value = getenv("DICT_RECOVERY_THREADS")) != NULL)
+        config->recovery_threads = atoi(value);
+    if ((value = getenv("DICT_WARMUP_MS")) != NULL)
+        config->warmup_ms = atoi(value);
+    if ((value = getenv("DICT_UDP")) != NULL)
+        config->udp = atoi(value);
+    if ((value = getenv("DICT_BACKLOG")) != NULL)
+        config->backlog = atoi(value);
+    if ((value = getenv("DICT_DEFER_ACCEPT")) != NULL)
+        config->defer_accept_s = atoi(value);
+    if ((value = getenv("DICT_NAGLE")) != NULL)
+        config->nagle = atoi(value);
+    if ((value = getenv("DICT_MMAP_CACHE")) != NULL)
+        config->mmap_cache_entries = atoi(value);
+    if ((value = getenv("DICT_MIGRATE_KEYS")) != NULL)
+        config->migrate_keys = atoi(value);
+    config->engine = getenv("DICT_ENGINE");
+    config->namespaces = getenv("DICT_NAMESPACES");
+
+    if ((value = getenv("DICT_CPUS")) != NULL) {
+        char * end;
+        while (*value != '\0' && config->cpu_count < DICT_SERVER_MAX_WORKERS) {
+            long cpu = strtol(value, &end, 10);
+            if (end == value || cpu < 0 || (*end != ',' && *end != '\0')) {
+                LOG_ERROR("Invalid DICT_CPUS");
+                return -1;
+            }
+            config->cpus[config->cpu_count++] = cpu;
+            value = *end == ',' ? end + 1 : end;
+        }
+    }
+
+    if (config->workers < 1 || config->workers > DICT_SERVER_MAX_WORKERS ||
+        config->busy_poll_us < 0 || config->watchdog_ms < 0 || config->defrag_cpu_percent < 0 ||
+        config->defrag_cpu_percent > 100 || config->write_back_ms < 0 ||
+        config->recovery_threads < 0 || config->warmup_ms < 0 || config->backlog < 0 ||
+        config->defer_accept_s < 0 || config->mmap_cache_entries < 0) {
+        LOG_ERROR("Invalid DICT_WORKERS, DICT_BUSY_POLL, DICT_WATCHDOG_MS, DICT_DEFRAG_CPU, "
+                  "DICT_WRITE_BACK_MS, DICT_RECOVERY_THREADS, DICT_WARMUP_MS, DICT_BACKLOG, "
+                  "DICT_DEFER_ACCEPT or DICT_MMAP_CACHE");
+        return -1;
+    }
+    return 0;
+}
 
 /* === Public function implementation ========================================================== */
 
 int main(void) {
+    // No SA_RESTART, blocking calls must return EINTR for the server to notice the stop.
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = main_signal_handler;
+    sigemptyset(&action.sa_mask);
+    if (sigaction(SIGINT, &action, NULL) < 0 || sigaction(SIGTERM, &action, NULL) < 0) {
+        LOG_ERROR("Can not install signal handlers");
+        return 1;
+    }
+
+    // A client gone before its reply is sent must not kill the server.
+    action.sa_handler = SIG_IGN;
+    if (sigaction(SIGPIPE, &action, NULL) < 0) {
+        LOG_ERROR("Can not ignore SIGPIPE");
+        return 1;
+    }
+
+    dict_server_config_t config;
+    if (main_config_load(&config) < 0)
+        return 1;
+
     // Initialize dictionary server.
-    int err = dict_server_start();
+    int err = dict_server_start(&config);
     return err;
 }
 